@@ -0,0 +1,207 @@
+/*
+ * Measures the cost of each endpoint: wall time per request, and the heap allocations the
+ * handler makes (counted by interposing malloc and friends on the requesting thread, minus the ones
+ * the httpd shim makes to capture the response). Runs the firmware (app_main) with the simulated
+ * sensors, so the handlers read live data.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "sim.h"
+
+#define SENSOR_SUPPLY ((ds18x20_addr_t)0x28000000000001ULL)
+#define SENSOR_RETURN ((ds18x20_addr_t)0x28000000000002ULL)
+#define WARMUP_REQUESTS 10
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static __thread bool s_counting;
+static __thread size_t s_allocs;
+static __thread size_t s_alloc_bytes;
+
+static inline void count(size_t size)
+{
+    if (s_counting)
+    {
+        s_allocs++;
+        s_alloc_bytes += size;
+    }
+}
+
+void *malloc(size_t size)
+{
+    count(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count_, size_t size)
+{
+    count(count_ * size);
+    return __libc_calloc(count_, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    count(size);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+typedef struct
+{
+    const char *label;
+    const char *uri;
+    const char *headers;
+} endpoint_t;
+
+static const endpoint_t ENDPOINTS[] = {
+    {"/relay", "/relay"},
+    {"/relay/on", "/relay/on"},
+    {"/temperature", "/temperature"},
+    {"/temperature/delta", "/temperature/delta"},
+    {"/flow", "/flow"},
+    {"/flow/totals", "/flow/totals"},
+    {"/history?series=delta", "/history?series=delta"},
+    {"/history?series=relay&tier=minute", "/history?series=relay&tier=minute"},
+    {"/status", "/status"},
+    {"/metrics", "/metrics"},
+    {"/status (If-None-Match: *)", "/status", "If-None-Match: *\r\n"},
+    {"/zones", "/zones"},
+    {"/zones/main/temperature/delta", "/zones/main/temperature/delta"},
+    {"/system", "/system"},
+    {"/latency", "/latency"},
+    {"/flow/rate", "/flow/rate"},
+    {"/config", "/config"},
+    {"/relay?fields=state", "/relay?fields=state"},
+    {"/batch", "/batch"},
+    {"/batch?paths=...&fields=... (poller)",
+     "/batch?paths=/relay,/temperature,/flow&fields=relay.state,temperature.delta.latest,temperature.delta.ewma,"
+     "flow.current_rate,flow.current_cycle.pulses,flow.totals.cycles"},
+    {"/ (dashboard)", "/"},
+    {"/ (If-None-Match: *)", "/", "If-None-Match: *\r\n"},
+#if CONFIG_ZONES >= 2
+    {"/zones/<zone 2>/status", "/zones/" CONFIG_ZONE_2_NAME "/status"},
+#endif
+};
+
+static int64_t real_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -n, --requests N   requests per endpoint (default 2000)\n"
+            "  -w, --warmup S     virtual seconds to run the firmware before measuring (default 7200)\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    int requests = 2000;
+    double warmup = 7200;
+    const struct option long_options[] = {
+        {"requests", required_argument, NULL, 'n'},
+        {"warmup", required_argument, NULL, 'w'},
+        {"help", no_argument, NULL, 'h'},
+        {0},
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "n:w:h", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            requests = atoi(optarg);
+            break;
+        case 'w':
+            warmup = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // fill some history quickly, then slow down so the firmware tasks stay out of the measurements
+    sim_clock_set_speed(5000);
+    esp_log_level_set("*", ESP_LOG_WARN);
+    ESP_ERROR_CHECK(sim_ds18x20_add_device(CONFIG_TEMPERATURE_SENSORS_GPIO, SENSOR_SUPPLY));
+    ESP_ERROR_CHECK(sim_ds18x20_add_device(CONFIG_TEMPERATURE_SENSORS_GPIO, SENSOR_RETURN));
+#if CONFIG_ZONES >= 2
+    ESP_ERROR_CHECK(sim_ds18x20_add_device(CONFIG_ZONE_2_TEMPERATURE_SENSORS_GPIO, SENSOR_SUPPLY));
+    ESP_ERROR_CHECK(sim_ds18x20_add_device(CONFIG_ZONE_2_TEMPERATURE_SENSORS_GPIO, SENSOR_RETURN));
+#endif
+#if CONFIG_ZONES >= 3
+    ESP_ERROR_CHECK(sim_ds18x20_add_device(CONFIG_ZONE_3_TEMPERATURE_SENSORS_GPIO, SENSOR_SUPPLY));
+    ESP_ERROR_CHECK(sim_ds18x20_add_device(CONFIG_ZONE_3_TEMPERATURE_SENSORS_GPIO, SENSOR_RETURN));
+#endif
+    sim_pulse_sensor_set_rate(CONFIG_FLOW_METER_SENSOR_GPIO, 30);
+    extern void app_main(void);
+    app_main();
+    sim_clock_sleep_us((int64_t)(warmup * 1000000));
+    sim_clock_set_speed(1);
+
+    const httpd_handle_t server = sim_httpd_get_server();
+    if (server == NULL)
+    {
+        fprintf(stderr, "httpd did not start\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-36s %10s %12s %12s %10s %8s\n", "endpoint", "avg us", "allocs/req", "bytes/req", "resp bytes",
+           "chunks");
+    for (size_t i = 0; i < sizeof(ENDPOINTS) / sizeof(ENDPOINTS[0]); i++)
+    {
+        size_t allocs = 0;
+        size_t alloc_bytes = 0;
+        int64_t elapsed = 0;
+        sim_httpd_response_t response = {0};
+        for (int r = -WARMUP_REQUESTS; r < requests; r++)
+        {
+            s_allocs = s_alloc_bytes = 0;
+            s_counting = true;
+            const int64_t start = real_now_us();
+            sim_httpd_request(server, HTTP_GET, ENDPOINTS[i].uri, ENDPOINTS[i].headers, NULL, &response);
+            const int64_t end = real_now_us();
+            s_counting = false;
+            if (response.err != ESP_OK)
+            {
+                fprintf(stderr, "%s failed: %s (%d)\n", ENDPOINTS[i].label, response.status, response.err);
+                return EXIT_FAILURE;
+            }
+            if (r >= 0)
+            {
+                elapsed += end - start;
+                allocs += s_allocs - response.capture_allocs;
+                alloc_bytes += s_alloc_bytes - response.capture_bytes;
+            }
+            if (r < requests - 1)
+            {
+                sim_httpd_response_free(&response);
+            }
+        }
+        printf("%-36s %10.2f %12.2f %12.1f %10zu %8zu\n", ENDPOINTS[i].label, (double)elapsed / requests,
+               (double)allocs / requests, (double)alloc_bytes / requests, response.body_len, response.chunks);
+        sim_httpd_response_free(&response);
+    }
+    fflush(stdout);
+    _Exit(EXIT_SUCCESS); // firmware tasks never return
+}
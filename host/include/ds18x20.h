@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+ * Host stand-in for the esp-idf-lib ds18x20 driver, backed by the simulated OneWire bus in sim.h.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef uint64_t onewire_addr_t;
+    typedef onewire_addr_t ds18x20_addr_t;
+
+#define ONEWIRE_NONE ((onewire_addr_t)(0xffffffffffffffffULL))
+#define DS18X20_ANY ONEWIRE_NONE
+
+    esp_err_t ds18x20_scan_devices(gpio_num_t pin, ds18x20_addr_t *addr_list, size_t addr_count, size_t *found);
+    esp_err_t ds18x20_measure(gpio_num_t pin, ds18x20_addr_t addr, bool wait);
+    esp_err_t ds18x20_read_temperature(gpio_num_t pin, ds18x20_addr_t addr, float *temperature);
+    esp_err_t ds18x20_measure_and_read(gpio_num_t pin, ds18x20_addr_t addr, float *temperature);
+    esp_err_t ds18x20_measure_and_read_multi(gpio_num_t pin, ds18x20_addr_t *addr_list, size_t addr_count,
+                                             float *result_list);
+    esp_err_t ds18x20_read_temp_multi(gpio_num_t pin, ds18x20_addr_t *addr_list, size_t addr_count,
+                                      float *result_list);
+
+#ifdef __cplusplus
+}
+#endif
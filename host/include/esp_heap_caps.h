@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+ * Host stand-in for the ESP-IDF heap capabilities API. The host has a single heap, which is reported
+ * as the internal (and DMA-capable) memory of a board with SIM_HEAP_SIZE bytes of heap; the used
+ * bytes are the process' allocated bytes, so leaks and growth show as on the device. There is no
+ * SPIRAM, and no fragmentation: the largest free block is the free size.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SIM_HEAP_SIZE (300 * 1024)
+
+#define MALLOC_CAP_EXEC (1 << 0)
+#define MALLOC_CAP_32BIT (1 << 1)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    size_t heap_caps_get_total_size(uint32_t caps);
+    size_t heap_caps_get_free_size(uint32_t caps);
+    size_t heap_caps_get_minimum_free_size(uint32_t caps);
+    size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+#ifdef __cplusplus
+}
+#endif
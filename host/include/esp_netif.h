@@ -0,0 +1,15 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_event.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    esp_err_t esp_netif_init(void);
+
+#ifdef __cplusplus
+}
+#endif
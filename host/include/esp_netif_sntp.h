@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * The host clock is already synchronized, so SNTP only needs to accept its configuration.
+     */
+    typedef struct
+    {
+        bool start;             /// start right away
+        const char *servers[1]; /// NTP servers
+        int num_of_servers;
+    } esp_sntp_config_t;
+
+#define ESP_NETIF_SNTP_DEFAULT_CONFIG(server) \
+    {                                         \
+        .start = true,                        \
+        .servers = {server},                  \
+        .num_of_servers = 1,                  \
+    }
+
+    esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *config);
+    void esp_netif_sntp_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+
+/*
+ * Host stand-in for the ESP-IDF FreeRTOS port. Tasks are POSIX threads, queues and semaphores are
+ * mutex/condition-variable ring buffers, and every tick-based wait runs against the simulation's
+ * virtual clock (see sim.h), so firmware modules compile unchanged and can run faster than real time.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef int BaseType_t;
+    typedef unsigned int UBaseType_t;
+    typedef uint32_t TickType_t;
+    typedef uint32_t StackType_t;
+
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define configMAX_TASK_NAME_LEN 16
+#define configRUN_TIME_COUNTER_TYPE uint32_t
+#define configSTACK_DEPTH_TYPE uint32_t
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((TickType_t)(xTimeInMs) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+#define pdTICKS_TO_MS(xTicks) ((TickType_t)((uint64_t)(xTicks) * 1000 / configTICK_RATE_HZ))
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS (pdTRUE)
+#define pdFAIL (pdFALSE)
+#define errQUEUE_EMPTY ((BaseType_t)0)
+#define errQUEUE_FULL ((BaseType_t)0)
+
+#define portYIELD_FROM_ISR(x) ((void)(x))
+#define tskNO_AFFINITY ((BaseType_t)0x7FFFFFFF)
+
+    typedef struct QueueDefinition *QueueHandle_t;
+    typedef struct tskTaskControlBlock *TaskHandle_t;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define queueSEND_TO_BACK ((BaseType_t)0)
+#define queueSEND_TO_FRONT ((BaseType_t)1)
+#define queueOVERWRITE ((BaseType_t)2)
+
+    QueueHandle_t xQueueGenericCreate(const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize,
+                                      const UBaseType_t uxInitialCount);
+    BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void *const pvItemToQueue,
+                                 TickType_t xTicksToWait, const BaseType_t xCopyPosition);
+    BaseType_t xQueueReceive(QueueHandle_t xQueue, void *const pvBuffer, TickType_t xTicksToWait);
+    BaseType_t xQueuePeek(QueueHandle_t xQueue, void *const pvBuffer, TickType_t xTicksToWait);
+    UBaseType_t uxQueueMessagesWaiting(const QueueHandle_t xQueue);
+    UBaseType_t uxQueueSpacesAvailable(const QueueHandle_t xQueue);
+    BaseType_t xQueueReset(QueueHandle_t xQueue);
+    void vQueueDelete(QueueHandle_t xQueue);
+    void vQueueAddToRegistry(QueueHandle_t xQueue, const char *pcQueueName);
+
+    // Queue sets: each send to a member (except an overwrite of a pending item) queues its handle in the set.
+    typedef QueueHandle_t QueueSetHandle_t;
+    typedef QueueHandle_t QueueSetMemberHandle_t;
+    QueueSetHandle_t xQueueCreateSet(const UBaseType_t uxEventQueueLength);
+    // The member must be empty, and not in a set.
+    BaseType_t xQueueAddToSet(QueueSetMemberHandle_t xQueueOrSemaphore, QueueSetHandle_t xQueueSet);
+    // The member must be empty.
+    BaseType_t xQueueRemoveFromSet(QueueSetMemberHandle_t xQueueOrSemaphore, QueueSetHandle_t xQueueSet);
+    QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t xQueueSet, const TickType_t xTicksToWait);
+
+#define xQueueCreate(uxQueueLength, uxItemSize) xQueueGenericCreate((uxQueueLength), (uxItemSize), 0)
+#define xQueueSend(xQueue, pvItemToQueue, xTicksToWait) \
+    xQueueGenericSend((xQueue), (pvItemToQueue), (xTicksToWait), queueSEND_TO_BACK)
+#define xQueueSendToBack(xQueue, pvItemToQueue, xTicksToWait) \
+    xQueueGenericSend((xQueue), (pvItemToQueue), (xTicksToWait), queueSEND_TO_BACK)
+#define xQueueSendToFront(xQueue, pvItemToQueue, xTicksToWait) \
+    xQueueGenericSend((xQueue), (pvItemToQueue), (xTicksToWait), queueSEND_TO_FRONT)
+#define xQueueOverwrite(xQueue, pvItemToQueue) \
+    xQueueGenericSend((xQueue), (pvItemToQueue), 0, queueOVERWRITE)
+#define xQueueSendFromISR(xQueue, pvItemToQueue, pxHigherPriorityTaskWoken) \
+    ((void)(pxHigherPriorityTaskWoken), xQueueGenericSend((xQueue), (pvItemToQueue), 0, queueSEND_TO_BACK))
+#define xQueueSendToBackFromISR(xQueue, pvItemToQueue, pxHigherPriorityTaskWoken) \
+    xQueueSendFromISR((xQueue), (pvItemToQueue), (pxHigherPriorityTaskWoken))
+#define xQueueOverwriteFromISR(xQueue, pvItemToQueue, pxHigherPriorityTaskWoken) \
+    ((void)(pxHigherPriorityTaskWoken), xQueueGenericSend((xQueue), (pvItemToQueue), 0, queueOVERWRITE))
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef QueueHandle_t SemaphoreHandle_t;
+
+#define xSemaphoreCreateMutex() xQueueGenericCreate(1, 0, 1)
+#define xSemaphoreCreateBinary() xQueueGenericCreate(1, 0, 0)
+#define xSemaphoreCreateCounting(uxMaxCount, uxInitialCount) \
+    xQueueGenericCreate((uxMaxCount), 0, (uxInitialCount))
+#define xSemaphoreTake(xSemaphore, xBlockTime) xQueueReceive((xSemaphore), NULL, (xBlockTime))
+#define xSemaphoreGive(xSemaphore) xQueueGenericSend((xSemaphore), NULL, 0, queueSEND_TO_BACK)
+#define xSemaphoreGiveFromISR(xSemaphore, pxHigherPriorityTaskWoken) \
+    ((void)(pxHigherPriorityTaskWoken), xSemaphoreGive(xSemaphore))
+#define vSemaphoreDelete(xSemaphore) vQueueDelete((QueueHandle_t)(xSemaphore))
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef void (*TaskFunction_t)(void *);
+
+    typedef enum
+    {
+        eNoAction = 0,
+        eSetBits,
+        eIncrement,
+        eSetValueWithOverwrite,
+        eSetValueWithoutOverwrite
+    } eNotifyAction;
+
+    BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *const pcName,
+                           const uint32_t usStackDepth, void *const pvParameters,
+                           UBaseType_t uxPriority, TaskHandle_t *const pxCreatedTask);
+    BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char *const pcName,
+                                       const uint32_t usStackDepth, void *const pvParameters,
+                                       UBaseType_t uxPriority, TaskHandle_t *const pxCreatedTask,
+                                       const BaseType_t xCoreID);
+    void vTaskDelete(TaskHandle_t xTaskToDelete);
+    void vTaskDelay(const TickType_t xTicksToDelay);
+    TickType_t xTaskGetTickCount(void);
+    TickType_t xTaskGetTickCountFromISR(void);
+    TaskHandle_t xTaskGetCurrentTaskHandle(void);
+    char *pcTaskGetName(TaskHandle_t xTaskToQuery);
+
+    typedef enum
+    {
+        eRunning = 0,
+        eReady,
+        eBlocked,
+        eSuspended,
+        eDeleted,
+        eInvalid
+    } eTaskState;
+
+    typedef struct xTASK_STATUS
+    {
+        TaskHandle_t xHandle;
+        const char *pcTaskName;
+        UBaseType_t xTaskNumber;
+        eTaskState eCurrentState;
+        UBaseType_t uxCurrentPriority;
+        UBaseType_t uxBasePriority;
+        configRUN_TIME_COUNTER_TYPE ulRunTimeCounter; /// CPU time of the thread (in µs)
+        StackType_t *pxStackBase;
+        configSTACK_DEPTH_TYPE usStackHighWaterMark; /// the host cannot tell stack use: the whole stack
+        BaseType_t xCoreID;
+    } TaskStatus_t;
+
+    // The tasks created with xTaskCreate (the shim's own threads are not tasks). The total run time is
+    // the wall time (in µs), so that a task's share of it is its share of one host CPU.
+    UBaseType_t uxTaskGetNumberOfTasks(void);
+    UBaseType_t uxTaskGetSystemState(TaskStatus_t *const pxTaskStatusArray, const UBaseType_t uxArraySize,
+                                     configRUN_TIME_COUNTER_TYPE *const pulTotalRunTime);
+    UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask);
+
+    BaseType_t xTaskGenericNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue,
+                                  eNotifyAction eAction, uint32_t *pulPreviousNotificationValue);
+    BaseType_t xTaskNotifyWait(uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit,
+                               uint32_t *pulNotificationValue, TickType_t xTicksToWait);
+    uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+
+#define xTaskNotify(xTaskToNotify, ulValue, eAction) \
+    xTaskGenericNotify((xTaskToNotify), (ulValue), (eAction), NULL)
+#define xTaskNotifyFromISR(xTaskToNotify, ulValue, eAction, pxHigherPriorityTaskWoken) \
+    ((void)(pxHigherPriorityTaskWoken), xTaskGenericNotify((xTaskToNotify), (ulValue), (eAction), NULL))
+#define xTaskNotifyGive(xTaskToNotify) \
+    xTaskGenericNotify((xTaskToNotify), 0, eIncrement, NULL)
+
+#ifdef __cplusplus
+}
+#endif
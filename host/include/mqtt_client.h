@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_event.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * The subset of esp-mqtt the firmware uses. Clients talk to an in-process broker (see sim.h) that
+     * accepts every connection and acknowledges QoS 1 publishes after a delay.
+     */
+    ESP_EVENT_DECLARE_BASE(MQTT_EVENTS);
+
+    typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+    typedef enum
+    {
+        MQTT_EVENT_ANY = -1,
+        MQTT_EVENT_ERROR = 0,
+        MQTT_EVENT_CONNECTED,
+        MQTT_EVENT_DISCONNECTED,
+        MQTT_EVENT_SUBSCRIBED,
+        MQTT_EVENT_UNSUBSCRIBED,
+        MQTT_EVENT_PUBLISHED,
+        MQTT_EVENT_DATA,
+        MQTT_EVENT_BEFORE_CONNECT,
+        MQTT_EVENT_DELETED,
+    } esp_mqtt_event_id_t;
+
+    typedef struct
+    {
+        esp_mqtt_event_id_t event_id;
+        esp_mqtt_client_handle_t client;
+        int msg_id;
+    } esp_mqtt_event_t;
+
+    typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+    typedef struct
+    {
+        struct
+        {
+            struct
+            {
+                const char *uri;
+            } address;
+        } broker;
+        struct
+        {
+            const char *client_id;
+        } credentials;
+        struct
+        {
+            int keepalive; /// seconds
+        } session;
+        struct
+        {
+            int reconnect_timeout_ms;
+            int timeout_ms;
+        } network;
+        struct
+        {
+            uint64_t limit; /// bytes of unacknowledged messages kept for retransmission
+        } outbox;
+    } esp_mqtt_client_config_t;
+
+    esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config);
+    esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                             esp_event_handler_t event_handler, void *event_handler_arg);
+    esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+    esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client);
+    esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client);
+    // Returns the message id (0 for QoS 0), or -1 if the client is not connected.
+    int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                                int retain);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* The simulated station is always associated; Wi-Fi drops are injected with sim_wifi_disconnect(). */
+    esp_err_t example_connect(void);
+    esp_err_t example_disconnect(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+
+/*
+ * Host stand-in for the esp32-pulse-sensor component (components/esp32-pulse-sensor). It mirrors the
+ * interface this project uses; pulses come from the simulated flow meter in sim.h instead of a GPIO ISR.
+ */
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef struct
+    {
+        gpio_num_t gpio_num;              /// GPIO number of the pulse input (*required)
+        uint32_t min_cycle_pulses;        /// pulses needed within a cycle for it to count as started
+        uint64_t sampling_period;         /// time (in microseconds) between pulse counter samples
+        uint64_t max_cycle_idle;          /// time (in microseconds) without pulses that ends a cycle
+        TickType_t notification_timeout;  /// max time (in ticks) to wait to send a notification
+        QueueHandle_t notification_queue; /// queue to which to send cycle notifications (optional)
+        void *notification_arg;           /// an argument to pass in each notification message (optional)
+    } pulse_sensor_config_t;
+
+#define PULSE_SENSOR_CONFIG_DEFAULT()             \
+    {                                             \
+        .min_cycle_pulses = 10,                   \
+        .sampling_period = 1000000,               \
+        .max_cycle_idle = 3000000,                \
+        .notification_timeout = pdMS_TO_TICKS(1), \
+    }
+
+    typedef struct pulse_sensor_s *pulse_sensor_t;
+
+    typedef enum
+    {
+        PULSE_SENSOR_CYCLE_STARTED,
+        PULSE_SENSOR_CYCLE_ENDED,
+    } pulse_sensor_notification_type_t;
+
+    typedef struct
+    {
+        pulse_sensor_notification_type_t type; /// what happened
+        pulse_sensor_t sensor;                 /// the sensor
+        void *notification_arg;                /// the configured argument
+    } pulse_sensor_notification_t;
+
+    typedef struct
+    {
+        uint32_t current_cycle_pulses;         /// pulses in the current cycle (0 when idle)
+        int64_t current_cycle_start_timestamp; /// microseconds since boot of the current cycle's first pulse
+        int64_t latest_pulse_timestamp;        /// microseconds since boot of the latest pulse
+        uint32_t sample_pulses;                /// pulses counted in the latest sampling period
+        uint64_t sample_period;                /// length (in microseconds) of the sampling period
+        uint64_t total_pulses;                 /// pulses across all completed cycles
+        uint64_t total_duration;               /// microseconds across all completed cycles
+        uint32_t cycles;                       /// completed cycles
+        uint32_t partial_cycles;               /// cycles that ended before reaching min_cycle_pulses
+    } pulse_sensor_data_t;
+
+    esp_err_t pulse_sensor_open(const pulse_sensor_config_t *config, pulse_sensor_t *sensor_out);
+    esp_err_t pulse_sensor_close(pulse_sensor_t sensor);
+    esp_err_t pulse_sensor_get_data(pulse_sensor_t sensor, pulse_sensor_data_t *data);
+
+    uint64_t pulse_sensor_get_current_cycle_duration(const pulse_sensor_data_t *data);
+    float pulse_sensor_get_current_cycle_rate(const pulse_sensor_data_t *data);
+    float pulse_sensor_get_current_rate(const pulse_sensor_data_t *data);
+    float pulse_sensor_get_total_rate(const pulse_sensor_data_t *data);
+
+#ifdef __cplusplus
+}
+#endif
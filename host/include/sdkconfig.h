@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+ * Host build configuration. Mirrors the defaults in main/Kconfig.projbuild plus the handful of
+ * ESP-IDF options the firmware depends on; keep it in sync when adding project options.
+ */
+
+#define CONFIG_IDF_TARGET "linux"
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+#define CONFIG_FREERTOS_USE_TRACE_FACILITY 1
+#define CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS 1
+
+#define CONFIG_MAX_ASYNC_REQUESTS 2
+#define CONFIG_EVENTS_BUFFERED_MESSAGES 16
+#define CONFIG_ZONES 1
+#define CONFIG_ZONE_NAME "main"
+#define CONFIG_TEMPERATURE_SENSORS_GPIO 4
+#define CONFIG_TEMPERATURE_SENSORS_PROBES "1,2"
+#define CONFIG_TEMPERATURE_SENSORS_DELTAS "delta=1-2"
+#define CONFIG_TEMPERATURE_SENSORS_SAMPLE_PERIOD 10000
+#define CONFIG_TEMPERATURE_SENSORS_PUMP_SAMPLE_PERIOD 750
+#define CONFIG_TEMPERATURE_SENSORS_IDLE_SAMPLE_PERIOD 300000
+#define CONFIG_TEMPERATURE_SENSORS_READ_RETRIES 2
+#define CONFIG_TEMPERATURE_SENSORS_MAX_STEP 100
+#define CONFIG_TEMPERATURE_SENSORS_LOST_AFTER 3
+#define CONFIG_FLOW_METER_SENSOR_GPIO 16
+#define CONFIG_FLOW_METER_SENSOR_MIN_PULSES 20
+#define CONFIG_FLOW_METER_SENSOR_PULSES_PER_GALLON 1840
+#define CONFIG_RELAY_GPIO 17
+#define CONFIG_PUMP_ON_TEMPERATURE_DELTA 60
+#define CONFIG_PUMP_OFF_TEMPERATURE_DELTA 30
+#define CONFIG_HTTPD_PORT 80
+#define CONFIG_HTTPD_MAX_OPEN_SOCKETS 7
+#define CONFIG_HISTORY_RAW_SAMPLES 64
+#define CONFIG_HISTORY_MINUTE_ROLLUPS 1440
+#define CONFIG_HISTORY_HOUR_ROLLUPS 720
+#define CONFIG_PUMP_TRACE_RECORDS 512
+#define CONFIG_STATS_WINDOWS "300,3600,86400"
+#define CONFIG_STATS_RESOLUTION 30
+#define CONFIG_STATS_TIME_CONSTANT 300
+#define CONFIG_LATENCY_TRACE 1
+#define CONFIG_TOTALS_CHECKPOINT_INTERVAL 900
+#define CONFIG_JOURNAL_FLUSH_PERIOD 60
+#define CONFIG_PREHEAT_LEAD 300
+#define CONFIG_PREHEAT_MIN_LIKELIHOOD 50
+#define CONFIG_SYSTEM_MONITOR_PERIOD 60
+#define CONFIG_SYSTEM_MONITOR_LOG 1
+#define CONFIG_TIMEZONE "UTC0"
+#define CONFIG_SNTP_SERVER "pool.ntp.org"
+#define CONFIG_REPORTER_BROKER_URI "mqtt://localhost"
+#define CONFIG_REPORTER_TOPIC "pump_controller/events"
+#define CONFIG_REPORTER_CAPACITY 1024
+#define CONFIG_REPORTER_BATCH_SIZE 32
+#define CONFIG_REPORTER_BATCH_PERIOD 30
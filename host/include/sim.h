@@ -0,0 +1,111 @@
+#pragma once
+
+/*
+ * Control surface of the host simulation: the virtual clock, the simulated peripherals behind the
+ * ESP-IDF shims, and in-process access to the registered HTTP handlers.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <time.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "driver/gpio.h"
+#include "ds18x20.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Virtual clock: microseconds since boot advance `speed` times faster than the host's monotonic clock. */
+    void sim_clock_set_speed(double speed);
+    double sim_clock_get_speed(void);
+    int64_t sim_clock_now_us(void);
+    void sim_clock_sleep_us(int64_t us);
+    void sim_clock_deadline(int64_t at_us, struct timespec *deadline);
+    void sim_cond_init(pthread_cond_t *cond);
+    /* Waits on cond until virtual time at_us (or forever if at_us < 0). Returns false on timeout. */
+    bool sim_cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t at_us);
+    int64_t sim_ticks_to_deadline(TickType_t ticks);
+
+    /* Host monotonic clock (microseconds), for measuring real CPU cost. */
+    int64_t sim_real_now_us(void);
+
+    /* GPIO: the level of every pin, with an optional hook invoked on output level changes. */
+    typedef void (*sim_gpio_listener_t)(gpio_num_t gpio_num, uint32_t level, void *arg);
+    void sim_gpio_set_listener(sim_gpio_listener_t listener, void *arg);
+    int sim_gpio_get_level(gpio_num_t gpio_num);
+
+    /* OneWire bus: DS18B20 devices attached to a GPIO, with their (true) temperatures. */
+    esp_err_t sim_ds18x20_add_device(gpio_num_t gpio_num, ds18x20_addr_t addr);
+    esp_err_t sim_ds18x20_set_temperature(gpio_num_t gpio_num, ds18x20_addr_t addr, float temperature);
+    /* A device that is not present does not answer; once back, it has the 85 °C power-on scratchpad. */
+    esp_err_t sim_ds18x20_set_present(gpio_num_t gpio_num, ds18x20_addr_t addr, bool present);
+    void sim_ds18x20_set_error_rate(double error_rate);
+    uint32_t sim_ds18x20_get_conversions(void);
+
+    /* Flow meter: pulse rate seen by the pulse sensor opened on gpio_num. */
+    esp_err_t sim_pulse_sensor_set_rate(gpio_num_t gpio_num, float pulses_per_second);
+
+    /* Wi-Fi: posts station disconnect / got-IP events on the default event loop. */
+    void sim_wifi_disconnect(void);
+    void sim_wifi_connect(void);
+
+    /* MQTT: the broker acknowledges QoS 1 publishes delay_us (virtual) after they are sent (default 20 ms). */
+    void sim_mqtt_set_ack_delay(int64_t delay_us);
+    /* The messages published by all clients since boot, and their payload bytes. */
+    void sim_mqtt_get_received(uint32_t *messages, size_t *bytes);
+
+    /* HTTP: run a request against the most recently started server and capture the response. */
+    typedef struct
+    {
+        char status[32];
+        char content_type[64];
+        char *headers; /// "Field: value\r\n" lines set by the handler
+        size_t headers_len;
+        char *body;
+        size_t body_len;
+        size_t chunks;
+        esp_err_t err;         /// handler return value
+        size_t capture_allocs; /// heap allocations made by the shim to capture the response
+        size_t capture_bytes;  /// bytes requested by those allocations
+    } sim_httpd_response_t;
+
+    httpd_handle_t sim_httpd_get_server(void);
+    esp_err_t sim_httpd_request(httpd_handle_t handle, httpd_method_t method, const char *uri,
+                                const char *headers, const char *body, sim_httpd_response_t *response);
+    void sim_httpd_response_free(sim_httpd_response_t *response);
+
+    /*
+     * HTTP streaming: runs a GET whose handler may hand the request to another task (async handler);
+     * the bytes it sends afterwards are read with sim_httpd_stream_read. A send delay makes the client
+     * slow to read; closing makes further sends fail, as with a dropped connection.
+     */
+    typedef struct sim_httpd_stream_s *sim_httpd_stream_t;
+    esp_err_t sim_httpd_stream_open(httpd_handle_t handle, const char *uri, sim_httpd_stream_t *stream_out);
+    const sim_httpd_response_t *sim_httpd_stream_get_response(sim_httpd_stream_t stream);
+    size_t sim_httpd_stream_read(sim_httpd_stream_t stream, char *buf, size_t size);
+    void sim_httpd_stream_set_send_delay(sim_httpd_stream_t stream, int64_t delay_us);
+    bool sim_httpd_stream_is_active(sim_httpd_stream_t stream);
+    void sim_httpd_stream_close(sim_httpd_stream_t stream);
+
+    /* FreeRTOS queue statistics, in creation order. */
+    typedef struct
+    {
+        char name[32];
+        UBaseType_t length;
+        UBaseType_t item_size;
+        UBaseType_t max_waiting;
+        uint32_t sends;
+        uint32_t send_failures;
+        uint32_t receives;
+    } sim_queue_stats_t;
+
+    size_t sim_freertos_get_queue_stats(sim_queue_stats_t *stats, size_t max_stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,642 @@
+/*
+ * Runs the firmware (main/*.c) against the host shims and a simple plumbing model: a water heater,
+ * a recirculation loop whose return line cools while idle, random hot-water draws seen by the flow
+ * meter, and the pump driven by the relay GPIO. Virtual time runs --speed times faster than real time.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "sim.h"
+
+#define SENSOR_SUPPLY ((ds18x20_addr_t)0x28000000000001ULL)
+#define SENSOR_RETURN ((ds18x20_addr_t)0x28000000000002ULL)
+
+#define STEP_US 100000             // plant model resolution
+#define HOT_TEMPERATURE 50.0       // °C at the heater outlet
+#define AMBIENT_TEMPERATURE 22.0   // °C the loop cools down to
+#define LOOP_COOLING_TAU 2400.0    // seconds
+#define RETURN_HEATING_TAU 8.0     // seconds
+#define PUMP_TRANSIT_TIME 45.0     // seconds for hot water to reach the return sensor with the pump on
+#define DRAW_TRANSIT_TIME 120.0    // ... and with only a faucet open
+#define DRAW_GALLONS_PER_MINUTE 1.5
+#define MAX_DRAWS 4096
+#define MAX_ENDPOINTS 8
+#define MAX_STREAMS 8
+#define SLOW_STREAM_SEND_DELAY 30000000 // virtual us per send for the slow /events subscriber
+
+typedef struct
+{
+    double speed;
+    double duration;        // virtual seconds
+    double draw_interval;   // mean virtual seconds between draws
+    double http_period;     // virtual seconds between dashboard polls (0 disables)
+    double error_rate;      // probability of a OneWire read failure
+    double outage;          // virtual seconds the return probe is disconnected for, halfway through
+    double wifi_outage;     // virtual seconds Wi-Fi is down for, a quarter through
+    int streams;            // /events subscribers (the last one slow, when more than one)
+    const char *trace_path; // where to save the pump control trace (NULL to skip)
+    unsigned int seed;
+    bool verbose;
+} options_t;
+
+typedef struct
+{
+    int64_t start;   // virtual us of the first pulse
+    int64_t pump_on; // virtual us the relay closed in response (0 if it did not)
+    int64_t hot;     // virtual us the return line reached temperature (0 if it did not)
+} draw_t;
+
+typedef struct
+{
+    const char *uri;
+    uint32_t requests;
+    uint32_t failures;
+    int64_t total_us;
+    int64_t max_us;
+    size_t bytes;
+} endpoint_stats_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static draw_t s_draws[MAX_DRAWS];
+static size_t s_draw_count;
+static uint32_t s_relay_transitions;
+static int64_t s_relay_on_since;
+static int64_t s_pump_on_time;
+
+typedef struct
+{
+    sim_httpd_stream_t stream;
+    uint32_t events; // messages received
+    size_t bytes;
+    bool slow;
+} stream_stats_t;
+
+static stream_stats_t s_streams[MAX_STREAMS];
+
+static endpoint_stats_t s_endpoints[MAX_ENDPOINTS] = {
+    {.uri = "/relay"},
+    {.uri = "/temperature"},
+    {.uri = "/flow"},
+};
+
+static void relay_listener(gpio_num_t gpio_num, uint32_t level, void *arg)
+{
+    if (gpio_num != CONFIG_RELAY_GPIO)
+    {
+        return;
+    }
+    const int64_t now = sim_clock_now_us();
+    pthread_mutex_lock(&s_lock);
+    s_relay_transitions++;
+    if (level)
+    {
+        s_relay_on_since = now;
+        if (s_draw_count && s_draws[s_draw_count - 1].pump_on == 0)
+        {
+            s_draws[s_draw_count - 1].pump_on = now;
+        }
+    }
+    else
+    {
+        s_pump_on_time += now - s_relay_on_since;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+static double exponential(double mean, unsigned int *seed)
+{
+    return -mean * log(1.0 - (double)rand_r(seed) / ((double)RAND_MAX + 1));
+}
+
+static void poll_endpoints(void)
+{
+    const httpd_handle_t server = sim_httpd_get_server();
+    if (server == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < MAX_ENDPOINTS && s_endpoints[i].uri; i++)
+    {
+        sim_httpd_response_t response;
+        const int64_t start = sim_real_now_us();
+        sim_httpd_request(server, HTTP_GET, s_endpoints[i].uri, NULL, NULL, &response);
+        const int64_t elapsed = sim_real_now_us() - start;
+        endpoint_stats_t *e = &s_endpoints[i];
+        e->requests++;
+        e->failures += response.err != ESP_OK;
+        e->total_us += elapsed;
+        e->max_us = elapsed > e->max_us ? elapsed : e->max_us;
+        e->bytes += response.body_len;
+        sim_httpd_response_free(&response);
+    }
+}
+
+static void open_streams(const options_t *options)
+{
+    const httpd_handle_t server = sim_httpd_get_server();
+    for (int i = 0; server && i < options->streams && i < MAX_STREAMS; i++)
+    {
+        stream_stats_t *st = &s_streams[i];
+        if (sim_httpd_stream_open(server, "/events", &st->stream) != ESP_OK)
+        {
+            continue;
+        }
+        st->slow = options->streams > 1 && i == options->streams - 1;
+        if (st->slow)
+        {
+            sim_httpd_stream_set_send_delay(st->stream, SLOW_STREAM_SEND_DELAY);
+        }
+    }
+}
+
+static void read_streams(void)
+{
+    char buf[1024];
+    for (int i = 0; i < MAX_STREAMS; i++)
+    {
+        stream_stats_t *st = &s_streams[i];
+        size_t n;
+        while (st->stream && (n = sim_httpd_stream_read(st->stream, buf, sizeof(buf) - 1)) > 0)
+        {
+            buf[n] = '\0';
+            st->bytes += n;
+            // every send is a whole message, so reads never split one
+            for (const char *p = buf; (p = strstr(p, "event: ")); p++)
+            {
+                st->events++;
+            }
+        }
+    }
+}
+
+static void run(const options_t *options)
+{
+    unsigned int seed = options->seed;
+    const int64_t end = (int64_t)(options->duration * 1000000);
+    double return_temperature = AMBIENT_TEMPERATURE + 5;
+    double hot_front = 0;     // fraction of the loop filled with hot water
+    double next_draw = exponential(options->draw_interval, &seed);
+    double draw_remaining = 0;
+    double next_poll = options->http_period;
+    const float draw_rate = CONFIG_FLOW_METER_SENSOR_PULSES_PER_GALLON * DRAW_GALLONS_PER_MINUTE / 60;
+    const double outage_start = (options->duration - options->outage) / 2;
+    bool absent = false;
+    const double wifi_outage_start = options->duration / 4;
+    bool offline = false;
+
+    for (int64_t now = sim_clock_now_us(); now < end; now = sim_clock_now_us())
+    {
+        const double t = now / 1e6;
+        const double dt = STEP_US / 1e6;
+        if (draw_remaining <= 0 && t >= next_draw)
+        {
+            draw_remaining = 15 + rand_r(&seed) % 75;
+            pthread_mutex_lock(&s_lock);
+            if (s_draw_count < MAX_DRAWS)
+            {
+                s_draws[s_draw_count++] = (draw_t){.start = now};
+            }
+            pthread_mutex_unlock(&s_lock);
+            sim_pulse_sensor_set_rate(CONFIG_FLOW_METER_SENSOR_GPIO, draw_rate);
+        }
+        else if (draw_remaining > 0 && (draw_remaining -= dt) <= 0)
+        {
+            sim_pulse_sensor_set_rate(CONFIG_FLOW_METER_SENSOR_GPIO, 0);
+            next_draw = t + exponential(options->draw_interval, &seed);
+        }
+
+        if (options->outage > 0 && absent != (t >= outage_start && t < outage_start + options->outage))
+        {
+            absent = !absent;
+            printf("%.0f s: return probe %s\n", t, absent ? "disconnected" : "reconnected");
+            sim_ds18x20_set_present(CONFIG_TEMPERATURE_SENSORS_GPIO, SENSOR_RETURN, !absent);
+        }
+        if (options->wifi_outage > 0 &&
+            offline != (t >= wifi_outage_start && t < wifi_outage_start + options->wifi_outage))
+        {
+            offline = !offline;
+            printf("%.0f s: Wi-Fi %s\n", t, offline ? "down" : "up");
+            if (offline)
+            {
+                sim_wifi_disconnect();
+            }
+            else
+            {
+                sim_wifi_connect();
+            }
+        }
+
+        const bool pump_on = sim_gpio_get_level(CONFIG_RELAY_GPIO);
+        const double velocity = (pump_on ? 1 / PUMP_TRANSIT_TIME : 0) + (draw_remaining > 0 ? 1 / DRAW_TRANSIT_TIME : 0);
+        if (velocity > 0)
+        {
+            hot_front = fmin(1.0, hot_front + velocity * dt);
+        }
+        else
+        {
+            hot_front = fmax(0.0, hot_front - dt / LOOP_COOLING_TAU);
+        }
+        if (hot_front >= 1.0)
+        {
+            return_temperature += (HOT_TEMPERATURE - return_temperature) * dt / RETURN_HEATING_TAU;
+        }
+        else
+        {
+            return_temperature += (AMBIENT_TEMPERATURE - return_temperature) * dt / LOOP_COOLING_TAU;
+        }
+        const double noise = ((double)rand_r(&seed) / RAND_MAX - 0.5) * 0.125;
+        sim_ds18x20_set_temperature(CONFIG_TEMPERATURE_SENSORS_GPIO, SENSOR_SUPPLY, HOT_TEMPERATURE + noise);
+        sim_ds18x20_set_temperature(CONFIG_TEMPERATURE_SENSORS_GPIO, SENSOR_RETURN, return_temperature - noise);
+
+        pthread_mutex_lock(&s_lock);
+        if (s_draw_count && !s_draws[s_draw_count - 1].hot && return_temperature >= HOT_TEMPERATURE - 3)
+        {
+            s_draws[s_draw_count - 1].hot = now;
+        }
+        pthread_mutex_unlock(&s_lock);
+
+        // the web server is stopped while Wi-Fi is down
+        if (options->http_period > 0 && t >= next_poll && !offline)
+        {
+            poll_endpoints();
+            next_poll = t + options->http_period;
+        }
+        read_streams();
+        sim_clock_sleep_us(STEP_US - (sim_clock_now_us() - now) % STEP_US);
+    }
+}
+
+// Prints the readings by sampling mode, as reported by GET /temperature.
+static void report_sampling(void)
+{
+    sim_httpd_response_t response = {0};
+    sim_httpd_request(sim_httpd_get_server(), HTTP_GET, "/temperature", NULL, NULL, &response);
+    const char *samples = response.err == ESP_OK ? strstr(response.body, "\"samples\":") : NULL;
+    const char *end = samples ? strchr(samples, '}') : NULL;
+    if (end)
+    {
+        printf("readings by mode:   %.*s\n", (int)(end + 1 - samples - 10), samples + 10);
+    }
+    sim_httpd_response_free(&response);
+}
+
+// Prints the faults of the OneWire bus and the errors of each probe, as reported by GET /temperature.
+static void report_bus(void)
+{
+    sim_httpd_response_t response = {0};
+    sim_httpd_request(sim_httpd_get_server(), HTTP_GET, "/temperature", NULL, NULL, &response);
+    const char *bus = response.err == ESP_OK ? strstr(response.body, "\"bus\":") : NULL;
+    unsigned faults;
+    double conversion_max, read_max;
+    if (bus && sscanf(bus, "\"bus\":{\"faults\":%u,\"conversion_time\":%*f,\"conversion_time_max\":%lf,"
+                           "\"read_time\":%*f,\"read_time_max\":%lf",
+                      &faults, &conversion_max, &read_max) == 3)
+    {
+        printf("OneWire bus:        %u faults, max conversion %.1f ms, max read %.3f ms\n", faults, conversion_max,
+               read_max);
+    }
+    int probe = 0;
+    for (const char *health = bus; (health = strstr(health, "\"health\":{")); health++)
+    {
+        unsigned read_errors, retries, implausible, power_on, outliers, losses;
+        if (sscanf(health, "\"health\":{\"lost\":%*[a-z],\"read_errors\":%u,\"retries\":%u,\"implausible\":%u,"
+                           "\"power_on\":%u,\"outliers\":%u,\"consecutive_failures\":%*u,\"losses\":%u",
+                   &read_errors, &retries, &implausible, &power_on, &outliers, &losses) == 6)
+        {
+            printf("  probe %d:          %u read errors (%u retries), %u implausible, %u power-on, %u outliers, "
+                   "lost %u times\n",
+                   ++probe, read_errors, retries, implausible, power_on, outliers, losses);
+        }
+    }
+    sim_httpd_response_free(&response);
+}
+
+// Prints the NVS checkpoints of the totals, as reported by GET /totals.
+static void report_checkpoints(void)
+{
+    sim_httpd_response_t response = {0};
+    sim_httpd_request(sim_httpd_get_server(), HTTP_GET, "/totals", NULL, NULL, &response);
+    const char *checkpoints = response.err == ESP_OK ? strstr(response.body, "\"checkpoints\":") : NULL;
+    unsigned writes, last_day, budget;
+    if (checkpoints && sscanf(checkpoints, "\"checkpoints\":{\"restored\":%*[a-z],\"sequence\":%*u,\"writes\":%u,"
+                                           "\"write_failures\":%*u,\"writes_last_day\":%u,\"write_budget\":%u",
+                              &writes, &last_day, &budget) == 3)
+    {
+        printf("NVS checkpoints:    %u (%u in the last day, budget %u)\n", writes, last_day, budget);
+    }
+    sim_httpd_response_free(&response);
+}
+
+static unsigned count_occurrences(const char *haystack, const char *needle)
+{
+    unsigned count = 0;
+    for (const char *p = haystack; (p = strstr(p, needle)); p += strlen(needle))
+    {
+        count++;
+    }
+    return count;
+}
+
+// Prints the journaled events by type, as reported by GET /journal.
+static void report_journal(void)
+{
+    sim_httpd_response_t response = {0};
+    sim_httpd_request(sim_httpd_get_server(), HTTP_GET, "/journal", NULL, NULL, &response);
+    if (response.err == ESP_OK)
+    {
+        printf("journal records:    %u pump on, %u pump off, %u flow cycles, %u sensor faults (%zu bytes)\n",
+               count_occurrences(response.body, "\"pump_on\""), count_occurrences(response.body, "\"pump_off\""),
+               count_occurrences(response.body, "\"flow_cycle\""),
+               count_occurrences(response.body, "\"sensor_fault\""), response.body_len);
+    }
+    sim_httpd_response_free(&response);
+}
+
+// The value of an unlabeled sample in a GET /metrics body (NAN if absent).
+static double metric_value(const char *body, const char *name)
+{
+    char key[64];
+    snprintf(key, sizeof(key), "\nrecirc_%s ", name);
+    const char *sample = strstr(body, key);
+    return sample ? atof(sample + strlen(key)) : NAN;
+}
+
+// Prints what the MQTT reporter published, as reported by GET /metrics and the simulated broker.
+static void report_reporter(void)
+{
+    sim_httpd_response_t response = {0};
+    sim_httpd_request(sim_httpd_get_server(), HTTP_GET, "/metrics", NULL, NULL, &response);
+    if (response.err == ESP_OK && strstr(response.body, "\nrecirc_reporter_events_total "))
+    {
+        const double batches = metric_value(response.body, "reporter_batch_events_count");
+        uint32_t messages;
+        size_t bytes;
+        sim_mqtt_get_received(&messages, &bytes);
+        printf("MQTT reports:       %.0f events, %.0f dropped, %.0f queued; %.0f batches (avg %.1f, max %.0f events, "
+               "%.0f retries)\n",
+               metric_value(response.body, "reporter_events_total"),
+               metric_value(response.body, "reporter_events_dropped_total"),
+               metric_value(response.body, "reporter_events_queued"), batches,
+               batches ? metric_value(response.body, "reporter_batch_events_sum") / batches : 0,
+               metric_value(response.body, "reporter_batch_events_max"),
+               metric_value(response.body, "reporter_retries_total"));
+        printf("  publish latency:  avg %.1f ms, max %.1f ms; broker received %u messages, %zu bytes\n",
+               batches ? metric_value(response.body, "reporter_publish_seconds_sum") * 1e3 / batches : 0,
+               metric_value(response.body, "reporter_publish_seconds_max") * 1e3, messages, bytes);
+    }
+    sim_httpd_response_free(&response);
+}
+
+#if CONFIG_LATENCY_TRACE
+// Prints the mean latency of each traced stage of a flow start, as reported by GET /latency.
+static void report_latency(void)
+{
+    static const char *const stages[] = {"detection", "input", "decision", "relay", "total"};
+    sim_httpd_response_t response = {0};
+    sim_httpd_request(sim_httpd_get_server(), HTTP_GET, "/latency", NULL, NULL, &response);
+    if (response.err == ESP_OK)
+    {
+        printf("traced latency:    ");
+        for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++)
+        {
+            char key[32];
+            snprintf(key, sizeof(key), "\"%s\":{", stages[i]);
+            const char *stage = strstr(response.body, key);
+            unsigned count = 0;
+            double mean = 0;
+            if (stage && sscanf(stage + strlen(key), "\"count\":%u,\"mean\":%lf", &count, &mean) >= 1)
+            {
+                printf(" %s %.3f ms (%u)", stages[i], mean, count);
+            }
+        }
+        printf("\n");
+    }
+    sim_httpd_response_free(&response);
+}
+#endif
+
+static void report(const options_t *options)
+{
+    pthread_mutex_lock(&s_lock);
+    size_t served = 0, hot = 0;
+    double latency_total = 0, latency_max = 0, wait_total = 0;
+    for (size_t i = 0; i < s_draw_count; i++)
+    {
+        if (s_draws[i].pump_on)
+        {
+            const double latency = (s_draws[i].pump_on - s_draws[i].start) / 1e3;
+            latency_total += latency;
+            latency_max = fmax(latency_max, latency);
+            served++;
+        }
+        if (s_draws[i].hot)
+        {
+            wait_total += (s_draws[i].hot - s_draws[i].start) / 1e6;
+            hot++;
+        }
+    }
+    if (sim_gpio_get_level(CONFIG_RELAY_GPIO))
+    {
+        s_pump_on_time += sim_clock_now_us() - s_relay_on_since;
+    }
+
+    printf("\n=== Simulation report (%.0f virtual seconds at %.0fx) ===\n", options->duration, options->speed);
+    printf("draws:              %zu\n", s_draw_count);
+    printf("pump starts:        %zu (on draw)\n", served);
+    printf("relay transitions:  %u\n", s_relay_transitions);
+    printf("pump on time:       %.1f s (%.2f%%)\n", s_pump_on_time / 1e6, 100 * s_pump_on_time / 1e6 / options->duration);
+    printf("draw -> relay on:   avg %.1f ms, max %.1f ms\n", served ? latency_total / served : 0, latency_max);
+#if CONFIG_LATENCY_TRACE
+    report_latency();
+#endif
+    printf("draw -> hot water:  avg %.1f s over %zu draws\n", hot ? wait_total / hot : 0, hot);
+    printf("DS18B20 conversions: %u\n", sim_ds18x20_get_conversions());
+    pthread_mutex_unlock(&s_lock);
+    report_sampling();
+    report_bus();
+    report_checkpoints();
+    report_journal();
+    report_reporter();
+
+    printf("\n%-24s %8s %8s %10s %10s %10s\n", "endpoint", "requests", "failures", "avg us", "max us", "avg bytes");
+    for (int i = 0; i < MAX_ENDPOINTS && s_endpoints[i].uri; i++)
+    {
+        const endpoint_stats_t *e = &s_endpoints[i];
+        printf("%-24s %8u %8u %10.1f %10lld %10zu\n", e->uri, e->requests, e->failures,
+               e->requests ? (double)e->total_us / e->requests : 0, (long long)e->max_us,
+               e->requests ? e->bytes / e->requests : 0);
+    }
+
+    if (options->streams)
+    {
+        printf("\n%-24s %8s %10s %8s\n", "/events subscriber", "messages", "bytes", "status");
+        for (int i = 0; i < MAX_STREAMS; i++)
+        {
+            const stream_stats_t *st = &s_streams[i];
+            if (st->stream == NULL && i < options->streams)
+            {
+                printf("%-24d %8s %10s %8s\n", i, "-", "-", "refused");
+            }
+            else if (st->stream)
+            {
+                char name[32];
+                snprintf(name, sizeof(name), "%d%s", i, st->slow ? " (slow)" : "");
+                printf("%-24s %8u %10zu %8s\n", name, st->events, st->bytes,
+                       sim_httpd_stream_is_active(st->stream) ? "open"
+                                                              : sim_httpd_stream_get_response(st->stream)->status);
+            }
+        }
+    }
+
+    sim_queue_stats_t stats[32];
+    const size_t n = sim_freertos_get_queue_stats(stats, 32);
+    printf("\n%-24s %6s %6s %8s %8s %8s %8s\n", "queue", "length", "item", "max", "sends", "failed", "received");
+    for (size_t i = 0; i < n; i++)
+    {
+        if (stats[i].item_size == 0)
+        {
+            continue; // semaphores
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%s", stats[i].name[0] ? stats[i].name : "(unnamed)");
+        printf("%-24s %6u %6u %8u %8u %8u %8u\n", name, stats[i].length, stats[i].item_size,
+               stats[i].max_waiting, stats[i].sends, stats[i].send_failures, stats[i].receives);
+    }
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -s, --speed X          virtual clock speed-up (default 100)\n"
+            "  -d, --duration S       virtual seconds to simulate (default 21600)\n"
+            "  -i, --draw-interval S  mean virtual seconds between hot-water draws (default 1800)\n"
+            "  -p, --http-period S    virtual seconds between polls of the JSON endpoints, 0 to disable (default 5)\n"
+            "  -e, --error-rate P     probability of a failed DS18B20 read (default 0)\n"
+            "  -o, --outage S         disconnect the return probe for S virtual seconds halfway through (default 0)\n"
+            "  -w, --wifi-outage S    take Wi-Fi down for S virtual seconds a quarter through (default 0)\n"
+            "  -S, --sse N            subscribe N clients to /events, the last one slow if N > 1 (default 0)\n"
+            "  -t, --trace FILE       save the pump control trace (GET /trace) for pump_replay\n"
+            "  -r, --seed N           random seed (default 1)\n"
+            "  -v, --verbose          debug logging\n",
+            program);
+}
+
+static bool save_trace(const char *path)
+{
+    sim_httpd_response_t response = {0};
+    sim_httpd_request(sim_httpd_get_server(), HTTP_GET, "/trace", NULL, NULL, &response);
+    bool saved = false;
+    if (response.err != ESP_OK)
+    {
+        fprintf(stderr, "GET /trace failed: %s (%d)\n", response.status, response.err);
+    }
+    else
+    {
+        FILE *file = fopen(path, "wb");
+        saved = file && fwrite(response.body, 1, response.body_len, file) == response.body_len;
+        saved = file && fclose(file) == 0 && saved;
+        if (saved)
+        {
+            printf("\nSaved %zu byte trace to %s\n", response.body_len, path);
+        }
+        else
+        {
+            perror(path);
+        }
+    }
+    sim_httpd_response_free(&response);
+    return saved;
+}
+
+int main(int argc, char **argv)
+{
+    options_t options = {
+        .speed = 100, .duration = 21600, .draw_interval = 1800, .http_period = 5, .seed = 1};
+    const struct option long_options[] = {
+        {"speed", required_argument, NULL, 's'},
+        {"duration", required_argument, NULL, 'd'},
+        {"draw-interval", required_argument, NULL, 'i'},
+        {"http-period", required_argument, NULL, 'p'},
+        {"error-rate", required_argument, NULL, 'e'},
+        {"outage", required_argument, NULL, 'o'},
+        {"wifi-outage", required_argument, NULL, 'w'},
+        {"sse", required_argument, NULL, 'S'},
+        {"trace", required_argument, NULL, 't'},
+        {"seed", required_argument, NULL, 'r'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {0},
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "s:d:i:p:e:o:w:S:t:r:vh", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 's':
+            options.speed = atof(optarg);
+            break;
+        case 'd':
+            options.duration = atof(optarg);
+            break;
+        case 'i':
+            options.draw_interval = atof(optarg);
+            break;
+        case 'p':
+            options.http_period = atof(optarg);
+            break;
+        case 'e':
+            options.error_rate = atof(optarg);
+            break;
+        case 'o':
+            options.outage = atof(optarg);
+            break;
+        case 'w':
+            options.wifi_outage = atof(optarg);
+            break;
+        case 'S':
+            options.streams = atoi(optarg);
+            break;
+        case 't':
+            options.trace_path = optarg;
+            break;
+        case 'r':
+            options.seed = (unsigned int)strtoul(optarg, NULL, 0);
+            break;
+        case 'v':
+            options.verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    sim_clock_set_speed(options.speed);
+    esp_log_level_set("*", options.verbose ? ESP_LOG_DEBUG : ESP_LOG_INFO);
+    sim_ds18x20_set_error_rate(options.error_rate);
+    ESP_ERROR_CHECK(sim_ds18x20_add_device(CONFIG_TEMPERATURE_SENSORS_GPIO, SENSOR_SUPPLY));
+    ESP_ERROR_CHECK(sim_ds18x20_add_device(CONFIG_TEMPERATURE_SENSORS_GPIO, SENSOR_RETURN));
+    sim_gpio_set_listener(relay_listener, NULL);
+
+    extern void app_main(void);
+    app_main();
+    open_streams(&options);
+    run(&options);
+    report(&options);
+    if (options.trace_path && !save_trace(options.trace_path))
+    {
+        fflush(stdout);
+        _Exit(EXIT_FAILURE);
+    }
+    fflush(stdout);
+    _Exit(EXIT_SUCCESS); // firmware tasks never return
+}
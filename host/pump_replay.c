@@ -0,0 +1,162 @@
+/*
+ * Replays a pump control trace (GET /trace, or pump_controller_sim --trace) through the firmware's
+ * decision code (main/pump_control.c), and checks that every replayed decision matches the recorded
+ * one. Prints the relay transitions; --verbose prints every record.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pump_control.h"
+#include "pump_trace.h"
+
+#define USEC_IN_SEC (double)1000000
+
+static const char *const EVENT_NAMES[PUMP_CONTROL_EVENT_MAX] = {
+    [PUMP_CONTROL_FLOW_STARTED] = "flow_started",
+    [PUMP_CONTROL_TEMPERATURE_MEASURED] = "temperature",
+    [PUMP_CONTROL_TIMEOUT] = "timeout",
+    [PUMP_CONTROL_CUTOFF] = "cutoff",
+    [PUMP_CONTROL_PREHEAT] = "preheat",
+};
+
+static const char *event_name(uint8_t event)
+{
+    return event < PUMP_CONTROL_EVENT_MAX ? EVENT_NAMES[event] : "?";
+}
+
+static void format_actions(uint32_t actions, char *buf, size_t size)
+{
+    static const char *const names[] = {"request_reading", "relay_on", "relay_off", "start_timeout",
+                                        "stop_timeout", "start_cutoff", "stop_cutoff"};
+    size_t len = 0;
+    buf[0] = '\0';
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        if (actions & (1 << i))
+        {
+            len += snprintf(buf + len, len < size ? size - len : 0, "%s%s", len ? "," : "", names[i]);
+        }
+    }
+    if (!len)
+    {
+        snprintf(buf, size, "-");
+    }
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [options] TRACE\n"
+            "  -v, --verbose   print every record, not only the relay transitions\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    bool verbose = false;
+    const struct option long_options[] = {
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {0},
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "vh", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *file = fopen(argv[optind], "rb");
+    if (!file)
+    {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+    pump_trace_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, PUMP_TRACE_MAGIC, 4) != 0)
+    {
+        fprintf(stderr, "%s: not a pump control trace\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+    if (header.version != PUMP_TRACE_VERSION || header.record_size != sizeof(pump_trace_record_t))
+    {
+        fprintf(stderr, "%s: unsupported trace version %u (%u byte records)\n", argv[optind], header.version,
+                header.record_size);
+        return EXIT_FAILURE;
+    }
+    const pump_control_config_t config = header.control; // copied out of the packed header
+    printf("%lu records (%lu overwritten before the first)\n", (unsigned long)header.count,
+           (unsigned long)header.overwritten);
+    printf("config: delta on >= %.2f, off <= %.2f; min off %.0f s, min on %.0f s, max on %.0f s\n\n",
+           config.max_temperature_delta, config.min_temperature_delta, config.min_off_duration / USEC_IN_SEC,
+           config.min_on_duration / USEC_IN_SEC, config.max_on_duration / USEC_IN_SEC);
+    printf("%6s %12s %-12s %8s %5s %10s  %s\n", "record", "time (s)", "event", "delta", "relay", "in state",
+           "actions");
+
+    uint32_t transitions = 0;
+    uint32_t mismatches = 0;
+    uint32_t outside_changes = 0;
+    int expected_state = -1; // the relay state the previous decision left, if it changed it
+    pump_trace_record_t record;
+    uint32_t i = 0;
+    for (; i < header.count && fread(&record, sizeof(record), 1, file) == 1; i++)
+    {
+        pump_control_input_t input;
+        pump_trace_get_input(&record, &input);
+        const uint32_t actions = pump_control_step(&config, &input);
+        const bool transition = actions & (PUMP_CONTROL_RELAY_ON | PUMP_CONTROL_RELAY_OFF);
+        const bool mismatch = actions != record.actions;
+        if (expected_state >= 0 && record.relay_state != expected_state)
+        {
+            outside_changes++;
+        }
+        expected_state = actions & PUMP_CONTROL_RELAY_ON ? RELAY_ON : actions & PUMP_CONTROL_RELAY_OFF ? RELAY_OFF
+                                                                                                        : -1;
+        transitions += transition;
+        mismatches += mismatch;
+        if (verbose || transition || mismatch)
+        {
+            char buf[128];
+            format_actions(actions, buf, sizeof(buf));
+            printf("%6lu %12.3f %-12s %8.2f %5s %10.1f  %s", (unsigned long)i, record.timestamp / USEC_IN_SEC,
+                   event_name(record.event), record.temperature_delta, record.relay_state ? "on" : "off",
+                   record.time_in_relay_state / USEC_IN_SEC, buf);
+            if (mismatch)
+            {
+                format_actions(record.actions, buf, sizeof(buf));
+                printf("  MISMATCH: recorded %s", buf);
+            }
+            printf("\n");
+        }
+    }
+    fclose(file);
+
+    printf("\n%lu records replayed, %lu relay transitions, %lu mismatches\n", (unsigned long)i,
+           (unsigned long)transitions, (unsigned long)mismatches);
+    if (outside_changes)
+    {
+        printf("%lu records found the relay in another state than the previous decision left it "
+               "(records lost, or the relay set elsewhere)\n",
+               (unsigned long)outside_changes);
+    }
+    if (i != header.count)
+    {
+        fprintf(stderr, "truncated trace: %lu of %lu records\n", (unsigned long)i, (unsigned long)header.count);
+        return EXIT_FAILURE;
+    }
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,213 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include "ds18x20.h"
+#include "sim.h"
+
+#define MAX_DEVICES 16
+#define CONVERSION_TIME_US 750000 // 12-bit resolution
+#define POWER_ON_TEMPERATURE 85.0f
+
+typedef struct
+{
+    gpio_num_t gpio_num;
+    ds18x20_addr_t addr;
+    float temperature;  /// the (true) temperature at the probe
+    float scratchpad;   /// the latest converted temperature
+    int64_t conversion; /// virtual time at which the pending conversion completes (0 if none)
+    bool absent;        /// disconnected: no presence pulse, and the power-on scratchpad once back
+} device_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static device_t s_devices[MAX_DEVICES];
+static size_t s_device_count;
+static double s_error_rate;
+static unsigned int s_seed = 1;
+static uint32_t s_conversions;
+
+static device_t *find(gpio_num_t pin, ds18x20_addr_t addr)
+{
+    for (size_t i = 0; i < s_device_count; i++)
+    {
+        if (s_devices[i].gpio_num == pin && s_devices[i].addr == addr)
+        {
+            return &s_devices[i];
+        }
+    }
+    return NULL;
+}
+
+static void latch(device_t *device, int64_t now)
+{
+    if (device->conversion && now >= device->conversion)
+    {
+        device->scratchpad = device->temperature;
+        device->conversion = 0;
+    }
+}
+
+esp_err_t sim_ds18x20_add_device(gpio_num_t gpio_num, ds18x20_addr_t addr)
+{
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    if (s_device_count == MAX_DEVICES || find(gpio_num, addr))
+    {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else
+    {
+        s_devices[s_device_count++] = (device_t){
+            .gpio_num = gpio_num, .addr = addr, .temperature = 20.0f, .scratchpad = POWER_ON_TEMPERATURE};
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+esp_err_t sim_ds18x20_set_present(gpio_num_t gpio_num, ds18x20_addr_t addr, bool present)
+{
+    pthread_mutex_lock(&s_lock);
+    device_t *device = find(gpio_num, addr);
+    if (device && device->absent && present)
+    {
+        device->scratchpad = POWER_ON_TEMPERATURE;
+        device->conversion = 0;
+    }
+    if (device)
+    {
+        device->absent = !present;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return device ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t sim_ds18x20_set_temperature(gpio_num_t gpio_num, ds18x20_addr_t addr, float temperature)
+{
+    pthread_mutex_lock(&s_lock);
+    device_t *device = find(gpio_num, addr);
+    if (device)
+    {
+        device->temperature = temperature;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return device ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+void sim_ds18x20_set_error_rate(double error_rate)
+{
+    pthread_mutex_lock(&s_lock);
+    s_error_rate = error_rate;
+    pthread_mutex_unlock(&s_lock);
+}
+
+uint32_t sim_ds18x20_get_conversions(void)
+{
+    pthread_mutex_lock(&s_lock);
+    const uint32_t conversions = s_conversions;
+    pthread_mutex_unlock(&s_lock);
+    return conversions;
+}
+
+esp_err_t ds18x20_scan_devices(gpio_num_t pin, ds18x20_addr_t *addr_list, size_t addr_count, size_t *found)
+{
+    if (addr_list == NULL || found == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    *found = 0;
+    for (size_t i = 0; i < s_device_count; i++)
+    {
+        if (s_devices[i].gpio_num == pin && !s_devices[i].absent)
+        {
+            if (*found < addr_count)
+            {
+                addr_list[*found] = s_devices[i].addr;
+            }
+            (*found)++;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return *found ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t ds18x20_measure(gpio_num_t pin, ds18x20_addr_t addr, bool wait)
+{
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    pthread_mutex_lock(&s_lock);
+    const int64_t conversion = sim_clock_now_us() + CONVERSION_TIME_US;
+    for (size_t i = 0; i < s_device_count; i++)
+    {
+        if (s_devices[i].gpio_num == pin && !s_devices[i].absent && (addr == DS18X20_ANY || s_devices[i].addr == addr))
+        {
+            s_devices[i].conversion = conversion;
+            ret = ESP_OK;
+        }
+    }
+    if (ret == ESP_OK)
+    {
+        s_conversions++;
+    }
+    pthread_mutex_unlock(&s_lock);
+    if (ret == ESP_OK && wait)
+    {
+        sim_clock_sleep_us(CONVERSION_TIME_US);
+    }
+    return ret;
+}
+
+esp_err_t ds18x20_read_temperature(gpio_num_t pin, ds18x20_addr_t addr, float *temperature)
+{
+    if (temperature == NULL || addr == DS18X20_ANY)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    device_t *device = find(pin, addr);
+    if (device == NULL)
+    {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+    else if (device->absent)
+    {
+        ret = ESP_ERR_INVALID_RESPONSE;
+    }
+    else if (s_error_rate > 0 && rand_r(&s_seed) < s_error_rate * RAND_MAX)
+    {
+        ret = ESP_ERR_INVALID_CRC;
+    }
+    else
+    {
+        latch(device, sim_clock_now_us());
+        *temperature = device->scratchpad;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+esp_err_t ds18x20_measure_and_read(gpio_num_t pin, ds18x20_addr_t addr, float *temperature)
+{
+    esp_err_t err = ds18x20_measure(pin, addr, true);
+    return err == ESP_OK ? ds18x20_read_temperature(pin, addr, temperature) : err;
+}
+
+esp_err_t ds18x20_read_temp_multi(gpio_num_t pin, ds18x20_addr_t *addr_list, size_t addr_count,
+                                  float *result_list)
+{
+    esp_err_t ret = ESP_OK;
+    for (size_t i = 0; i < addr_count; i++)
+    {
+        esp_err_t err = ds18x20_read_temperature(pin, addr_list[i], &result_list[i]);
+        if (err != ESP_OK)
+        {
+            ret = err;
+        }
+    }
+    return ret;
+}
+
+esp_err_t ds18x20_measure_and_read_multi(gpio_num_t pin, ds18x20_addr_t *addr_list, size_t addr_count,
+                                         float *result_list)
+{
+    esp_err_t err = ds18x20_measure(pin, DS18X20_ANY, true);
+    return err == ESP_OK ? ds18x20_read_temp_multi(pin, addr_list, addr_count, result_list) : err;
+}
@@ -0,0 +1,133 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_event.h"
+
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+
+typedef struct handler_s
+{
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+    struct handler_s *next;
+} handler_t;
+
+typedef struct
+{
+    esp_event_base_t base;
+    int32_t id;
+    void *data;
+} event_t;
+
+// recursive, so handlers may (un)register handlers while being dispatched
+static pthread_mutex_t s_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static handler_t *s_handlers;
+static QueueHandle_t s_queue;
+
+static void event_loop_task(void *args)
+{
+    event_t event;
+    while (xQueueReceive(s_queue, &event, portMAX_DELAY))
+    {
+        pthread_mutex_lock(&s_lock);
+        for (handler_t *h = s_handlers; h; h = h->next)
+        {
+            if ((h->base == ESP_EVENT_ANY_BASE || h->base == event.base) &&
+                (h->id == ESP_EVENT_ANY_ID || h->id == event.id))
+            {
+                h->handler(h->arg, event.base, event.id, event.data);
+            }
+        }
+        pthread_mutex_unlock(&s_lock);
+        free(event.data);
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    if (s_queue)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_queue = xQueueCreate(32, sizeof(event_t));
+    if (s_queue == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    vQueueAddToRegistry(s_queue, "sys_evt");
+    return xTaskCreate(event_loop_task, "sys_evt", 2304, NULL, 20, NULL) == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    handler_t *h = calloc(1, sizeof(handler_t));
+    if (h == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    h->base = event_base;
+    h->id = event_id;
+    h->handler = event_handler;
+    h->arg = event_handler_arg;
+    pthread_mutex_lock(&s_lock);
+    handler_t **tail = &s_handlers;
+    while (*tail)
+    {
+        tail = &(*tail)->next;
+    }
+    *tail = h;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id,
+                                       esp_event_handler_t event_handler)
+{
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    pthread_mutex_lock(&s_lock);
+    for (handler_t **h = &s_handlers; *h; h = &(*h)->next)
+    {
+        if ((*h)->base == event_base && (*h)->id == event_id && (*h)->handler == event_handler)
+        {
+            handler_t *found = *h;
+            *h = found->next;
+            free(found);
+            ret = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait)
+{
+    if (s_queue == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    event_t event = {.base = event_base, .id = event_id};
+    if (event_data && event_data_size)
+    {
+        event.data = malloc(event_data_size);
+        if (event.data == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(event.data, event_data, event_data_size);
+    }
+    if (!xQueueSend(s_queue, &event, ticks_to_wait))
+    {
+        free(event.data);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,53 @@
+#include <stdbool.h>
+#include <malloc.h>
+#include <pthread.h>
+#include "esp_heap_caps.h"
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t s_minimum_free = SIM_HEAP_SIZE;
+
+static bool is_simulated(uint32_t caps)
+{
+    return !(caps & MALLOC_CAP_SPIRAM);
+}
+
+size_t heap_caps_get_total_size(uint32_t caps)
+{
+    return is_simulated(caps) ? SIM_HEAP_SIZE : 0;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    if (!is_simulated(caps))
+    {
+        return 0;
+    }
+    const struct mallinfo2 info = mallinfo2();
+    const size_t free_size = info.uordblks < SIM_HEAP_SIZE ? SIM_HEAP_SIZE - info.uordblks : 0;
+    pthread_mutex_lock(&s_lock);
+    if (free_size < s_minimum_free)
+    {
+        s_minimum_free = free_size;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return free_size;
+}
+
+// The minimum is that of the samples taken by heap_caps_get_free_size.
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    if (!is_simulated(caps))
+    {
+        return 0;
+    }
+    heap_caps_get_free_size(caps);
+    pthread_mutex_lock(&s_lock);
+    const size_t minimum = s_minimum_free;
+    pthread_mutex_unlock(&s_lock);
+    return minimum;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return heap_caps_get_free_size(caps);
+}
@@ -0,0 +1,517 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "esp_check.h"
+#include "esp_http_server.h"
+#include "sim.h"
+
+static const char *TAG = "httpd";
+
+typedef struct
+{
+    httpd_config_t config;
+    httpd_uri_t *handlers;
+    size_t handler_count;
+    pthread_mutex_t lock; /// requests are served one at a time, like the single httpd task
+} server_t;
+
+struct sim_httpd_stream_s
+{
+    pthread_mutex_t lock;
+    sim_httpd_response_t response; /// the response, including every byte sent after the handler returned
+    size_t read_offset;            /// bytes of the body already read by the client
+    int64_t send_delay;            /// virtual microseconds each send takes (a slow client)
+    bool closed;                   /// the client closed the connection
+    bool async;                    /// an async request is still sending
+    int refs;                      /// the client, plus the async request
+};
+
+typedef struct
+{
+    sim_httpd_stream_t stream; /// set for requests made through sim_httpd_stream_open
+    const char *headers; /// request headers
+    const char *body;    /// request body
+    size_t body_offset;
+    sim_httpd_response_t *response;
+    bool sent; /// a complete response (or the last chunk) was sent
+} request_aux_t;
+
+static pthread_mutex_t s_servers_lock = PTHREAD_MUTEX_INITIALIZER;
+static server_t *s_latest_server;
+
+// Appends to a captured response buffer; the allocations are counted so that benchmarks can tell
+// them apart from the handler's own.
+static esp_err_t append(sim_httpd_response_t *response, char **buf, size_t *len, const char *data, size_t data_len)
+{
+    char *grown = realloc(*buf, *len + data_len + 1);
+    if (grown == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    response->capture_allocs++;
+    response->capture_bytes += *len + data_len + 1;
+    memcpy(grown + *len, data, data_len);
+    *len += data_len;
+    grown[*len] = '\0';
+    *buf = grown;
+    return ESP_OK;
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(handle && config, ESP_ERR_INVALID_ARG, TAG, "null");
+    server_t *server = calloc(1, sizeof(server_t));
+    ESP_RETURN_ON_FALSE(server, ESP_ERR_HTTPD_ALLOC_MEM, TAG, "malloc server");
+    server->config = *config;
+    server->handlers = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+    if (server->handlers == NULL)
+    {
+        free(server);
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_mutex_lock(&s_servers_lock);
+    s_latest_server = server;
+    pthread_mutex_unlock(&s_servers_lock);
+    *handle = server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "null");
+    server_t *server = (server_t *)handle;
+    pthread_mutex_lock(&s_servers_lock);
+    if (s_latest_server == server)
+    {
+        s_latest_server = NULL;
+    }
+    pthread_mutex_unlock(&s_servers_lock);
+    pthread_mutex_lock(&server->lock); // wait for an in-flight request
+    pthread_mutex_unlock(&server->lock);
+    for (size_t i = 0; i < server->handler_count; i++)
+    {
+        free((char *)server->handlers[i].uri);
+    }
+    free(server->handlers);
+    free(server);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    ESP_RETURN_ON_FALSE(handle && uri_handler, ESP_ERR_INVALID_ARG, TAG, "null");
+    server_t *server = (server_t *)handle;
+    for (size_t i = 0; i < server->handler_count; i++)
+    {
+        if (server->handlers[i].method == uri_handler->method &&
+            strcmp(server->handlers[i].uri, uri_handler->uri) == 0)
+        {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (server->handler_count == server->config.max_uri_handlers)
+    {
+        ESP_LOGW(TAG, "no slots left for registering handler");
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    // like ESP-IDF, keeps a copy of the URI, so that it may be built on the caller's stack
+    char *uri = strdup(uri_handler->uri);
+    if (uri == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    server->handlers[server->handler_count] = *uri_handler;
+    server->handlers[server->handler_count++].uri = uri;
+    return ESP_OK;
+}
+
+bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match, size_t match_upto)
+{
+    size_t n = strlen(uri_template);
+    const bool asterisk = n && uri_template[n - 1] == '*';
+    n -= asterisk;
+    const bool quest = n && uri_template[n - 1] == '?';
+    n -= quest;
+    if (quest && match_upto == n - 1 && strncmp(uri_template, uri_to_match, n - 1) == 0)
+    {
+        return true; // the optional character is absent
+    }
+    if (match_upto < n || strncmp(uri_template, uri_to_match, n) != 0)
+    {
+        return false;
+    }
+    return asterisk || match_upto == n;
+}
+
+static request_aux_t *aux(httpd_req_t *r)
+{
+    return (request_aux_t *)r->aux;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    ESP_RETURN_ON_FALSE(r && status, ESP_ERR_INVALID_ARG, TAG, "null");
+    strncpy(aux(r)->response->status, status, sizeof(aux(r)->response->status) - 1);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    ESP_RETURN_ON_FALSE(r && type, ESP_ERR_INVALID_ARG, TAG, "null");
+    strncpy(aux(r)->response->content_type, type, sizeof(aux(r)->response->content_type) - 1);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    ESP_RETURN_ON_FALSE(r && field && value, ESP_ERR_INVALID_ARG, TAG, "null");
+    sim_httpd_response_t *response = aux(r)->response;
+    ESP_RETURN_ON_ERROR(append(response, &response->headers, &response->headers_len, field, strlen(field)), TAG, "hdr");
+    ESP_RETURN_ON_ERROR(append(response, &response->headers, &response->headers_len, ": ", 2), TAG, "hdr");
+    ESP_RETURN_ON_ERROR(append(response, &response->headers, &response->headers_len, value, strlen(value)), TAG, "hdr");
+    return append(response, &response->headers, &response->headers_len, "\r\n", 2);
+}
+
+static void stream_release(sim_httpd_stream_t stream)
+{
+    pthread_mutex_lock(&stream->lock);
+    const bool last = --stream->refs == 0;
+    pthread_mutex_unlock(&stream->lock);
+    if (last)
+    {
+        sim_httpd_response_free(&stream->response);
+        pthread_mutex_destroy(&stream->lock);
+        free(stream);
+    }
+}
+
+// Locks the stream (if any) of a request for a send; fails when its client is gone.
+static esp_err_t send_begin(httpd_req_t *r)
+{
+    sim_httpd_stream_t stream = aux(r)->stream;
+    if (stream == NULL)
+    {
+        return ESP_OK;
+    }
+    pthread_mutex_lock(&stream->lock);
+    const int64_t send_delay = stream->send_delay;
+    pthread_mutex_unlock(&stream->lock);
+    if (send_delay)
+    {
+        sim_clock_sleep_us(send_delay);
+    }
+    pthread_mutex_lock(&stream->lock);
+    if (stream->closed)
+    {
+        pthread_mutex_unlock(&stream->lock);
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t send_end(httpd_req_t *r, esp_err_t err)
+{
+    if (aux(r)->stream)
+    {
+        pthread_mutex_unlock(&aux(r)->stream->lock);
+    }
+    return err;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    ESP_RETURN_ON_FALSE(r, ESP_ERR_HTTPD_INVALID_REQ, TAG, "null");
+    ESP_RETURN_ON_FALSE(!aux(r)->sent, ESP_ERR_HTTPD_RESP_SEND, TAG, "response already sent");
+    sim_httpd_response_t *response = aux(r)->response;
+    const size_t len = buf == NULL ? 0 : (buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : (size_t)buf_len);
+    ESP_RETURN_ON_ERROR(send_begin(r), TAG, "send");
+    aux(r)->sent = true;
+    return send_end(r, append(response, &response->body, &response->body_len, buf ? buf : "", len));
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    ESP_RETURN_ON_FALSE(r, ESP_ERR_HTTPD_INVALID_REQ, TAG, "null");
+    ESP_RETURN_ON_FALSE(!aux(r)->sent, ESP_ERR_HTTPD_RESP_SEND, TAG, "response already sent");
+    sim_httpd_response_t *response = aux(r)->response;
+    const size_t len = buf == NULL ? 0 : (buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : (size_t)buf_len);
+    ESP_RETURN_ON_ERROR(send_begin(r), TAG, "send");
+    if (len == 0)
+    {
+        aux(r)->sent = true; // terminating chunk
+        return send_end(r, ESP_OK);
+    }
+    response->chunks++;
+    return send_end(r, append(response, &response->body, &response->body_len, buf, len));
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg)
+{
+    static const char *const STATUS[HTTPD_ERR_CODE_MAX] = {
+        "500 Internal Server Error", "501 Method Not Implemented", "505 Version Not Supported",
+        "400 Bad Request", "401 Unauthorized", "403 Forbidden", "404 Not Found",
+        "405 Method Not Allowed", "408 Request Timeout", "411 Length Required", "414 URI Too Long",
+        "431 Request Header Fields Too Large"};
+    ESP_RETURN_ON_FALSE(error < HTTPD_ERR_CODE_MAX, ESP_ERR_INVALID_ARG, TAG, "error code");
+    ESP_RETURN_ON_ERROR(httpd_resp_set_status(req, STATUS[error]), TAG, "status");
+    ESP_RETURN_ON_ERROR(httpd_resp_set_type(req, HTTPD_TYPE_TEXT), TAG, "type");
+    return httpd_resp_sendstr(req, msg);
+}
+
+static const char *query_of(httpd_req_t *r)
+{
+    const char *q = strchr(r->uri, '?');
+    return q ? q + 1 : NULL;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r)
+{
+    const char *q = query_of(r);
+    return q ? strlen(q) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    ESP_RETURN_ON_FALSE(r && buf && buf_len, ESP_ERR_INVALID_ARG, TAG, "null");
+    const char *q = query_of(r);
+    if (q == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    strncpy(buf, q, buf_len - 1);
+    buf[buf_len - 1] = '\0';
+    return strlen(q) < buf_len ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    ESP_RETURN_ON_FALSE(qry && key && val && val_size, ESP_ERR_INVALID_ARG, TAG, "null");
+    const size_t key_len = strlen(key);
+    for (const char *p = qry; p && *p; p = strchr(p, '&') ? strchr(p, '&') + 1 : NULL)
+    {
+        if (strncmp(p, key, key_len) == 0 && p[key_len] == '=')
+        {
+            const char *v = p + key_len + 1;
+            const size_t len = strcspn(v, "&");
+            const size_t n = len < val_size ? len : val_size - 1;
+            memcpy(val, v, n);
+            val[n] = '\0';
+            return len < val_size ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+static const char *find_header(httpd_req_t *r, const char *field, size_t *len)
+{
+    const size_t field_len = strlen(field);
+    for (const char *p = aux(r)->headers; p && *p; p = strstr(p, "\r\n") ? strstr(p, "\r\n") + 2 : NULL)
+    {
+        if (strncasecmp(p, field, field_len) == 0 && p[field_len] == ':')
+        {
+            const char *v = p + field_len + 1;
+            while (*v == ' ')
+            {
+                v++;
+            }
+            *len = strcspn(v, "\r\n");
+            return v;
+        }
+    }
+    return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    size_t len = 0;
+    return find_header(r, field, &len) ? len : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    ESP_RETURN_ON_FALSE(r && field && val && val_size, ESP_ERR_INVALID_ARG, TAG, "null");
+    size_t len = 0;
+    const char *v = find_header(r, field, &len);
+    if (v == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    const size_t n = len < val_size ? len : val_size - 1;
+    memcpy(val, v, n);
+    val[n] = '\0';
+    return len < val_size ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    request_aux_t *a = aux(r);
+    const size_t remaining = r->content_len - a->body_offset;
+    const size_t n = remaining < buf_len ? remaining : buf_len;
+    memcpy(buf, a->body + a->body_offset, n);
+    a->body_offset += n;
+    return (int)n;
+}
+
+httpd_handle_t sim_httpd_get_server(void)
+{
+    pthread_mutex_lock(&s_servers_lock);
+    httpd_handle_t server = s_latest_server;
+    pthread_mutex_unlock(&s_servers_lock);
+    return server;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out)
+{
+    ESP_RETURN_ON_FALSE(r && out, ESP_ERR_INVALID_ARG, TAG, "null");
+    sim_httpd_stream_t stream = aux(r)->stream;
+    ESP_RETURN_ON_FALSE(stream, ESP_ERR_NOT_SUPPORTED, TAG, "async requests need sim_httpd_stream_open");
+    httpd_req_t *copy = malloc(sizeof(httpd_req_t));
+    request_aux_t *copy_aux = malloc(sizeof(request_aux_t));
+    if (copy == NULL || copy_aux == NULL)
+    {
+        free(copy);
+        free(copy_aux);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, r, sizeof(httpd_req_t));
+    *copy_aux = *aux(r);
+    copy_aux->headers = copy_aux->body = NULL; // owned by the caller of sim_httpd_stream_open
+    copy->aux = copy_aux;
+    pthread_mutex_lock(&stream->lock);
+    stream->refs++;
+    stream->async = true;
+    pthread_mutex_unlock(&stream->lock);
+    *out = copy;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r)
+{
+    ESP_RETURN_ON_FALSE(r && aux(r)->stream, ESP_ERR_INVALID_ARG, TAG, "not an async request");
+    sim_httpd_stream_t stream = aux(r)->stream;
+    pthread_mutex_lock(&stream->lock);
+    stream->async = false;
+    pthread_mutex_unlock(&stream->lock);
+    stream_release(stream);
+    free(r->aux);
+    free(r);
+    return ESP_OK;
+}
+
+static esp_err_t request(httpd_handle_t handle, httpd_method_t method, const char *uri, const char *headers,
+                         const char *body, sim_httpd_response_t *response, sim_httpd_stream_t stream)
+{
+    ESP_RETURN_ON_FALSE(handle && uri && response, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(strlen(uri) <= HTTPD_MAX_URI_LEN, ESP_ERR_INVALID_SIZE, TAG, "uri too long");
+    server_t *server = (server_t *)handle;
+    *response = (sim_httpd_response_t){.status = HTTPD_200, .content_type = HTTPD_TYPE_TEXT};
+    request_aux_t req_aux = {.stream = stream, .headers = headers, .body = body, .response = response};
+    httpd_req_t req = {.handle = handle, .method = method, .aux = &req_aux,
+                       .content_len = body ? strlen(body) : 0};
+    strcpy((char *)req.uri, uri);
+    const size_t path_len = strcspn(uri, "?");
+
+    pthread_mutex_lock(&server->lock);
+    const httpd_uri_t *handler = NULL;
+    bool path_found = false;
+    for (size_t i = 0; i < server->handler_count && handler == NULL; i++)
+    {
+        const httpd_uri_t *h = &server->handlers[i];
+        const bool match = server->config.uri_match_fn
+                               ? server->config.uri_match_fn(h->uri, uri, path_len)
+                               : strlen(h->uri) == path_len && strncmp(h->uri, uri, path_len) == 0;
+        path_found |= match;
+        if (match && h->method == method)
+        {
+            handler = h;
+        }
+    }
+    if (handler == NULL)
+    {
+        strcpy(response->status, path_found ? "405 Method Not Allowed" : HTTPD_404);
+        response->err = ESP_ERR_NOT_FOUND;
+    }
+    else
+    {
+        req.user_ctx = handler->user_ctx;
+        response->err = handler->handler(&req);
+        if (response->err != ESP_OK && !req_aux.sent)
+        {
+            strcpy(response->status, HTTPD_500); // the real server would drop the connection
+        }
+    }
+    pthread_mutex_unlock(&server->lock);
+    return ESP_OK;
+}
+
+esp_err_t sim_httpd_request(httpd_handle_t handle, httpd_method_t method, const char *uri,
+                            const char *headers, const char *body, sim_httpd_response_t *response)
+{
+    return request(handle, method, uri, headers, body, response, NULL);
+}
+
+esp_err_t sim_httpd_stream_open(httpd_handle_t handle, const char *uri, sim_httpd_stream_t *stream_out)
+{
+    ESP_RETURN_ON_FALSE(handle && uri && stream_out, ESP_ERR_INVALID_ARG, TAG, "null");
+    sim_httpd_stream_t stream = calloc(1, sizeof(struct sim_httpd_stream_s));
+    ESP_RETURN_ON_FALSE(stream, ESP_ERR_NO_MEM, TAG, "malloc stream");
+    pthread_mutex_init(&stream->lock, NULL);
+    stream->refs = 1;
+    const esp_err_t err = request(handle, HTTP_GET, uri, NULL, NULL, &stream->response, stream);
+    if (err != ESP_OK)
+    {
+        stream_release(stream);
+        return err;
+    }
+    *stream_out = stream;
+    return ESP_OK;
+}
+
+const sim_httpd_response_t *sim_httpd_stream_get_response(sim_httpd_stream_t stream)
+{
+    return &stream->response;
+}
+
+size_t sim_httpd_stream_read(sim_httpd_stream_t stream, char *buf, size_t size)
+{
+    pthread_mutex_lock(&stream->lock);
+    const size_t available = stream->response.body_len - stream->read_offset;
+    const size_t n = available < size ? available : size;
+    memcpy(buf, stream->response.body + stream->read_offset, n);
+    stream->read_offset += n;
+    pthread_mutex_unlock(&stream->lock);
+    return n;
+}
+
+void sim_httpd_stream_set_send_delay(sim_httpd_stream_t stream, int64_t delay_us)
+{
+    pthread_mutex_lock(&stream->lock);
+    stream->send_delay = delay_us;
+    pthread_mutex_unlock(&stream->lock);
+}
+
+bool sim_httpd_stream_is_active(sim_httpd_stream_t stream)
+{
+    pthread_mutex_lock(&stream->lock);
+    const bool async = stream->async;
+    pthread_mutex_unlock(&stream->lock);
+    return async;
+}
+
+void sim_httpd_stream_close(sim_httpd_stream_t stream)
+{
+    pthread_mutex_lock(&stream->lock);
+    stream->closed = true;
+    pthread_mutex_unlock(&stream->lock);
+    stream_release(stream);
+}
+
+void sim_httpd_response_free(sim_httpd_response_t *response)
+{
+    free(response->headers);
+    free(response->body);
+    response->headers = response->body = NULL;
+    response->headers_len = response->body_len = 0;
+}
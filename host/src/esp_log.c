@@ -0,0 +1,36 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "sim.h"
+
+static esp_log_level_t s_level = (esp_log_level_t)CONFIG_LOG_DEFAULT_LEVEL;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    // per-tag levels are not simulated; any tag (including "*") sets the global level
+    (void)tag;
+    s_level = level;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(sim_clock_now_us() / 1000);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    (void)tag;
+    if (level > s_level)
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&s_lock);
+    vfprintf(stderr, format, args);
+    pthread_mutex_unlock(&s_lock);
+    va_end(args);
+}
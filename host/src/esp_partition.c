@@ -0,0 +1,127 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_partition.h"
+
+#define CUSTOM_SUBTYPE_JOURNAL 0x40
+
+typedef struct
+{
+    esp_partition_t partition;
+    uint8_t *flash; /// allocated (erased) on first access
+} entry_t;
+
+// The data partitions of partitions.csv, at the offsets the partition table tool assigns them.
+static entry_t s_entries[] = {
+    {.partition = {.type = ESP_PARTITION_TYPE_DATA, .subtype = ESP_PARTITION_SUBTYPE_DATA_NVS, .address = 0x9000,
+                   .size = 0x6000, .erase_size = SPI_FLASH_SEC_SIZE, .label = "nvs"}},
+    {.partition = {.type = ESP_PARTITION_TYPE_DATA, .subtype = ESP_PARTITION_SUBTYPE_DATA_PHY, .address = 0xf000,
+                   .size = 0x1000, .erase_size = SPI_FLASH_SEC_SIZE, .label = "phy_init"}},
+    {.partition = {.type = ESP_PARTITION_TYPE_DATA, .subtype = CUSTOM_SUBTYPE_JOURNAL, .address = 0x190000,
+                   .size = 0x40000, .erase_size = SPI_FLASH_SEC_SIZE, .label = "journal"}},
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static entry_t *get_entry(const esp_partition_t *partition)
+{
+    for (size_t i = 0; i < sizeof(s_entries) / sizeof(s_entries[0]); i++)
+    {
+        if (&s_entries[i].partition == partition)
+        {
+            return &s_entries[i];
+        }
+    }
+    return NULL;
+}
+
+static uint8_t *get_flash(entry_t *entry)
+{
+    if (!entry->flash)
+    {
+        entry->flash = malloc(entry->partition.size);
+        if (entry->flash)
+        {
+            memset(entry->flash, 0xff, entry->partition.size);
+        }
+    }
+    return entry->flash;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    for (size_t i = 0; i < sizeof(s_entries) / sizeof(s_entries[0]); i++)
+    {
+        const esp_partition_t *p = &s_entries[i].partition;
+        if ((type == ESP_PARTITION_TYPE_ANY || p->type == type) &&
+            (subtype == ESP_PARTITION_SUBTYPE_ANY || p->subtype == subtype) && (!label || !strcmp(p->label, label)))
+        {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    entry_t *entry = get_entry(partition);
+    if (!entry || !dst || src_offset > partition->size || size > partition->size - src_offset)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&s_lock);
+    const uint8_t *flash = get_flash(entry);
+    if (flash)
+    {
+        memcpy(dst, flash + src_offset, size);
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    entry_t *entry = get_entry(partition);
+    if (!entry || !src || dst_offset > partition->size || size > partition->size - dst_offset)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&s_lock);
+    uint8_t *flash = get_flash(entry);
+    if (flash)
+    {
+        // NOR flash: programming only clears bits, so writing over unerased data corrupts it as it would
+        for (size_t i = 0; i < size; i++)
+        {
+            flash[dst_offset + i] &= ((const uint8_t *)src)[i];
+        }
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    entry_t *entry = get_entry(partition);
+    if (!entry || offset % partition->erase_size || size % partition->erase_size || offset > partition->size ||
+        size > partition->size - offset)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&s_lock);
+    uint8_t *flash = get_flash(entry);
+    if (flash)
+    {
+        memset(flash + offset, 0xff, size);
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
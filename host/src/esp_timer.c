@@ -0,0 +1,181 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include "esp_timer.h"
+#include "sim.h"
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    int64_t alarm;   /// virtual time (microseconds) of the next expiry
+    uint64_t period; /// 0 for one-shot timers
+    bool active;
+    struct esp_timer *next;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_changed;
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static esp_timer_handle_t s_timers;
+
+/* Plays the role of the "esp_timer" task: callbacks are dispatched one at a time from this thread. */
+static void *timer_task(void *arg)
+{
+    pthread_mutex_lock(&s_lock);
+    while (true)
+    {
+        esp_timer_handle_t next = NULL;
+        for (esp_timer_handle_t t = s_timers; t; t = t->next)
+        {
+            if (t->active && (next == NULL || t->alarm < next->alarm))
+            {
+                next = t;
+            }
+        }
+        if (next == NULL)
+        {
+            pthread_cond_wait(&s_changed, &s_lock);
+            continue;
+        }
+        if (sim_clock_now_us() < next->alarm)
+        {
+            sim_cond_wait_until(&s_changed, &s_lock, next->alarm);
+            continue;
+        }
+        if (next->period)
+        {
+            next->alarm += next->period;
+        }
+        else
+        {
+            next->active = false;
+        }
+        const esp_timer_cb_t callback = next->callback;
+        void *const callback_arg = next->arg;
+        pthread_mutex_unlock(&s_lock);
+        callback(callback_arg);
+        pthread_mutex_lock(&s_lock);
+    }
+    return NULL;
+}
+
+static void start_timer_task(void)
+{
+    sim_cond_init(&s_changed);
+    pthread_t thread;
+    pthread_create(&thread, NULL, timer_task, NULL);
+    pthread_detach(thread);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    if (create_args == NULL || create_args->callback == NULL || out_handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_once(&s_once, start_timer_task);
+    esp_timer_handle_t timer = calloc(1, sizeof(struct esp_timer));
+    if (timer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->name = create_args->name;
+    pthread_mutex_lock(&s_lock);
+    timer->next = s_timers;
+    s_timers = timer;
+    pthread_mutex_unlock(&s_lock);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period)
+{
+    if (timer == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    if (timer->active)
+    {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else
+    {
+        timer->alarm = sim_clock_now_us() + timeout_us;
+        timer->period = period;
+        timer->active = true;
+        pthread_cond_broadcast(&s_changed);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    return start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (timer == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    if (!timer->active)
+    {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    pthread_cond_broadcast(&s_changed);
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (timer->active)
+    {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (esp_timer_handle_t *t = &s_timers; *t; t = &(*t)->next)
+    {
+        if (*t == timer)
+        {
+            *t = timer->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&s_lock);
+    const bool active = timer && timer->active;
+    pthread_mutex_unlock(&s_lock);
+    return active;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_clock_now_us();
+}
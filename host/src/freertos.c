@@ -0,0 +1,571 @@
+#include <pthread.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "sim.h"
+
+static const char *TAG = "freertos";
+
+struct tskTaskControlBlock
+{
+    pthread_t thread;
+    char name[configMAX_TASK_NAME_LEN];
+    TaskFunction_t code;
+    void *parameters;
+    uint32_t stack_depth;
+    UBaseType_t priority;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notification_value;
+    bool notification_pending;
+    UBaseType_t number;
+    struct tskTaskControlBlock *next; /// in s_tasks
+};
+
+struct QueueDefinition
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t waiting;
+    UBaseType_t head;
+    uint8_t *storage;
+    sim_queue_stats_t stats;
+    struct QueueDefinition *set; /// the queue set the queue is a member of
+    struct QueueDefinition *next;
+};
+
+static __thread TaskHandle_t s_current_task;
+static pthread_mutex_t s_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+static TaskHandle_t s_tasks; /// the running tasks; a task leaves before its thread ends
+static UBaseType_t s_task_count;
+static UBaseType_t s_tasks_created;
+static pthread_mutex_t s_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static QueueHandle_t s_queues;
+
+static void unlock_mutex(void *mutex)
+{
+    pthread_mutex_unlock((pthread_mutex_t *)mutex);
+}
+
+/* ----------------------------------------------------------------------------------------------- tasks */
+
+static void add_task(TaskHandle_t task)
+{
+    pthread_mutex_lock(&s_tasks_lock);
+    task->number = ++s_tasks_created;
+    task->next = s_tasks;
+    s_tasks = task;
+    s_task_count++;
+    pthread_mutex_unlock(&s_tasks_lock);
+}
+
+static void remove_task(TaskHandle_t task)
+{
+    pthread_mutex_lock(&s_tasks_lock);
+    for (TaskHandle_t *t = &s_tasks; *t; t = &(*t)->next)
+    {
+        if (*t == task)
+        {
+            *t = task->next;
+            s_task_count--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_tasks_lock);
+}
+
+static void *task_entry(void *arg)
+{
+    TaskHandle_t task = (TaskHandle_t)arg;
+    s_current_task = task;
+    task->code(task->parameters);
+    ESP_LOGW(TAG, "Task '%s' returned from its function", task->name);
+    remove_task(task);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char *const pcName,
+                                   const uint32_t usStackDepth, void *const pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t *const pxCreatedTask,
+                                   const BaseType_t xCoreID)
+{
+    TaskHandle_t task = calloc(1, sizeof(struct tskTaskControlBlock));
+    if (task == NULL)
+    {
+        return pdFAIL;
+    }
+    strncpy(task->name, pcName ? pcName : "", sizeof(task->name) - 1);
+    task->code = pxTaskCode;
+    task->parameters = pvParameters;
+    task->stack_depth = usStackDepth;
+    task->priority = uxPriority;
+    pthread_mutex_init(&task->lock, NULL);
+    sim_cond_init(&task->notified);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    // listed before it runs, as it may delete itself right away
+    add_task(task);
+    const int r = pthread_create(&task->thread, &attr, task_entry, task);
+    pthread_attr_destroy(&attr);
+    if (r != 0)
+    {
+        remove_task(task);
+        free(task);
+        return pdFAIL;
+    }
+    if (pxCreatedTask)
+    {
+        *pxCreatedTask = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *const pcName,
+                       const uint32_t usStackDepth, void *const pvParameters,
+                       UBaseType_t uxPriority, TaskHandle_t *const pxCreatedTask)
+{
+    return xTaskCreatePinnedToCore(pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority,
+                                   pxCreatedTask, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    if (xTaskToDelete == NULL || xTaskToDelete == s_current_task)
+    {
+        if (s_current_task)
+        {
+            remove_task(s_current_task);
+        }
+        pthread_exit(NULL);
+    }
+    remove_task(xTaskToDelete);
+    pthread_cancel(xTaskToDelete->thread);
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    pthread_testcancel();
+    sim_clock_sleep_us((int64_t)xTicksToDelay * 1000000 / configTICK_RATE_HZ);
+    pthread_testcancel();
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(sim_clock_now_us() * configTICK_RATE_HZ / 1000000);
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return xTaskGetTickCount();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return s_current_task;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+    pthread_mutex_lock(&s_tasks_lock);
+    const UBaseType_t count = s_task_count;
+    pthread_mutex_unlock(&s_tasks_lock);
+    return count;
+}
+
+static uint32_t elapsed_us(clockid_t clock)
+{
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0)
+    {
+        return 0;
+    }
+    return (uint32_t)((int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *const pxTaskStatusArray, const UBaseType_t uxArraySize,
+                                 configRUN_TIME_COUNTER_TYPE *const pulTotalRunTime)
+{
+    UBaseType_t n = 0;
+    pthread_mutex_lock(&s_tasks_lock);
+    if (uxArraySize >= s_task_count)
+    {
+        // a listed task's thread has not ended, so its CPU clock is valid
+        for (TaskHandle_t task = s_tasks; task; task = task->next)
+        {
+            clockid_t clock;
+            pxTaskStatusArray[n++] = (TaskStatus_t){
+                .xHandle = task,
+                .pcTaskName = task->name,
+                .xTaskNumber = task->number,
+                .eCurrentState = task == s_current_task ? eRunning : eBlocked,
+                .uxCurrentPriority = task->priority,
+                .uxBasePriority = task->priority,
+                .ulRunTimeCounter =
+                    pthread_getcpuclockid(task->thread, &clock) == 0 ? elapsed_us(clock) : 0,
+                .usStackHighWaterMark = task->stack_depth,
+                .xCoreID = tskNO_AFFINITY,
+            };
+        }
+    }
+    pthread_mutex_unlock(&s_tasks_lock);
+    if (pulTotalRunTime)
+    {
+        *pulTotalRunTime = elapsed_us(CLOCK_MONOTONIC);
+    }
+    return n;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask)
+{
+    const TaskHandle_t task = xTask ? xTask : s_current_task;
+    return task ? task->stack_depth : 0;
+}
+
+char *pcTaskGetName(TaskHandle_t xTaskToQuery)
+{
+    TaskHandle_t task = xTaskToQuery ? xTaskToQuery : s_current_task;
+    return task ? task->name : "main";
+}
+
+BaseType_t xTaskGenericNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue,
+                              eNotifyAction eAction, uint32_t *pulPreviousNotificationValue)
+{
+    BaseType_t ret = pdPASS;
+    pthread_mutex_lock(&xTaskToNotify->lock);
+    if (pulPreviousNotificationValue)
+    {
+        *pulPreviousNotificationValue = xTaskToNotify->notification_value;
+    }
+    switch (eAction)
+    {
+    case eSetBits:
+        xTaskToNotify->notification_value |= ulValue;
+        break;
+    case eIncrement:
+        xTaskToNotify->notification_value++;
+        break;
+    case eSetValueWithOverwrite:
+        xTaskToNotify->notification_value = ulValue;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (xTaskToNotify->notification_pending)
+        {
+            ret = pdFAIL;
+        }
+        else
+        {
+            xTaskToNotify->notification_value = ulValue;
+        }
+        break;
+    case eNoAction:
+    default:
+        break;
+    }
+    xTaskToNotify->notification_pending = true;
+    pthread_cond_broadcast(&xTaskToNotify->notified);
+    pthread_mutex_unlock(&xTaskToNotify->lock);
+    return ret;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit,
+                           uint32_t *pulNotificationValue, TickType_t xTicksToWait)
+{
+    TaskHandle_t task = s_current_task;
+    const int64_t deadline = sim_ticks_to_deadline(xTicksToWait);
+    BaseType_t ret = pdTRUE;
+    pthread_mutex_lock(&task->lock);
+    pthread_cleanup_push(unlock_mutex, &task->lock);
+    if (!task->notification_pending)
+    {
+        task->notification_value &= ~ulBitsToClearOnEntry;
+    }
+    while (!task->notification_pending)
+    {
+        if (xTicksToWait == 0 || !sim_cond_wait_until(&task->notified, &task->lock, deadline))
+        {
+            ret = task->notification_pending ? pdTRUE : pdFALSE;
+            break;
+        }
+    }
+    if (pulNotificationValue)
+    {
+        *pulNotificationValue = task->notification_value;
+    }
+    if (ret == pdTRUE)
+    {
+        task->notification_value &= ~ulBitsToClearOnExit;
+        task->notification_pending = false;
+    }
+    pthread_cleanup_pop(1);
+    return ret;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    TaskHandle_t task = s_current_task;
+    const int64_t deadline = sim_ticks_to_deadline(xTicksToWait);
+    pthread_mutex_lock(&task->lock);
+    pthread_cleanup_push(unlock_mutex, &task->lock);
+    while (task->notification_value == 0 && xTicksToWait != 0 &&
+           sim_cond_wait_until(&task->notified, &task->lock, deadline))
+    {
+    }
+    pthread_cleanup_pop(0);
+    const uint32_t value = task->notification_value;
+    if (value)
+    {
+        task->notification_value = xClearCountOnExit ? 0 : value - 1;
+    }
+    task->notification_pending = false;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+/* ---------------------------------------------------------------------------------------------- queues */
+
+QueueHandle_t xQueueGenericCreate(const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize,
+                                  const UBaseType_t uxInitialCount)
+{
+    QueueHandle_t queue = calloc(1, sizeof(struct QueueDefinition));
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    queue->storage = uxItemSize ? calloc(uxQueueLength, uxItemSize) : NULL;
+    if (uxItemSize && queue->storage == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    sim_cond_init(&queue->not_empty);
+    sim_cond_init(&queue->not_full);
+    queue->length = uxQueueLength;
+    queue->item_size = uxItemSize;
+    queue->waiting = uxInitialCount;
+    queue->stats.length = uxQueueLength;
+    queue->stats.item_size = uxItemSize;
+
+    pthread_mutex_lock(&s_registry_lock);
+    QueueHandle_t *tail = &s_queues;
+    while (*tail)
+    {
+        tail = &(*tail)->next;
+    }
+    *tail = queue;
+    pthread_mutex_unlock(&s_registry_lock);
+    return queue;
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void *const pvItemToQueue,
+                             TickType_t xTicksToWait, const BaseType_t xCopyPosition)
+{
+    const int64_t deadline = sim_ticks_to_deadline(xTicksToWait);
+    BaseType_t ret = pdPASS;
+    pthread_mutex_lock(&xQueue->lock);
+    pthread_cleanup_push(unlock_mutex, &xQueue->lock);
+    const bool overwrite = xCopyPosition == queueOVERWRITE && xQueue->waiting == xQueue->length;
+    if (overwrite)
+    {
+        xQueue->waiting--; // single-item mailbox: replace the pending item
+    }
+    while (xQueue->waiting == xQueue->length)
+    {
+        if (xTicksToWait == 0 || !sim_cond_wait_until(&xQueue->not_full, &xQueue->lock, deadline))
+        {
+            if (xQueue->waiting == xQueue->length)
+            {
+                ret = errQUEUE_FULL;
+                break;
+            }
+        }
+    }
+    if (ret == pdPASS)
+    {
+        UBaseType_t slot;
+        if (xCopyPosition == queueSEND_TO_FRONT)
+        {
+            xQueue->head = (xQueue->head + xQueue->length - 1) % xQueue->length;
+            slot = xQueue->head;
+        }
+        else
+        {
+            slot = (xQueue->head + xQueue->waiting) % xQueue->length;
+        }
+        if (xQueue->item_size)
+        {
+            memcpy(xQueue->storage + slot * xQueue->item_size, pvItemToQueue, xQueue->item_size);
+        }
+        xQueue->waiting++;
+        xQueue->stats.sends++;
+        if (xQueue->waiting > xQueue->stats.max_waiting)
+        {
+            xQueue->stats.max_waiting = xQueue->waiting;
+        }
+        pthread_cond_signal(&xQueue->not_empty);
+        // the set already holds the handle of an overwritten item; it is sized to never be full
+        if (xQueue->set && !overwrite)
+        {
+            xQueueGenericSend(xQueue->set, &xQueue, 0, queueSEND_TO_BACK);
+        }
+    }
+    else
+    {
+        xQueue->stats.send_failures++;
+    }
+    pthread_cleanup_pop(1);
+    return ret;
+}
+
+static BaseType_t queue_receive(QueueHandle_t xQueue, void *const pvBuffer, TickType_t xTicksToWait,
+                                bool remove)
+{
+    const int64_t deadline = sim_ticks_to_deadline(xTicksToWait);
+    BaseType_t ret = pdPASS;
+    pthread_mutex_lock(&xQueue->lock);
+    pthread_cleanup_push(unlock_mutex, &xQueue->lock);
+    while (xQueue->waiting == 0)
+    {
+        if (xTicksToWait == 0 || !sim_cond_wait_until(&xQueue->not_empty, &xQueue->lock, deadline))
+        {
+            if (xQueue->waiting == 0)
+            {
+                ret = errQUEUE_EMPTY;
+                break;
+            }
+        }
+    }
+    if (ret == pdPASS)
+    {
+        if (xQueue->item_size && pvBuffer)
+        {
+            memcpy(pvBuffer, xQueue->storage + xQueue->head * xQueue->item_size, xQueue->item_size);
+        }
+        if (remove)
+        {
+            xQueue->head = (xQueue->head + 1) % xQueue->length;
+            xQueue->waiting--;
+            xQueue->stats.receives++;
+            pthread_cond_signal(&xQueue->not_full);
+        }
+    }
+    pthread_cleanup_pop(1);
+    return ret;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *const pvBuffer, TickType_t xTicksToWait)
+{
+    return queue_receive(xQueue, pvBuffer, xTicksToWait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t xQueue, void *const pvBuffer, TickType_t xTicksToWait)
+{
+    return queue_receive(xQueue, pvBuffer, xTicksToWait, false);
+}
+
+UBaseType_t uxQueueMessagesWaiting(const QueueHandle_t xQueue)
+{
+    pthread_mutex_lock(&xQueue->lock);
+    const UBaseType_t waiting = xQueue->waiting;
+    pthread_mutex_unlock(&xQueue->lock);
+    return waiting;
+}
+
+UBaseType_t uxQueueSpacesAvailable(const QueueHandle_t xQueue)
+{
+    pthread_mutex_lock(&xQueue->lock);
+    const UBaseType_t spaces = xQueue->length - xQueue->waiting;
+    pthread_mutex_unlock(&xQueue->lock);
+    return spaces;
+}
+
+BaseType_t xQueueReset(QueueHandle_t xQueue)
+{
+    pthread_mutex_lock(&xQueue->lock);
+    xQueue->waiting = 0;
+    xQueue->head = 0;
+    pthread_cond_broadcast(&xQueue->not_full);
+    pthread_mutex_unlock(&xQueue->lock);
+    return pdPASS;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    pthread_mutex_lock(&s_registry_lock);
+    for (QueueHandle_t *q = &s_queues; *q; q = &(*q)->next)
+    {
+        if (*q == xQueue)
+        {
+            *q = xQueue->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_registry_lock);
+    free(xQueue->storage);
+    free(xQueue);
+}
+
+void vQueueAddToRegistry(QueueHandle_t xQueue, const char *pcQueueName)
+{
+    pthread_mutex_lock(&xQueue->lock);
+    strncpy(xQueue->stats.name, pcQueueName, sizeof(xQueue->stats.name) - 1);
+    pthread_mutex_unlock(&xQueue->lock);
+}
+
+QueueSetHandle_t xQueueCreateSet(const UBaseType_t uxEventQueueLength)
+{
+    return xQueueCreate(uxEventQueueLength, sizeof(QueueHandle_t));
+}
+
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t xQueueOrSemaphore, QueueSetHandle_t xQueueSet)
+{
+    pthread_mutex_lock(&xQueueOrSemaphore->lock);
+    const BaseType_t ret = xQueueOrSemaphore->set || xQueueOrSemaphore->waiting ? pdFAIL : pdPASS;
+    if (ret == pdPASS)
+    {
+        xQueueOrSemaphore->set = xQueueSet;
+    }
+    pthread_mutex_unlock(&xQueueOrSemaphore->lock);
+    return ret;
+}
+
+BaseType_t xQueueRemoveFromSet(QueueSetMemberHandle_t xQueueOrSemaphore, QueueSetHandle_t xQueueSet)
+{
+    pthread_mutex_lock(&xQueueOrSemaphore->lock);
+    const BaseType_t ret = xQueueOrSemaphore->set != xQueueSet || xQueueOrSemaphore->waiting ? pdFAIL : pdPASS;
+    if (ret == pdPASS)
+    {
+        xQueueOrSemaphore->set = NULL;
+    }
+    pthread_mutex_unlock(&xQueueOrSemaphore->lock);
+    return ret;
+}
+
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t xQueueSet, const TickType_t xTicksToWait)
+{
+    QueueSetMemberHandle_t member = NULL;
+    return xQueueReceive(xQueueSet, &member, xTicksToWait) ? member : NULL;
+}
+
+size_t sim_freertos_get_queue_stats(sim_queue_stats_t *stats, size_t max_stats)
+{
+    size_t n = 0;
+    pthread_mutex_lock(&s_registry_lock);
+    for (QueueHandle_t q = s_queues; q && n < max_stats; q = q->next)
+    {
+        pthread_mutex_lock(&q->lock);
+        stats[n++] = q->stats;
+        pthread_mutex_unlock(&q->lock);
+    }
+    pthread_mutex_unlock(&s_registry_lock);
+    return n;
+}
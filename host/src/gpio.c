@@ -0,0 +1,70 @@
+#include <stdatomic.h>
+#include "driver/gpio.h"
+#include "sim.h"
+
+static atomic_int s_levels[GPIO_NUM_MAX];
+static gpio_mode_t s_modes[GPIO_NUM_MAX];
+static sim_gpio_listener_t s_listener;
+static void *s_listener_arg;
+
+static bool is_valid(gpio_num_t gpio_num)
+{
+    return gpio_num >= 0 && gpio_num < GPIO_NUM_MAX;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    if (!is_valid(gpio_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_modes[gpio_num] = mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (!is_valid(gpio_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const int previous = atomic_exchange(&s_levels[gpio_num], level ? 1 : 0);
+    if (previous != (level ? 1 : 0) && s_listener && (s_modes[gpio_num] & GPIO_MODE_OUTPUT))
+    {
+        s_listener(gpio_num, level ? 1 : 0, s_listener_arg);
+    }
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    return is_valid(gpio_num) ? atomic_load(&s_levels[gpio_num]) : 0;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num)
+{
+    if (!is_valid(gpio_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_modes[gpio_num] = GPIO_MODE_DISABLE;
+    atomic_store(&s_levels[gpio_num], 0);
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    (void)intr_alloc_flags;
+    return ESP_OK;
+}
+
+void sim_gpio_set_listener(sim_gpio_listener_t listener, void *arg)
+{
+    s_listener_arg = arg;
+    s_listener = listener;
+}
+
+int sim_gpio_get_level(gpio_num_t gpio_num)
+{
+    return gpio_get_level(gpio_num);
+}
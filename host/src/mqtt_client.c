@@ -0,0 +1,211 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_check.h"
+#include "mqtt_client.h"
+#include "sim.h"
+
+#define CONNECT_DELAY 50000 // virtual us from start to MQTT_EVENT_CONNECTED
+#define MAX_PENDING 16      // unacknowledged publishes per client
+
+ESP_EVENT_DEFINE_BASE(MQTT_EVENTS);
+
+static const char *TAG = "mqtt_client";
+
+typedef struct
+{
+    int msg_id;
+    int64_t at; /// virtual us of the acknowledgement
+} pending_t;
+
+struct esp_mqtt_client
+{
+    esp_event_handler_t handler;
+    void *handler_arg;
+    bool started;
+    bool connected;
+    bool destroyed;
+    int64_t connect_at; /// virtual us of the pending MQTT_EVENT_CONNECTED (0: none)
+    int next_msg_id;
+    pending_t pending[MAX_PENDING];
+    size_t pending_count;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+// the broker: what it received from all clients
+static pthread_mutex_t s_broker_lock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t s_ack_delay = 20000;
+static uint32_t s_messages;
+static size_t s_bytes;
+
+static void dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event_id, int msg_id)
+{
+    esp_mqtt_event_t event = {.event_id = event_id, .client = client, .msg_id = msg_id};
+    if (client->handler)
+    {
+        client->handler(client->handler_arg, MQTT_EVENTS, event_id, &event);
+    }
+}
+
+/* Plays the role of the client's task: events are dispatched one at a time from this thread. */
+static void *client_task(void *arg)
+{
+    const esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t)arg;
+    pthread_mutex_lock(&client->lock);
+    while (!client->destroyed)
+    {
+        int64_t next = client->connect_at ? client->connect_at : -1;
+        if (client->pending_count && (next < 0 || client->pending[0].at < next))
+        {
+            next = client->pending[0].at;
+        }
+        if (next < 0 || sim_clock_now_us() < next)
+        {
+            sim_cond_wait_until(&client->changed, &client->lock, next);
+            continue;
+        }
+        esp_mqtt_event_id_t event_id;
+        int msg_id = 0;
+        if (client->connect_at && client->connect_at <= next)
+        {
+            client->connect_at = 0;
+            client->connected = true;
+            event_id = MQTT_EVENT_CONNECTED;
+        }
+        else
+        {
+            msg_id = client->pending[0].msg_id;
+            memmove(client->pending, client->pending + 1, --client->pending_count * sizeof(pending_t));
+            event_id = MQTT_EVENT_PUBLISHED;
+        }
+        pthread_mutex_unlock(&client->lock);
+        dispatch(client, event_id, msg_id);
+        pthread_mutex_lock(&client->lock);
+    }
+    pthread_mutex_unlock(&client->lock);
+    pthread_mutex_destroy(&client->lock);
+    pthread_cond_destroy(&client->changed);
+    free(client);
+    return NULL;
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    if (config == NULL || config->broker.address.uri == NULL)
+    {
+        return NULL;
+    }
+    esp_mqtt_client_handle_t client = calloc(1, sizeof(struct esp_mqtt_client));
+    if (client == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_init(&client->lock, NULL);
+    sim_cond_init(&client->changed);
+    client->next_msg_id = 1;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, client_task, client) != 0)
+    {
+        pthread_mutex_destroy(&client->lock);
+        pthread_cond_destroy(&client->changed);
+        free(client);
+        return NULL;
+    }
+    pthread_detach(thread);
+    return client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    ESP_RETURN_ON_FALSE(client && event_handler, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(event == MQTT_EVENT_ANY, ESP_ERR_NOT_SUPPORTED, TAG, "only MQTT_EVENT_ANY is supported");
+    pthread_mutex_lock(&client->lock);
+    client->handler = event_handler;
+    client->handler_arg = event_handler_arg;
+    pthread_mutex_unlock(&client->lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    ESP_RETURN_ON_FALSE(client, ESP_ERR_INVALID_ARG, TAG, "null");
+    pthread_mutex_lock(&client->lock);
+    const bool started = client->started;
+    if (!started)
+    {
+        client->started = true;
+        client->connect_at = sim_clock_now_us() + CONNECT_DELAY;
+        pthread_cond_broadcast(&client->changed);
+    }
+    pthread_mutex_unlock(&client->lock);
+    return started ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    ESP_RETURN_ON_FALSE(client, ESP_ERR_INVALID_ARG, TAG, "null");
+    pthread_mutex_lock(&client->lock);
+    const bool started = client->started;
+    // the connection is dropped: unacknowledged publishes are never acknowledged
+    client->started = false;
+    client->connected = false;
+    client->connect_at = 0;
+    client->pending_count = 0;
+    pthread_cond_broadcast(&client->changed);
+    pthread_mutex_unlock(&client->lock);
+    return started ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    ESP_RETURN_ON_FALSE(client, ESP_ERR_INVALID_ARG, TAG, "null");
+    pthread_mutex_lock(&client->lock);
+    client->destroyed = true;
+    pthread_cond_broadcast(&client->changed);
+    pthread_mutex_unlock(&client->lock);
+    return ESP_OK;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                            int retain)
+{
+    if (client == NULL || topic == NULL || (data == NULL && len))
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&client->lock);
+    int msg_id = -1;
+    if (client->connected && (qos == 0 || client->pending_count < MAX_PENDING))
+    {
+        msg_id = qos ? client->next_msg_id++ : 0;
+        pthread_mutex_lock(&s_broker_lock);
+        s_messages++;
+        s_bytes += len ? len : strlen(data);
+        const int64_t delay = s_ack_delay;
+        pthread_mutex_unlock(&s_broker_lock);
+        if (qos)
+        {
+            client->pending[client->pending_count++] = (pending_t){.msg_id = msg_id, .at = sim_clock_now_us() + delay};
+            pthread_cond_broadcast(&client->changed);
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+    return msg_id;
+}
+
+void sim_mqtt_set_ack_delay(int64_t delay_us)
+{
+    pthread_mutex_lock(&s_broker_lock);
+    s_ack_delay = delay_us;
+    pthread_mutex_unlock(&s_broker_lock);
+}
+
+void sim_mqtt_get_received(uint32_t *messages, size_t *bytes)
+{
+    pthread_mutex_lock(&s_broker_lock);
+    *messages = s_messages;
+    *bytes = s_bytes;
+    pthread_mutex_unlock(&s_broker_lock);
+}
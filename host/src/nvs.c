@@ -0,0 +1,211 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nvs.h"
+
+#define MAX_HANDLES 16
+#define MAX_ENTRIES 64
+
+typedef struct
+{
+    char namespace_name[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    void *value;
+    size_t length;
+} entry_t;
+
+typedef struct
+{
+    bool open;
+    nvs_open_mode_t mode;
+    char namespace_name[NVS_KEY_NAME_MAX_SIZE];
+} handle_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static entry_t s_entries[MAX_ENTRIES];
+static handle_t s_handles[MAX_HANDLES];
+
+// Handles are 1-based indexes into s_handles, so that 0 is never valid.
+static handle_t *get_handle(nvs_handle_t handle)
+{
+    return handle >= 1 && handle <= MAX_HANDLES && s_handles[handle - 1].open ? &s_handles[handle - 1] : NULL;
+}
+
+static entry_t *find_entry(const handle_t *h, const char *key)
+{
+    for (int i = 0; i < MAX_ENTRIES; i++)
+    {
+        if (s_entries[i].value && !strcmp(s_entries[i].namespace_name, h->namespace_name) &&
+            !strcmp(s_entries[i].key, key))
+        {
+            return &s_entries[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (!namespace_name || !out_handle)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strlen(namespace_name) >= NVS_KEY_NAME_MAX_SIZE)
+    {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    esp_err_t err = ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < MAX_HANDLES; i++)
+    {
+        if (!s_handles[i].open)
+        {
+            s_handles[i] = (handle_t){.open = true, .mode = open_mode};
+            strcpy(s_handles[i].namespace_name, namespace_name);
+            *out_handle = i + 1;
+            err = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&s_lock);
+    handle_t *h = get_handle(handle);
+    if (h)
+    {
+        h->open = false;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    if (!key || !length)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    const handle_t *h = get_handle(handle);
+    const entry_t *entry = h ? find_entry(h, key) : NULL;
+    if (!h)
+    {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    else if (!entry)
+    {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    }
+    else if (out_value && *length < entry->length)
+    {
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    else
+    {
+        if (out_value)
+        {
+            memcpy(out_value, entry->value, entry->length);
+        }
+        *length = entry->length;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    if (!key || (!value && length))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+    {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    void *copy = malloc(length ? length : 1);
+    if (!copy)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, value, length);
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    const handle_t *h = get_handle(handle);
+    entry_t *entry = h ? find_entry(h, key) : NULL;
+    for (int i = 0; h && !entry && i < MAX_ENTRIES; i++)
+    {
+        if (!s_entries[i].value)
+        {
+            entry = &s_entries[i];
+            strcpy(entry->namespace_name, h->namespace_name);
+            strcpy(entry->key, key);
+        }
+    }
+    if (!h)
+    {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    else if (h->mode == NVS_READONLY)
+    {
+        err = ESP_ERR_NVS_READ_ONLY;
+    }
+    else if (!entry)
+    {
+        err = ESP_ERR_NO_MEM;
+    }
+    else
+    {
+        free(entry->value);
+        entry->value = copy;
+        entry->length = length;
+        copy = NULL;
+    }
+    pthread_mutex_unlock(&s_lock);
+    free(copy);
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    if (!key)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    const handle_t *h = get_handle(handle);
+    entry_t *entry = h ? find_entry(h, key) : NULL;
+    if (!h)
+    {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    else if (h->mode == NVS_READONLY)
+    {
+        err = ESP_ERR_NVS_READ_ONLY;
+    }
+    else if (!entry)
+    {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    }
+    else
+    {
+        free(entry->value);
+        *entry = (entry_t){0};
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&s_lock);
+    const bool valid = get_handle(handle) != NULL;
+    pthread_mutex_unlock(&s_lock);
+    // writes are applied right away
+    return valid ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
@@ -0,0 +1,202 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "pulse_sensor.h"
+#include "sim.h"
+
+#define TICK_PERIOD_US 10000 // resolution of the simulated pulse train
+#define MAX_SENSORS 4
+
+static const char *TAG = "pulse_sensor";
+
+struct pulse_sensor_s
+{
+    pulse_sensor_config_t config;
+    pulse_sensor_data_t data;
+    float rate;            /// simulated pulses per second
+    float fraction;        /// pulses accumulated but not yet emitted
+    uint32_t sample_count; /// pulses seen in the current sampling period
+    int64_t sample_start;
+    esp_timer_handle_t timer;
+    pthread_mutex_t lock;
+};
+
+static pthread_mutex_t s_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pulse_sensor_t s_sensors[MAX_SENSORS];
+
+static void notify(pulse_sensor_t sensor, pulse_sensor_notification_type_t type)
+{
+    if (sensor->config.notification_queue == NULL)
+    {
+        return;
+    }
+    const pulse_sensor_notification_t msg = {
+        .type = type, .sensor = sensor, .notification_arg = sensor->config.notification_arg};
+    if (!xQueueSendToBack(sensor->config.notification_queue, &msg, sensor->config.notification_timeout))
+    {
+        ESP_LOGW(TAG, "Notification timeout on GPIO %d queue", sensor->config.gpio_num);
+    }
+}
+
+static void tick(void *arg)
+{
+    pulse_sensor_t sensor = (pulse_sensor_t)arg;
+    const int64_t now = esp_timer_get_time();
+    bool started = false, ended = false;
+
+    pthread_mutex_lock(&sensor->lock);
+    pulse_sensor_data_t *data = &sensor->data;
+    sensor->fraction += sensor->rate * TICK_PERIOD_US / 1000000.0f;
+    const uint32_t pulses = (uint32_t)sensor->fraction;
+    sensor->fraction -= pulses;
+    if (pulses)
+    {
+        if (data->current_cycle_pulses == 0)
+        {
+            data->current_cycle_start_timestamp = now;
+        }
+        const uint32_t before = data->current_cycle_pulses;
+        data->current_cycle_pulses += pulses;
+        data->latest_pulse_timestamp = now;
+        sensor->sample_count += pulses;
+        started = before < sensor->config.min_cycle_pulses &&
+                  data->current_cycle_pulses >= sensor->config.min_cycle_pulses;
+    }
+    else if (data->current_cycle_pulses &&
+             now - data->latest_pulse_timestamp >= (int64_t)sensor->config.max_cycle_idle)
+    {
+        if (data->current_cycle_pulses >= sensor->config.min_cycle_pulses)
+        {
+            data->cycles++;
+            data->total_pulses += data->current_cycle_pulses;
+            data->total_duration += data->latest_pulse_timestamp - data->current_cycle_start_timestamp;
+            ended = true;
+        }
+        else
+        {
+            data->partial_cycles++;
+        }
+        data->current_cycle_pulses = 0;
+    }
+    if (now - sensor->sample_start >= (int64_t)sensor->config.sampling_period)
+    {
+        data->sample_pulses = sensor->sample_count;
+        data->sample_period = now - sensor->sample_start;
+        sensor->sample_count = 0;
+        sensor->sample_start = now;
+    }
+    pthread_mutex_unlock(&sensor->lock);
+
+    if (started)
+    {
+        notify(sensor, PULSE_SENSOR_CYCLE_STARTED);
+    }
+    if (ended)
+    {
+        notify(sensor, PULSE_SENSOR_CYCLE_ENDED);
+    }
+}
+
+esp_err_t pulse_sensor_open(const pulse_sensor_config_t *config, pulse_sensor_t *sensor_out)
+{
+    ESP_RETURN_ON_FALSE(config && sensor_out, ESP_ERR_INVALID_ARG, TAG, "null");
+    pulse_sensor_t sensor = calloc(1, sizeof(struct pulse_sensor_s));
+    ESP_RETURN_ON_FALSE(sensor, ESP_ERR_NO_MEM, TAG, "malloc sensor");
+    sensor->config = *config;
+    sensor->sample_start = esp_timer_get_time();
+    pthread_mutex_init(&sensor->lock, NULL);
+    const esp_timer_create_args_t timer_args = {.callback = tick, .arg = sensor, .name = "pulse sensor"};
+    esp_err_t ret = esp_timer_create(&timer_args, &sensor->timer);
+    if (ret == ESP_OK)
+    {
+        ret = esp_timer_start_periodic(sensor->timer, TICK_PERIOD_US);
+    }
+    if (ret != ESP_OK)
+    {
+        free(sensor);
+        return ret;
+    }
+    pthread_mutex_lock(&s_registry_lock);
+    for (int i = 0; i < MAX_SENSORS; i++)
+    {
+        if (s_sensors[i] == NULL)
+        {
+            s_sensors[i] = sensor;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_registry_lock);
+    *sensor_out = sensor;
+    ESP_LOGI(TAG, "Opened on GPIO %d", config->gpio_num);
+    return ESP_OK;
+}
+
+esp_err_t pulse_sensor_close(pulse_sensor_t sensor)
+{
+    ESP_RETURN_ON_FALSE(sensor, ESP_ERR_INVALID_ARG, TAG, "sensor must not be NULL");
+    esp_timer_stop(sensor->timer);
+    esp_timer_delete(sensor->timer);
+    pthread_mutex_lock(&s_registry_lock);
+    for (int i = 0; i < MAX_SENSORS; i++)
+    {
+        if (s_sensors[i] == sensor)
+        {
+            s_sensors[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&s_registry_lock);
+    free(sensor);
+    return ESP_OK;
+}
+
+esp_err_t pulse_sensor_get_data(pulse_sensor_t sensor, pulse_sensor_data_t *data)
+{
+    ESP_RETURN_ON_FALSE(sensor && data, ESP_ERR_INVALID_ARG, TAG, "null");
+    pthread_mutex_lock(&sensor->lock);
+    *data = sensor->data;
+    pthread_mutex_unlock(&sensor->lock);
+    return ESP_OK;
+}
+
+uint64_t pulse_sensor_get_current_cycle_duration(const pulse_sensor_data_t *data)
+{
+    return data->current_cycle_pulses ? data->latest_pulse_timestamp - data->current_cycle_start_timestamp : 0;
+}
+
+float pulse_sensor_get_current_cycle_rate(const pulse_sensor_data_t *data)
+{
+    const uint64_t duration = pulse_sensor_get_current_cycle_duration(data);
+    return duration ? data->current_cycle_pulses * 1000000.0f / duration : 0;
+}
+
+float pulse_sensor_get_current_rate(const pulse_sensor_data_t *data)
+{
+    return data->sample_period ? data->sample_pulses * 1000000.0f / data->sample_period : 0;
+}
+
+float pulse_sensor_get_total_rate(const pulse_sensor_data_t *data)
+{
+    return data->total_duration ? data->total_pulses * 1000000.0f / data->total_duration : 0;
+}
+
+esp_err_t sim_pulse_sensor_set_rate(gpio_num_t gpio_num, float pulses_per_second)
+{
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    pthread_mutex_lock(&s_registry_lock);
+    for (int i = 0; i < MAX_SENSORS; i++)
+    {
+        if (s_sensors[i] && s_sensors[i]->config.gpio_num == gpio_num)
+        {
+            pthread_mutex_lock(&s_sensors[i]->lock);
+            s_sensors[i]->rate = pulses_per_second;
+            pthread_mutex_unlock(&s_sensors[i]->lock);
+            ret = ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&s_registry_lock);
+    return ret;
+}
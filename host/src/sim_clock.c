@@ -0,0 +1,105 @@
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "sim.h"
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static double s_speed = 1.0;
+static int64_t s_base_real; // host time of the latest speed change
+static int64_t s_base_virtual = -1;
+
+int64_t sim_real_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t now_locked(void)
+{
+    const int64_t real = sim_real_now_us();
+    if (s_base_virtual < 0)
+    {
+        s_base_real = real;
+        s_base_virtual = 0;
+    }
+    return s_base_virtual + (int64_t)((real - s_base_real) * s_speed);
+}
+
+void sim_clock_set_speed(double speed)
+{
+    pthread_mutex_lock(&s_lock);
+    s_base_virtual = now_locked();
+    s_base_real = sim_real_now_us();
+    s_speed = speed > 0 ? speed : 1.0;
+    pthread_mutex_unlock(&s_lock);
+}
+
+double sim_clock_get_speed(void)
+{
+    pthread_mutex_lock(&s_lock);
+    const double speed = s_speed;
+    pthread_mutex_unlock(&s_lock);
+    return speed;
+}
+
+int64_t sim_clock_now_us(void)
+{
+    pthread_mutex_lock(&s_lock);
+    const int64_t now = now_locked();
+    pthread_mutex_unlock(&s_lock);
+    return now;
+}
+
+void sim_clock_deadline(int64_t at_us, struct timespec *deadline)
+{
+    pthread_mutex_lock(&s_lock);
+    const int64_t now = now_locked();
+    const int64_t real = s_base_real + (int64_t)((at_us - s_base_virtual) / s_speed);
+    pthread_mutex_unlock(&s_lock);
+    const int64_t target = at_us > now ? real : sim_real_now_us();
+    deadline->tv_sec = target / 1000000;
+    deadline->tv_nsec = (target % 1000000) * 1000;
+}
+
+void sim_clock_sleep_us(int64_t us)
+{
+    const int64_t until = sim_clock_now_us() + us;
+    struct timespec deadline;
+    while (sim_clock_now_us() < until)
+    {
+        sim_clock_deadline(until, &deadline);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+    }
+}
+
+void sim_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+bool sim_cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t at_us)
+{
+    if (at_us < 0)
+    {
+        pthread_cond_wait(cond, mutex);
+        return true;
+    }
+    struct timespec deadline;
+    sim_clock_deadline(at_us, &deadline);
+    return pthread_cond_timedwait(cond, mutex, &deadline) != ETIMEDOUT || sim_clock_now_us() < at_us;
+}
+
+int64_t sim_ticks_to_deadline(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        return -1;
+    }
+    return sim_clock_now_us() + (int64_t)ticks * 1000000 / configTICK_RATE_HZ;
+}
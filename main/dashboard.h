@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * The web dashboard (dashboard/), gzipped at build time by dashboard/embed.cmake, which generates
+     * the definitions. The data is const, so it stays in flash and is sent from there as is.
+     */
+    typedef struct
+    {
+        const char *uri;
+        const char *type;          /// Content-Type
+        const char *cache_control; /// Cache-Control
+        const char *etag;          /// strong ETag (quoted): the hash of the content
+        const uint8_t *data;       /// gzipped content
+        size_t size;
+    } dashboard_asset_t;
+
+    extern const dashboard_asset_t dashboard_assets[];
+    extern const size_t dashboard_asset_count;
+
+#ifdef __cplusplus
+}
+#endif
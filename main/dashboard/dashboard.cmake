@@ -0,0 +1,15 @@
+# Embeds the dashboard assets (this directory) into target: they are minified and gzipped at build
+# time into a generated source (see embed.cmake), which defines the table declared by dashboard.h.
+set(DASHBOARD_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+function(dashboard_add_assets target)
+    set(output ${CMAKE_CURRENT_BINARY_DIR}/dashboard_assets.c)
+    add_custom_command(
+        OUTPUT ${output}
+        COMMAND ${CMAKE_COMMAND} -DDASHBOARD_DIR=${DASHBOARD_DIR} -DOUTPUT=${output} -P ${DASHBOARD_DIR}/embed.cmake
+        DEPENDS ${DASHBOARD_DIR}/embed.cmake ${DASHBOARD_DIR}/index.html ${DASHBOARD_DIR}/dashboard.css
+                ${DASHBOARD_DIR}/dashboard.js
+        COMMENT "Embedding the dashboard"
+        VERBATIM)
+    target_sources(${target} PRIVATE ${output})
+endfunction()
@@ -0,0 +1,107 @@
+// Renders one card per zone from its /status (revalidated with its ETag, so an unchanged status costs
+// a 304), refreshed on each server-sent event of the zone and every few seconds otherwise.
+"use strict";
+
+const POLL_INTERVAL = 5000; // ms
+const STATUS_KEYS = ["t", "readings", "faults"]; // the other keys of the temperature in a status are channels
+
+const cards = new Map();
+
+function zonePath(zone) {
+    return "/zones/" + encodeURIComponent(zone);
+}
+
+function formatAge(seconds) {
+    return seconds < 60 ? Math.round(seconds) + " s" : seconds < 3600 ? Math.round(seconds / 60) + " min"
+        : (seconds / 3600).toFixed(1) + " h";
+}
+
+function render(card, status) {
+    const relay = card.querySelector(".relay");
+    relay.textContent = status.relay.state + " for " + formatAge(status.t - status.relay.since);
+    relay.classList.toggle("on", status.relay.state === "on");
+    card.querySelector(".flow").textContent = status.flow.state === "active"
+        ? "drawing for " + formatAge(status.t - status.flow.cycle_start) : "idle (" + status.flow.cycles + " cycles)";
+    card.querySelector(".readings").textContent = status.temperature.readings + " (" + status.temperature.faults
+        + " faults)";
+    const rows = Object.keys(status.temperature).filter((key) => !STATUS_KEYS.includes(key)).map((channel) => {
+        const value = status.temperature[channel];
+        const row = document.createElement("tr");
+        row.insertCell().textContent = channel;
+        row.insertCell().textContent = value === null ? "unknown" : value.toFixed(2) + " °C";
+        return row;
+    });
+    card.querySelector(".temperatures").replaceChildren(...rows);
+}
+
+async function refresh(zone) {
+    const card = cards.get(zone);
+    if (!card) {
+        return;
+    }
+    try {
+        const response = await fetch(zonePath(zone) + "/status", {cache: "no-cache"});
+        render(card, await response.json());
+    } catch (error) {
+        card.querySelector(".relay").textContent = "unreachable";
+    }
+}
+
+async function loadConfig(zone, form) {
+    const response = await fetch(zonePath(zone) + "/config");
+    const config = await response.json();
+    for (const input of form.querySelectorAll("input")) {
+        input.value = config[input.name];
+    }
+}
+
+async function saveConfig(zone, form) {
+    const output = form.querySelector("output");
+    const response = await fetch(zonePath(zone) + "/config", {
+        method: "PUT",
+        headers: {"Content-Type": "application/x-www-form-urlencoded"},
+        body: new URLSearchParams(new FormData(form)).toString(),
+    });
+    output.textContent = response.ok ? "Saved" : await response.text();
+}
+
+function addZone(zone) {
+    const card = document.getElementById("zone").content.firstElementChild.cloneNode(true);
+    card.querySelector(".name").textContent = zone;
+    const form = card.querySelector("form");
+    form.addEventListener("submit", (event) => {
+        event.preventDefault();
+        saveConfig(zone, form);
+    });
+    document.getElementById("zones").append(card);
+    cards.set(zone, card);
+    loadConfig(zone, form);
+    refresh(zone);
+}
+
+function subscribe() {
+    const link = document.getElementById("link");
+    const events = new EventSource("/events");
+    const onEvent = (event) => refresh(JSON.parse(event.data).zone);
+    for (const name of ["relay", "flow", "temperature"]) {
+        events.addEventListener(name, onEvent);
+    }
+    events.onopen = () => {
+        link.textContent = "live";
+        link.classList.add("live");
+    };
+    events.onerror = () => {
+        link.textContent = "reconnecting";
+        link.classList.remove("live");
+    };
+}
+
+async function main() {
+    const response = await fetch("/zones");
+    const {zones} = await response.json();
+    zones.forEach(addZone);
+    subscribe();
+    setInterval(() => cards.forEach((card, zone) => refresh(zone)), POLL_INTERVAL);
+}
+
+main();
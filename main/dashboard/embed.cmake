@@ -0,0 +1,83 @@
+# Minifies and gzips the dashboard assets, and writes them into a C source as arrays with their ETags
+# (see dashboard.h). Run at build time by dashboard_add_assets (dashboard.cmake):
+#
+#   cmake -DDASHBOARD_DIR=<this directory> -DOUTPUT=<dashboard_assets.c> -P embed.cmake
+#
+# The stylesheet and the script are referenced by index.html with their content hash in the query
+# string, so that they can be cached for good: another build changes their URL. index.html itself is
+# revalidated on each load.
+cmake_minimum_required(VERSION 3.19)
+
+get_filename_component(WORK_DIR ${OUTPUT} DIRECTORY)
+set(WORK_DIR ${WORK_DIR}/dashboard)
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+# Drops indentation, blank lines and comments. The script keeps its line breaks, so that automatic
+# semicolons are left alone, and loses only the trailing comments that follow a statement (";", "{",
+# "}", "," or ")" then whitespace) and quote nothing up to the line end, so that they cannot be in a
+# string. The stylesheet, which has no strings, is also joined around its braces, semicolons and
+# commas. The markup keeps a line break between tags, which costs no more than the space it would
+# collapse to.
+function(minify file out_var)
+    file(READ ${DASHBOARD_DIR}/${file} content)
+    string(REGEX REPLACE "[ \t\r]*\n[ \t]*" "\n" content "\n${content}")
+    string(REGEX REPLACE "\n//[^\n]*" "" content "${content}")
+    string(REGEX REPLACE "\n/\\*[^\n]*\\*/(\n)" "\\1" content "${content}")
+    if(file MATCHES "\\.js$")
+        string(REGEX REPLACE "([;{},)])[ \t]+//[^\n\"'`]*\n" "\\1\n" content "${content}")
+    elseif(file MATCHES "\\.css$")
+        string(REGEX REPLACE "/\\*[^*]*\\*/" "" content "${content}")
+        string(REGEX REPLACE "[ \t\n]*([{};,])[ \t\n]*" "\\1" content "${content}")
+        string(REGEX REPLACE "([a-z-]):[ \t]+" "\\1:" content "${content}")
+        string(REPLACE ";}" "}" content "${content}")
+    endif()
+    string(REGEX REPLACE "\n\n+" "\n" content "${content}")
+    string(REGEX REPLACE "^\n" "" content "${content}")
+    set(${out_var} "${content}" PARENT_SCOPE)
+endfunction()
+
+# Appends the gzipped content as a C array named symbol to the generated source, and sets the
+# asset's ETag (the hash of its content).
+function(embed name content symbol etag_var)
+    file(WRITE ${WORK_DIR}/${name} "${content}")
+    file(ARCHIVE_CREATE OUTPUT ${WORK_DIR}/${name}.gz PATHS ${WORK_DIR}/${name} FORMAT raw COMPRESSION GZip
+         COMPRESSION_LEVEL 9)
+    file(READ ${WORK_DIR}/${name}.gz hex HEX)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+    string(REPEAT "0x..," 16 row)
+    string(REGEX REPLACE "(${row})" "\\1\n    " bytes "${bytes}")
+    string(REGEX REPLACE "\n    $" "" bytes "${bytes}")
+    string(APPEND source "\nstatic const uint8_t ${symbol}[] = {\n    ${bytes}\n};\n")
+    set(source "${source}" PARENT_SCOPE)
+    string(SHA256 hash "${content}")
+    string(SUBSTRING ${hash} 0 16 hash)
+    set(${etag_var} ${hash} PARENT_SCOPE)
+endfunction()
+
+set(source "// Generated by main/dashboard/embed.cmake from main/dashboard: do not edit.\n#include \"dashboard.h\"\n")
+
+minify(dashboard.css css)
+embed(dashboard.css "${css}" dashboard_css css_etag)
+minify(dashboard.js js)
+embed(dashboard.js "${js}" dashboard_js js_etag)
+minify(index.html html)
+string(REPLACE "@dashboard.css@" "/dashboard.css?v=${css_etag}" html "${html}")
+string(REPLACE "@dashboard.js@" "/dashboard.js?v=${js_etag}" html "${html}")
+embed(index.html "${html}" index_html html_etag)
+
+set(IMMUTABLE "public, max-age=31536000, immutable")
+string(APPEND source "
+const dashboard_asset_t dashboard_assets[] = {
+    {.uri = \"/\", .type = \"text/html; charset=utf-8\", .cache_control = \"no-cache\",
+     .etag = \"\\\"${html_etag}\\\"\", .data = index_html, .size = sizeof(index_html)},
+    {.uri = \"/dashboard.css\", .type = \"text/css\", .cache_control = \"${IMMUTABLE}\",
+     .etag = \"\\\"${css_etag}\\\"\", .data = dashboard_css, .size = sizeof(dashboard_css)},
+    {.uri = \"/dashboard.js\", .type = \"text/javascript\", .cache_control = \"${IMMUTABLE}\",
+     .etag = \"\\\"${js_etag}\\\"\", .data = dashboard_js, .size = sizeof(dashboard_js)},
+};
+
+const size_t dashboard_asset_count = sizeof(dashboard_assets) / sizeof(dashboard_assets[0]);
+")
+
+# rewritten only when changed, so that an unchanged dashboard is not recompiled
+file(CONFIGURE OUTPUT ${OUTPUT} CONTENT "${source}" @ONLY)
@@ -0,0 +1,245 @@
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include "event_stream.h"
+
+#define MUTEX_TIMEOUT pdMS_TO_TICKS(10) // max time a publisher waits for the lock before dropping (10 ms)
+
+static const char *TAG = "event_stream";
+
+typedef struct
+{
+    uint16_t len;
+    char data[EVENT_STREAM_MESSAGE_SIZE];
+} message_t;
+
+typedef struct
+{
+    const char *name; /// the event name (as passed to publish, which must outlive the stream)
+    const char *zone; /// the zone name (likewise; NULL for an event of the board)
+    message_t message;
+} retained_t;
+
+struct event_stream_s
+{
+    event_stream_config_t config;
+    message_t *ring;                                    /// config.slots messages, indexed by sequence % slots
+    uint32_t next;                                      /// sequence number of the next message
+    retained_t retained[EVENT_STREAM_MAX_RETAINED];     /// the latest message of each event name and zone
+    size_t retained_count;                              /// number of event names and zones seen
+    TaskHandle_t subscribers[EVENT_STREAM_MAX_SUBSCRIBERS]; /// tasks to wake on publish (NULL if free)
+    atomic_uint dropped;                                /// messages not published (lock timeout or too long)
+    SemaphoreHandle_t mutex;                            /// guards everything above
+};
+
+esp_err_t event_stream_open(const event_stream_config_t *config, event_stream_t *stream_out)
+{
+    esp_err_t ret = ESP_FAIL;
+    ESP_GOTO_ON_FALSE(config && stream_out, ESP_ERR_INVALID_ARG, handle_error, TAG, "null");
+    ESP_GOTO_ON_FALSE(config->slots, ESP_ERR_INVALID_ARG, handle_error, TAG, "no slots");
+    const event_stream_t stream = calloc(1, sizeof(struct event_stream_s));
+    ESP_GOTO_ON_FALSE(stream, ESP_ERR_NO_MEM, handle_error, TAG, "malloc stream");
+    stream->config = *config;
+    stream->ring = calloc(config->slots, sizeof(message_t));
+    ESP_GOTO_ON_FALSE(stream->ring, ESP_ERR_NO_MEM, free_stream, TAG, "malloc %u slots", (unsigned)config->slots);
+    stream->mutex = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(stream->mutex, ESP_ERR_NO_MEM, free_ring, TAG, "create mutex");
+    *stream_out = stream;
+    ESP_LOGI(TAG, "Opened with %u slots", (unsigned)config->slots);
+    return ESP_OK;
+free_ring:
+    free(stream->ring);
+free_stream:
+    free(stream);
+handle_error:
+    return ret;
+}
+
+esp_err_t event_stream_close(event_stream_t stream)
+{
+    ESP_RETURN_ON_FALSE(stream, ESP_ERR_INVALID_ARG, TAG, "stream must not be NULL");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(stream->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    vSemaphoreDelete(stream->mutex);
+    free(stream->ring);
+    free(stream);
+    ESP_LOGI(TAG, "Closed");
+    return ESP_OK;
+}
+
+static bool is_same_zone(const char *a, const char *b)
+{
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+static retained_t *find_retained(event_stream_t stream, const char *name, const char *zone)
+{
+    for (size_t i = 0; i < stream->retained_count; i++)
+    {
+        if (strcmp(stream->retained[i].name, name) == 0 && is_same_zone(stream->retained[i].zone, zone))
+        {
+            return &stream->retained[i];
+        }
+    }
+    if (stream->retained_count == EVENT_STREAM_MAX_RETAINED)
+    {
+        ESP_LOGW(TAG, "No room to retain '%s' of zone '%s'", name, zone ? zone : "");
+        return NULL;
+    }
+    stream->retained[stream->retained_count].name = name;
+    stream->retained[stream->retained_count].zone = zone;
+    return &stream->retained[stream->retained_count++];
+}
+
+esp_err_t event_stream_publish(event_stream_t stream, const char *name, const char *zone, const char *format, ...)
+{
+    ESP_RETURN_ON_FALSE(stream && name && format, ESP_ERR_INVALID_ARG, TAG, "null");
+    // formatted before taking the lock, which then only covers a copy
+    message_t message;
+    const size_t size = sizeof(message.data);
+    size_t len = snprintf(message.data, size, "event: %s\ndata: ", name);
+    if (len < size)
+    {
+        va_list args;
+        va_start(args, format);
+        len += vsnprintf(message.data + len, size - len, format, args);
+        va_end(args);
+    }
+    if (len < size)
+    {
+        len += snprintf(message.data + len, size - len, "\n\n");
+    }
+    if (len >= size)
+    {
+        ESP_LOGW(TAG, "Dropped '%s' message of %u bytes", name, (unsigned)len);
+        stream->dropped++;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    message.len = len;
+
+    if (!xSemaphoreTake(stream->mutex, MUTEX_TIMEOUT))
+    {
+        stream->dropped++;
+        return ESP_ERR_TIMEOUT;
+    }
+    memcpy(&stream->ring[stream->next % stream->config.slots], &message, sizeof(message_t));
+    stream->next++;
+    retained_t *retained = find_retained(stream, name, zone);
+    if (retained)
+    {
+        memcpy(&retained->message, &message, sizeof(message_t));
+    }
+    TaskHandle_t subscribers[EVENT_STREAM_MAX_SUBSCRIBERS];
+    memcpy(subscribers, stream->subscribers, sizeof(subscribers));
+    xSemaphoreGive(stream->mutex);
+
+    for (int i = 0; i < EVENT_STREAM_MAX_SUBSCRIBERS; i++)
+    {
+        if (subscribers[i])
+        {
+            xTaskNotifyGive(subscribers[i]);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t event_stream_subscribe(event_stream_t stream, TaskHandle_t task, uint32_t *cursor)
+{
+    esp_err_t ret = ESP_OK;
+    ESP_RETURN_ON_FALSE(stream && task && cursor, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(stream->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    int i = 0;
+    while (i < EVENT_STREAM_MAX_SUBSCRIBERS && stream->subscribers[i])
+    {
+        i++;
+    }
+    ESP_GOTO_ON_FALSE(i < EVENT_STREAM_MAX_SUBSCRIBERS, ESP_ERR_NO_MEM, release_mutex, TAG, "too many subscribers");
+    stream->subscribers[i] = task;
+    *cursor = stream->next;
+release_mutex:
+    xSemaphoreGive(stream->mutex);
+    return ret;
+}
+
+esp_err_t event_stream_unsubscribe(event_stream_t stream, TaskHandle_t task)
+{
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    ESP_RETURN_ON_FALSE(stream && task, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(stream->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    for (int i = 0; i < EVENT_STREAM_MAX_SUBSCRIBERS; i++)
+    {
+        if (stream->subscribers[i] == task)
+        {
+            stream->subscribers[i] = NULL;
+            ret = ESP_OK;
+        }
+    }
+    xSemaphoreGive(stream->mutex);
+    return ret;
+}
+
+esp_err_t event_stream_read(event_stream_t stream, uint32_t *cursor, char *buf, size_t size, size_t *len,
+                            uint32_t *missed)
+{
+    esp_err_t ret = ESP_OK;
+    ESP_RETURN_ON_FALSE(stream && cursor && buf && len && missed, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(size >= EVENT_STREAM_MESSAGE_SIZE, ESP_ERR_INVALID_SIZE, TAG, "buffer too small");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(stream->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    *missed = 0;
+    if (*cursor == stream->next)
+    {
+        ret = ESP_ERR_NOT_FOUND;
+        goto release_mutex;
+    }
+    // unsigned arithmetic, so that sequence numbers may wrap
+    if (stream->next - *cursor > stream->config.slots)
+    {
+        *missed = stream->next - stream->config.slots - *cursor;
+        *cursor = stream->next - stream->config.slots;
+    }
+    const message_t *message = &stream->ring[*cursor % stream->config.slots];
+    memcpy(buf, message->data, message->len);
+    *len = message->len;
+    (*cursor)++;
+release_mutex:
+    xSemaphoreGive(stream->mutex);
+    return ret;
+}
+
+esp_err_t event_stream_read_retained(event_stream_t stream, size_t index, char *buf, size_t size, size_t *len)
+{
+    esp_err_t ret = ESP_OK;
+    ESP_RETURN_ON_FALSE(stream && buf && len, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(size >= EVENT_STREAM_MESSAGE_SIZE, ESP_ERR_INVALID_SIZE, TAG, "buffer too small");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(stream->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    if (index < stream->retained_count)
+    {
+        const message_t *message = &stream->retained[index].message;
+        memcpy(buf, message->data, message->len);
+        *len = message->len;
+    }
+    else
+    {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+    xSemaphoreGive(stream->mutex);
+    return ret;
+}
+
+uint32_t event_stream_get_published(event_stream_t stream)
+{
+    ESP_RETURN_ON_FALSE(stream, 0, TAG, "stream must not be NULL");
+    return stream->next;
+}
+
+uint32_t event_stream_get_dropped(event_stream_t stream)
+{
+    ESP_RETURN_ON_FALSE(stream, 0, TAG, "stream must not be NULL");
+    return stream->dropped;
+}
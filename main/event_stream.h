@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "zone.h"
+
+#define EVENT_STREAM_MESSAGE_SIZE 256 // max length of a formatted message ("event: ...\ndata: ...\n\n")
+#define EVENT_STREAM_MAX_RETAINED (3 * ZONE_MAX_ZONES) // the latest relay, temperature and flow message of each zone
+#define EVENT_STREAM_MAX_SUBSCRIBERS 8
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Fan-out buffer for Server-Sent Events. Publishers format each message once into a shared ring;
+     * every subscriber reads it through its own cursor, so a subscriber that falls behind loses the
+     * oldest messages instead of holding up the publishers or the other subscribers. The latest
+     * message of each event name and zone is also retained, so that a new (or lapped) subscriber can
+     * be sent the current state (of every zone) first.
+     */
+    typedef struct
+    {
+        size_t slots; /// number of messages kept in the ring (*required)
+    } event_stream_config_t;
+
+    typedef struct event_stream_s *event_stream_t;
+
+    esp_err_t event_stream_open(const event_stream_config_t *config, event_stream_t *stream_out);
+    esp_err_t event_stream_close(event_stream_t stream);
+
+    /*
+     * Formats "event: <name>\ndata: <printf(format, ...)>\n\n" into the ring, then wakes the subscribers.
+     * The message is retained as the latest of name in zone (NULL for an event of the board); both must
+     * outlive the stream.
+     */
+    esp_err_t event_stream_publish(event_stream_t stream, const char *name, const char *zone, const char *format,
+                                   ...) __attribute__((format(printf, 4, 5)));
+
+    // Registers a task to be notified (xTaskNotifyGive) on each publish; *cursor is set to the next message.
+    esp_err_t event_stream_subscribe(event_stream_t stream, TaskHandle_t task, uint32_t *cursor);
+    esp_err_t event_stream_unsubscribe(event_stream_t stream, TaskHandle_t task);
+
+    /*
+     * Copies the message at *cursor and advances it. Returns ESP_ERR_NOT_FOUND when there is no new
+     * message. When the cursor fell more than the ring size behind, it skips to the oldest message
+     * kept and *missed is set to the number of messages skipped (otherwise 0).
+     */
+    esp_err_t event_stream_read(event_stream_t stream, uint32_t *cursor, char *buf, size_t size, size_t *len,
+                                uint32_t *missed);
+
+    // Copies the latest message of the index-th event name and zone; ESP_ERR_NOT_FOUND past the last one.
+    esp_err_t event_stream_read_retained(event_stream_t stream, size_t index, char *buf, size_t size, size_t *len);
+
+    uint32_t event_stream_get_published(event_stream_t stream);
+    uint32_t event_stream_get_dropped(event_stream_t stream);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,331 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "sdkconfig.h"
+#include "history.h"
+
+#define MUTEX_TIMEOUT pdMS_TO_TICKS(100) // max time to wait for a lock (100 ms)
+#define NO_DATA INT16_MIN                // rollup value of an interval without data
+
+static const char *TAG = "history";
+
+static const uint64_t TIER_INTERVAL[HISTORY_TIERS] = {0, 60000000, 3600000000};
+static const size_t TIER_CAPACITY[HISTORY_TIERS] = {
+    CONFIG_HISTORY_RAW_SAMPLES, CONFIG_HISTORY_MINUTE_ROLLUPS, CONFIG_HISTORY_HOUR_ROLLUPS};
+
+typedef struct
+{
+    int64_t timestamp;
+    float value;
+} raw_t;
+
+typedef struct
+{
+    int16_t min;
+    int16_t max;
+    int16_t mean;
+} rollup_t;
+
+typedef struct
+{
+    int64_t interval;   /// index of the interval being accumulated (timestamp / tier interval)
+    int64_t integrated; /// step series: time up to which the held value has been accumulated
+    double sum;         /// sum of values, or of value x time for step series
+    uint64_t weight;    /// number of values, or time (in microseconds) for step series
+    float min;
+    float max;
+} accumulator_t;
+
+typedef struct
+{
+    const history_series_config_t *config;
+    raw_t *raw;                           /// ring of raw values
+    size_t raw_head;                      /// index of the next raw value
+    size_t raw_count;                     /// number of raw values (up to the tier capacity)
+    rollup_t *rollups[HISTORY_TIERS];     /// rings of rollups, indexed by interval % capacity
+    int64_t newest[HISTORY_TIERS];        /// interval of the newest stored rollup
+    size_t stored[HISTORY_TIERS];         /// number of stored rollups (up to the tier capacity)
+    accumulator_t pending[HISTORY_TIERS]; /// the rollup being accumulated
+    float last_value;                     /// the latest recorded value
+    bool has_value;                       /// whether a value was recorded yet
+} series_t;
+
+struct history_s
+{
+    series_t *series;
+    size_t series_count;
+    size_t memory_size;      /// bytes allocated for samples and rollups
+    SemaphoreHandle_t mutex; /// synchronization mutex
+};
+
+static int16_t quantize(const series_t *s, float value)
+{
+    const float q = roundf(value / s->config->resolution);
+    return (int16_t)fmaxf(-INT16_MAX, fminf(INT16_MAX, q));
+}
+
+static float dequantize(const series_t *s, int16_t value)
+{
+    return value == NO_DATA ? NAN : value * s->config->resolution;
+}
+
+static void reset_pending(series_t *s, history_tier_t tier, int64_t interval)
+{
+    accumulator_t *p = &s->pending[tier];
+    p->interval = interval;
+    p->integrated = interval * TIER_INTERVAL[tier];
+    p->sum = 0;
+    p->weight = 0;
+    const bool held = s->config->kind == HISTORY_SERIES_STEP && s->has_value;
+    p->min = held ? s->last_value : INFINITY;
+    p->max = held ? s->last_value : -INFINITY;
+}
+
+static void accumulate_step(accumulator_t *p, float value, int64_t until)
+{
+    if (until > p->integrated)
+    {
+        p->sum += (double)value * (until - p->integrated);
+        p->weight += until - p->integrated;
+        p->integrated = until;
+    }
+}
+
+static void store_pending(series_t *s, history_tier_t tier)
+{
+    const accumulator_t *p = &s->pending[tier];
+    rollup_t rollup = {NO_DATA, NO_DATA, NO_DATA};
+    if (p->weight)
+    {
+        rollup = (rollup_t){quantize(s, p->min), quantize(s, p->max), quantize(s, p->sum / p->weight)};
+    }
+    s->rollups[tier][p->interval % TIER_CAPACITY[tier]] = rollup;
+    s->newest[tier] = p->interval;
+    if (s->stored[tier] < TIER_CAPACITY[tier])
+    {
+        s->stored[tier]++;
+    }
+}
+
+// Closes every interval of a rollup tier that ended before timestamp.
+static void roll(series_t *s, history_tier_t tier, int64_t timestamp)
+{
+    const int64_t interval = timestamp / TIER_INTERVAL[tier];
+    accumulator_t *p = &s->pending[tier];
+    if (p->interval < 0)
+    {
+        reset_pending(s, tier, interval);
+        return;
+    }
+    while (p->interval < interval)
+    {
+        if (s->config->kind == HISTORY_SERIES_STEP && s->has_value)
+        {
+            accumulate_step(p, s->last_value, (p->interval + 1) * TIER_INTERVAL[tier]);
+        }
+        store_pending(s, tier);
+        // after a gap longer than the tier, only its last TIER_CAPACITY intervals need to be written
+        const int64_t next = p->interval + 1;
+        const int64_t first = interval - (int64_t)TIER_CAPACITY[tier];
+        reset_pending(s, tier, next > first ? next : first);
+    }
+}
+
+esp_err_t history_open(const history_config_t *config, history_t *history_out)
+{
+    esp_err_t ret = ESP_FAIL;
+    ESP_GOTO_ON_FALSE(config && history_out, ESP_ERR_INVALID_ARG, handle_error, TAG, "null");
+    ESP_GOTO_ON_FALSE(config->series && config->series_count, ESP_ERR_INVALID_ARG, handle_error, TAG,
+                      "no series");
+    const history_t history = calloc(1, sizeof(struct history_s));
+    ESP_GOTO_ON_FALSE(history, ESP_ERR_NO_MEM, handle_error, TAG, "malloc history");
+    history->series = calloc(config->series_count, sizeof(series_t));
+    ESP_GOTO_ON_FALSE(history->series, ESP_ERR_NO_MEM, free_history, TAG, "malloc series");
+    history->series_count = config->series_count;
+
+    // a single allocation holds every ring, so the whole budget is claimed (or refused) up front
+    const size_t raw_size = TIER_CAPACITY[HISTORY_TIER_RAW] * sizeof(raw_t);
+    const size_t rollups_size = (TIER_CAPACITY[HISTORY_TIER_MINUTE] + TIER_CAPACITY[HISTORY_TIER_HOUR]) * sizeof(rollup_t);
+    history->memory_size = config->series_count * (raw_size + rollups_size);
+    uint8_t *memory = malloc(history->memory_size);
+    ESP_GOTO_ON_FALSE(memory, ESP_ERR_NO_MEM, free_series, TAG, "malloc %u bytes of history",
+                      (unsigned)history->memory_size);
+    for (size_t i = 0; i < config->series_count; i++)
+    {
+        series_t *s = &history->series[i];
+        s->config = &config->series[i];
+        s->raw = (raw_t *)memory;
+        memory += raw_size;
+        for (history_tier_t tier = HISTORY_TIER_MINUTE; tier < HISTORY_TIERS; tier++)
+        {
+            s->rollups[tier] = (rollup_t *)memory;
+            memory += TIER_CAPACITY[tier] * sizeof(rollup_t);
+            s->newest[tier] = -1;
+            s->pending[tier].interval = -1;
+        }
+    }
+
+    history->mutex = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(history->mutex, ESP_ERR_NO_MEM, free_memory, TAG, "create mutex");
+    *history_out = history;
+    ESP_LOGI(TAG, "Opened with %u series (%u bytes)", (unsigned)config->series_count,
+             (unsigned)history->memory_size);
+    return ESP_OK;
+free_memory:
+    free(history->series[0].raw);
+free_series:
+    free(history->series);
+free_history:
+    free(history);
+handle_error:
+    return ret;
+}
+
+esp_err_t history_close(history_t history)
+{
+    ESP_RETURN_ON_FALSE(history, ESP_ERR_INVALID_ARG, TAG, "history must not be NULL");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(history->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    vSemaphoreDelete(history->mutex);
+    free(history->series[0].raw);
+    free(history->series);
+    free(history);
+    ESP_LOGI(TAG, "Closed");
+    return ESP_OK;
+}
+
+esp_err_t history_record(history_t history, size_t series, int64_t timestamp, float value)
+{
+    ESP_RETURN_ON_FALSE(history, ESP_ERR_INVALID_ARG, TAG, "history must not be NULL");
+    ESP_RETURN_ON_FALSE(series < history->series_count, ESP_ERR_INVALID_ARG, TAG, "invalid series %u",
+                        (unsigned)series);
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(history->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    series_t *s = &history->series[series];
+    s->raw[s->raw_head] = (raw_t){.timestamp = timestamp, .value = value};
+    s->raw_head = (s->raw_head + 1) % TIER_CAPACITY[HISTORY_TIER_RAW];
+    if (s->raw_count < TIER_CAPACITY[HISTORY_TIER_RAW])
+    {
+        s->raw_count++;
+    }
+    for (history_tier_t tier = HISTORY_TIER_MINUTE; tier < HISTORY_TIERS; tier++)
+    {
+        roll(s, tier, timestamp);
+        accumulator_t *p = &s->pending[tier];
+        if (s->config->kind == HISTORY_SERIES_STEP)
+        {
+            if (s->has_value)
+            {
+                accumulate_step(p, s->last_value, timestamp);
+            }
+            p->integrated = timestamp;
+        }
+        else
+        {
+            p->sum += value;
+            p->weight++;
+        }
+        p->min = fminf(p->min, value);
+        p->max = fmaxf(p->max, value);
+    }
+    s->last_value = value;
+    s->has_value = true;
+    ESP_RETURN_ON_FALSE(xSemaphoreGive(history->mutex), ESP_ERR_NOT_FINISHED, TAG, "release mutex");
+    return ESP_OK;
+}
+
+int history_find_series(history_t history, const char *name)
+{
+    ESP_RETURN_ON_FALSE(history && name, -1, TAG, "null");
+    for (size_t i = 0; i < history->series_count; i++)
+    {
+        if (strcmp(history->series[i].config->name, name) == 0)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+const char *history_get_series_name(history_t history, size_t series)
+{
+    ESP_RETURN_ON_FALSE(history && series < history->series_count, NULL, TAG, "invalid series");
+    return history->series[series].config->name;
+}
+
+uint64_t history_get_tier_interval(history_tier_t tier)
+{
+    return tier < HISTORY_TIERS ? TIER_INTERVAL[tier] : 0;
+}
+
+size_t history_get_memory_size(history_t history)
+{
+    return history ? history->memory_size : 0;
+}
+
+static size_t read_raw(const series_t *s, int64_t to, int64_t *cursor, history_entry_t *entries, size_t max_entries)
+{
+    const size_t capacity = TIER_CAPACITY[HISTORY_TIER_RAW];
+    size_t n = 0;
+    for (size_t i = 0; i < s->raw_count && n < max_entries; i++)
+    {
+        const raw_t *r = &s->raw[(s->raw_head + capacity - s->raw_count + i) % capacity];
+        if (r->timestamp >= *cursor && r->timestamp < to)
+        {
+            entries[n++] = (history_entry_t){r->timestamp, r->value, r->value, r->value};
+        }
+    }
+    if (n)
+    {
+        *cursor = entries[n - 1].timestamp + 1;
+    }
+    return n;
+}
+
+static size_t read_rollups(const series_t *s, history_tier_t tier, int64_t to, int64_t *cursor,
+                           history_entry_t *entries, size_t max_entries)
+{
+    const int64_t interval = TIER_INTERVAL[tier];
+    const int64_t oldest = s->newest[tier] - (int64_t)s->stored[tier] + 1;
+    int64_t first = (*cursor + interval - 1) / interval;
+    first = first > oldest ? first : oldest;
+    size_t n = 0;
+    for (int64_t i = first; i <= s->newest[tier] && i * interval < to && n < max_entries; i++)
+    {
+        const rollup_t *r = &s->rollups[tier][i % TIER_CAPACITY[tier]];
+        entries[n++] = (history_entry_t){
+            i * interval, dequantize(s, r->min), dequantize(s, r->max), dequantize(s, r->mean)};
+    }
+    if (n)
+    {
+        *cursor = entries[n - 1].timestamp + interval;
+    }
+    return n;
+}
+
+esp_err_t history_read(history_t history, size_t series, history_tier_t tier, int64_t to,
+                       int64_t *cursor, history_entry_t *entries, size_t max_entries, size_t *count)
+{
+    ESP_RETURN_ON_FALSE(history && cursor && entries && count, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(series < history->series_count, ESP_ERR_INVALID_ARG, TAG, "invalid series %u",
+                        (unsigned)series);
+    ESP_RETURN_ON_FALSE(tier < HISTORY_TIERS, ESP_ERR_INVALID_ARG, TAG, "invalid tier %d", tier);
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(history->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    series_t *s = &history->series[series];
+    if (tier == HISTORY_TIER_RAW)
+    {
+        *count = read_raw(s, to, cursor, entries, max_entries);
+    }
+    else
+    {
+        // close the intervals that ended since the latest value was recorded
+        roll(s, tier, esp_timer_get_time());
+        *count = read_rollups(s, tier, to, cursor, entries, max_entries);
+    }
+    ESP_RETURN_ON_FALSE(xSemaphoreGive(history->mutex), ESP_ERR_NOT_FINISHED, TAG, "release mutex");
+    return ESP_OK;
+}
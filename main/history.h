@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef enum
+    {
+        HISTORY_TIER_RAW = 0,    /// every recorded value, most recent CONFIG_HISTORY_RAW_SAMPLES
+        HISTORY_TIER_MINUTE = 1, /// 1-minute rollups, most recent CONFIG_HISTORY_MINUTE_ROLLUPS
+        HISTORY_TIER_HOUR = 2,   /// 1-hour rollups, most recent CONFIG_HISTORY_HOUR_ROLLUPS
+        HISTORY_TIERS
+    } history_tier_t;
+
+    typedef enum
+    {
+        HISTORY_SERIES_SAMPLED, /// rollups average the recorded values (e.g. temperatures)
+        HISTORY_SERIES_STEP,    /// a value holds until the next one; rollups are time-weighted (e.g. relay state)
+    } history_series_kind_t;
+
+    typedef struct
+    {
+        const char *name;           /// the name used to query the series
+        history_series_kind_t kind; /// how values are rolled up
+        float resolution;           /// rollups store multiples of this in 16 bits (e.g. 0.01 for °C)
+    } history_series_config_t;
+
+    typedef struct
+    {
+        const history_series_config_t *series; /// the series to keep (*required)
+        size_t series_count;                   /// number of series
+    } history_config_t;
+
+    typedef struct history_s *history_t;
+
+    typedef struct
+    {
+        int64_t timestamp; /// microseconds since boot of the value (or of the start of a rollup interval)
+        float min;         /// minimum value (equal to mean for raw values)
+        float max;         /// maximum value (equal to mean for raw values)
+        float mean;        /// the value, or its (time-weighted) average; NAN for an interval without data
+    } history_entry_t;
+
+    esp_err_t history_open(const history_config_t *config, history_t *history_out);
+    esp_err_t history_close(history_t history);
+
+    esp_err_t history_record(history_t history, size_t series, int64_t timestamp, float value);
+
+    // Returns the index of the named series, or -1 if there is none.
+    int history_find_series(history_t history, const char *name);
+    const char *history_get_series_name(history_t history, size_t series);
+    uint64_t history_get_tier_interval(history_tier_t tier);
+    size_t history_get_memory_size(history_t history);
+
+    /*
+     * Copies up to max_entries entries of a series tier, with timestamps in [*cursor, to), oldest
+     * first, and advances *cursor past the last one copied. Call repeatedly until *count is 0 to
+     * stream a range without holding the history lock in between.
+     */
+    esp_err_t history_read(history_t history, size_t series, history_tier_t tier, int64_t to,
+                           int64_t *cursor, history_entry_t *entries, size_t max_entries, size_t *count);
+
+#ifdef __cplusplus
+}
+#endif
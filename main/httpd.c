@@ -1,25 +1,65 @@
+#include <stdio.h>
 #include <freertos/FreeRTOS.h>
 #include <esp_check.h>
 #include <esp_log.h>
 #include <esp_http_server.h>
-#include <cJSON.h>
 #include "sdkconfig.h"
 #include "httpd.h"
+#include "httpd_util.h"
 #include "httpd_relay.h"
 #include "httpd_temperature_delta_sensor.h"
 #include "httpd_flow_sensor.h"
+#include "httpd_history.h"
+#include "httpd_events.h"
+#include "httpd_status.h"
+#include "httpd_metrics.h"
+#include "httpd_trace.h"
+#include "httpd_pump_model.h"
+#include "httpd_preheat.h"
+#include "httpd_totals.h"
+#include "httpd_journal.h"
+#include "httpd_system.h"
+#include "httpd_latency.h"
+#include "httpd_config.h"
+#include "httpd_batch.h"
+#include "httpd_dashboard.h"
+#include "dashboard.h"
 
 #define USEC_IN_SEC (double)1000000
+#define BOARD_URI_HANDLERS 6 // /zones, /events, /metrics, /journal, /system, /latency
+#define ZONE_URI_HANDLERS 21 // relay (5), temperature (3), flow (4), history, status, trace, model, preheat, config (2),
+                             // batch, totals
 
 static const char *TAG = "httpd";
 
-static esp_err_t index_handler(httpd_req_t *req)
+static esp_err_t zones_handler(httpd_req_t *req)
 {
+    const httpd_context_t *context = (const httpd_context_t *)req->user_ctx;
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    httpd_util_json_array_begin(&json, "zones");
+    for (size_t i = 0; i < context->zone_count; i++)
+    {
+        httpd_util_json_string(&json, NULL, context->zones[i].name);
+    }
+    httpd_util_json_array_end(&json);
+    return httpd_util_json_end(&json);
+}
 
-    ESP_LOGI(TAG, "uri: /");
-    // TODO: implement
-    const char *html = "<div>Re-circulation controller</div>";
-    return httpd_resp_sendstr(req, html);
+static void register_zone_handlers(const httpd_handle_t httpd, const char *prefix, const httpd_zone_context_t *zone)
+{
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_relay_register_handlers(httpd, prefix, zone->relay));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(
+        httpd_temperature_delta_sensor_register_handlers(httpd, prefix, zone->temperature_delta_sensor));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_flow_sensor_register_handlers(httpd, prefix, zone->flow_sensor, zone->flow_stats));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_history_register_handlers(httpd, prefix, zone->history));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_status_register_handlers(httpd, prefix, zone->status));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_trace_register_handlers(httpd, prefix, zone->trace));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_pump_model_register_handlers(httpd, prefix, zone->pump_model));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_preheat_register_handlers(httpd, prefix, zone->preheat));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_config_register_handlers(httpd, prefix, zone->zone));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_batch_register_handlers(httpd, prefix, zone));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_totals_register_handlers(httpd, prefix, zone));
 }
 
 esp_err_t httpd_open(const httpd_context_t *context, httpd_handle_t *httpd_out)
@@ -27,7 +67,11 @@ esp_err_t httpd_open(const httpd_context_t *context, httpd_handle_t *httpd_out)
     esp_err_t ret = ESP_FAIL;
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.max_uri_handlers = 14;
+    // the dashboard has a handler per asset; the first zone's handlers are registered twice: at the root, and
+    // under its name
+    config.max_uri_handlers =
+        BOARD_URI_HANDLERS + dashboard_asset_count + ZONE_URI_HANDLERS * (context->zone_count + 1);
+    config.uri_match_fn = httpd_uri_match_wildcard;
     config.lru_purge_enable = true;
     config.server_port = CONFIG_HTTPD_PORT;
     config.max_open_sockets = CONFIG_HTTPD_MAX_OPEN_SOCKETS;
@@ -36,12 +80,26 @@ esp_err_t httpd_open(const httpd_context_t *context, httpd_handle_t *httpd_out)
     ESP_GOTO_ON_ERROR(httpd_start(&httpd, &config), handle_error, TAG,
                       "start httpd on port %d", config.server_port);
 
-    const httpd_uri_t uri_handler = {.method = HTTP_GET, .uri = "/", .handler = index_handler};
-    ESP_GOTO_ON_ERROR(httpd_register_uri_handler(httpd, &uri_handler), stop_httpd, TAG, "register GET /");
+    ESP_GOTO_ON_ERROR(httpd_dashboard_register_handlers(httpd), stop_httpd, TAG, "register dashboard");
+
+    const httpd_uri_t zones_uri_handler = {
+        .user_ctx = (void *)context, .method = HTTP_GET, .uri = "/zones", .handler = zones_handler};
+    ESP_GOTO_ON_ERROR(httpd_register_uri_handler(httpd, &zones_uri_handler), stop_httpd, TAG, "register GET /zones");
 
-    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_relay_register_handlers(httpd, context->relay));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_temperature_delta_sensor_register_handlers(httpd, context->temperature_delta_sensor));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_flow_sensor_register_handlers(httpd, context->flow_sensor));
+    register_zone_handlers(httpd, "", &context->zones[0]);
+    for (size_t i = 0; i < context->zone_count; i++)
+    {
+        char prefix[HTTPD_UTIL_URI_SIZE / 2];
+        snprintf(prefix, sizeof(prefix), "/zones/%s", context->zones[i].name);
+        register_zone_handlers(httpd, prefix, &context->zones[i]);
+    }
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_events_register_handlers(httpd, context->events));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_metrics_register_handlers(httpd, context->metrics));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_journal_register_handlers(httpd, context->journal));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_system_register_handlers(httpd, context->system));
+#if CONFIG_LATENCY_TRACE
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_latency_register_handlers(httpd));
+#endif
 
     ESP_LOGI(TAG, "Opened httpd on port: %d", config.server_port);
     *httpd_out = httpd;
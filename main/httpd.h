@@ -5,16 +5,47 @@
 #include "relay.h"
 #include "temperature_delta_sensor.h"
 #include "pulse_sensor.h"
+#include "history.h"
+#include "httpd_events.h"
+#include "httpd_status.h"
+#include "httpd_metrics.h"
+#include "pump_trace.h"
+#include "pump_model.h"
+#include "preheat.h"
+#include "totals.h"
+#include "journal.h"
+#include "system_monitor.h"
+#include "zone.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
+    // What is served for one zone, under /zones/<name>.
     typedef struct
     {
+        const char *name;
+        zone_t zone; /// for its thresholds (GET/PUT /config)
         temperature_delta_sensor_t temperature_delta_sensor;
         relay_t relay;
         pulse_sensor_t flow_sensor;
+        window_stats_t flow_stats; /// of the flow rate (optional)
+        history_t history;
+        httpd_status_t status;
+        pump_trace_t trace;
+        pump_model_t pump_model;
+        preheat_t preheat;
+        totals_t totals;
+    } httpd_zone_context_t;
+
+    typedef struct
+    {
+        httpd_zone_context_t zones[ZONE_MAX_ZONES]; /// the first zone is also served at the root
+        size_t zone_count;
+        httpd_events_t events;
+        httpd_metrics_t metrics;
+        journal_t journal;
+        system_monitor_t system;
     } httpd_context_t;
 
     esp_err_t httpd_open(const httpd_context_t *context, httpd_handle_t *httpd_out);
@@ -0,0 +1,130 @@
+#include <string.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include "httpd_util.h"
+#include "httpd_relay.h"
+#include "httpd_temperature_delta_sensor.h"
+#include "httpd_flow_sensor.h"
+#include "httpd_batch.h"
+
+#define PATHS_SIZE 64
+
+static const char *TAG = "httpd_batch";
+
+typedef enum
+{
+    RESOURCE_RELAY,
+    RESOURCE_TEMPERATURE,
+    RESOURCE_FLOW,
+    RESOURCE_MAX,
+} resource_t;
+
+static const char *const RESOURCE_NAMES[RESOURCE_MAX] = {
+    [RESOURCE_RELAY] = "relay",
+    [RESOURCE_TEMPERATURE] = "temperature",
+    [RESOURCE_FLOW] = "flow",
+};
+
+// Parses "[?paths=<path>[,<path>...]]" into a bit per resource (all of them if there is no paths parameter).
+static esp_err_t parse_paths(httpd_req_t *req, uint32_t *resources)
+{
+    char q[HTTPD_UTIL_QUERY_SIZE];
+    char paths[PATHS_SIZE];
+    *resources = (1u << RESOURCE_MAX) - 1;
+    if (httpd_req_get_url_query_len(req) == 0)
+    {
+        return ESP_OK;
+    }
+    ESP_RETURN_ON_ERROR(httpd_req_get_url_query_str(req, q, sizeof(q)), TAG, "get query");
+    const esp_err_t err = httpd_query_key_value(q, "paths", paths, sizeof(paths));
+    if (err == ESP_ERR_NOT_FOUND)
+    {
+        return ESP_OK;
+    }
+    ESP_RETURN_ON_ERROR(err, TAG, "get paths");
+    httpd_util_url_decode(paths);
+    *resources = 0;
+    for (const char *path = paths; *path;)
+    {
+        // "/relay" and "relay" name the same resource
+        const size_t len = strcspn(path, ",");
+        const size_t skip = path[0] == '/';
+        resource_t r = 0;
+        while (r < RESOURCE_MAX &&
+               (len - skip != strlen(RESOURCE_NAMES[r]) || strncmp(path + skip, RESOURCE_NAMES[r], len - skip) != 0))
+        {
+            r++;
+        }
+        ESP_RETURN_ON_FALSE(r < RESOURCE_MAX, ESP_ERR_NOT_FOUND, TAG, "unknown path '%.*s'", (int)len, path);
+        *resources |= 1u << r;
+        path += len + (path[len] == ',');
+    }
+    return ESP_OK;
+}
+
+// GET [prefix]/batch[?paths=<path>[,<path>...]][&fields=<field>[,<field>...]]: the resources at the paths (any
+// of /relay, /temperature and /flow, all of them by default) as members of one object named after them, with
+// their fields prefixed by the name (e.g. "?paths=/relay,/flow&fields=relay.state,flow.current_rate"). The
+// resources are all read before any is written, so they are as of the same moment.
+static esp_err_t get_batch(httpd_req_t *req)
+{
+    const httpd_zone_context_t *zone = (const httpd_zone_context_t *)req->user_ctx;
+    uint32_t resources;
+    if (parse_paths(req, &resources) != ESP_OK)
+    {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                                   "expecting [?paths=/relay|/temperature|/flow[,...]][&fields=<field>[,...]]");
+    }
+    ESP_LOGI(TAG, "Getting batch 0x%x", (unsigned)resources);
+    relay_data_t relay = {};
+    temperature_delta_sensor_data_t temperature;
+    temperature_delta_sensor_health_t health;
+    pulse_sensor_data_t flow = {0};
+    if (resources & (1u << RESOURCE_RELAY))
+    {
+        ESP_RETURN_ON_ERROR(relay_get_data(zone->relay, &relay), TAG, "get relay data");
+    }
+    if (resources & (1u << RESOURCE_TEMPERATURE))
+    {
+        ESP_RETURN_ON_ERROR(temperature_delta_sensor_get_data(zone->temperature_delta_sensor, &temperature), TAG,
+                            "get temperature data");
+        ESP_RETURN_ON_ERROR(temperature_delta_sensor_get_health(zone->temperature_delta_sensor, &health), TAG,
+                            "get temperature health");
+    }
+    if (resources & (1u << RESOURCE_FLOW))
+    {
+        ESP_RETURN_ON_ERROR(pulse_sensor_get_data(zone->flow_sensor, &flow), TAG, "get flow data");
+    }
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    if (resources & (1u << RESOURCE_RELAY))
+    {
+        httpd_util_json_object_begin(&json, RESOURCE_NAMES[RESOURCE_RELAY]);
+        httpd_relay_write(&json, zone->relay, &relay);
+        httpd_util_json_object_end(&json);
+    }
+    if (resources & (1u << RESOURCE_TEMPERATURE))
+    {
+        httpd_util_json_object_begin(&json, RESOURCE_NAMES[RESOURCE_TEMPERATURE]);
+        httpd_temperature_delta_sensor_write(&json, zone->temperature_delta_sensor, &temperature, &health);
+        httpd_util_json_object_end(&json);
+    }
+    if (resources & (1u << RESOURCE_FLOW))
+    {
+        httpd_util_json_object_begin(&json, RESOURCE_NAMES[RESOURCE_FLOW]);
+        httpd_flow_sensor_write(&json, &flow);
+        httpd_util_json_object_end(&json);
+    }
+    return httpd_util_json_end(&json);
+}
+
+esp_err_t httpd_batch_register_handlers(const httpd_handle_t httpd, const char *prefix,
+                                        const httpd_zone_context_t *zone)
+{
+    const httpd_uri_t handlers[] = {
+        {.user_ctx = (void *)zone, .method = HTTP_GET, .uri = "/batch", .handler = get_batch},
+    };
+    return httpd_util_register_prefixed_handlers(TAG, httpd, prefix, handlers,
+                                                 sizeof(handlers) / sizeof(httpd_uri_t));
+}
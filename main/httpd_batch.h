@@ -0,0 +1,7 @@
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "httpd.h"
+
+// Serves GET [prefix]/batch: the relay, temperature and flow of zone (which must outlive the server) at once.
+esp_err_t httpd_batch_register_handlers(const httpd_handle_t httpd, const char *prefix,
+                                        const httpd_zone_context_t *zone);
@@ -0,0 +1,150 @@
+#include <math.h>
+#include <stdlib.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include "httpd_util.h"
+#include "httpd_config.h"
+
+#define USEC_IN_SEC (double)1000000
+#define MAX_BODY_SIZE 256
+
+static const char *TAG = "httpd_config";
+
+static const char *const USAGE = "expecting [max_temperature_delta=<°C>][&min_temperature_delta=<°C>]"
+                                 "[&min_off_duration=<s>][&min_on_duration=<s>][&max_on_duration=<s>]";
+
+// Deltas are in °C, durations in seconds.
+static esp_err_t send_config(httpd_req_t *req, const pump_control_config_t *control)
+{
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    httpd_util_json_float(&json, "max_temperature_delta", control->max_temperature_delta);
+    httpd_util_json_float(&json, "min_temperature_delta", control->min_temperature_delta);
+    httpd_util_json_number(&json, "min_off_duration", control->min_off_duration / USEC_IN_SEC);
+    httpd_util_json_number(&json, "min_on_duration", control->min_on_duration / USEC_IN_SEC);
+    httpd_util_json_number(&json, "max_on_duration", control->max_on_duration / USEC_IN_SEC);
+    return httpd_util_json_end(&json);
+}
+
+static esp_err_t get_config(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Getting config");
+    pump_control_config_t control;
+    ESP_RETURN_ON_ERROR(zone_get_control_config((zone_t)req->user_ctx, &control), TAG, "get config");
+    return send_config(req, &control);
+}
+
+// Reads the whole body (a form: key=value pairs separated by "&") into buf.
+static esp_err_t read_body(httpd_req_t *req, char *buf, size_t size)
+{
+    ESP_RETURN_ON_FALSE(req->content_len && req->content_len < size, ESP_ERR_INVALID_SIZE, TAG,
+                        "invalid body length %u", (unsigned)req->content_len);
+    size_t len = 0;
+    while (len < req->content_len)
+    {
+        const int received = httpd_req_recv(req, buf + len, req->content_len - len);
+        ESP_RETURN_ON_FALSE(received > 0, ESP_FAIL, TAG, "receive body: %d", received);
+        len += received;
+    }
+    buf[len] = '\0';
+    return ESP_OK;
+}
+
+// Parses the value of key in form, if any, into *value, and then sets *found.
+static esp_err_t parse_value(const char *form, const char *key, double max, double *value, bool *found)
+{
+    char text[16];
+    if (httpd_query_key_value(form, key, text, sizeof(text)) != ESP_OK)
+    {
+        return ESP_OK;
+    }
+    char *end;
+    *value = strtod(text, &end);
+    // written so that NANs fail
+    ESP_RETURN_ON_FALSE(end != text && !*end && *value >= 0 && *value <= max, ESP_ERR_INVALID_ARG, TAG,
+                        "invalid %s '%s'", key, text);
+    *found = true;
+    return ESP_OK;
+}
+
+static esp_err_t parse_delta(const char *form, const char *key, float *delta, bool *found)
+{
+    double value;
+    bool present = false;
+    ESP_RETURN_ON_ERROR(parse_value(form, key, 100, &value, &present), TAG, "parse");
+    if (present)
+    {
+        *delta = value;
+        *found = true;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t parse_duration(const char *form, const char *key, uint64_t *duration, bool *found)
+{
+    double value;
+    bool present = false;
+    ESP_RETURN_ON_ERROR(parse_value(form, key, PUMP_CONTROL_MAX_DURATION / USEC_IN_SEC, &value, &present), TAG,
+                        "parse");
+    if (present)
+    {
+        *duration = llround(value * USEC_IN_SEC);
+        *found = true;
+    }
+    return ESP_OK;
+}
+
+// Sets the keys present in the form; the others keep their current values.
+static esp_err_t parse_config(const char *form, pump_control_config_t *control)
+{
+    bool found = false;
+    ESP_RETURN_ON_ERROR(parse_delta(form, "max_temperature_delta", &control->max_temperature_delta, &found), TAG,
+                        "parse max_temperature_delta");
+    ESP_RETURN_ON_ERROR(parse_delta(form, "min_temperature_delta", &control->min_temperature_delta, &found), TAG,
+                        "parse min_temperature_delta");
+    ESP_RETURN_ON_ERROR(parse_duration(form, "min_off_duration", &control->min_off_duration, &found), TAG,
+                        "parse min_off_duration");
+    ESP_RETURN_ON_ERROR(parse_duration(form, "min_on_duration", &control->min_on_duration, &found), TAG,
+                        "parse min_on_duration");
+    ESP_RETURN_ON_ERROR(parse_duration(form, "max_on_duration", &control->max_on_duration, &found), TAG,
+                        "parse max_on_duration");
+    ESP_RETURN_ON_FALSE(found, ESP_ERR_NOT_FOUND, TAG, "no known key");
+    return ESP_OK;
+}
+
+/*
+ * Sets the thresholds from a form body (e.g. "max_temperature_delta=6.5&min_on_duration=90"), and
+ * answers with all of them. The control task switches to them with its next message.
+ */
+static esp_err_t put_config(httpd_req_t *req)
+{
+    const zone_t zone = (zone_t)req->user_ctx;
+    char form[MAX_BODY_SIZE];
+    pump_control_config_t control;
+    ESP_RETURN_ON_ERROR(zone_get_control_config(zone, &control), TAG, "get config");
+    if (read_body(req, form, sizeof(form)) != ESP_OK || parse_config(form, &control) != ESP_OK)
+    {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, USAGE);
+    }
+    ESP_LOGI(TAG, "Setting config: %s", form);
+    const esp_err_t err = zone_set_control_config(zone, &control);
+    if (err == ESP_ERR_INVALID_ARG)
+    {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                                   "expecting 0 < min_temperature_delta < max_temperature_delta and "
+                                   "min_on_duration <= max_on_duration, with 0 < max_on_duration");
+    }
+    ESP_RETURN_ON_ERROR(err, TAG, "set config");
+    return send_config(req, &control);
+}
+
+esp_err_t httpd_config_register_handlers(const httpd_handle_t httpd, const char *prefix, const zone_t zone)
+{
+    const httpd_uri_t handlers[] = {
+        {.user_ctx = zone, .method = HTTP_GET, .uri = "/config", .handler = get_config},
+        {.user_ctx = zone, .method = HTTP_PUT, .uri = "/config", .handler = put_config},
+    };
+    return httpd_util_register_prefixed_handlers(TAG, httpd, prefix, handlers,
+                                                 sizeof(handlers) / sizeof(httpd_uri_t));
+}
@@ -0,0 +1,5 @@
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "zone.h"
+
+esp_err_t httpd_config_register_handlers(const httpd_handle_t httpd, const char *prefix, const zone_t zone);
@@ -0,0 +1,43 @@
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include "dashboard.h"
+#include "httpd_util.h"
+#include "httpd_dashboard.h"
+
+static const char *TAG = "httpd_dashboard";
+
+/*
+ * Sends the asset gzipped, whatever the request's Accept-Encoding: every browser accepts it, and the
+ * device has no other copy. A request naming its ETag gets a 304 without the body.
+ */
+static esp_err_t get_asset(httpd_req_t *req)
+{
+    const dashboard_asset_t *asset = (const dashboard_asset_t *)req->user_ctx;
+    ESP_RETURN_ON_ERROR(httpd_resp_set_hdr(req, "ETag", asset->etag), TAG, "send ETag");
+    ESP_RETURN_ON_ERROR(httpd_resp_set_hdr(req, "Cache-Control", asset->cache_control), TAG, "send Cache-Control");
+    if (httpd_util_etag_matches(req, asset->etag))
+    {
+        ESP_LOGD(TAG, "Not modified: %s", asset->uri);
+        ESP_RETURN_ON_ERROR(httpd_resp_set_status(req, "304 Not Modified"), TAG, "send 304");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    ESP_LOGI(TAG, "Sending %s (%u bytes)", asset->uri, (unsigned)asset->size);
+    ESP_RETURN_ON_ERROR(httpd_resp_set_type(req, asset->type), TAG, "send content type");
+    ESP_RETURN_ON_ERROR(httpd_resp_set_hdr(req, "Content-Encoding", "gzip"), TAG, "send Content-Encoding");
+    return httpd_resp_send(req, (const char *)asset->data, asset->size);
+}
+
+esp_err_t httpd_dashboard_register_handlers(const httpd_handle_t httpd)
+{
+    for (size_t i = 0; i < dashboard_asset_count; i++)
+    {
+        const httpd_uri_t handler = {.user_ctx = (void *)&dashboard_assets[i],
+                                     .method = HTTP_GET,
+                                     .uri = dashboard_assets[i].uri,
+                                     .handler = get_asset};
+        ESP_RETURN_ON_ERROR(httpd_register_uri_handler(httpd, &handler), TAG, "register GET %s",
+                            dashboard_assets[i].uri);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,5 @@
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+// Serves the dashboard at / (see dashboard.h); one handler per asset.
+esp_err_t httpd_dashboard_register_handlers(const httpd_handle_t httpd);
@@ -0,0 +1,230 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include "sdkconfig.h"
+#include "httpd_util.h"
+#include "httpd_events.h"
+
+#define KEEPALIVE_PERIOD pdMS_TO_TICKS(15000) // comment sent to idle subscribers, to detect closed sockets
+#define RETRY_DELAY 5000                      // milliseconds a client waits before reconnecting
+#define STOP_WARN_PERIOD pdMS_TO_TICKS(5000)  // how often a stop still waiting for a worker (in a send) says so
+#define STOP_POLL pdMS_TO_TICKS(50)
+
+static const char *TAG = "httpd_events";
+
+struct httpd_events_s
+{
+    event_stream_t stream;
+    QueueHandle_t requests;                         /// async requests waiting for a worker
+    TaskHandle_t workers[CONFIG_MAX_ASYNC_REQUESTS]; /// one subscriber each
+    atomic_uint idle;                               /// workers waiting for a request
+    atomic_bool stopped;                            /// the server is stopping: sessions end, none start
+    atomic_uint sessions;
+    atomic_uint rejected;
+    atomic_uint sent;
+    atomic_uint missed;
+};
+
+static esp_err_t send_retained(httpd_events_t events, httpd_req_t *req, char *buf)
+{
+    size_t len;
+    for (size_t i = 0; !events->stopped; i++)
+    {
+        if (event_stream_read_retained(events->stream, i, buf, EVENT_STREAM_MESSAGE_SIZE, &len) != ESP_OK)
+        {
+            break;
+        }
+        ESP_RETURN_ON_ERROR(httpd_resp_send_chunk(req, buf, len), TAG, "send retained");
+        events->sent++;
+    }
+    return ESP_OK;
+}
+
+// Streams to one subscriber until a send fails (the client went away) or the server stops.
+static void serve(httpd_events_t events, httpd_req_t *req)
+{
+    char buf[EVENT_STREAM_MESSAGE_SIZE];
+    uint32_t cursor;
+    esp_err_t err = event_stream_subscribe(events->stream, xTaskGetCurrentTaskHandle(), &cursor);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Subscribe: %d", err);
+        return;
+    }
+    // subscribed first, so that nothing published while the current state is sent is lost
+    err = httpd_resp_send_chunk(req, buf, snprintf(buf, sizeof(buf), "retry: %d\n\n", RETRY_DELAY));
+    if (err == ESP_OK)
+    {
+        err = send_retained(events, req, buf);
+    }
+    while (err == ESP_OK && !events->stopped)
+    {
+        const bool notified = ulTaskNotifyTake(pdTRUE, KEEPALIVE_PERIOD);
+        size_t len;
+        uint32_t missed;
+        while (err == ESP_OK && !events->stopped &&
+               event_stream_read(events->stream, &cursor, buf, sizeof(buf), &len, &missed) == ESP_OK)
+        {
+            if (missed)
+            {
+                // fell behind: the retained messages bring the client back to the current state
+                ESP_LOGW(TAG, "Subscriber missed %lu messages", (unsigned long)missed);
+                events->missed += missed;
+                err = send_retained(events, req, buf);
+                continue;
+            }
+            err = httpd_resp_send_chunk(req, buf, len);
+            events->sent++;
+        }
+        if (err == ESP_OK && !notified && !events->stopped)
+        {
+            err = httpd_resp_sendstr_chunk(req, ":\n\n");
+        }
+    }
+    if (err == ESP_OK)
+    {
+        // the last chunk ends the response, so that the client reconnects once the server is back
+        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_resp_send_chunk(req, NULL, 0));
+    }
+    ESP_ERROR_CHECK_WITHOUT_ABORT(event_stream_unsubscribe(events->stream, xTaskGetCurrentTaskHandle()));
+}
+
+static void worker_task(void *args)
+{
+    const httpd_events_t events = (httpd_events_t)args;
+    httpd_req_t *req;
+    while (true)
+    {
+        if (!xQueueReceive(events->requests, &req, portMAX_DELAY))
+        {
+            continue;
+        }
+        if (!events->stopped)
+        {
+            ESP_LOGI(TAG, "Subscriber connected");
+            serve(events, req);
+            ESP_LOGI(TAG, "Subscriber disconnected");
+        }
+        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_req_async_handler_complete(req));
+        events->idle++;
+    }
+}
+
+esp_err_t httpd_events_open(event_stream_t stream, httpd_events_t *events_out)
+{
+    esp_err_t ret = ESP_FAIL;
+    ESP_GOTO_ON_FALSE(stream && events_out, ESP_ERR_INVALID_ARG, handle_error, TAG, "null");
+    const httpd_events_t events = calloc(1, sizeof(struct httpd_events_s));
+    ESP_GOTO_ON_FALSE(events, ESP_ERR_NO_MEM, handle_error, TAG, "malloc events");
+    events->stream = stream;
+    events->requests = xQueueCreate(CONFIG_MAX_ASYNC_REQUESTS, sizeof(httpd_req_t *));
+    ESP_GOTO_ON_FALSE(events->requests, ESP_ERR_NO_MEM, free_events, TAG, "create queue");
+    int i = 0;
+    for (; i < CONFIG_MAX_ASYNC_REQUESTS; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Events worker %d", i);
+        ESP_GOTO_ON_FALSE(xTaskCreate(worker_task, name, 3072, events, 1, &events->workers[i]) == pdPASS,
+                          ESP_ERR_NO_MEM, delete_workers, TAG, "create worker %d", i);
+    }
+    events->idle = CONFIG_MAX_ASYNC_REQUESTS;
+    *events_out = events;
+    ESP_LOGI(TAG, "Opened with %d workers", CONFIG_MAX_ASYNC_REQUESTS);
+    return ESP_OK;
+delete_workers:
+    while (i--)
+    {
+        vTaskDelete(events->workers[i]);
+    }
+    vQueueDelete(events->requests);
+free_events:
+    free(events);
+handle_error:
+    return ret;
+}
+
+esp_err_t httpd_events_get_data(httpd_events_t events, httpd_events_data_t *data)
+{
+    ESP_RETURN_ON_FALSE(events && data, ESP_ERR_INVALID_ARG, TAG, "null");
+    data->subscribers = CONFIG_MAX_ASYNC_REQUESTS - events->idle;
+    data->sessions = events->sessions;
+    data->rejected = events->rejected;
+    data->sent = events->sent;
+    data->missed = events->missed;
+    return ESP_OK;
+}
+
+esp_err_t httpd_events_stop(httpd_events_t events)
+{
+    ESP_RETURN_ON_FALSE(events, ESP_ERR_INVALID_ARG, TAG, "null");
+    events->stopped = true;
+    for (int i = 0; i < CONFIG_MAX_ASYNC_REQUESTS; i++)
+    {
+        xTaskNotifyGive(events->workers[i]);
+    }
+    // a worker in a send ends its session when the send returns, which the socket's send timeout bounds
+    TickType_t waited = 0;
+    while (events->idle < CONFIG_MAX_ASYNC_REQUESTS)
+    {
+        vTaskDelay(STOP_POLL);
+        waited += STOP_POLL;
+        if (waited % STOP_WARN_PERIOD == 0)
+        {
+            ESP_LOGW(TAG, "Stopping: %u subscribers still served",
+                     CONFIG_MAX_ASYNC_REQUESTS - (unsigned int)events->idle);
+        }
+    }
+    ESP_LOGI(TAG, "Stopped");
+    return ESP_OK;
+}
+
+static esp_err_t get_events(httpd_req_t *req)
+{
+    const httpd_events_t events = (httpd_events_t)req->user_ctx;
+    if (events->stopped)
+    {
+        ESP_RETURN_ON_ERROR(httpd_resp_set_status(req, "503 Service Unavailable"), TAG, "send 503");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    // claim a worker up front, so that the request is never queued behind a busy one
+    unsigned int idle = events->idle;
+    while (idle && !atomic_compare_exchange_weak(&events->idle, &idle, idle - 1))
+    {
+    }
+    if (!idle)
+    {
+        events->rejected++;
+        ESP_LOGW(TAG, "Refused subscriber: all %d workers busy", CONFIG_MAX_ASYNC_REQUESTS);
+        ESP_RETURN_ON_ERROR(httpd_resp_set_status(req, "503 Service Unavailable"), TAG, "send 503");
+        ESP_RETURN_ON_ERROR(httpd_resp_set_hdr(req, "Retry-After", "30"), TAG, "send Retry-After");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    esp_err_t ret = ESP_OK;
+    httpd_req_t *async_req = NULL;
+    ESP_GOTO_ON_ERROR(httpd_resp_set_type(req, "text/event-stream"), release_worker, TAG, "send content type");
+    ESP_GOTO_ON_ERROR(httpd_resp_set_hdr(req, "Cache-Control", "no-cache"), release_worker, TAG, "send Cache-Control");
+    ESP_GOTO_ON_ERROR(httpd_req_async_handler_begin(req, &async_req), release_worker, TAG, "begin async request");
+    // the queue has room for every worker, and a worker was claimed above
+    xQueueSend(events->requests, &async_req, 0);
+    events->sessions++;
+    return ESP_OK;
+release_worker:
+    events->idle++;
+    return ret;
+}
+
+esp_err_t httpd_events_register_handlers(const httpd_handle_t httpd, const httpd_events_t events)
+{
+    // registered as the server starts (again)
+    events->stopped = false;
+    const httpd_uri_t handlers[] = {
+        {.user_ctx = events, .method = HTTP_GET, .uri = "/events", .handler = get_events},
+    };
+    return httpd_util_register_handlers(TAG, httpd, handlers, sizeof(handlers) / sizeof(httpd_uri_t));
+}
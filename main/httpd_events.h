@@ -0,0 +1,41 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "event_stream.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Serves an event stream as Server-Sent Events on GET /events. Each subscriber is an async request
+     * served by its own worker task (CONFIG_MAX_ASYNC_REQUESTS of them), so a client that is slow to
+     * read only delays itself; the httpd task and the publishers never wait for it.
+     */
+    typedef struct httpd_events_s *httpd_events_t;
+
+    typedef struct
+    {
+        uint32_t subscribers; /// subscribers currently connected
+        uint32_t sessions;    /// subscriptions served since open
+        uint32_t rejected;    /// subscriptions refused because every worker was busy
+        uint32_t sent;        /// messages sent
+        uint32_t missed;      /// messages skipped because a subscriber fell behind the ring
+    } httpd_events_data_t;
+
+    // Created once: the workers outlive restarts of the web server.
+    esp_err_t httpd_events_open(event_stream_t stream, httpd_events_t *events_out);
+    esp_err_t httpd_events_get_data(httpd_events_t events, httpd_events_data_t *data);
+    /*
+     * Ends every session and waits for the workers to complete their requests; call it before stopping the
+     * server, which frees them. New subscriptions are refused until the handlers are registered again.
+     */
+    esp_err_t httpd_events_stop(httpd_events_t events);
+
+    esp_err_t httpd_events_register_handlers(const httpd_handle_t httpd, const httpd_events_t events);
+
+#ifdef __cplusplus
+}
+#endif
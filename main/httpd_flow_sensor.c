@@ -1,7 +1,6 @@
 #include <esp_check.h>
 #include <esp_log.h>
 #include <esp_http_server.h>
-#include <cJSON.h>
 #include "httpd_util.h"
 #include "pulse_sensor.h"
 #include "httpd_flow_sensor.h"
@@ -12,26 +11,31 @@ static const char *TAG = "httpd_pulse_sensor";
 
 // TODO: add units (liters vs gallons vs pulses)
 
-static esp_err_t add_current_cycle_attrs(cJSON *object, pulse_sensor_data_t *data)
+static void add_current_cycle_attrs(httpd_util_json_t *json, const pulse_sensor_data_t *data)
 {
-    ESP_RETURN_ON_FALSE(object, ESP_ERR_NO_MEM, TAG, "null object");
-    ESP_RETURN_ON_FALSE(data, ESP_ERR_NO_MEM, TAG, "null data");
-    ESP_RETURN_ON_FALSE(cJSON_AddNumberToObject(object, "pulses", data->current_cycle_pulses), ESP_ERR_NO_MEM, TAG, "add current_cycle_pulses");
-    ESP_RETURN_ON_FALSE(cJSON_AddNumberToObject(object, "duration", pulse_sensor_get_current_cycle_duration(data) / USEC_IN_SEC), ESP_ERR_NO_MEM, TAG, "add current_cycle_duration");
-    ESP_RETURN_ON_FALSE(cJSON_AddNumberToObject(object, "rate", pulse_sensor_get_current_cycle_rate(data)), ESP_ERR_NO_MEM, TAG, "add current_cycle_rate");
-    return ESP_OK;
+    httpd_util_json_number(json, "pulses", data->current_cycle_pulses);
+    httpd_util_json_float(json, "duration", pulse_sensor_get_current_cycle_duration(data) / USEC_IN_SEC);
+    httpd_util_json_float(json, "rate", pulse_sensor_get_current_cycle_rate(data));
 }
 
-static esp_err_t add_totals_attrs(cJSON *object, pulse_sensor_data_t *data)
+static void add_totals_attrs(httpd_util_json_t *json, const pulse_sensor_data_t *data)
 {
-    ESP_RETURN_ON_FALSE(object, ESP_ERR_NO_MEM, TAG, "null object");
-    ESP_RETURN_ON_FALSE(data, ESP_ERR_NO_MEM, TAG, "null data");
-    ESP_RETURN_ON_FALSE(cJSON_AddNumberToObject(object, "pulses", data->total_pulses), ESP_ERR_NO_MEM, TAG, "add total_pulses");
-    ESP_RETURN_ON_FALSE(cJSON_AddNumberToObject(object, "duration", data->total_duration / USEC_IN_SEC), ESP_ERR_NO_MEM, TAG, "add total_duration");
-    ESP_RETURN_ON_FALSE(cJSON_AddNumberToObject(object, "rate", pulse_sensor_get_total_rate(data)), ESP_ERR_NO_MEM, TAG, "add total_rate");
-    ESP_RETURN_ON_FALSE(cJSON_AddNumberToObject(object, "cycles", data->cycles), ESP_ERR_NO_MEM, TAG, "add cycles");
-    ESP_RETURN_ON_FALSE(cJSON_AddNumberToObject(object, "partial_cycles", data->partial_cycles), ESP_ERR_NO_MEM, TAG, "add partial_cycles");
-    return ESP_OK;
+    httpd_util_json_number(json, "pulses", data->total_pulses);
+    httpd_util_json_float(json, "duration", data->total_duration / USEC_IN_SEC);
+    httpd_util_json_float(json, "rate", pulse_sensor_get_total_rate(data));
+    httpd_util_json_number(json, "cycles", data->cycles);
+    httpd_util_json_number(json, "partial_cycles", data->partial_cycles);
+}
+
+void httpd_flow_sensor_write(httpd_util_json_t *json, const pulse_sensor_data_t *data)
+{
+    httpd_util_json_float(json, "current_rate", pulse_sensor_get_current_rate(data));
+    httpd_util_json_object_begin(json, "current_cycle");
+    add_current_cycle_attrs(json, data);
+    httpd_util_json_object_end(json);
+    httpd_util_json_object_begin(json, "totals");
+    add_totals_attrs(json, data);
+    httpd_util_json_object_end(json);
 }
 
 static esp_err_t get_all(httpd_req_t *req)
@@ -39,16 +43,10 @@ static esp_err_t get_all(httpd_req_t *req)
     ESP_LOGI(TAG, "Getting all");
     pulse_sensor_data_t data = {0};
     ESP_RETURN_ON_ERROR(pulse_sensor_get_data((pulse_sensor_t)req->user_ctx, &data), TAG, "get data");
-    cJSON *object = cJSON_CreateObject();
-    ESP_RETURN_ON_FALSE(object, ESP_ERR_NO_MEM, TAG, "create json object");
-    esp_err_t ret = ESP_OK;
-    ESP_GOTO_ON_FALSE(cJSON_AddNumberToObject(object, "current_rate", pulse_sensor_get_current_rate(&data)), ESP_ERR_NO_MEM, free_object, TAG, "add current_rate");
-    ESP_GOTO_ON_ERROR(add_current_cycle_attrs(cJSON_AddObjectToObject(object, "current_cycle"), &data), free_object, TAG, "add current_cycle");
-    ESP_GOTO_ON_ERROR(add_totals_attrs(cJSON_AddObjectToObject(object, "totals"), &data), free_object, TAG, "add totals");
-    ESP_GOTO_ON_ERROR(httpd_util_send_json_object(TAG, req, object), free_object, TAG, "send JSON");
-free_object:
-    cJSON_Delete(object);
-    return ret;
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    httpd_flow_sensor_write(&json, &data);
+    return httpd_util_json_end(&json);
 }
 
 static esp_err_t get_current_cycle(httpd_req_t *req)
@@ -56,14 +54,10 @@ static esp_err_t get_current_cycle(httpd_req_t *req)
     ESP_LOGI(TAG, "Getting current_cycle");
     pulse_sensor_data_t data = {0};
     ESP_RETURN_ON_ERROR(pulse_sensor_get_data((pulse_sensor_t)req->user_ctx, &data), TAG, "get data");
-    cJSON *object = cJSON_CreateObject();
-    ESP_RETURN_ON_FALSE(object, ESP_ERR_NO_MEM, TAG, "create json object");
-    esp_err_t ret = ESP_OK;
-    ESP_GOTO_ON_ERROR(add_current_cycle_attrs(object, &data), free_object, TAG, "add attrs");
-    ESP_GOTO_ON_ERROR(httpd_util_send_json_object(TAG, req, object), free_object, TAG, "send JSON");
-free_object:
-    cJSON_Delete(object);
-    return ret;
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    add_current_cycle_attrs(&json, &data);
+    return httpd_util_json_end(&json);
 }
 
 static esp_err_t get_totals(httpd_req_t *req)
@@ -71,23 +65,36 @@ static esp_err_t get_totals(httpd_req_t *req)
     ESP_LOGI(TAG, "Getting totals");
     pulse_sensor_data_t data = {0};
     ESP_RETURN_ON_ERROR(pulse_sensor_get_data((pulse_sensor_t)req->user_ctx, &data), TAG, "get data");
-    cJSON *object = cJSON_CreateObject();
-    ESP_RETURN_ON_FALSE(object, ESP_ERR_NO_MEM, TAG, "create json object");
-    esp_err_t ret = ESP_OK;
-    ESP_GOTO_ON_ERROR(add_totals_attrs(object, &data), free_object, TAG, "add attrs");
-    ESP_GOTO_ON_ERROR(httpd_util_send_json_object(TAG, req, object), free_object, TAG, "send JSON");
-free_object:
-    cJSON_Delete(object);
-    return ret;
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    add_totals_attrs(&json, &data);
+    return httpd_util_json_end(&json);
+}
+
+// The statistics of the current rate, sampled every second; the windows are in seconds.
+static esp_err_t get_rate(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Getting rate");
+    const window_stats_t stats = (window_stats_t)req->user_ctx;
+    window_stats_summary_t summary;
+    ESP_RETURN_ON_ERROR(window_stats_get(stats, 0, &summary), TAG, "get stats");
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    httpd_util_json_number(&json, "samples", summary.count);
+    httpd_util_json_float(&json, "average", summary.mean);
+    httpd_util_json_window_stats(&json, stats, &summary);
+    return httpd_util_json_end(&json);
 }
 
-esp_err_t httpd_flow_sensor_register_handlers(const httpd_handle_t httpd,
-                                              const pulse_sensor_t sensor)
+esp_err_t httpd_flow_sensor_register_handlers(const httpd_handle_t httpd, const char *prefix,
+                                              const pulse_sensor_t sensor, const window_stats_t rate_stats)
 {
     httpd_uri_t handlers[] = {
         {.user_ctx = sensor, .method = HTTP_GET, .uri = "/flow", .handler = get_all},
         {.user_ctx = sensor, .method = HTTP_GET, .uri = "/flow/current_cycle", .handler = get_current_cycle},
         {.user_ctx = sensor, .method = HTTP_GET, .uri = "/flow/totals", .handler = get_totals},
+        {.user_ctx = rate_stats, .method = HTTP_GET, .uri = "/flow/rate", .handler = get_rate},
     };
-    return httpd_util_register_handlers(TAG, httpd, handlers, sizeof(handlers) / sizeof(httpd_uri_t));
+    const size_t count = sizeof(handlers) / sizeof(httpd_uri_t);
+    return httpd_util_register_prefixed_handlers(TAG, httpd, prefix, handlers, rate_stats ? count : count - 1);
 }
@@ -1,5 +1,11 @@
 #include <esp_err.h>
 #include <esp_http_server.h>
+#include "httpd_util.h"
 #include "pulse_sensor.h"
+#include "window_stats.h"
 
-esp_err_t httpd_flow_sensor_register_handlers(const httpd_handle_t httpd, const pulse_sensor_t sensor);
+// rate_stats (of the current rate, in pulses/s) are served on /flow/rate unless NULL.
+esp_err_t httpd_flow_sensor_register_handlers(const httpd_handle_t httpd, const char *prefix,
+                                              const pulse_sensor_t sensor, const window_stats_t rate_stats);
+// Writes the body of GET /flow (from data, read by the caller) into the current object of json.
+void httpd_flow_sensor_write(httpd_util_json_t *json, const pulse_sensor_data_t *data);
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_http_server.h>
+#include "httpd_util.h"
+#include "httpd_history.h"
+
+#define USEC_IN_SEC (double)1000000
+#define ENTRIES_PER_READ 16 // history entries copied per acquisition of the history lock
+
+static const char *TAG = "httpd_history";
+
+static const char *const TIER_NAMES[HISTORY_TIERS] = {"raw", "minute", "hour"};
+
+typedef struct
+{
+    int series;
+    history_tier_t tier;
+    int64_t from; /// microseconds since boot
+    int64_t to;   /// microseconds since boot
+} query_t;
+
+// Parses "?series=<name>[&tier=raw|minute|hour][&from=<s>][&to=<s>]", with times in seconds since boot.
+static esp_err_t parse_query(httpd_req_t *req, history_t history, query_t *query)
+{
+    char q[128];
+    char value[32];
+    ESP_RETURN_ON_ERROR(httpd_req_get_url_query_str(req, q, sizeof(q)), TAG, "get query");
+    ESP_RETURN_ON_ERROR(httpd_query_key_value(q, "series", value, sizeof(value)), TAG, "get series");
+    query->series = history_find_series(history, value);
+    ESP_RETURN_ON_FALSE(query->series >= 0, ESP_ERR_NOT_FOUND, TAG, "unknown series '%s'", value);
+    query->tier = HISTORY_TIER_RAW;
+    if (httpd_query_key_value(q, "tier", value, sizeof(value)) == ESP_OK)
+    {
+        for (query->tier = 0; query->tier < HISTORY_TIERS; query->tier++)
+        {
+            if (strcmp(value, TIER_NAMES[query->tier]) == 0)
+            {
+                break;
+            }
+        }
+        ESP_RETURN_ON_FALSE(query->tier < HISTORY_TIERS, ESP_ERR_INVALID_ARG, TAG, "unknown tier '%s'", value);
+    }
+    query->from = 0;
+    if (httpd_query_key_value(q, "from", value, sizeof(value)) == ESP_OK)
+    {
+        query->from = strtod(value, NULL) * USEC_IN_SEC;
+    }
+    query->to = INT64_MAX;
+    if (httpd_query_key_value(q, "to", value, sizeof(value)) == ESP_OK)
+    {
+        query->to = strtod(value, NULL) * USEC_IN_SEC;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t get_history(httpd_req_t *req)
+{
+    const history_t history = (history_t)req->user_ctx;
+    query_t query;
+    if (parse_query(req, history, &query) != ESP_OK)
+    {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                                   "expecting ?series=<name>[&tier=raw|minute|hour][&from=<s>][&to=<s>]");
+    }
+    ESP_LOGI(TAG, "Getting %s history of series %d", TIER_NAMES[query.tier], query.series);
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    httpd_util_json_string(&json, "series", history_get_series_name(history, query.series));
+    httpd_util_json_string(&json, "tier", TIER_NAMES[query.tier]);
+    httpd_util_json_number(&json, "interval", history_get_tier_interval(query.tier) / USEC_IN_SEC);
+    httpd_util_json_array_begin(&json, "entries");
+
+    // entries are copied a few at a time, so that neither the history lock nor the range is held in full
+    history_entry_t entries[ENTRIES_PER_READ];
+    int64_t cursor = query.from;
+    size_t count;
+    do
+    {
+        ESP_RETURN_ON_ERROR(history_read(history, query.series, query.tier, query.to, &cursor,
+                                         entries, ENTRIES_PER_READ, &count),
+                            TAG, "read history");
+        for (size_t i = 0; i < count; i++)
+        {
+            httpd_util_json_array_begin(&json, NULL);
+            httpd_util_json_number(&json, NULL, entries[i].timestamp / USEC_IN_SEC);
+            if (query.tier == HISTORY_TIER_RAW)
+            {
+                httpd_util_json_float(&json, NULL, entries[i].mean);
+            }
+            else
+            {
+                httpd_util_json_float(&json, NULL, entries[i].min);
+                httpd_util_json_float(&json, NULL, entries[i].max);
+                httpd_util_json_float(&json, NULL, entries[i].mean);
+            }
+            httpd_util_json_array_end(&json);
+        }
+    } while (count == ENTRIES_PER_READ);
+    httpd_util_json_array_end(&json);
+    return httpd_util_json_end(&json);
+}
+
+esp_err_t httpd_history_register_handlers(const httpd_handle_t httpd, const char *prefix,
+                                          const history_t history)
+{
+    const httpd_uri_t handlers[] = {
+        {.user_ctx = history, .method = HTTP_GET, .uri = "/history", .handler = get_history},
+    };
+    return httpd_util_register_prefixed_handlers(TAG, httpd, prefix, handlers,
+                                                 sizeof(handlers) / sizeof(httpd_uri_t));
+}
@@ -0,0 +1,6 @@
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "history.h"
+
+esp_err_t httpd_history_register_handlers(const httpd_handle_t httpd, const char *prefix,
+                                          const history_t history);
@@ -0,0 +1,109 @@
+#include <math.h>
+#include <stdlib.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include "httpd_util.h"
+#include "httpd_journal.h"
+
+#define RECORDS_PER_READ 16 // journal records read from flash per acquisition of the journal lock
+
+static const char *TAG = "httpd_journal";
+
+// Parses "[?][from=<s>][&to=<s>]", with times in seconds since the epoch.
+static esp_err_t parse_query(httpd_req_t *req, uint32_t *from, uint32_t *to)
+{
+    char q[64];
+    char value[16];
+    *from = 0;
+    *to = UINT32_MAX;
+    if (httpd_req_get_url_query_len(req) == 0)
+    {
+        return ESP_OK;
+    }
+    ESP_RETURN_ON_ERROR(httpd_req_get_url_query_str(req, q, sizeof(q)), TAG, "get query");
+    if (httpd_query_key_value(q, "from", value, sizeof(value)) == ESP_OK)
+    {
+        *from = strtoul(value, NULL, 10);
+    }
+    if (httpd_query_key_value(q, "to", value, sizeof(value)) == ESP_OK)
+    {
+        *to = strtoul(value, NULL, 10);
+    }
+    return ESP_OK;
+}
+
+static void add_record(httpd_util_json_t *json, const journal_record_t *record)
+{
+    httpd_util_json_object_begin(json, NULL);
+    httpd_util_json_number(json, "sequence", record->sequence);
+    // a record written before the clock was set has its time since boot
+    httpd_util_json_number(json, record->time < JOURNAL_CLOCK_SET_AFTER ? "uptime" : "time", record->time);
+    httpd_util_json_number(json, "zone", record->zone);
+    httpd_util_json_string(json, "type", journal_type_name(record->type));
+    switch (record->type)
+    {
+    case JOURNAL_PUMP_ON:
+        httpd_util_json_string(json, "reason", journal_reason_name(record->detail));
+        httpd_util_json_float(json, "temperature_delta",
+                              (int32_t)record->value == INT32_MIN ? NAN : (int32_t)record->value / 100.0f);
+        break;
+    case JOURNAL_PUMP_OFF:
+        httpd_util_json_string(json, "reason", journal_reason_name(record->detail));
+        httpd_util_json_number(json, "duration", record->value / 1000.0);
+        break;
+    case JOURNAL_FLOW_CYCLE:
+        httpd_util_json_number(json, "duration", record->detail);
+        httpd_util_json_number(json, "pulses", record->value);
+        break;
+    case JOURNAL_SENSOR_FAULT:
+        httpd_util_json_string(json, "error", esp_err_to_name((int16_t)record->detail));
+        break;
+    }
+    httpd_util_json_object_end(json);
+}
+
+// Durations are in seconds.
+static esp_err_t get_journal(httpd_req_t *req)
+{
+    const journal_t journal = (journal_t)req->user_ctx;
+    uint32_t from, to;
+    if (parse_query(req, &from, &to) != ESP_OK)
+    {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "expecting [?from=<s>][&to=<s>]");
+    }
+    ESP_LOGI(TAG, "Getting records from %lu to %lu", (unsigned long)from, (unsigned long)to);
+    journal_data_t data;
+    ESP_RETURN_ON_ERROR(journal_get_data(journal, &data), TAG, "get data");
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    httpd_util_json_number(&json, "first", data.first);
+    httpd_util_json_number(&json, "next", data.next);
+    httpd_util_json_number(&json, "capacity", data.capacity);
+    httpd_util_json_number(&json, "dropped", data.dropped);
+    httpd_util_json_array_begin(&json, "records");
+
+    // records are read a few at a time, so that neither the journal lock nor the range is held in full
+    journal_record_t records[RECORDS_PER_READ];
+    uint32_t cursor = data.first;
+    size_t count;
+    do
+    {
+        ESP_RETURN_ON_ERROR(journal_read(journal, from, to, &cursor, records, RECORDS_PER_READ, &count), TAG,
+                            "read journal");
+        for (size_t i = 0; i < count; i++)
+        {
+            add_record(&json, &records[i]);
+        }
+    } while (count == RECORDS_PER_READ);
+    httpd_util_json_array_end(&json);
+    return httpd_util_json_end(&json);
+}
+
+esp_err_t httpd_journal_register_handlers(const httpd_handle_t httpd, const journal_t journal)
+{
+    const httpd_uri_t handlers[] = {
+        {.user_ctx = journal, .method = HTTP_GET, .uri = "/journal", .handler = get_journal},
+    };
+    return httpd_util_register_handlers(TAG, httpd, handlers, sizeof(handlers) / sizeof(httpd_uri_t));
+}
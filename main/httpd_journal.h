@@ -0,0 +1,5 @@
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "journal.h"
+
+esp_err_t httpd_journal_register_handlers(const httpd_handle_t httpd, const journal_t journal);
@@ -0,0 +1,59 @@
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include "httpd_util.h"
+#include "httpd_latency.h"
+
+#if CONFIG_LATENCY_TRACE
+
+#define USEC_IN_MSEC (double)1000
+
+static const char *TAG = "httpd_latency";
+
+// Latencies are in milliseconds; buckets are [upper bound, count] pairs of the non-empty buckets (the bound of
+// the last bucket is the max).
+static esp_err_t get_latency(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Getting latency");
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    for (latency_trace_stage_t stage = 0; stage < LATENCY_TRACE_STAGE_MAX; stage++)
+    {
+        latency_trace_data_t data;
+        ESP_RETURN_ON_ERROR(latency_trace_get_data(stage, &data), TAG, "get data");
+        httpd_util_json_object_begin(&json, latency_trace_stage_name(stage));
+        httpd_util_json_number(&json, "count", data.count);
+        if (data.count)
+        {
+            httpd_util_json_number(&json, "mean", data.sum / USEC_IN_MSEC / data.count);
+            httpd_util_json_number(&json, "p50", latency_trace_get_quantile(&data, 0.5f) / USEC_IN_MSEC);
+            httpd_util_json_number(&json, "p99", latency_trace_get_quantile(&data, 0.99f) / USEC_IN_MSEC);
+            httpd_util_json_number(&json, "max", data.max / USEC_IN_MSEC);
+        }
+        httpd_util_json_array_begin(&json, "buckets");
+        for (size_t i = 0; i < LATENCY_TRACE_BUCKETS; i++)
+        {
+            if (data.buckets[i])
+            {
+                httpd_util_json_array_begin(&json, NULL);
+                const uint32_t bound = latency_trace_bucket_bound(i);
+                httpd_util_json_number(&json, NULL, (bound == UINT32_MAX ? data.max : bound) / USEC_IN_MSEC);
+                httpd_util_json_number(&json, NULL, data.buckets[i]);
+                httpd_util_json_array_end(&json);
+            }
+        }
+        httpd_util_json_array_end(&json);
+        httpd_util_json_object_end(&json);
+    }
+    return httpd_util_json_end(&json);
+}
+
+esp_err_t httpd_latency_register_handlers(const httpd_handle_t httpd)
+{
+    const httpd_uri_t handlers[] = {
+        {.method = HTTP_GET, .uri = "/latency", .handler = get_latency},
+    };
+    return httpd_util_register_handlers(TAG, httpd, handlers, sizeof(handlers) / sizeof(httpd_uri_t));
+}
+
+#endif
@@ -0,0 +1,5 @@
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "latency_trace.h"
+
+esp_err_t httpd_latency_register_handlers(const httpd_handle_t httpd);
@@ -0,0 +1,550 @@
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_http_server.h>
+#include "httpd_util.h"
+#include "httpd_metrics.h"
+
+#define MUTEX_TIMEOUT pdMS_TO_TICKS(100) // max time a scrape waits for another one (100 ms)
+#define CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+#define PREFIX "recirc_"
+#define USEC_IN_SEC (double)1000000
+#define PROBE_SERIES 6   // samples of each probe: errors (4), retries, lost
+#define CHANNEL_SERIES 4 // samples of each channel: latest, min, max, average
+
+static const char *TAG = "httpd_metrics";
+
+struct httpd_metrics_s
+{
+    httpd_metrics_config_t config;
+    SemaphoreHandle_t mutex; /// guards the buffer
+    size_t size;             /// of the buffer
+    size_t len;
+    bool overflow;           /// the latest scrape did not fit
+    char buf[];
+};
+
+static void append(httpd_metrics_t metrics, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void append(httpd_metrics_t metrics, const char *format, ...)
+{
+    if (metrics->overflow)
+    {
+        return;
+    }
+    const size_t size = metrics->size - metrics->len;
+    va_list args;
+    va_start(args, format);
+    const int len = vsnprintf(metrics->buf + metrics->len, size, format, args);
+    va_end(args);
+    if (len < 0 || len >= size)
+    {
+        metrics->overflow = true;
+        return;
+    }
+    metrics->len += len;
+}
+
+static void add_family(httpd_metrics_t metrics, const char *name, const char *type, const char *help)
+{
+    append(metrics, "# HELP " PREFIX "%s %s\n# TYPE " PREFIX "%s %s\n", name, help, name, type);
+}
+
+// Adds a sample; labels is either NULL or the 'name="value",...' list without the braces.
+static void add_sample(httpd_metrics_t metrics, const char *name, const char *labels, double value)
+{
+    append(metrics, PREFIX "%s%s%s%s ", name, labels ? "{" : "", labels ? labels : "", labels ? "}" : "");
+    if (isnan(value))
+    {
+        append(metrics, "NaN\n");
+    }
+    else if (isinf(value))
+    {
+        append(metrics, "%cInf\n", value > 0 ? '+' : '-');
+    }
+    else
+    {
+        append(metrics, "%.15g\n", value);
+    }
+}
+
+#define LABELS_SIZE 96
+
+// Formats the zone label of a zone's sample, followed by the extra labels (if any).
+static const char *zone_labels(httpd_metrics_t metrics, size_t zone, const char *extra, char labels[LABELS_SIZE])
+{
+    snprintf(labels, LABELS_SIZE, "zone=\"%s\"%s%s", metrics->config.zones[zone].name, extra ? "," : "",
+             extra ? extra : "");
+    return labels;
+}
+
+static esp_err_t add_relay(httpd_metrics_t metrics)
+{
+    const size_t zones = metrics->config.zone_count;
+    relay_data_t data[ZONE_MAX_ZONES] = {};
+    for (size_t z = 0; z < zones; z++)
+    {
+        ESP_RETURN_ON_ERROR(relay_get_data(metrics->config.zones[z].relay, &data[z]), TAG, "get relay data");
+    }
+    char labels[LABELS_SIZE];
+    add_family(metrics, "relay_on", "gauge", "Whether the relay (pump) is on.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "relay_on", zone_labels(metrics, z, NULL, labels), data[z].current_state == RELAY_ON);
+    }
+    add_family(metrics, "relay_state_changes_total", "counter", "Transitions into each relay state.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "relay_state_changes_total", zone_labels(metrics, z, "state=\"off\"", labels),
+                   relay_get_total_state_changes(&data[z], RELAY_OFF));
+        add_sample(metrics, "relay_state_changes_total", zone_labels(metrics, z, "state=\"on\"", labels),
+                   relay_get_total_state_changes(&data[z], RELAY_ON));
+    }
+    add_family(metrics, "relay_state_seconds_total", "counter", "Time spent in each relay state.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "relay_state_seconds_total", zone_labels(metrics, z, "state=\"off\"", labels),
+                   relay_get_total_time_in_state(&data[z], RELAY_OFF) / USEC_IN_SEC);
+        add_sample(metrics, "relay_state_seconds_total", zone_labels(metrics, z, "state=\"on\"", labels),
+                   relay_get_total_time_in_state(&data[z], RELAY_ON) / USEC_IN_SEC);
+    }
+    return ESP_OK;
+}
+
+// Adds a sample of the statistic (one of the data's arrays, by channel) for every channel of every zone.
+static void add_channels(httpd_metrics_t metrics, const char *name, const temperature_delta_sensor_data_t data[],
+                         size_t offset)
+{
+    for (size_t z = 0; z < metrics->config.zone_count; z++)
+    {
+        const temperature_delta_sensor_t sensor = metrics->config.zones[z].temperature_delta_sensor;
+        const float *values = (const float *)((const char *)&data[z] + offset);
+        for (size_t c = 0; c < data[z].channel_count; c++)
+        {
+            char position[TEMPERATURE_DELTA_SENSOR_NAME_SIZE + 12];
+            snprintf(position, sizeof(position), "position=\"%s\"",
+                     temperature_delta_sensor_get_channel_name(sensor, c));
+            char labels[LABELS_SIZE];
+            add_sample(metrics, name, zone_labels(metrics, z, position, labels), values[c]);
+        }
+    }
+}
+
+// Adds the OneWire bus health of every zone: the error counters of each probe, and the bus timings.
+static esp_err_t add_probe_health(httpd_metrics_t metrics)
+{
+    static const struct
+    {
+        const char *error;
+        size_t offset;
+    } errors[] = {
+        {"read", offsetof(temperature_delta_sensor_probe_health_t, read_errors)},
+        {"implausible", offsetof(temperature_delta_sensor_probe_health_t, implausible)},
+        {"power_on", offsetof(temperature_delta_sensor_probe_health_t, power_on)},
+        {"outlier", offsetof(temperature_delta_sensor_probe_health_t, outliers)},
+    };
+    const size_t zones = metrics->config.zone_count;
+    temperature_delta_sensor_health_t health[ZONE_MAX_ZONES];
+    for (size_t z = 0; z < zones; z++)
+    {
+        ESP_RETURN_ON_ERROR(
+            temperature_delta_sensor_get_health(metrics->config.zones[z].temperature_delta_sensor, &health[z]), TAG,
+            "get temperature health");
+    }
+    char labels[LABELS_SIZE];
+    char extra[LABELS_SIZE];
+    add_family(metrics, "temperature_probe_errors_total", "counter",
+               "Failed scratchpad reads and rejected readings, by probe and error.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        const temperature_delta_sensor_t sensor = metrics->config.zones[z].temperature_delta_sensor;
+        for (size_t p = 0; p < health[z].probe_count; p++)
+        {
+            for (size_t e = 0; e < sizeof(errors) / sizeof(errors[0]); e++)
+            {
+                snprintf(extra, sizeof(extra), "position=\"%s\",error=\"%s\"",
+                         temperature_delta_sensor_get_channel_name(sensor, p), errors[e].error);
+                add_sample(metrics, "temperature_probe_errors_total", zone_labels(metrics, z, extra, labels),
+                           *(const uint32_t *)((const char *)&health[z].probes[p] + errors[e].offset));
+            }
+        }
+    }
+    add_family(metrics, "temperature_probe_retries_total", "counter", "Scratchpad reads retried, by probe.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        for (size_t p = 0; p < health[z].probe_count; p++)
+        {
+            snprintf(extra, sizeof(extra), "position=\"%s\"",
+                     temperature_delta_sensor_get_channel_name(metrics->config.zones[z].temperature_delta_sensor, p));
+            add_sample(metrics, "temperature_probe_retries_total", zone_labels(metrics, z, extra, labels),
+                       health[z].probes[p].retries);
+        }
+    }
+    add_family(metrics, "temperature_probe_lost", "gauge", "Whether the probe is lost (its readings are unknown).");
+    for (size_t z = 0; z < zones; z++)
+    {
+        for (size_t p = 0; p < health[z].probe_count; p++)
+        {
+            snprintf(extra, sizeof(extra), "position=\"%s\"",
+                     temperature_delta_sensor_get_channel_name(metrics->config.zones[z].temperature_delta_sensor, p));
+            add_sample(metrics, "temperature_probe_lost", zone_labels(metrics, z, extra, labels),
+                       health[z].probes[p].lost);
+        }
+    }
+    add_family(metrics, "temperature_conversion_seconds", "gauge",
+               "Time from the latest conversion command to the reading of its result.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "temperature_conversion_seconds", zone_labels(metrics, z, NULL, labels),
+                   health[z].conversion_time / USEC_IN_SEC);
+    }
+    add_family(metrics, "temperature_read_seconds", "gauge",
+               "Time the latest reading of the scratchpads took, retries included.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "temperature_read_seconds", zone_labels(metrics, z, NULL, labels),
+                   health[z].read_time / USEC_IN_SEC);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t add_temperature(httpd_metrics_t metrics)
+{
+    const size_t zones = metrics->config.zone_count;
+    temperature_delta_sensor_data_t data[ZONE_MAX_ZONES];
+    for (size_t z = 0; z < zones; z++)
+    {
+        ESP_RETURN_ON_ERROR(temperature_delta_sensor_get_data(metrics->config.zones[z].temperature_delta_sensor,
+                                                              &data[z]),
+                            TAG, "get temperature data");
+    }
+    char labels[LABELS_SIZE];
+    add_family(metrics, "temperature_celsius", "gauge", "Latest temperature reading.");
+    add_channels(metrics, "temperature_celsius", data, offsetof(temperature_delta_sensor_data_t, latest));
+    add_family(metrics, "temperature_min_celsius", "gauge", "Lowest temperature reading since reset.");
+    add_channels(metrics, "temperature_min_celsius", data, offsetof(temperature_delta_sensor_data_t, min));
+    add_family(metrics, "temperature_max_celsius", "gauge", "Highest temperature reading since reset.");
+    add_channels(metrics, "temperature_max_celsius", data, offsetof(temperature_delta_sensor_data_t, max));
+    add_family(metrics, "temperature_average_celsius", "gauge", "Average temperature reading since reset.");
+    add_channels(metrics, "temperature_average_celsius", data, offsetof(temperature_delta_sensor_data_t, average));
+    add_family(metrics, "temperature_readings_total", "counter", "Successful temperature readings.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "temperature_readings_total", zone_labels(metrics, z, NULL, labels), data[z].readings);
+    }
+    add_family(metrics, "temperature_faults_total", "counter", "Failed temperature conversions or readings.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "temperature_faults_total", zone_labels(metrics, z, NULL, labels), data[z].faults);
+    }
+    ESP_RETURN_ON_ERROR(add_probe_health(metrics), TAG, "add probe health");
+    add_family(metrics, "temperature_sample_period_seconds", "gauge", "Current time between temperature readings.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "temperature_sample_period_seconds", zone_labels(metrics, z, NULL, labels),
+                   data[z].sample_period / 1000.0);
+    }
+    add_family(metrics, "temperature_samples_total", "counter", "Successful temperature readings by sampling mode.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        for (int i = 0; i < TEMPERATURE_DELTA_SENSOR_SAMPLING_MAX; i++)
+        {
+            char sampling[32];
+            snprintf(sampling, sizeof(sampling), "sampling=\"%s\"", temperature_delta_sensor_sampling_name(i));
+            add_sample(metrics, "temperature_samples_total", zone_labels(metrics, z, sampling, labels),
+                       data[z].samples[i]);
+        }
+    }
+    add_family(metrics, "temperature_notifications_dropped_total", "counter",
+               "Readings not reported to the control loop because its queue stayed full.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "temperature_notifications_dropped_total", zone_labels(metrics, z, NULL, labels),
+                   temperature_delta_sensor_get_dropped_notifications(
+                       metrics->config.zones[z].temperature_delta_sensor));
+    }
+    add_family(metrics, "temperature_notifications_coalesced_total", "counter",
+               "Readings superseded by a newer one before the control loop took them.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "temperature_notifications_coalesced_total", zone_labels(metrics, z, NULL, labels),
+                   temperature_delta_sensor_get_coalesced_notifications(
+                       metrics->config.zones[z].temperature_delta_sensor));
+    }
+    return ESP_OK;
+}
+
+static esp_err_t add_flow(httpd_metrics_t metrics)
+{
+    const size_t zones = metrics->config.zone_count;
+    pulse_sensor_data_t data[ZONE_MAX_ZONES] = {};
+    for (size_t z = 0; z < zones; z++)
+    {
+        ESP_RETURN_ON_ERROR(pulse_sensor_get_data(metrics->config.zones[z].flow_sensor, &data[z]), TAG,
+                            "get flow data");
+    }
+    char labels[LABELS_SIZE];
+    add_family(metrics, "flow_rate_pulses_per_second", "gauge", "Current flow rate.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "flow_rate_pulses_per_second", zone_labels(metrics, z, NULL, labels),
+                   pulse_sensor_get_current_rate(&data[z]));
+    }
+    add_family(metrics, "flow_current_cycle_pulses", "gauge", "Pulses in the current flow cycle (0 when idle).");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "flow_current_cycle_pulses", zone_labels(metrics, z, NULL, labels),
+                   data[z].current_cycle_pulses);
+    }
+    add_family(metrics, "flow_pulses_total", "counter", "Pulses across completed flow cycles.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "flow_pulses_total", zone_labels(metrics, z, NULL, labels), data[z].total_pulses);
+    }
+    add_family(metrics, "flow_seconds_total", "counter", "Duration of completed flow cycles.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "flow_seconds_total", zone_labels(metrics, z, NULL, labels),
+                   data[z].total_duration / USEC_IN_SEC);
+    }
+    add_family(metrics, "flow_cycles_total", "counter", "Completed flow cycles.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "flow_cycles_total", zone_labels(metrics, z, NULL, labels), data[z].cycles);
+    }
+    add_family(metrics, "flow_partial_cycles_total", "counter", "Flow cycles that ended below the minimum pulses.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        add_sample(metrics, "flow_partial_cycles_total", zone_labels(metrics, z, NULL, labels),
+                   data[z].partial_cycles);
+    }
+    return ESP_OK;
+}
+
+static void add_drops(httpd_metrics_t metrics)
+{
+    if (metrics->config.queue_count)
+    {
+        add_family(metrics, "queue_dropped_total", "counter", "Messages not sent because the queue stayed full.");
+        for (size_t i = 0; i < metrics->config.queue_count; i++)
+        {
+            const httpd_metrics_queue_t *queue = &metrics->config.queues[i];
+            char labels[48];
+            snprintf(labels, sizeof(labels), "queue=\"%s\"", queue->name);
+            add_sample(metrics, "queue_dropped_total", labels, atomic_load(queue->dropped));
+        }
+    }
+    if (metrics->config.executor)
+    {
+        add_family(metrics, "control_messages_total", "counter", "Messages handled by the pump control task.");
+        for (zone_source_t source = 0; source < ZONE_SOURCE_MAX; source++)
+        {
+            char labels[32];
+            snprintf(labels, sizeof(labels), "source=\"%s\"", zone_source_name(source));
+            add_sample(metrics, "control_messages_total", labels,
+                       zone_executor_get_received(metrics->config.executor, source));
+        }
+    }
+    if (metrics->config.event_stream)
+    {
+        add_family(metrics, "events_published_total", "counter", "Server-Sent Events published.");
+        add_sample(metrics, "events_published_total", NULL, event_stream_get_published(metrics->config.event_stream));
+        add_family(metrics, "events_dropped_total", "counter", "Server-Sent Events not published.");
+        add_sample(metrics, "events_dropped_total", NULL, event_stream_get_dropped(metrics->config.event_stream));
+    }
+}
+
+static esp_err_t add_totals(httpd_metrics_t metrics)
+{
+    const size_t zones = metrics->config.zone_count;
+    totals_data_t data[ZONE_MAX_ZONES] = {};
+    bool any = false;
+    for (size_t z = 0; z < zones; z++)
+    {
+        if (metrics->config.zones[z].totals)
+        {
+            ESP_RETURN_ON_ERROR(totals_get_data(metrics->config.zones[z].totals, &data[z]), TAG, "get totals");
+            any = true;
+        }
+    }
+    if (!any)
+    {
+        return ESP_OK;
+    }
+    char labels[LABELS_SIZE];
+    add_family(metrics, "lifetime_pump_seconds_total", "counter", "Time the pump ran, across reboots.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        if (metrics->config.zones[z].totals)
+        {
+            add_sample(metrics, "lifetime_pump_seconds_total", zone_labels(metrics, z, NULL, labels),
+                       data[z].totals.pump_on_time / USEC_IN_SEC);
+        }
+    }
+    add_family(metrics, "lifetime_pump_starts_total", "counter", "Times the pump was turned on, across reboots.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        if (metrics->config.zones[z].totals)
+        {
+            add_sample(metrics, "lifetime_pump_starts_total", zone_labels(metrics, z, NULL, labels),
+                       data[z].totals.pump_starts);
+        }
+    }
+    add_family(metrics, "lifetime_flow_pulses_total", "counter", "Flow meter pulses, across reboots.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        if (metrics->config.zones[z].totals)
+        {
+            add_sample(metrics, "lifetime_flow_pulses_total", zone_labels(metrics, z, NULL, labels),
+                       data[z].totals.flow_pulses);
+        }
+    }
+    add_family(metrics, "boots_total", "counter", "Boots since the totals were first checkpointed.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        if (metrics->config.zones[z].totals)
+        {
+            add_sample(metrics, "boots_total", zone_labels(metrics, z, NULL, labels), data[z].totals.boots);
+        }
+    }
+    add_family(metrics, "nvs_checkpoints_total", "counter", "Totals checkpoints written to NVS since boot.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        if (metrics->config.zones[z].totals)
+        {
+            add_sample(metrics, "nvs_checkpoints_total", zone_labels(metrics, z, NULL, labels), data[z].writes);
+        }
+    }
+    add_family(metrics, "nvs_checkpoints_last_day", "gauge", "Totals checkpoints written in the last 24 hours.");
+    for (size_t z = 0; z < zones; z++)
+    {
+        if (metrics->config.zones[z].totals)
+        {
+            add_sample(metrics, "nvs_checkpoints_last_day", zone_labels(metrics, z, NULL, labels),
+                       data[z].writes_last_day);
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t add_reporter(httpd_metrics_t metrics)
+{
+    reporter_data_t data;
+    ESP_RETURN_ON_ERROR(reporter_get_data(metrics->config.reporter, &data), TAG, "get reporter data");
+    add_family(metrics, "reporter_connected", "gauge", "Whether the reporter is connected to the MQTT broker.");
+    add_sample(metrics, "reporter_connected", NULL, data.connected);
+    add_family(metrics, "reporter_events_total", "counter", "Events added to the MQTT reports.");
+    add_sample(metrics, "reporter_events_total", NULL, data.events);
+    add_family(metrics, "reporter_events_dropped_total", "counter",
+               "Events not reported because the queue was full (the broker was unreachable).");
+    add_sample(metrics, "reporter_events_dropped_total", NULL, data.dropped);
+    add_family(metrics, "reporter_events_queued", "gauge", "Events waiting for a batch.");
+    add_sample(metrics, "reporter_events_queued", NULL, data.queued);
+    add_family(metrics, "reporter_batch_events", "summary", "Events per batch acknowledged by the broker.");
+    add_sample(metrics, "reporter_batch_events_sum", NULL, data.published);
+    add_sample(metrics, "reporter_batch_events_count", NULL, data.batches);
+    add_family(metrics, "reporter_batch_events_max", "gauge", "Events in the largest batch.");
+    add_sample(metrics, "reporter_batch_events_max", NULL, data.max_batch);
+    add_family(metrics, "reporter_bytes_total", "counter", "Payload bytes acknowledged by the broker.");
+    add_sample(metrics, "reporter_bytes_total", NULL, data.bytes);
+    add_family(metrics, "reporter_publish_seconds", "summary", "Time from publish to acknowledgement, per batch.");
+    add_sample(metrics, "reporter_publish_seconds_sum", NULL, data.latency_sum / USEC_IN_SEC);
+    add_sample(metrics, "reporter_publish_seconds_count", NULL, data.batches);
+    add_family(metrics, "reporter_publish_seconds_max", "gauge", "Longest time from publish to acknowledgement.");
+    add_sample(metrics, "reporter_publish_seconds_max", NULL, data.latency_max / USEC_IN_SEC);
+    add_family(metrics, "reporter_retries_total", "counter", "Batches published again (timed out or disconnected).");
+    add_sample(metrics, "reporter_retries_total", NULL, data.retries);
+    return ESP_OK;
+}
+
+static esp_err_t render(httpd_metrics_t metrics)
+{
+    metrics->len = 0;
+    metrics->overflow = false;
+    add_family(metrics, "uptime_seconds", "gauge", "Time since boot.");
+    add_sample(metrics, "uptime_seconds", NULL, esp_timer_get_time() / USEC_IN_SEC);
+    ESP_RETURN_ON_ERROR(add_relay(metrics), TAG, "relay");
+    ESP_RETURN_ON_ERROR(add_temperature(metrics), TAG, "temperature");
+    ESP_RETURN_ON_ERROR(add_flow(metrics), TAG, "flow");
+    add_drops(metrics);
+    ESP_RETURN_ON_ERROR(add_totals(metrics), TAG, "totals");
+    if (metrics->config.reporter)
+    {
+        ESP_RETURN_ON_ERROR(add_reporter(metrics), TAG, "reporter");
+    }
+    ESP_RETURN_ON_FALSE(!metrics->overflow, ESP_ERR_INVALID_SIZE, TAG, "metrics exceed %zu bytes", metrics->size);
+    return ESP_OK;
+}
+
+esp_err_t httpd_metrics_open(const httpd_metrics_config_t *config, httpd_metrics_t *metrics_out)
+{
+    esp_err_t ret = ESP_FAIL;
+    ESP_GOTO_ON_FALSE(config && metrics_out, ESP_ERR_INVALID_ARG, handle_error, TAG, "null");
+    ESP_GOTO_ON_FALSE(config->zones && config->zone_count && config->zone_count <= ZONE_MAX_ZONES,
+                      ESP_ERR_INVALID_ARG, handle_error, TAG, "invalid zones");
+    for (size_t z = 0; z < config->zone_count; z++)
+    {
+        const httpd_metrics_zone_t *zone = &config->zones[z];
+        ESP_GOTO_ON_FALSE(zone->name && zone->relay && zone->temperature_delta_sensor && zone->flow_sensor,
+                          ESP_ERR_INVALID_ARG, handle_error, TAG, "missing producer of zone %zu", z);
+    }
+    ESP_GOTO_ON_FALSE(config->queues || !config->queue_count, ESP_ERR_INVALID_ARG, handle_error, TAG, "null queues");
+    size_t size = HTTPD_METRICS_BUFFER_SIZE + HTTPD_METRICS_ZONE_BUFFER_SIZE * config->zone_count;
+    for (size_t z = 0; z < config->zone_count; z++)
+    {
+        temperature_delta_sensor_data_t data;
+        ESP_GOTO_ON_ERROR(temperature_delta_sensor_get_data(config->zones[z].temperature_delta_sensor, &data),
+                          handle_error, TAG, "get temperature data of zone %zu", z);
+        size += (PROBE_SERIES * data.probe_count + CHANNEL_SERIES * data.channel_count) * HTTPD_METRICS_SERIES_SIZE;
+    }
+    const httpd_metrics_t metrics = calloc(1, sizeof(struct httpd_metrics_s) + size);
+    ESP_GOTO_ON_FALSE(metrics, ESP_ERR_NO_MEM, handle_error, TAG, "malloc metrics");
+    metrics->config = *config;
+    metrics->size = size;
+    metrics->mutex = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(metrics->mutex, ESP_ERR_NO_MEM, free_metrics, TAG, "create mutex");
+    *metrics_out = metrics;
+    ESP_LOGI(TAG, "Opened with a %zu byte buffer", size);
+    return ESP_OK;
+free_metrics:
+    free(metrics);
+handle_error:
+    return ret;
+}
+
+static esp_err_t get_metrics(httpd_req_t *req)
+{
+    const httpd_metrics_t metrics = (httpd_metrics_t)req->user_ctx;
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(metrics->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    esp_err_t ret = render(metrics);
+    if (ret == ESP_OK)
+    {
+        ret = httpd_resp_set_type(req, CONTENT_TYPE);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = httpd_resp_send(req, metrics->buf, metrics->len);
+    }
+    else
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to render metrics");
+    }
+    xSemaphoreGive(metrics->mutex);
+    return ret;
+}
+
+esp_err_t httpd_metrics_register_handlers(const httpd_handle_t httpd, const httpd_metrics_t metrics)
+{
+    const httpd_uri_t handlers[] = {
+        {.user_ctx = metrics, .method = HTTP_GET, .uri = "/metrics", .handler = get_metrics},
+    };
+    return httpd_util_register_handlers(TAG, httpd, handlers, sizeof(handlers) / sizeof(httpd_uri_t));
+}
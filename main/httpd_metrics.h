@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "relay.h"
+#include "temperature_delta_sensor.h"
+#include "pulse_sensor.h"
+#include "event_stream.h"
+#include "totals.h"
+#include "reporter.h"
+#include "zone.h"
+
+#define HTTPD_METRICS_BUFFER_SIZE 7168      // max length of the board's part of a rendered scrape
+#define HTTPD_METRICS_ZONE_BUFFER_SIZE 2048 // max length of each zone's part, but for its probes and channels
+#define HTTPD_METRICS_SERIES_SIZE 144       // max length of a sample of a probe or channel
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Serves GET /metrics in the Prometheus text exposition format. Every scrape is rendered into the
+     * same buffer, allocated once at open, so scraping never allocates. The buffer is sized for the
+     * zones' probes and channels as configured at open.
+     */
+    typedef struct httpd_metrics_s *httpd_metrics_t;
+
+    typedef struct
+    {
+        const char *name;             /// the "queue" label
+        const atomic_uint *dropped;   /// messages not sent because the queue stayed full
+    } httpd_metrics_queue_t;
+
+    typedef struct
+    {
+        const char *name;                                    /// the "zone" label (*required)
+        relay_t relay;                                       /// (*required)
+        temperature_delta_sensor_t temperature_delta_sensor; /// (*required)
+        pulse_sensor_t flow_sensor;                          /// (*required)
+        totals_t totals;                                     /// (optional)
+    } httpd_metrics_zone_t;
+
+    typedef struct
+    {
+        const httpd_metrics_zone_t *zones;                   /// the zones whose producers to export (*required)
+        size_t zone_count;
+        event_stream_t event_stream;                         /// (optional)
+        const httpd_metrics_queue_t *queues;                 /// queues whose drops to export (optional)
+        size_t queue_count;
+        zone_executor_t executor;                            /// whose inbox to export (optional)
+        reporter_t reporter;                                 /// (optional)
+    } httpd_metrics_config_t;
+
+    // Created once: the buffer outlives restarts of the web server.
+    esp_err_t httpd_metrics_open(const httpd_metrics_config_t *config, httpd_metrics_t *metrics_out);
+
+    esp_err_t httpd_metrics_register_handlers(const httpd_handle_t httpd, const httpd_metrics_t metrics);
+
+#ifdef __cplusplus
+}
+#endif
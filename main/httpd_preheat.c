@@ -0,0 +1,44 @@
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include "httpd_util.h"
+#include "httpd_preheat.h"
+
+#define USEC_IN_SEC (double)1000000
+
+static const char *TAG = "httpd_preheat";
+
+// Likelihoods are in %, bins start on Sunday 00:00 local time.
+static esp_err_t get_preheat(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Getting preheat");
+    preheat_data_t data;
+    ESP_RETURN_ON_ERROR(preheat_get_data((preheat_t)req->user_ctx, &data), TAG, "get data");
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    httpd_util_json_bool(&json, "clock_set", data.clock_set);
+    httpd_util_json_number(&json, "predictions", data.predictions);
+    httpd_util_json_number(&json, "preheats", data.preheats);
+    httpd_util_json_number(&json, "hits", data.hits);
+    httpd_util_json_number(&json, "misses", data.misses);
+    httpd_util_json_number(&json, "unpredicted", data.unpredicted);
+    httpd_util_json_number(&json, "runtime", data.runtime / USEC_IN_SEC);
+    httpd_util_json_number(&json, "bin_minutes", PREHEAT_BIN_MINUTES);
+    httpd_util_json_array_begin(&json, "likelihood");
+    for (int i = 0; i < PREHEAT_BINS; i++)
+    {
+        httpd_util_json_number(&json, NULL, data.bins[i] * 100 / 256);
+    }
+    httpd_util_json_array_end(&json);
+    return httpd_util_json_end(&json);
+}
+
+esp_err_t httpd_preheat_register_handlers(const httpd_handle_t httpd, const char *prefix,
+                                          const preheat_t preheat)
+{
+    const httpd_uri_t handlers[] = {
+        {.user_ctx = preheat, .method = HTTP_GET, .uri = "/preheat", .handler = get_preheat},
+    };
+    return httpd_util_register_prefixed_handlers(TAG, httpd, prefix, handlers,
+                                                 sizeof(handlers) / sizeof(httpd_uri_t));
+}
@@ -0,0 +1,6 @@
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "preheat.h"
+
+esp_err_t httpd_preheat_register_handlers(const httpd_handle_t httpd, const char *prefix,
+                                          const preheat_t preheat);
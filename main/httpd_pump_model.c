@@ -0,0 +1,40 @@
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include "httpd_util.h"
+#include "httpd_pump_model.h"
+
+static const char *TAG = "httpd_pump_model";
+
+// Times are in seconds; parameters not learned (yet) are null.
+static esp_err_t get_model(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Getting model");
+    pump_model_data_t data;
+    ESP_RETURN_ON_ERROR(pump_model_get_data((pump_model_t)req->user_ctx, &data), TAG, "get data");
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    httpd_util_json_number(&json, "cycles", data.cycles);
+    httpd_util_json_number(&json, "cold_cycles", data.cold_cycles);
+    httpd_util_json_float(&json, "transit", data.transit);
+    httpd_util_json_float(&json, "decay", data.decay);
+    httpd_util_json_object_begin(&json, "last_cycle");
+    httpd_util_json_float(&json, "start_delta", data.last.start_delta);
+    httpd_util_json_float(&json, "predicted_cutoff", data.last.predicted_cutoff);
+    httpd_util_json_float(&json, "on_duration", data.last.on_duration);
+    httpd_util_json_number(&json, "samples", data.last.samples);
+    httpd_util_json_float(&json, "transit", data.last.transit);
+    httpd_util_json_float(&json, "decay", data.last.decay);
+    httpd_util_json_object_end(&json);
+    return httpd_util_json_end(&json);
+}
+
+esp_err_t httpd_pump_model_register_handlers(const httpd_handle_t httpd, const char *prefix,
+                                             const pump_model_t model)
+{
+    const httpd_uri_t handlers[] = {
+        {.user_ctx = model, .method = HTTP_GET, .uri = "/model", .handler = get_model},
+    };
+    return httpd_util_register_prefixed_handlers(TAG, httpd, prefix, handlers,
+                                                 sizeof(handlers) / sizeof(httpd_uri_t));
+}
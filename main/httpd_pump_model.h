@@ -0,0 +1,6 @@
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "pump_model.h"
+
+esp_err_t httpd_pump_model_register_handlers(const httpd_handle_t httpd, const char *prefix,
+                                             const pump_model_t model);
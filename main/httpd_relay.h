@@ -1,5 +1,8 @@
 #include <esp_err.h>
 #include <esp_http_server.h>
+#include "httpd_util.h"
 #include "relay.h"
 
-esp_err_t httpd_relay_register_handlers(const httpd_handle_t httpd, const relay_t relay);
+esp_err_t httpd_relay_register_handlers(const httpd_handle_t httpd, const char *prefix, const relay_t relay);
+// Writes the body of GET /relay (from data, read by the caller) into the current object of json.
+void httpd_relay_write(httpd_util_json_t *json, const relay_t relay, const relay_data_t *data);
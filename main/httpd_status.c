@@ -0,0 +1,164 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_random.h>
+#include <esp_timer.h>
+#include <esp_http_server.h>
+#include "httpd_util.h"
+#include "snapshot.h"
+#include "httpd_status.h"
+
+#define MUTEX_TIMEOUT pdMS_TO_TICKS(100) // max time a producer waits for another one's rendering (100 ms)
+#define ETAG_SIZE 24                     // "\"xxxxxxxx-nnnnnnnnnn\"" and the terminator
+#define USEC_IN_SEC (double)1000000
+
+static const char *TAG = "httpd_status";
+
+typedef struct
+{
+    uint32_t version;
+    uint16_t len;
+    char etag[ETAG_SIZE];
+    char json[HTTPD_STATUS_SIZE];
+} rendering_t;
+
+struct httpd_status_s
+{
+    httpd_status_config_t config;
+    uint32_t boot_id;         /// ETag prefix, so that the versions of a previous boot never match
+    uint32_t version;         /// version of the latest rendering
+    SemaphoreHandle_t mutex;  /// serializes the producers, which makes them the latch's single writer
+    snapshot_latch_t latch;
+    rendering_t renderings[2]; /// the latest rendering (latch copies)
+    atomic_uint sent;
+    atomic_uint not_modified;
+};
+
+static esp_err_t render(httpd_status_t status, rendering_t *rendering)
+{
+    relay_data_t relay = {};
+    temperature_delta_sensor_data_t temperature = {};
+    pulse_sensor_data_t flow = {};
+    ESP_RETURN_ON_ERROR(relay_get_data(status->config.relay, &relay), TAG, "get relay data");
+    ESP_RETURN_ON_ERROR(temperature_delta_sensor_get_data(status->config.temperature_delta_sensor, &temperature),
+                        TAG, "get temperature data");
+    ESP_RETURN_ON_ERROR(pulse_sensor_get_data(status->config.flow_sensor, &flow), TAG, "get flow data");
+    const int64_t now = esp_timer_get_time();
+
+    char channels[HTTPD_STATUS_SIZE / 2] = "";
+    for (size_t c = 0, len = 0; c < temperature.channel_count && len < sizeof(channels); c++)
+    {
+        // JSON has no NaN: an unknown temperature is null
+        const char *name = temperature_delta_sensor_get_channel_name(status->config.temperature_delta_sensor, c);
+        len += isnan(temperature.latest[c])
+                   ? snprintf(channels + len, sizeof(channels) - len, "\"%s\":null,", name)
+                   : snprintf(channels + len, sizeof(channels) - len, "\"%s\":%.2f,", name, temperature.latest[c]);
+    }
+    char cycle_start[24] = "null";
+    if (flow.current_cycle_pulses)
+    {
+        snprintf(cycle_start, sizeof(cycle_start), "%.3f", flow.current_cycle_start_timestamp / USEC_IN_SEC);
+    }
+    const int len = snprintf(
+        rendering->json, sizeof(rendering->json),
+        "{\"version\":%lu,\"t\":%.3f,"
+        "\"relay\":{\"state\":\"%s\",\"since\":%.3f,\"state_changes\":%lu},"
+        "\"temperature\":{%s\"t\":%.3f,\"readings\":%lu,\"faults\":%lu},"
+        "\"flow\":{\"state\":\"%s\",\"cycle_start\":%s,\"cycles\":%lu,\"partial_cycles\":%lu,"
+        "\"total_pulses\":%llu,\"total_duration\":%.3f}}",
+        (unsigned long)rendering->version, now / USEC_IN_SEC,
+        relay.current_state ? "on" : "off", (now - (int64_t)relay.time_in_current_state) / USEC_IN_SEC,
+        (unsigned long)relay.state_changes,
+        channels, temperature.latest_reading_timestamp / USEC_IN_SEC,
+        (unsigned long)temperature.readings, (unsigned long)temperature.faults,
+        flow.current_cycle_pulses ? "active" : "idle", cycle_start, (unsigned long)flow.cycles,
+        (unsigned long)flow.partial_cycles, (unsigned long long)flow.total_pulses, flow.total_duration / USEC_IN_SEC);
+    ESP_RETURN_ON_FALSE(len > 0 && len < sizeof(rendering->json), ESP_ERR_INVALID_SIZE, TAG, "%d bytes", len);
+    rendering->len = len;
+    return ESP_OK;
+}
+
+esp_err_t httpd_status_update(httpd_status_t status)
+{
+    esp_err_t ret = ESP_OK;
+    ESP_RETURN_ON_FALSE(status, ESP_ERR_INVALID_ARG, TAG, "status must not be NULL");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(status->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    // the data is read under the lock, so that a producer waiting for it renders its own change
+    rendering_t rendering;
+    rendering.version = status->version + 1;
+    snprintf(rendering.etag, sizeof(rendering.etag), "\"%08lx-%lu\"", (unsigned long)status->boot_id,
+             (unsigned long)rendering.version);
+    ESP_GOTO_ON_ERROR(render(status, &rendering), release_mutex, TAG, "render version %lu",
+                      (unsigned long)rendering.version);
+    snapshot_publish(&status->latch, status->renderings, &rendering, sizeof(rendering_t));
+    status->version = rendering.version;
+release_mutex:
+    xSemaphoreGive(status->mutex);
+    return ret;
+}
+
+esp_err_t httpd_status_open(const httpd_status_config_t *config, httpd_status_t *status_out)
+{
+    esp_err_t ret = ESP_FAIL;
+    ESP_GOTO_ON_FALSE(config && status_out, ESP_ERR_INVALID_ARG, handle_error, TAG, "null");
+    ESP_GOTO_ON_FALSE(config->relay && config->temperature_delta_sensor && config->flow_sensor,
+                      ESP_ERR_INVALID_ARG, handle_error, TAG, "missing producer");
+    const httpd_status_t status = calloc(1, sizeof(struct httpd_status_s));
+    ESP_GOTO_ON_FALSE(status, ESP_ERR_NO_MEM, handle_error, TAG, "malloc status");
+    status->config = *config;
+    status->boot_id = esp_random();
+    status->mutex = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(status->mutex, ESP_ERR_NO_MEM, free_status, TAG, "create mutex");
+    ESP_GOTO_ON_ERROR(httpd_status_update(status), delete_mutex, TAG, "first rendering");
+    *status_out = status;
+    ESP_LOGI(TAG, "Opened");
+    return ESP_OK;
+delete_mutex:
+    vSemaphoreDelete(status->mutex);
+free_status:
+    free(status);
+handle_error:
+    return ret;
+}
+
+esp_err_t httpd_status_get_data(httpd_status_t status, httpd_status_data_t *data)
+{
+    ESP_RETURN_ON_FALSE(status && data, ESP_ERR_INVALID_ARG, TAG, "null");
+    data->version = status->version;
+    data->sent = status->sent;
+    data->not_modified = status->not_modified;
+    return ESP_OK;
+}
+
+static esp_err_t get_status(httpd_req_t *req)
+{
+    const httpd_status_t status = (httpd_status_t)req->user_ctx;
+    rendering_t rendering;
+    snapshot_read(&status->latch, status->renderings, &rendering, sizeof(rendering_t));
+    ESP_RETURN_ON_ERROR(httpd_resp_set_hdr(req, "ETag", rendering.etag), TAG, "send ETag");
+    ESP_RETURN_ON_ERROR(httpd_resp_set_hdr(req, "Cache-Control", "no-cache"), TAG, "send Cache-Control");
+    if (httpd_util_etag_matches(req, rendering.etag))
+    {
+        status->not_modified++;
+        ESP_RETURN_ON_ERROR(httpd_resp_set_status(req, "304 Not Modified"), TAG, "send 304");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    status->sent++;
+    ESP_RETURN_ON_ERROR(httpd_resp_set_type(req, HTTPD_TYPE_JSON), TAG, "send content type");
+    return httpd_resp_send(req, rendering.json, rendering.len);
+}
+
+esp_err_t httpd_status_register_handlers(const httpd_handle_t httpd, const char *prefix,
+                                         const httpd_status_t status)
+{
+    const httpd_uri_t handlers[] = {
+        {.user_ctx = status, .method = HTTP_GET, .uri = "/status", .handler = get_status},
+    };
+    return httpd_util_register_prefixed_handlers(TAG, httpd, prefix, handlers,
+                                                 sizeof(handlers) / sizeof(httpd_uri_t));
+}
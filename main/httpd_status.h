@@ -0,0 +1,52 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "relay.h"
+#include "temperature_delta_sensor.h"
+#include "pulse_sensor.h"
+
+#define HTTPD_STATUS_SIZE 768 // max length of the rendered JSON document
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Serves GET /status: one JSON document summarizing the relay, the temperatures and the flow. The
+     * document is rendered by the producers when something changed (httpd_status_update), not per
+     * request, so a request only copies the latest rendering out. Each rendering gets a new version,
+     * which is sent as the ETag; a request whose If-None-Match names the current version is answered
+     * with 304 Not Modified and no body.
+     */
+    typedef struct httpd_status_s *httpd_status_t;
+
+    typedef struct
+    {
+        relay_t relay;                                       /// (*required)
+        temperature_delta_sensor_t temperature_delta_sensor; /// (*required)
+        pulse_sensor_t flow_sensor;                          /// (*required)
+    } httpd_status_config_t;
+
+    typedef struct
+    {
+        uint32_t version;      /// renderings since open
+        uint32_t sent;         /// responses with a body
+        uint32_t not_modified; /// 304 responses
+    } httpd_status_data_t;
+
+    // Created once, and rendered right away: the cache outlives restarts of the web server.
+    esp_err_t httpd_status_open(const httpd_status_config_t *config, httpd_status_t *status_out);
+
+    // Re-renders the document from the current data. Called by the producers after each change.
+    esp_err_t httpd_status_update(httpd_status_t status);
+
+    esp_err_t httpd_status_get_data(httpd_status_t status, httpd_status_data_t *data);
+
+    esp_err_t httpd_status_register_handlers(const httpd_handle_t httpd, const char *prefix,
+                                             const httpd_status_t status);
+
+#ifdef __cplusplus
+}
+#endif
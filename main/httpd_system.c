@@ -0,0 +1,68 @@
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include "httpd_util.h"
+#include "httpd_system.h"
+
+#define USEC_IN_SEC (double)1000000
+
+static const char *TAG = "httpd_system";
+
+// Times are in seconds, sizes in bytes; the sample is at most the monitor's period old.
+static esp_err_t get_system(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Getting system");
+    const system_monitor_t monitor = (system_monitor_t)req->user_ctx;
+    static system_monitor_data_t data; // too large for the stack; requests are served one at a time
+    ESP_RETURN_ON_ERROR(system_monitor_get_data(monitor, &data), TAG, "get data");
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    httpd_util_json_number(&json, "timestamp", data.timestamp / USEC_IN_SEC);
+    httpd_util_json_number(&json, "period", data.period / USEC_IN_SEC);
+    httpd_util_json_object_begin(&json, "heaps");
+    for (system_monitor_heap_t i = 0; i < SYSTEM_MONITOR_HEAP_MAX; i++)
+    {
+        const system_monitor_heap_data_t *heap = &data.heaps[i];
+        httpd_util_json_object_begin(&json, system_monitor_heap_name(i));
+        httpd_util_json_number(&json, "total", heap->total);
+        httpd_util_json_number(&json, "free", heap->free);
+        httpd_util_json_number(&json, "minimum_free", heap->minimum_free);
+        httpd_util_json_number(&json, "largest_free_block", heap->largest_free_block);
+        httpd_util_json_object_end(&json);
+    }
+    httpd_util_json_object_end(&json);
+    httpd_util_json_number(&json, "total_tasks", data.total_tasks);
+    httpd_util_json_array_begin(&json, "tasks");
+    for (size_t i = 0; i < data.task_count; i++)
+    {
+        const system_monitor_task_data_t *task = &data.tasks[i];
+        httpd_util_json_object_begin(&json, NULL);
+        httpd_util_json_string(&json, "name", task->name);
+        httpd_util_json_number(&json, "priority", task->priority);
+        httpd_util_json_number(&json, "stack_high_water_mark", task->stack_high_water_mark);
+        if (task->cpu >= 0)
+        {
+            httpd_util_json_number(&json, "cpu", task->cpu);
+        }
+        httpd_util_json_object_end(&json);
+    }
+    httpd_util_json_array_end(&json);
+    httpd_util_json_object_begin(&json, "queues");
+    for (size_t i = 0; i < system_monitor_get_queue_count(monitor); i++)
+    {
+        httpd_util_json_object_begin(&json, system_monitor_get_queue_name(monitor, i));
+        httpd_util_json_number(&json, "waiting", data.queues[i].waiting);
+        httpd_util_json_number(&json, "length", data.queues[i].length);
+        httpd_util_json_object_end(&json);
+    }
+    httpd_util_json_object_end(&json);
+    return httpd_util_json_end(&json);
+}
+
+esp_err_t httpd_system_register_handlers(const httpd_handle_t httpd, const system_monitor_t monitor)
+{
+    const httpd_uri_t handlers[] = {
+        {.user_ctx = monitor, .method = HTTP_GET, .uri = "/system", .handler = get_system},
+    };
+    return httpd_util_register_handlers(TAG, httpd, handlers, sizeof(handlers) / sizeof(httpd_uri_t));
+}
@@ -0,0 +1,5 @@
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "system_monitor.h"
+
+esp_err_t httpd_system_register_handlers(const httpd_handle_t httpd, const system_monitor_t monitor);
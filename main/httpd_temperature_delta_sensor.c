@@ -1,7 +1,9 @@
+#include <stdio.h>
+#include <string.h>
 #include <esp_check.h>
 #include <esp_log.h>
 #include <esp_http_server.h>
-#include <cJSON.h>
+#include "httpd_util.h"
 #include "httpd_temperature_delta_sensor.h"
 
 #define USEC_IN_SEC (float)1000000
@@ -10,81 +12,133 @@ static const char *TAG = "httpd_temperature_delta_sensor";
 
 // TODO: add units (C vs F)
 
-static esp_err_t add_info_attrs(cJSON *object, temperature_delta_sensor_info_t *info)
+// The bus health of a probe; the counters are since boot.
+static void add_probe_health(httpd_util_json_t *json, const temperature_delta_sensor_probe_health_t *health)
 {
-    ESP_RETURN_ON_FALSE(object, ESP_ERR_NO_MEM, TAG, "null object");
-    ESP_RETURN_ON_FALSE(cJSON_AddNumberToObject(object, "latest", info->latest), ESP_ERR_NO_MEM, TAG, "add latest");
-    ESP_RETURN_ON_FALSE(cJSON_AddNumberToObject(object, "min", info->min), ESP_ERR_NO_MEM, TAG, "add min");
-    ESP_RETURN_ON_FALSE(cJSON_AddNumberToObject(object, "max", info->max), ESP_ERR_NO_MEM, TAG, "add max");
-    ESP_RETURN_ON_FALSE(cJSON_AddNumberToObject(object, "average", info->average), ESP_ERR_NO_MEM, TAG, "add average");
-    return ESP_OK;
-}
-
-static esp_err_t get_all(httpd_req_t *req)
-{
-    ESP_LOGI(TAG, "Getting all data");
-    temperature_delta_sensor_data_t data;
-    ESP_RETURN_ON_ERROR(
-        temperature_delta_sensor_get_data((const temperature_delta_sensor_t)req->user_ctx, &data),
-        TAG, "get data");
-    ESP_RETURN_ON_ERROR(httpd_resp_set_type(req, HTTPD_TYPE_JSON), TAG, "send content type");
-    cJSON *object = cJSON_CreateObject();
-    ESP_RETURN_ON_FALSE(object, ESP_ERR_NO_MEM, TAG, "create json object");
-    esp_err_t ret = ESP_OK;
-    ESP_GOTO_ON_FALSE(
-        cJSON_AddNumberToObject(object, "readings", data.readings),
-        ESP_ERR_NO_MEM, free_object, TAG, "add readings");
-    ESP_GOTO_ON_FALSE(
-        cJSON_AddNumberToObject(object, "latest_reading_timestamp", data.latest_reading_timestamp),
-        ESP_ERR_NO_MEM, free_object, TAG, "add latest_reading_timestamp");
-    ESP_GOTO_ON_ERROR(add_info_attrs(cJSON_AddObjectToObject(object, "1"), &data.info[TEMPERATURE_DELTA_SENSOR_FIRST]), free_object, TAG, "add first");
-    ESP_GOTO_ON_ERROR(add_info_attrs(cJSON_AddObjectToObject(object, "2"), &data.info[TEMPERATURE_DELTA_SENSOR_SECOND]), free_object, TAG, "add second");
-    ESP_GOTO_ON_ERROR(add_info_attrs(cJSON_AddObjectToObject(object, "delta"), &data.info[TEMPERATURE_DELTA_SENSOR_DELTA]), free_object, TAG, "add delta");
-    char *json = cJSON_Print(object);
-    ESP_GOTO_ON_FALSE(json, ESP_ERR_NO_MEM, free_object, TAG, "json to string");
-    ESP_GOTO_ON_ERROR(httpd_resp_sendstr(req, json), free_json, TAG, "send response");
-free_json:
-    cJSON_free(json);
-free_object:
-    cJSON_Delete(object);
-    return ret;
+    httpd_util_json_object_begin(json, "health");
+    httpd_util_json_bool(json, "lost", health->lost);
+    httpd_util_json_number(json, "read_errors", health->read_errors);
+    httpd_util_json_number(json, "retries", health->retries);
+    httpd_util_json_number(json, "implausible", health->implausible);
+    httpd_util_json_number(json, "power_on", health->power_on);
+    httpd_util_json_number(json, "outliers", health->outliers);
+    httpd_util_json_number(json, "consecutive_failures", health->consecutive_failures);
+    httpd_util_json_number(json, "losses", health->losses);
+    if (health->last_error != ESP_OK)
+    {
+        httpd_util_json_string(json, "last_error", esp_err_to_name(health->last_error));
+    }
+    httpd_util_json_object_end(json);
 }
 
-static esp_err_t get_position(httpd_req_t *req, temperature_delta_sensor_position_t position)
+// min, max, average and stddev are since the latest reset; the windows are in seconds.
+static void add_channel_attrs(httpd_util_json_t *json, temperature_delta_sensor_t sensor,
+                              const temperature_delta_sensor_data_t *data,
+                              const temperature_delta_sensor_health_t *health, size_t channel)
 {
-    ESP_LOGI(TAG, "Getting info for position %d", position);
-    temperature_delta_sensor_data_t data;
-    ESP_RETURN_ON_ERROR(
-        temperature_delta_sensor_get_data((const temperature_delta_sensor_t)req->user_ctx, &data),
-        TAG, "get data");
-    ESP_RETURN_ON_ERROR(httpd_resp_set_type(req, HTTPD_TYPE_JSON), TAG, "send content type");
-    cJSON *object = cJSON_CreateObject();
-    ESP_RETURN_ON_FALSE(object, ESP_ERR_NO_MEM, TAG, "create json object");
-    esp_err_t ret = ESP_OK;
-    ESP_GOTO_ON_ERROR(add_info_attrs(object, &data.info[position]), free_object, TAG, "add info");
-    char *json = cJSON_Print(object);
-    ESP_GOTO_ON_FALSE(json, ESP_ERR_NO_MEM, free_object, TAG, "json to string");
-    ESP_GOTO_ON_ERROR(httpd_resp_sendstr(req, json), free_json, TAG, "send response");
-free_json:
-    cJSON_free(json);
-free_object:
-    cJSON_Delete(object);
-    return ret;
+    httpd_util_json_float(json, "latest", data->latest[channel]);
+    httpd_util_json_float(json, "min", data->min[channel]);
+    httpd_util_json_float(json, "max", data->max[channel]);
+    httpd_util_json_float(json, "average", data->average[channel]);
+    const window_stats_t stats = temperature_delta_sensor_get_stats(sensor);
+    window_stats_summary_t summary;
+    if (window_stats_get(stats, channel, &summary) == ESP_OK)
+    {
+        httpd_util_json_window_stats(json, stats, &summary);
+    }
+    if (channel < health->probe_count)
+    {
+        add_probe_health(json, &health->probes[channel]);
+    }
 }
 
-static esp_err_t get_first(httpd_req_t *req)
+void httpd_temperature_delta_sensor_write(httpd_util_json_t *json, const temperature_delta_sensor_t sensor,
+                                          const temperature_delta_sensor_data_t *data,
+                                          const temperature_delta_sensor_health_t *health)
 {
-    return get_position(req, TEMPERATURE_DELTA_SENSOR_FIRST);
+    httpd_util_json_number(json, "readings", data->readings);
+    httpd_util_json_number(json, "latest_reading_timestamp", data->latest_reading_timestamp);
+    httpd_util_json_number(json, "snapshot_retries", temperature_delta_sensor_get_snapshot_retries(sensor));
+    httpd_util_json_object_begin(json, "sampling");
+    httpd_util_json_string(json, "mode", temperature_delta_sensor_sampling_name(data->sampling));
+    httpd_util_json_number(json, "period", data->sample_period);
+    httpd_util_json_object_begin(json, "samples");
+    for (int i = 0; i < TEMPERATURE_DELTA_SENSOR_SAMPLING_MAX; i++)
+    {
+        httpd_util_json_number(json, temperature_delta_sensor_sampling_name(i), data->samples[i]);
+    }
+    httpd_util_json_object_end(json);
+    httpd_util_json_object_end(json);
+    // the OneWire bus: faults are readings that failed or missed a probe; times are in milliseconds
+    httpd_util_json_object_begin(json, "bus");
+    httpd_util_json_number(json, "faults", data->faults);
+    httpd_util_json_number(json, "conversion_time", health->conversion_time / 1000.0);
+    httpd_util_json_number(json, "conversion_time_max", health->conversion_time_max / 1000.0);
+    httpd_util_json_number(json, "read_time", health->read_time / 1000.0);
+    httpd_util_json_number(json, "read_time_max", health->read_time_max / 1000.0);
+    httpd_util_json_object_end(json);
+    for (size_t c = 0; c < data->channel_count; c++)
+    {
+        httpd_util_json_object_begin(json, temperature_delta_sensor_get_channel_name(sensor, c));
+        add_channel_attrs(json, sensor, data, health, c);
+        httpd_util_json_object_end(json);
+    }
 }
 
-static esp_err_t get_second(httpd_req_t *req)
+static esp_err_t get_all(httpd_req_t *req)
 {
-    return get_position(req, TEMPERATURE_DELTA_SENSOR_SECOND);
+    ESP_LOGI(TAG, "Getting all data");
+    const temperature_delta_sensor_t sensor = (const temperature_delta_sensor_t)req->user_ctx;
+    temperature_delta_sensor_data_t data;
+    ESP_RETURN_ON_ERROR(temperature_delta_sensor_get_data(sensor, &data), TAG, "get data");
+    temperature_delta_sensor_health_t health;
+    ESP_RETURN_ON_ERROR(temperature_delta_sensor_get_health(sensor, &health), TAG, "get health");
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    httpd_temperature_delta_sensor_write(&json, sensor, &data, &health);
+    return httpd_util_json_end(&json);
 }
 
-static esp_err_t get_delta(httpd_req_t *req)
+// GET [prefix]/temperature/<name>: a probe (with its ROM address) or a delta.
+static esp_err_t get_channel(httpd_req_t *req)
 {
-    return get_position(req, TEMPERATURE_DELTA_SENSOR_DELTA);
+    const temperature_delta_sensor_t sensor = (const temperature_delta_sensor_t)req->user_ctx;
+    char name[TEMPERATURE_DELTA_SENSOR_NAME_SIZE];
+    // the name is the last segment of the path, whatever the prefix the handler was registered at
+    const size_t path_len = strcspn(req->uri, "?");
+    const char *uri = req->uri + path_len;
+    while (uri > req->uri && uri[-1] != '/')
+    {
+        uri--;
+    }
+    const size_t len = req->uri + path_len - uri;
+    int channel = -1;
+    if (len < sizeof(name))
+    {
+        memcpy(name, uri, len);
+        name[len] = '\0';
+        channel = temperature_delta_sensor_find_channel(sensor, name);
+    }
+    if (channel < 0)
+    {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no such probe or delta");
+    }
+    ESP_LOGI(TAG, "Getting data of '%s'", name);
+    temperature_delta_sensor_data_t data;
+    ESP_RETURN_ON_ERROR(temperature_delta_sensor_get_data(sensor, &data), TAG, "get data");
+    temperature_delta_sensor_health_t health;
+    ESP_RETURN_ON_ERROR(temperature_delta_sensor_get_health(sensor, &health), TAG, "get health");
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    if (channel < data.probe_count)
+    {
+        char address[17];
+        snprintf(address, sizeof(address), "%016llx",
+                 (unsigned long long)temperature_delta_sensor_get_address(sensor, channel));
+        httpd_util_json_string(&json, "address", address);
+    }
+    add_channel_attrs(&json, sensor, &data, &health, channel);
+    return httpd_util_json_end(&json);
 }
 
 static esp_err_t reset(httpd_req_t *req)
@@ -95,20 +149,14 @@ static esp_err_t reset(httpd_req_t *req)
     return httpd_resp_send(req, NULL, 0);
 }
 
-esp_err_t httpd_temperature_delta_sensor_register_handlers(const httpd_handle_t httpd,
+esp_err_t httpd_temperature_delta_sensor_register_handlers(const httpd_handle_t httpd, const char *prefix,
                                                            const temperature_delta_sensor_t sensor)
 {
     const httpd_uri_t handlers[] = {
         {.user_ctx = sensor, .method = HTTP_GET, .uri = "/temperature", .handler = get_all},
-        {.user_ctx = sensor, .method = HTTP_GET, .uri = "/temperature/1", .handler = get_first},
-        {.user_ctx = sensor, .method = HTTP_GET, .uri = "/temperature/2", .handler = get_second},
-        {.user_ctx = sensor, .method = HTTP_GET, .uri = "/temperature/delta", .handler = get_delta},
         {.user_ctx = sensor, .method = HTTP_DELETE, .uri = "/temperature/readings", .handler = reset},
+        {.user_ctx = sensor, .method = HTTP_GET, .uri = "/temperature/*", .handler = get_channel},
     };
-    for (int i = 0, len = sizeof(handlers) / sizeof(httpd_uri_t); i < len; i++)
-    {
-        ESP_RETURN_ON_ERROR(httpd_register_uri_handler(httpd, &handlers[i]), TAG,
-                            "register handler: %s", handlers[i].uri);
-    }
-    return ESP_OK;
+    return httpd_util_register_prefixed_handlers(TAG, httpd, prefix, handlers,
+                                                 sizeof(handlers) / sizeof(httpd_uri_t));
 }
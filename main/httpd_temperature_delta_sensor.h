@@ -1,6 +1,11 @@
 #include <esp_err.h>
 #include <esp_http_server.h>
+#include "httpd_util.h"
 #include "temperature_delta_sensor.h"
 
-esp_err_t httpd_temperature_delta_sensor_register_handlers(const httpd_handle_t httpd,
+esp_err_t httpd_temperature_delta_sensor_register_handlers(const httpd_handle_t httpd, const char *prefix,
                                                            const temperature_delta_sensor_t sensor);
+// Writes the body of GET /temperature (from data and health, read by the caller) into the current object of json.
+void httpd_temperature_delta_sensor_write(httpd_util_json_t *json, const temperature_delta_sensor_t sensor,
+                                          const temperature_delta_sensor_data_t *data,
+                                          const temperature_delta_sensor_health_t *health);
@@ -0,0 +1,56 @@
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include "httpd_util.h"
+#include "httpd_totals.h"
+
+#define USEC_IN_SEC (double)1000000
+
+static const char *TAG = "httpd_totals";
+
+// Times are in seconds.
+static esp_err_t get_totals(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Getting totals");
+    const httpd_zone_context_t *zone = (const httpd_zone_context_t *)req->user_ctx;
+    totals_data_t data;
+    ESP_RETURN_ON_ERROR(totals_get_data(zone->totals, &data), TAG, "get data");
+    const totals_counters_t *totals = &data.totals;
+    httpd_util_json_t json;
+    ESP_RETURN_ON_ERROR(httpd_util_json_begin(TAG, &json, req), TAG, "begin JSON");
+    httpd_util_json_string(&json, "zone", zone->name);
+    httpd_util_json_number(&json, "boots", totals->boots);
+    httpd_util_json_object_begin(&json, "pump");
+    httpd_util_json_number(&json, "starts", totals->pump_starts);
+    httpd_util_json_number(&json, "on_time", totals->pump_on_time / USEC_IN_SEC);
+    httpd_util_json_number(&json, "off_time", totals->pump_off_time / USEC_IN_SEC);
+    httpd_util_json_object_end(&json);
+    httpd_util_json_object_begin(&json, "flow");
+    httpd_util_json_number(&json, "cycles", totals->flow_cycles);
+    httpd_util_json_number(&json, "pulses", totals->flow_pulses);
+    httpd_util_json_number(&json, "duration", totals->flow_duration / USEC_IN_SEC);
+    httpd_util_json_object_end(&json);
+    httpd_util_json_object_begin(&json, "temperature");
+    httpd_util_json_number(&json, "readings", totals->temperature_readings);
+    httpd_util_json_number(&json, "faults", totals->temperature_faults);
+    httpd_util_json_object_end(&json);
+    httpd_util_json_object_begin(&json, "checkpoints");
+    httpd_util_json_bool(&json, "restored", data.restored);
+    httpd_util_json_number(&json, "sequence", data.sequence);
+    httpd_util_json_number(&json, "writes", data.writes);
+    httpd_util_json_number(&json, "write_failures", data.write_failures);
+    httpd_util_json_number(&json, "writes_last_day", data.writes_last_day);
+    httpd_util_json_number(&json, "write_budget", data.write_budget);
+    httpd_util_json_object_end(&json);
+    return httpd_util_json_end(&json);
+}
+
+esp_err_t httpd_totals_register_handlers(const httpd_handle_t httpd, const char *prefix,
+                                         const httpd_zone_context_t *zone)
+{
+    const httpd_uri_t handlers[] = {
+        {.user_ctx = (void *)zone, .method = HTTP_GET, .uri = "/totals", .handler = get_totals},
+    };
+    return httpd_util_register_prefixed_handlers(TAG, httpd, prefix, handlers,
+                                                 sizeof(handlers) / sizeof(httpd_uri_t));
+}
@@ -0,0 +1,44 @@
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include "httpd_util.h"
+#include "httpd_trace.h"
+
+#define RECORDS_PER_READ 16 // trace records copied per acquisition of the trace lock
+
+static const char *TAG = "httpd_trace";
+
+// Sends the binary trace (see pump_trace.h), for host/pump_replay.c.
+static esp_err_t get_trace(httpd_req_t *req)
+{
+    const pump_trace_t trace = (pump_trace_t)req->user_ctx;
+    pump_trace_header_t header;
+    uint32_t first;
+    ESP_RETURN_ON_ERROR(pump_trace_get_header(trace, &header, &first), TAG, "get header");
+    ESP_LOGI(TAG, "Getting %lu records", (unsigned long)header.count);
+    ESP_RETURN_ON_ERROR(httpd_resp_set_type(req, HTTPD_TYPE_OCTET), TAG, "send content type");
+    ESP_RETURN_ON_ERROR(httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"pump.trace\""),
+                        TAG, "send Content-Disposition");
+    ESP_RETURN_ON_ERROR(httpd_resp_send_chunk(req, (const char *)&header, sizeof(header)), TAG, "send header");
+    pump_trace_record_t records[RECORDS_PER_READ];
+    for (uint32_t sent = 0; sent < header.count;)
+    {
+        const size_t count = header.count - sent < RECORDS_PER_READ ? header.count - sent : RECORDS_PER_READ;
+        // a record overwritten mid-response cannot be sent anymore: the truncated trace is refused by the replay
+        ESP_RETURN_ON_ERROR(pump_trace_read(trace, first + sent, records, count), TAG, "read records");
+        ESP_RETURN_ON_ERROR(httpd_resp_send_chunk(req, (const char *)records, count * sizeof(pump_trace_record_t)),
+                            TAG, "send records");
+        sent += count;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+esp_err_t httpd_trace_register_handlers(const httpd_handle_t httpd, const char *prefix,
+                                        const pump_trace_t trace)
+{
+    const httpd_uri_t handlers[] = {
+        {.user_ctx = trace, .method = HTTP_GET, .uri = "/trace", .handler = get_trace},
+    };
+    return httpd_util_register_prefixed_handlers(TAG, httpd, prefix, handlers,
+                                                 sizeof(handlers) / sizeof(httpd_uri_t));
+}
@@ -1,33 +1,387 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
 #include <esp_check.h>
+#include <esp_log.h>
 #include <esp_http_server.h>
-#include <cJSON.h>
 #include "httpd_util.h"
 
-esp_err_t httpd_util_send_json_object(const char *TAG, httpd_req_t *req, const cJSON *object)
+static void json_flush(httpd_util_json_t *json)
+{
+    if (json->err == ESP_OK && json->len)
+    {
+        json->err = httpd_resp_send_chunk(json->req, json->buf, json->len);
+        json->len = 0;
+        json->chunked = true;
+    }
+}
+
+static void json_write(httpd_util_json_t *json, const char *data, size_t len)
+{
+    while (json->err == ESP_OK && len)
+    {
+        if (json->len == sizeof(json->buf))
+        {
+            json_flush(json);
+            continue;
+        }
+        const size_t n = MIN(len, sizeof(json->buf) - json->len);
+        memcpy(json->buf + json->len, data, n);
+        json->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+static void json_write_string(httpd_util_json_t *json, const char *s)
+{
+    json_write(json, "\"", 1);
+    while (*s)
+    {
+        const size_t n = strcspn(s, "\"\\\b\f\n\r\t\x01\x02\x03\x04\x05\x06\x07\x0b\x0e\x0f\x10\x11\x12"
+                                    "\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f");
+        json_write(json, s, n);
+        s += n;
+        if (*s)
+        {
+            char escaped[8];
+            const char *short_escape = strchr("\"\\\b\f\n\r\t", *s);
+            if (short_escape)
+            {
+                escaped[0] = '\\';
+                escaped[1] = "\"\\bfnrt"[short_escape - "\"\\\b\f\n\r\t"];
+                json_write(json, escaped, 2);
+            }
+            else
+            {
+                json_write(json, escaped, snprintf(escaped, sizeof(escaped), "\\u%04x", *s));
+            }
+            s++;
+        }
+    }
+    json_write(json, "\"", 1);
+}
+
+typedef enum
+{
+    JSON_SKIP,    /// the value is left out
+    JSON_PARTIAL, /// some of the members or elements of the object or array are selected
+    JSON_WHOLE,   /// the value is written whole
+} json_selection_t;
+
+// Which part of the value of key (in the current object) the fields select.
+static json_selection_t json_select(const httpd_util_json_t *json, const char *key)
+{
+    const size_t path_len = json->path_len[json->depth];
+    const size_t key_len = strlen(key);
+    // the prefix a field shares with the path of the value: path "." key
+    const size_t prefix_len = path_len + (path_len != 0) + key_len;
+    json_selection_t selection = JSON_SKIP;
+    const char *field = json->fields;
+    while (*field && selection != JSON_WHOLE)
+    {
+        const size_t len = strcspn(field, ",");
+        if (len >= prefix_len && memcmp(field, json->path, path_len) == 0 && (!path_len || field[path_len] == '.') &&
+            memcmp(field + prefix_len - key_len, key, key_len) == 0)
+        {
+            selection = len == prefix_len ? JSON_WHOLE : field[prefix_len] == '.' ? JSON_PARTIAL : selection;
+        }
+        field += len + (field[len] == ',');
+    }
+    return selection;
+}
+
+// Writes the separator and key (if any) that precede a value, unless the fields leave the value out.
+static json_selection_t json_key(httpd_util_json_t *json, const char *key, bool scalar)
+{
+    // the elements of a partly selected array are selected by the path of the array
+    const json_selection_t selection = json->skipped ? JSON_SKIP
+                                       : json->whole ? JSON_WHOLE
+                                       : key         ? json_select(json, key)
+                                                     : JSON_PARTIAL;
+    if (selection == JSON_SKIP || (scalar && selection == JSON_PARTIAL))
+    {
+        return JSON_SKIP;
+    }
+    const uint32_t bit = 1u << json->depth;
+    if (json->items & bit)
+    {
+        json_write(json, ",", 1);
+    }
+    json->items |= bit;
+    if (key)
+    {
+        json_write_string(json, key);
+        json_write(json, ":", 1);
+    }
+    return selection;
+}
+
+static void json_open(httpd_util_json_t *json, const char *key, const char *bracket)
+{
+    if (json->depth == HTTPD_UTIL_JSON_MAX_DEPTH)
+    {
+        if (json->err == ESP_OK)
+        {
+            ESP_LOGE(json->tag, "JSON nested too deep");
+            json->err = ESP_ERR_INVALID_STATE;
+        }
+        return;
+    }
+    const json_selection_t selection = json_key(json, key, false);
+    if (selection == JSON_SKIP)
+    {
+        json->skipped++;
+        return;
+    }
+    json_write(json, bracket, 1);
+    size_t path_len = json->path_len[json->depth];
+    if (selection == JSON_WHOLE && !json->whole)
+    {
+        json->whole = json->depth + 1;
+    }
+    else if (selection == JSON_PARTIAL && key)
+    {
+        // fits: a field is longer than the path
+        path_len += (path_len != 0);
+        json->path[path_len - 1] = '.';
+        memcpy(json->path + path_len, key, strlen(key));
+        path_len += strlen(key);
+    }
+    json->depth++;
+    json->path_len[json->depth] = path_len;
+    json->items &= ~(1u << json->depth);
+}
+
+static void json_close(httpd_util_json_t *json, const char *bracket)
+{
+    if (json->skipped)
+    {
+        json->skipped--;
+        return;
+    }
+    if (json->err == ESP_OK && json->depth == 0)
+    {
+        ESP_LOGE(json->tag, "JSON closed more than opened");
+        json->err = ESP_ERR_INVALID_STATE;
+    }
+    json_write(json, bracket, 1);
+    json->depth--;
+    if (json->depth < json->whole)
+    {
+        json->whole = 0;
+    }
+}
+
+void httpd_util_url_decode(char *s)
+{
+    char *out = s;
+    for (; *s; s++)
+    {
+        if (*s == '%' && isxdigit((unsigned char)s[1]) && isxdigit((unsigned char)s[2]))
+        {
+            const char hex[3] = {s[1], s[2], '\0'};
+            *out++ = strtol(hex, NULL, 16);
+            s += 2;
+        }
+        else
+        {
+            *out++ = *s == '+' ? ' ' : *s;
+        }
+    }
+    *out = '\0';
+}
+
+// Reads the fields query parameter into json->fields ("" if there is none).
+static esp_err_t json_parse_fields(httpd_util_json_t *json)
+{
+    json->fields[0] = '\0';
+    if (httpd_req_get_url_query_len(json->req) == 0)
+    {
+        return ESP_OK;
+    }
+    char query[HTTPD_UTIL_QUERY_SIZE];
+    if (httpd_req_get_url_query_str(json->req, query, sizeof(query)) != ESP_OK)
+    {
+        httpd_resp_send_err(json->req, HTTPD_414_URI_TOO_LONG, "query too long");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const esp_err_t err = httpd_query_key_value(query, "fields", json->fields, sizeof(json->fields));
+    if (err == ESP_ERR_HTTPD_RESULT_TRUNC)
+    {
+        httpd_resp_send_err(json->req, HTTPD_400_BAD_REQUEST, "fields too long");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (err != ESP_OK)
+    {
+        json->fields[0] = '\0';
+    }
+    httpd_util_url_decode(json->fields);
+    return ESP_OK;
+}
+
+esp_err_t httpd_util_json_begin(const char *TAG, httpd_util_json_t *json, httpd_req_t *req)
 {
     ESP_RETURN_ON_FALSE(TAG, ESP_ERR_INVALID_ARG, TAG, "null TAG");
+    ESP_RETURN_ON_FALSE(json, ESP_ERR_INVALID_ARG, TAG, "null json");
     ESP_RETURN_ON_FALSE(req, ESP_ERR_INVALID_ARG, TAG, "null req");
-    ESP_RETURN_ON_FALSE(object, ESP_ERR_INVALID_ARG, TAG, "null object");
+    json->tag = TAG;
+    json->req = req;
+    json->err = ESP_OK;
+    json->chunked = false;
+    json->depth = 0;
+    json->items = 0;
+    json->len = 0;
+    ESP_RETURN_ON_ERROR(json_parse_fields(json), TAG, "parse fields");
+    json->whole = json->fields[0] ? 0 : 1;
+    json->skipped = 0;
+    json->path_len[0] = 0;
     ESP_RETURN_ON_ERROR(httpd_resp_set_type(req, HTTPD_TYPE_JSON), TAG, "send content type");
-    esp_err_t ret = ESP_OK;
-    char *json = cJSON_Print(object);
-    ESP_GOTO_ON_FALSE(json, ESP_ERR_NO_MEM, handle_error, TAG, "json to string");
-    ESP_GOTO_ON_ERROR(httpd_resp_sendstr(req, json), free_json, TAG, "send response");
-free_json:
-    cJSON_free(json);
-handle_error:
-    return ret;
+    json_open(json, NULL, "{");
+    return ESP_OK;
+}
+
+void httpd_util_json_object_begin(httpd_util_json_t *json, const char *key)
+{
+    json_open(json, key, "{");
+}
+
+void httpd_util_json_object_end(httpd_util_json_t *json)
+{
+    json_close(json, "}");
+}
+
+void httpd_util_json_array_begin(httpd_util_json_t *json, const char *key)
+{
+    json_open(json, key, "[");
+}
+
+void httpd_util_json_array_end(httpd_util_json_t *json)
+{
+    json_close(json, "]");
+}
+
+static void json_format(httpd_util_json_t *json, const char *key, const char *format, double value)
+{
+    if (json_key(json, key, true) == JSON_SKIP)
+    {
+        return;
+    }
+    if (!isfinite(value))
+    {
+        json_write(json, "null", 4); // as cJSON does: JSON has no NaN or infinity
+        return;
+    }
+    char s[32];
+    json_write(json, s, snprintf(s, sizeof(s), format, value));
+}
+
+void httpd_util_json_number(httpd_util_json_t *json, const char *key, double value)
+{
+    json_format(json, key, "%.15g", value);
+}
+
+void httpd_util_json_float(httpd_util_json_t *json, const char *key, float value)
+{
+    // the digits a float actually holds, rather than the noise of its conversion to double
+    json_format(json, key, "%.7g", value);
+}
+
+void httpd_util_json_string(httpd_util_json_t *json, const char *key, const char *value)
+{
+    if (json_key(json, key, true) == JSON_SKIP)
+    {
+        return;
+    }
+    if (value)
+    {
+        json_write_string(json, value);
+    }
+    else
+    {
+        json_write(json, "null", 4);
+    }
+}
+
+void httpd_util_json_bool(httpd_util_json_t *json, const char *key, bool value)
+{
+    if (json_key(json, key, true) != JSON_SKIP)
+    {
+        json_write(json, value ? "true" : "false", value ? 4 : 5);
+    }
+}
+
+esp_err_t httpd_util_json_end(httpd_util_json_t *json)
+{
+    ESP_RETURN_ON_FALSE(json, ESP_ERR_INVALID_ARG, "httpd_util", "null json");
+    json_close(json, "}");
+    if (json->err == ESP_OK && json->depth)
+    {
+        ESP_LOGE(json->tag, "JSON ended with %d open objects or arrays", json->depth);
+        json->err = ESP_ERR_INVALID_STATE;
+    }
+    ESP_RETURN_ON_ERROR(json->err, json->tag, "write JSON");
+    if (!json->chunked)
+    {
+        // the whole response fit in the buffer: send it with a Content-Length
+        return httpd_resp_send(json->req, json->buf, json->len);
+    }
+    json_flush(json);
+    ESP_RETURN_ON_ERROR(json->err, json->tag, "send chunk");
+    return httpd_resp_send_chunk(json->req, NULL, 0);
+}
+
+void httpd_util_json_window_stats(httpd_util_json_t *json, window_stats_t stats, const window_stats_summary_t *summary)
+{
+    httpd_util_json_float(json, "stddev", summary->stddev);
+    httpd_util_json_float(json, "ewma", summary->ewma);
+    httpd_util_json_float(json, "ewm_stddev", summary->ewm_stddev);
+    httpd_util_json_array_begin(json, "windows");
+    for (size_t w = 0; w < window_stats_get_window_count(stats); w++)
+    {
+        httpd_util_json_object_begin(json, NULL);
+        httpd_util_json_number(json, "window", window_stats_get_window(stats, w));
+        httpd_util_json_float(json, "min", summary->min[w]);
+        httpd_util_json_float(json, "max", summary->max[w]);
+        httpd_util_json_object_end(json);
+    }
+    httpd_util_json_array_end(json);
+}
+
+bool httpd_util_etag_matches(httpd_req_t *req, const char *etag)
+{
+    char if_none_match[HTTPD_UTIL_IF_NONE_MATCH_SIZE];
+    return httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+           (strcmp(if_none_match, "*") == 0 || strstr(if_none_match, etag) != NULL);
 }
 
 esp_err_t httpd_util_register_handlers(const char *TAG,
                                        const httpd_handle_t httpd,
                                        const httpd_uri_t handlers[],
                                        const size_t len)
+{
+    return httpd_util_register_prefixed_handlers(TAG, httpd, "", handlers, len);
+}
+
+esp_err_t httpd_util_register_prefixed_handlers(const char *TAG,
+                                                const httpd_handle_t httpd,
+                                                const char *prefix,
+                                                const httpd_uri_t handlers[],
+                                                const size_t len)
 {
     for (int i = 0; i < len; i++)
     {
-        ESP_RETURN_ON_ERROR(httpd_register_uri_handler(httpd, &handlers[i]), TAG,
-                            "register handler: %s", handlers[i].uri);
+        // the server keeps a copy of the URI
+        char uri[HTTPD_UTIL_URI_SIZE];
+        const int n = snprintf(uri, sizeof(uri), "%s%s", prefix, handlers[i].uri);
+        ESP_RETURN_ON_FALSE(n > 0 && n < sizeof(uri), ESP_ERR_INVALID_SIZE, TAG, "URI too long: %s%s", prefix,
+                            handlers[i].uri);
+        httpd_uri_t handler = handlers[i];
+        handler.uri = uri;
+        ESP_RETURN_ON_ERROR(httpd_register_uri_handler(httpd, &handler), TAG, "register handler: %s", uri);
     }
     return ESP_OK;
-}
\ No newline at end of file
+}
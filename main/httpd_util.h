@@ -1,12 +1,76 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <esp_check.h>
 #include <esp_http_server.h>
-#include <cJSON.h>
+#include "window_stats.h"
 
-esp_err_t httpd_util_send_json_object(const char *TAG, httpd_req_t *req, const cJSON *object);
+#define HTTPD_UTIL_JSON_BUFFER_SIZE 512 // bytes formatted before a chunk is sent
+#define HTTPD_UTIL_JSON_MAX_DEPTH 31    // max nesting of objects and arrays
+#define HTTPD_UTIL_URI_SIZE 64          // max length of a prefixed handler URI, including the NUL
+#define HTTPD_UTIL_IF_NONE_MATCH_SIZE 64 // longer If-None-Match headers are not parsed (the body is sent)
+#define HTTPD_UTIL_QUERY_SIZE 256        // max length of a query string, including the NUL
+#define HTTPD_UTIL_FIELDS_SIZE 128       // max length of the fields= projection, including the NUL
+
+/*
+ * Streaming JSON response writer. Values are formatted into the fixed buffer of the writer (which
+ * lives on the handler's stack) and sent with httpd_resp_send_chunk whenever it fills up, so no
+ * response needs a heap allocation. A response that fits the buffer is sent in one piece.
+ *
+ * Errors are sticky: after the first failure every call is a no-op and httpd_util_json_end returns
+ * the error, so handlers only check the result of httpd_util_json_end. Keys must be NULL inside
+ * arrays.
+ *
+ * Every response accepts a "fields" query parameter: a comma-separated list of dotted paths of keys
+ * (e.g. "?fields=state,on.count"). Only the values they select are written, along with the objects
+ * and arrays on their way; a path selects the whole of an object or array, and the elements of an
+ * array are selected by the paths of the array. Handlers write all their values regardless.
+ */
+typedef struct
+{
+    const char *tag;        /// TAG of the calling module, for logging
+    httpd_req_t *req;       /// the request being answered
+    esp_err_t err;          /// the first error
+    bool chunked;           /// whether part of the response was sent already
+    uint8_t depth;          /// the current nesting depth
+    uint32_t items;         /// bit per depth: whether the current object or array has an item already
+    uint8_t whole;          /// depth of the outermost object or array selected whole (0: none)
+    uint8_t skipped;        /// objects and arrays opened since the outermost one left out (0: none)
+    uint8_t path_len[HTTPD_UTIL_JSON_MAX_DEPTH + 1]; /// length of path at each depth
+    char path[HTTPD_UTIL_FIELDS_SIZE];               /// the dotted keys of the current object (not terminated)
+    char fields[HTTPD_UTIL_FIELDS_SIZE];             /// the projection ("": all the values)
+    size_t len;             /// bytes in buf
+    char buf[HTTPD_UTIL_JSON_BUFFER_SIZE];
+} httpd_util_json_t;
+
+// Sets the JSON type and opens the response object; sends an error (and fails) if the fields cannot be parsed.
+esp_err_t httpd_util_json_begin(const char *TAG, httpd_util_json_t *json, httpd_req_t *req);
+void httpd_util_json_object_begin(httpd_util_json_t *json, const char *key);
+void httpd_util_json_object_end(httpd_util_json_t *json);
+void httpd_util_json_array_begin(httpd_util_json_t *json, const char *key);
+void httpd_util_json_array_end(httpd_util_json_t *json);
+void httpd_util_json_number(httpd_util_json_t *json, const char *key, double value);
+void httpd_util_json_float(httpd_util_json_t *json, const char *key, float value);
+void httpd_util_json_string(httpd_util_json_t *json, const char *key, const char *value);
+void httpd_util_json_bool(httpd_util_json_t *json, const char *key, bool value);
+esp_err_t httpd_util_json_end(httpd_util_json_t *json);
+// Writes the standard deviation, the EWMA and its deviation, and the min and max over each of the windows of stats.
+void httpd_util_json_window_stats(httpd_util_json_t *json, window_stats_t stats, const window_stats_summary_t *summary);
+
+// Decodes a query parameter in place: its %XX escapes, and "+" to a space.
+void httpd_util_url_decode(char *s);
+
+// Whether the request's If-None-Match header ("*", or a list of possibly weak ETags) matches etag.
+bool httpd_util_etag_matches(httpd_req_t *req, const char *etag);
 
 esp_err_t httpd_util_register_handlers(const char *TAG,
                                        const httpd_handle_t httpd,
                                        const httpd_uri_t handlers[],
-                                       const size_t len);
\ No newline at end of file
+                                       const size_t len);
+// Registers the handlers at prefix + their URI (e.g. "/zones/main" + "/relay"); prefix may be "".
+esp_err_t httpd_util_register_prefixed_handlers(const char *TAG,
+                                                const httpd_handle_t httpd,
+                                                const char *prefix,
+                                                const httpd_uri_t handlers[],
+                                                const size_t len);
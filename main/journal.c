@@ -0,0 +1,488 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include "journal.h"
+
+#define BATCH_RECORDS 32                 // records appended before the batch is written (512 bytes)
+#define SCAN_RECORDS 16                  // records read from flash at a time by the recovery scan
+#define MUTEX_TIMEOUT pdMS_TO_TICKS(100) // the lock is held for RAM updates and flash reads, never erases or writes
+#define WRITE_TIMEOUT pdMS_TO_TICKS(2000) // a batch spans two sectors at most, each erase taking a few hundred ms
+#define BLANK_SEQUENCE UINT32_MAX        // the sequence number of an erased slot
+#define CLOCK_WAIT 600                   // max seconds since boot records are held for the clock to be set
+#define USEC_IN_SEC 1000000
+
+static const char *TAG = "journal";
+
+static const char *const type_names[JOURNAL_TYPE_MAX] = {
+    [JOURNAL_PUMP_ON] = "pump_on",
+    [JOURNAL_PUMP_OFF] = "pump_off",
+    [JOURNAL_FLOW_CYCLE] = "flow_cycle",
+    [JOURNAL_SENSOR_FAULT] = "sensor_fault",
+};
+
+static const char *const reason_names[JOURNAL_REASON_MAX] = {
+    [JOURNAL_REASON_MANUAL] = "manual",
+    [JOURNAL_REASON_FLOW] = "flow",
+    [JOURNAL_REASON_PREHEAT] = "preheat",
+    [JOURNAL_REASON_TEMPERATURE] = "temperature",
+    [JOURNAL_REASON_CUTOFF] = "cutoff",
+    [JOURNAL_REASON_TIMEOUT] = "timeout",
+};
+
+typedef struct
+{
+    uint32_t min_time; /// of the sector's records timed since the epoch (UINT32_MAX when it has none)
+    uint32_t max_time;
+    bool boot_times;   /// the sector has records timed since boot, which the range does not cover
+} sector_index_t;
+
+struct journal_s
+{
+    journal_config_t config;
+    const esp_partition_t *partition;
+    uint32_t sectors;                       /// in the partition
+    uint32_t sector_records;                /// records per sector
+    sector_index_t *index;                  /// by sector
+    journal_record_t batch[BATCH_RECORDS];  /// appended records not yet taken by a flush
+    uint32_t pending;                       /// records in batch
+    journal_record_t writing[BATCH_RECORDS]; /// the records a flush is writing
+    uint32_t in_flight;                     /// records in writing
+    uint32_t written;                       /// sequence number of the next record to write
+    journal_data_t data;
+    TaskHandle_t task;                      /// flushes the batch, away from the appending tasks
+    SemaphoreHandle_t mutex;                /// guards the index, the batches and the counters
+    SemaphoreHandle_t write_mutex;          /// held by the flush in progress (of the task, or of journal_close)
+};
+
+static uint8_t get_check(const journal_record_t *record)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)record, offsetof(journal_record_t, check)) & 0xff;
+}
+
+// Whether the record is intact and belongs in the slot of the expected sequence number.
+static bool is_valid(const journal_record_t *record, uint32_t sequence)
+{
+    return record->sequence == sequence && record->type < JOURNAL_TYPE_MAX && record->check == get_check(record);
+}
+
+static bool is_blank(const journal_record_t *record)
+{
+    static const journal_record_t blank = {
+        .sequence = BLANK_SEQUENCE, .time = UINT32_MAX, .value = UINT32_MAX, .detail = UINT16_MAX,
+        .type = 0xf, .zone = 0xf, .check = UINT8_MAX};
+    return memcmp(record, &blank, sizeof(blank)) == 0;
+}
+
+static uint32_t get_sector(journal_t journal, uint32_t sequence)
+{
+    return sequence / journal->sector_records % journal->sectors;
+}
+
+static size_t get_offset(journal_t journal, uint32_t sequence)
+{
+    return (size_t)(sequence % (journal->sectors * journal->sector_records)) * sizeof(journal_record_t);
+}
+
+static void reset_index(sector_index_t *index)
+{
+    *index = (sector_index_t){.min_time = UINT32_MAX, .max_time = 0};
+}
+
+static void update_index(sector_index_t *index, const journal_record_t *record)
+{
+    if (record->time < JOURNAL_CLOCK_SET_AFTER)
+    {
+        index->boot_times = true;
+        return;
+    }
+    index->min_time = record->time < index->min_time ? record->time : index->min_time;
+    index->max_time = record->time > index->max_time ? record->time : index->max_time;
+}
+
+// The time of a record appended now: since the epoch once the clock is set, since boot until then.
+static uint32_t get_time(void)
+{
+    const time_t now = time(NULL);
+    return now >= JOURNAL_CLOCK_SET_AFTER ? (uint32_t)now : (uint32_t)(esp_timer_get_time() / USEC_IN_SEC);
+}
+
+// Once the clock is set, moves the times of the batch's records appended before it from boot to the epoch.
+static void restamp(journal_t journal)
+{
+    const time_t now = time(NULL);
+    if (now < JOURNAL_CLOCK_SET_AFTER)
+    {
+        return;
+    }
+    const uint32_t uptime = esp_timer_get_time() / USEC_IN_SEC;
+    for (uint32_t i = 0; i < journal->pending; i++)
+    {
+        journal_record_t *const record = &journal->batch[i];
+        if (record->time < JOURNAL_CLOCK_SET_AFTER)
+        {
+            record->time = (uint32_t)now - (uptime - record->time);
+            record->check = get_check(record);
+        }
+    }
+}
+
+/*
+ * Takes the batch, then writes it, erasing each sector before its first record; records that fail are
+ * dropped. The lock is only taken around the updates of the index and the counters, so that appending
+ * never waits for an erase or a write. Called with the write mutex held.
+ */
+static void flush(journal_t journal)
+{
+    // the others hold the lock briefly
+    xSemaphoreTake(journal->mutex, portMAX_DELAY);
+    restamp(journal);
+    const uint32_t count = journal->pending;
+    memcpy(journal->writing, journal->batch, count * sizeof(journal_record_t));
+    journal->in_flight = count;
+    journal->pending = 0;
+    xSemaphoreGive(journal->mutex);
+
+    uint32_t i = 0;
+    while (i < count)
+    {
+        const uint32_t sequence = journal->writing[i].sequence;
+        const uint32_t sector = get_sector(journal, sequence);
+        const uint32_t in_sector = sequence % journal->sector_records;
+        uint32_t n = journal->sector_records - in_sector;
+        n = n < count - i ? n : count - i;
+        esp_err_t err = ESP_OK;
+        if (!in_sector)
+        {
+            // dropped from the index and the range first, so that reads skip the sector while it is erased
+            xSemaphoreTake(journal->mutex, portMAX_DELAY);
+            reset_index(&journal->index[sector]);
+            journal->data.erases++;
+            // the erased sector held the oldest records, unless the ring has not wrapped yet
+            const uint32_t kept = (journal->sectors - 1) * journal->sector_records;
+            if (sequence - journal->data.first > kept)
+            {
+                journal->data.first = sequence - kept;
+            }
+            xSemaphoreGive(journal->mutex);
+            err = esp_partition_erase_range(journal->partition, (size_t)sector * journal->partition->erase_size,
+                                            journal->partition->erase_size);
+        }
+        if (err == ESP_OK)
+        {
+            err = esp_partition_write(journal->partition, get_offset(journal, sequence), &journal->writing[i],
+                                      n * sizeof(journal_record_t));
+        }
+        xSemaphoreTake(journal->mutex, portMAX_DELAY);
+        if (err == ESP_OK)
+        {
+            for (uint32_t j = i; j < i + n; j++)
+            {
+                update_index(&journal->index[sector], &journal->writing[j]);
+            }
+        }
+        else
+        {
+            ESP_LOGW(TAG, "Write records %lu..%lu: %s", (unsigned long)sequence, (unsigned long)(sequence + n - 1),
+                     esp_err_to_name(err));
+            journal->data.write_failures += n;
+        }
+        xSemaphoreGive(journal->mutex);
+        i += n;
+    }
+    if (count)
+    {
+        xSemaphoreTake(journal->mutex, portMAX_DELAY);
+        journal->written += count;
+        journal->in_flight = 0;
+        journal->data.flushes++;
+        xSemaphoreGive(journal->mutex);
+    }
+}
+
+/*
+ * Writes the batch when it fills up (notified by journal_append) or when the flush period passes. Sector
+ * erases take up to a few hundred milliseconds: they are done here, at a low priority, rather than in the
+ * esp_timer task, which the sensors' and the control loop's timers share. Until the clock is set (for up
+ * to CLOCK_WAIT), the periodic flush holds the records, so that they get times since the epoch.
+ */
+static void journal_task(void *arg)
+{
+    const journal_t journal = (journal_t)arg;
+    const TickType_t period = pdMS_TO_TICKS(journal->config.flush_period);
+    while (true)
+    {
+        const bool full = ulTaskNotifyTake(pdTRUE, period);
+        if (!full && time(NULL) < JOURNAL_CLOCK_SET_AFTER && esp_timer_get_time() < (int64_t)CLOCK_WAIT * USEC_IN_SEC)
+        {
+            continue;
+        }
+        xSemaphoreTake(journal->write_mutex, portMAX_DELAY);
+        flush(journal);
+        xSemaphoreGive(journal->write_mutex);
+    }
+}
+
+static esp_err_t read_record(journal_t journal, uint32_t sequence, journal_record_t *record)
+{
+    return esp_partition_read(journal->partition, get_offset(journal, sequence), record, sizeof(journal_record_t));
+}
+
+// Indexes the valid records of the sector whose first record has the given sequence number; returns
+// the number of slots up to and including the last valid one.
+static uint32_t scan_sector(journal_t journal, uint32_t first)
+{
+    const uint32_t sector = get_sector(journal, first);
+    uint32_t end = 0;
+    journal_record_t records[SCAN_RECORDS];
+    for (uint32_t i = 0; i < journal->sector_records; i += SCAN_RECORDS)
+    {
+        if (esp_partition_read(journal->partition, get_offset(journal, first + i), records, sizeof(records)) != ESP_OK)
+        {
+            break;
+        }
+        for (uint32_t j = 0; j < SCAN_RECORDS; j++)
+        {
+            // a record cut short by a power loss is skipped, as the records after it were written past it
+            if (is_valid(&records[j], first + i + j))
+            {
+                update_index(&journal->index[sector], &records[j]);
+                end = i + j + 1;
+            }
+        }
+    }
+    return end;
+}
+
+// Whether the sector whose first record has the given sequence number is part of the ring.
+static bool is_in_ring(journal_t journal, uint32_t first)
+{
+    journal_record_t record;
+    return read_record(journal, first, &record) == ESP_OK && is_valid(&record, first);
+}
+
+// Finds the newest sector from the sequence numbers of the sectors' first records, then the sectors
+// that precede it back to the oldest.
+static esp_err_t recover(journal_t journal)
+{
+    bool found = false;
+    uint32_t head = 0; // sequence number of the newest sector's first record
+    for (uint32_t sector = 0; sector < journal->sectors; sector++)
+    {
+        reset_index(&journal->index[sector]);
+        journal_record_t record;
+        ESP_RETURN_ON_ERROR(read_record(journal, sector * journal->sector_records, &record), TAG,
+                            "read sector %lu", (unsigned long)sector);
+        if (record.sequence % journal->sector_records == 0 && get_sector(journal, record.sequence) == sector &&
+            is_valid(&record, record.sequence) && (!found || record.sequence > head))
+        {
+            head = record.sequence;
+            found = true;
+        }
+    }
+    if (!found)
+    {
+        ESP_LOGI(TAG, "No records found, starting a new journal");
+        return ESP_OK;
+    }
+    journal->written = head + scan_sector(journal, head);
+    // slots written over would corrupt: a record cut short at the end is skipped too
+    journal_record_t record;
+    while (journal->written % journal->sector_records &&
+           read_record(journal, journal->written, &record) == ESP_OK && !is_blank(&record))
+    {
+        journal->written++;
+    }
+    journal->data.first = head;
+    for (uint32_t d = 1; d < journal->sectors && head >= d * journal->sector_records; d++)
+    {
+        const uint32_t first = head - d * journal->sector_records;
+        if (!is_in_ring(journal, first))
+        {
+            break;
+        }
+        scan_sector(journal, first);
+        journal->data.first = first;
+    }
+    ESP_LOGI(TAG, "Recovered records %lu..%lu", (unsigned long)journal->data.first,
+             (unsigned long)(journal->written - 1));
+    return ESP_OK;
+}
+
+esp_err_t journal_open(const journal_config_t *config, journal_t *journal_out)
+{
+    esp_err_t ret = ESP_FAIL;
+    ESP_GOTO_ON_FALSE(config && journal_out && config->partition_label, ESP_ERR_INVALID_ARG, handle_error, TAG,
+                      "null");
+    ESP_GOTO_ON_FALSE(config->flush_period, ESP_ERR_INVALID_ARG, handle_error, TAG, "invalid flush_period");
+    const esp_partition_t *partition =
+        esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, config->partition_label);
+    ESP_GOTO_ON_FALSE(partition, ESP_ERR_NOT_FOUND, handle_error, TAG, "no partition '%s'", config->partition_label);
+    ESP_GOTO_ON_FALSE(partition->size / partition->erase_size >= 2 &&
+                          partition->erase_size % (SCAN_RECORDS * sizeof(journal_record_t)) == 0,
+                      ESP_ERR_INVALID_SIZE, handle_error, TAG, "partition '%s' too small", config->partition_label);
+    const journal_t journal = calloc(1, sizeof(struct journal_s));
+    ESP_GOTO_ON_FALSE(journal, ESP_ERR_NO_MEM, handle_error, TAG, "malloc journal");
+    journal->config = *config;
+    journal->partition = partition;
+    journal->sectors = partition->size / partition->erase_size;
+    journal->sector_records = partition->erase_size / sizeof(journal_record_t);
+    journal->index = calloc(journal->sectors, sizeof(sector_index_t));
+    ESP_GOTO_ON_FALSE(journal->index, ESP_ERR_NO_MEM, free_journal, TAG, "malloc index");
+    ESP_GOTO_ON_ERROR(recover(journal), free_index, TAG, "recover");
+    journal->data.capacity = (journal->sectors - 1) * journal->sector_records;
+    journal->mutex = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(journal->mutex, ESP_ERR_NO_MEM, free_index, TAG, "create mutex");
+    journal->write_mutex = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(journal->write_mutex, ESP_ERR_NO_MEM, free_mutex, TAG, "create write mutex");
+    ESP_GOTO_ON_FALSE(xTaskCreate(journal_task, "Journal", 3072, journal, 1, &journal->task) == pdPASS,
+                      ESP_ERR_NO_MEM, free_write_mutex, TAG, "create task");
+    *journal_out = journal;
+    ESP_LOGI(TAG, "Opened on partition '%s' (%lu sectors of %lu records)", config->partition_label,
+             (unsigned long)journal->sectors, (unsigned long)journal->sector_records);
+    return ESP_OK;
+free_write_mutex:
+    vSemaphoreDelete(journal->write_mutex);
+free_mutex:
+    vSemaphoreDelete(journal->mutex);
+free_index:
+    free(journal->index);
+free_journal:
+    free(journal);
+handle_error:
+    return ret;
+}
+
+esp_err_t journal_close(journal_t journal)
+{
+    ESP_RETURN_ON_FALSE(journal, ESP_ERR_INVALID_ARG, TAG, "journal must not be NULL");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(journal->write_mutex, WRITE_TIMEOUT), ESP_ERR_TIMEOUT, TAG,
+                        "acquire write mutex");
+    // the task is not flushing: it would hold the write mutex
+    vTaskDelete(journal->task);
+    flush(journal);
+    vSemaphoreDelete(journal->write_mutex);
+    vSemaphoreDelete(journal->mutex);
+    free(journal->index);
+    free(journal);
+    ESP_LOGI(TAG, "Closed");
+    return ESP_OK;
+}
+
+esp_err_t journal_append(journal_t journal, uint8_t zone, journal_type_t type, uint16_t detail, uint32_t value)
+{
+    ESP_RETURN_ON_FALSE(journal, ESP_ERR_INVALID_ARG, TAG, "journal must not be NULL");
+    ESP_RETURN_ON_FALSE((unsigned)type < JOURNAL_TYPE_MAX, ESP_ERR_INVALID_ARG, TAG, "invalid type %d", type);
+    ESP_RETURN_ON_FALSE(zone < JOURNAL_MAX_ZONES, ESP_ERR_INVALID_ARG, TAG, "invalid zone %u", zone);
+    journal_record_t record = {
+        .time = get_time(),
+        .value = value,
+        .detail = detail,
+        .type = type,
+        .zone = zone,
+    };
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(journal->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    // the batch is still full if the task is writing the previous one: the appending task does not wait for it
+    if (journal->pending == BATCH_RECORDS)
+    {
+        journal->data.dropped++;
+        xSemaphoreGive(journal->mutex);
+        ESP_LOGW(TAG, "Batch full, dropped a %s record", type_names[type]);
+        return ESP_ERR_NO_MEM;
+    }
+    record.sequence = journal->written + journal->in_flight + journal->pending;
+    record.check = get_check(&record);
+    journal->batch[journal->pending++] = record;
+    journal->data.appended++;
+    const bool full = journal->pending == BATCH_RECORDS;
+    xSemaphoreGive(journal->mutex);
+    if (full)
+    {
+        xTaskNotifyGive(journal->task);
+    }
+    return ESP_OK;
+}
+
+esp_err_t journal_get_data(journal_t journal, journal_data_t *data)
+{
+    ESP_RETURN_ON_FALSE(journal && data, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(journal->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    *data = journal->data;
+    data->next = journal->written + journal->in_flight + journal->pending;
+    data->pending = journal->in_flight + journal->pending;
+    xSemaphoreGive(journal->mutex);
+    return ESP_OK;
+}
+
+esp_err_t journal_read(journal_t journal, uint32_t from, uint32_t to, uint32_t *cursor,
+                       journal_record_t *records, size_t max, size_t *count)
+{
+    esp_err_t ret = ESP_OK;
+    ESP_RETURN_ON_FALSE(journal && cursor && records && count, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(journal->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    // the oldest records may have been erased since the previous call
+    uint32_t sequence = *cursor > journal->data.first ? *cursor : journal->data.first;
+    *count = 0;
+    while (*count < max && sequence < journal->written)
+    {
+        const uint32_t sector_end = (sequence / journal->sector_records + 1) * journal->sector_records;
+        const sector_index_t *index = &journal->index[get_sector(journal, sequence)];
+        if (!index->boot_times && (index->max_time < from || index->min_time > to))
+        {
+            sequence = sector_end;
+            continue;
+        }
+        // read into the caller's buffer, then keep the records in the range
+        uint32_t n = sector_end < journal->written ? sector_end - sequence : journal->written - sequence;
+        n = n < max - *count ? n : max - *count;
+        journal_record_t *const read = &records[*count];
+        ESP_GOTO_ON_ERROR(esp_partition_read(journal->partition, get_offset(journal, sequence), read,
+                                             n * sizeof(journal_record_t)),
+                          release_mutex, TAG, "read records %lu..%lu", (unsigned long)sequence,
+                          (unsigned long)(sequence + n - 1));
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (is_valid(&read[i], sequence + i) && read[i].time >= from && read[i].time <= to)
+            {
+                records[(*count)++] = read[i];
+            }
+        }
+        sequence += n;
+    }
+    // then the records not written yet, from the batch being written and the pending one
+    const uint32_t next = journal->written + journal->in_flight + journal->pending;
+    while (*count < max && sequence < next)
+    {
+        const uint32_t in_ram = sequence - journal->written;
+        const journal_record_t *const record = in_ram < journal->in_flight
+                                                   ? &journal->writing[in_ram]
+                                                   : &journal->batch[in_ram - journal->in_flight];
+        if (record->time >= from && record->time <= to)
+        {
+            records[(*count)++] = *record;
+        }
+        sequence++;
+    }
+    *cursor = sequence;
+release_mutex:
+    xSemaphoreGive(journal->mutex);
+    return ret;
+}
+
+const char *journal_type_name(journal_type_t type)
+{
+    return (unsigned)type < JOURNAL_TYPE_MAX ? type_names[type] : "unknown";
+}
+
+const char *journal_reason_name(journal_reason_t reason)
+{
+    return (unsigned)reason < JOURNAL_REASON_MAX ? reason_names[reason] : "unknown";
+}
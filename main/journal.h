@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+#define JOURNAL_MAX_ZONES 16               // the zone is recorded in 4 bits
+#define JOURNAL_CLOCK_SET_AFTER 1700000000 // record times before this are seconds since boot
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * An append-only journal of pump, flow and sensor events on a dedicated flash partition. Records
+     * have a fixed size and are appended to a RAM batch, which a low-priority task writes when it fills
+     * up or when the flush period passes, so that a busy hour costs a few flash writes rather than one
+     * per event. The task takes the batch and writes it without holding the journal's lock, so that an
+     * append never waits for the flash; a record appended while the batch is full is dropped instead.
+     *
+     * Records appended before the clock is set (by SNTP) are stamped with the time since boot, and held
+     * in RAM until it is, so that they are written with times since the epoch. They are held for up to
+     * 10 minutes after boot, and no longer than the batch has room for: the records written before the
+     * clock is set keep their times since boot, which are below JOURNAL_CLOCK_SET_AFTER.
+     *
+     * The partition is a ring of sectors: the sector ahead of the writes is erased when they reach it,
+     * which drops its (oldest) records. A record's sequence number determines its slot, so that the
+     * journal is recovered at open from the sectors' first records. The minimum and maximum times of
+     * each sector are kept in RAM, which lets range queries skip the sectors outside the range.
+     */
+    typedef struct journal_s *journal_t;
+
+    typedef enum
+    {
+        JOURNAL_PUMP_ON,      /// detail: journal_reason_t; value: the delta (in 0.01 °C; INT32_MIN: unknown)
+        JOURNAL_PUMP_OFF,     /// detail: journal_reason_t; value: milliseconds the pump ran
+        JOURNAL_FLOW_CYCLE,   /// detail: seconds the cycle lasted (saturated); value: pulses
+        JOURNAL_SENSOR_FAULT, /// detail: the esp_err_t of the first of failed readings in a row (16 bits)
+        JOURNAL_TYPE_MAX,
+    } journal_type_t;
+
+    typedef enum
+    {
+        JOURNAL_REASON_MANUAL,      /// set over HTTP (0, the reason of relay_set_state)
+        JOURNAL_REASON_FLOW,        /// water is drawn
+        JOURNAL_REASON_PREHEAT,     /// water is predicted to be drawn
+        JOURNAL_REASON_TEMPERATURE, /// the temperature delta fell
+        JOURNAL_REASON_CUTOFF,      /// the predicted cutoff passed
+        JOURNAL_REASON_TIMEOUT,     /// the cycle timed out
+        JOURNAL_REASON_MAX,
+    } journal_reason_t;
+
+    typedef struct
+    {
+        uint32_t sequence; /// records appended before this one since the partition was first used
+        uint32_t time;     /// seconds since the epoch (since boot if less than JOURNAL_CLOCK_SET_AFTER)
+        uint32_t value;    /// depends on the type
+        uint16_t detail;   /// depends on the type
+        uint8_t type : 4;  /// journal_type_t
+        uint8_t zone : 4;  /// index of the zone the event happened in (0 in journals of a single zone)
+        uint8_t check;     /// low byte of the CRC-32 of the bytes before it
+    } journal_record_t;
+
+    typedef struct
+    {
+        const char *partition_label; /// the data partition to keep the journal in (*required)
+        uint32_t flush_period;       /// max milliseconds an appended record waits in RAM (once the clock is set)
+    } journal_config_t;
+
+#define JOURNAL_CONFIG_DEFAULT()          \
+    {                                     \
+        .partition_label = "journal",     \
+        .flush_period = 60000,            \
+    }
+
+    typedef struct
+    {
+        uint32_t first;          /// sequence number of the oldest record in flash
+        uint32_t next;           /// sequence number of the next record to append
+        uint32_t capacity;       /// records the partition holds before the oldest are dropped
+        uint32_t pending;        /// appended records not yet written
+        uint32_t appended;       /// records appended since boot
+        uint32_t flushes;        /// batches written since boot
+        uint32_t erases;         /// sectors erased since boot
+        uint32_t write_failures; /// records lost to failed erases or writes since boot
+        uint32_t dropped;        /// records not appended since boot, as the batch was full (being written)
+    } journal_data_t;
+
+    esp_err_t journal_open(const journal_config_t *config, journal_t *journal_out);
+    // Writes the pending records before closing.
+    esp_err_t journal_close(journal_t journal);
+    // zone is the index of the zone the event happened in (less than JOURNAL_MAX_ZONES).
+    esp_err_t journal_append(journal_t journal, uint8_t zone, journal_type_t type, uint16_t detail, uint32_t value);
+    esp_err_t journal_get_data(journal_t journal, journal_data_t *data);
+
+    /*
+     * Copies up to max of the records (written or pending) with a time in [from, to], starting at
+     * sequence number *cursor (0 for the oldest), and advances *cursor past the records examined. Fewer
+     * than max records (possibly 0) means that the end of the journal was reached.
+     */
+    esp_err_t journal_read(journal_t journal, uint32_t from, uint32_t to, uint32_t *cursor,
+                           journal_record_t *records, size_t max, size_t *count);
+
+    const char *journal_type_name(journal_type_t type);
+    const char *journal_reason_name(journal_reason_t reason);
+
+#ifdef __cplusplus
+}
+#endif
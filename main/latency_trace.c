@@ -0,0 +1,123 @@
+#include <stdatomic.h>
+#include <esp_check.h>
+#include <esp_timer.h>
+#include "latency_trace.h"
+
+#if CONFIG_LATENCY_TRACE
+
+static const char *TAG = "latency_trace";
+
+typedef struct
+{
+    atomic_uint count;
+    atomic_uint_least64_t sum;
+    atomic_uint max;
+    atomic_uint buckets[LATENCY_TRACE_BUCKETS];
+} histogram_t;
+
+static histogram_t s_histograms[LATENCY_TRACE_STAGE_MAX];
+
+// The number of significant bits of latency, i.e. the bucket it falls in.
+static size_t bucket_of(uint32_t latency)
+{
+    const size_t bucket = latency ? 32 - __builtin_clz(latency) : 0;
+    return bucket < LATENCY_TRACE_BUCKETS ? bucket : LATENCY_TRACE_BUCKETS - 1;
+}
+
+static void record(latency_trace_stage_t stage, int64_t latency)
+{
+    histogram_t *const histogram = &s_histograms[stage];
+    const uint32_t value = latency < 0 ? 0 : latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency;
+    // relaxed: the counters are independent, and readers accept a latency missing from some of them
+    atomic_fetch_add_explicit(&histogram->buckets[bucket_of(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+    unsigned max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while (value > max &&
+           !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value, memory_order_relaxed,
+                                                  memory_order_relaxed))
+    {
+    }
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+}
+
+void latency_trace_begin(latency_trace_span_t *span, int64_t origin)
+{
+    span->origin = origin;
+    span->mark = origin;
+}
+
+void latency_trace_mark(latency_trace_span_t *span, latency_trace_stage_t stage)
+{
+    if (span->origin && stage < LATENCY_TRACE_STAGE_MAX)
+    {
+        const int64_t now = esp_timer_get_time();
+        record(stage, now - span->mark);
+        span->mark = now;
+    }
+}
+
+void latency_trace_end(latency_trace_span_t *span, latency_trace_stage_t stage)
+{
+    if (span->origin)
+    {
+        latency_trace_mark(span, stage);
+        record(LATENCY_TRACE_TOTAL, span->mark - span->origin);
+        span->origin = 0;
+    }
+}
+
+esp_err_t latency_trace_get_data(latency_trace_stage_t stage, latency_trace_data_t *data)
+{
+    ESP_RETURN_ON_FALSE(stage < LATENCY_TRACE_STAGE_MAX && data, ESP_ERR_INVALID_ARG, TAG, "invalid args");
+    const histogram_t *const histogram = &s_histograms[stage];
+    data->count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+    data->sum = atomic_load_explicit(&histogram->sum, memory_order_relaxed);
+    data->max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    for (size_t i = 0; i < LATENCY_TRACE_BUCKETS; i++)
+    {
+        data->buckets[i] = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+    }
+    return ESP_OK;
+}
+
+#endif
+
+uint32_t latency_trace_get_quantile(const latency_trace_data_t *data, float q)
+{
+    uint32_t count = 0;
+    for (size_t i = 0; i < LATENCY_TRACE_BUCKETS; i++)
+    {
+        count += data->buckets[i];
+    }
+    // the rank of the quantile, counted from 1
+    const uint32_t rank = q <= 0 ? 1 : q >= 1 ? count : (uint32_t)(q * count + 0.999999f);
+    uint32_t seen = 0;
+    for (size_t i = 0; i < LATENCY_TRACE_BUCKETS && count; i++)
+    {
+        seen += data->buckets[i];
+        if (seen >= rank)
+        {
+            // the max bounds the quantile more tightly than the last buckets
+            const uint32_t bound = latency_trace_bucket_bound(i);
+            return bound < data->max ? bound : data->max;
+        }
+    }
+    return 0;
+}
+
+uint32_t latency_trace_bucket_bound(size_t bucket)
+{
+    return bucket + 1 < LATENCY_TRACE_BUCKETS ? (uint32_t)1 << bucket : UINT32_MAX;
+}
+
+const char *latency_trace_stage_name(latency_trace_stage_t stage)
+{
+    static const char *const names[LATENCY_TRACE_STAGE_MAX] = {
+        [LATENCY_TRACE_DETECTION] = "detection",
+        [LATENCY_TRACE_INPUT] = "input",
+        [LATENCY_TRACE_DECISION] = "decision",
+        [LATENCY_TRACE_RELAY] = "relay",
+        [LATENCY_TRACE_TOTAL] = "total",
+    };
+    return stage < LATENCY_TRACE_STAGE_MAX ? names[stage] : "unknown";
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "sdkconfig.h"
+
+#define LATENCY_TRACE_BUCKETS 24 // bucket i counts latencies in [2^(i-1), 2^i) µs; the last one, all longer ones
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Per-stage latency histograms of the path from the first pulse of a flow cycle to the relay GPIO.
+     * A span travels with the flow message: each trace point records the time since the previous one
+     * into its stage's histogram, whose counters are atomics, so that the control task never waits on
+     * a reader. Histograms have logarithmic (power of 2) buckets of microseconds.
+     *
+     * The trace points are macros, which expand to nothing without CONFIG_LATENCY_TRACE.
+     */
+    typedef enum
+    {
+        LATENCY_TRACE_DETECTION, /// first pulse -> cycle notification dequeued by the control task
+        LATENCY_TRACE_INPUT,     /// dequeued -> decision input read (sensor, relay and model get_data calls)
+        LATENCY_TRACE_DECISION,  /// input read -> actions decided and recorded in the pump trace
+        LATENCY_TRACE_RELAY,     /// actions decided -> relay GPIO set (only cycles that turn the pump on)
+        LATENCY_TRACE_TOTAL,     /// first pulse -> relay GPIO set (only cycles that turn the pump on)
+        LATENCY_TRACE_STAGE_MAX,
+    } latency_trace_stage_t;
+
+    typedef struct
+    {
+        int64_t origin; /// microseconds since boot the span began at (0: not begun)
+        int64_t mark;   /// microseconds since boot of the latest trace point
+    } latency_trace_span_t;
+
+    typedef struct
+    {
+        uint32_t count;
+        uint64_t sum; /// microseconds
+        uint32_t max; /// microseconds
+        uint32_t buckets[LATENCY_TRACE_BUCKETS];
+    } latency_trace_data_t;
+
+#if CONFIG_LATENCY_TRACE
+#define LATENCY_TRACE_BEGIN(span, origin) latency_trace_begin(span, origin)
+#define LATENCY_TRACE_MARK(span, stage) latency_trace_mark(span, stage)
+#define LATENCY_TRACE_END(span, stage) latency_trace_end(span, stage)
+#else
+#define LATENCY_TRACE_BEGIN(span, origin) ((void)0)
+#define LATENCY_TRACE_MARK(span, stage) ((void)0)
+#define LATENCY_TRACE_END(span, stage) ((void)0)
+#endif
+
+    // Begins the span at origin (microseconds since boot); a 0 origin leaves it untraced.
+    void latency_trace_begin(latency_trace_span_t *span, int64_t origin);
+    // Records the time since the span's previous trace point as the latency of stage.
+    void latency_trace_mark(latency_trace_span_t *span, latency_trace_stage_t stage);
+    // Marks stage, records the time since the span began as LATENCY_TRACE_TOTAL, and ends the span.
+    void latency_trace_end(latency_trace_span_t *span, latency_trace_stage_t stage);
+
+    /*
+     * Copies the histogram of stage. The counters are read one at a time, so a latency recorded
+     * meanwhile may be missing from some of them.
+     */
+    esp_err_t latency_trace_get_data(latency_trace_stage_t stage, latency_trace_data_t *data);
+    // The upper bound (in microseconds) of the bucket holding the quantile q (0-1), or 0 without latencies.
+    uint32_t latency_trace_get_quantile(const latency_trace_data_t *data, float q);
+    // The exclusive upper bound (in microseconds) of bucket; UINT32_MAX for the last one.
+    uint32_t latency_trace_bucket_bound(size_t bucket);
+    const char *latency_trace_stage_name(latency_trace_stage_t stage);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,5 +1,10 @@
 #include <sys/param.h>
 #include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stdatomic.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 #include <freertos/semphr.h>
@@ -10,6 +15,7 @@
 #include <esp_log.h>
 #include <esp_system.h>
 #include <nvs_flash.h>
+#include <esp_netif_sntp.h>
 #include "driver/gpio.h"
 #include "esp_netif.h"
 #include "esp_eth.h"
@@ -19,222 +25,619 @@
 #include "pulse_sensor.h"
 #include "temperature_delta_sensor.h"
 #include "relay.h"
+#include "history.h"
+#include "event_stream.h"
 #include "httpd.h"
+#include "httpd_events.h"
+#include "httpd_status.h"
+#include "httpd_metrics.h"
+#include "preheat.h"
+#include "totals.h"
+#include "journal.h"
+#include "zone.h"
+#include "system_monitor.h"
+#include "reporter.h"
+
+#define FLOW_HISTORY_PERIOD 1000000     //  1 second
+#define USEC_IN_SEC (double)1000000
+
+static const char *TAG = "main";
 
-#define MAX_TEMP_DIFF 6                 //  (°C)
-#define MIN_TEMP_DIFF 3                 //  (°C)
-#define MIN_PUMP_OFF_DURATION 180000000 //  3 minutes
-#define MIN_PUMP_ON_DURATION 60000000   //  1 minute
-#define MAX_PUMP_ON_DURATION 600000000  // 10 minutes
 typedef enum
 {
-    FLOW_STARTED,
-    TEMPERATURE_MEASURED,
-    PUMP_TIMEOUT,
-} pump_pump_control_message_type_t;
+    HISTORY_SERIES_FLOW,
+    HISTORY_SERIES_RELAY,
+    HISTORY_SERIES_TEMPERATURE, /// the first temperature channel, which the others follow
+} history_series_t;
+
+// What the board keeps for each zone besides the zone itself.
 typedef struct
 {
-    pump_pump_control_message_type_t type;
-    float temperature_delta;
-} pump_control_message_t;
+    zone_t zone;
+    zone_config_t config; /// static, as the history series use its probe and delta names
+    history_series_config_t history_series[HISTORY_SERIES_TEMPERATURE + TEMPERATURE_DELTA_SENSOR_MAX_CHANNELS];
+    history_t history;
+    httpd_status_t status;
+    pulse_sensor_data_t ended; /// the flow totals as of the latest cycle end
+    float recorded_rate;       /// the latest flow rate in the history
+    window_stats_t flow_stats; /// of the flow rate, sampled with the history
+    totals_t totals;           /// lifetime totals of the zone's pump, probes and flow meter
+} zone_context_t;
 
-static const char *TAG = "main";
-
-static QueueHandle_t flow_reporting_queue;
-static QueueHandle_t temperature_reporting_queue;
-static QueueHandle_t pump_control_queue;
-
-static pulse_sensor_t s_flow_sensor;
-static temperature_delta_sensor_t s_temperature_delta_sensor;
-static relay_t s_relay;
 static httpd_handle_t s_httpd;
+static event_stream_t s_event_stream;
+static journal_t s_journal;
+static reporter_t s_reporter; /// NULL if reporting is disabled
+static zone_context_t s_zones[CONFIG_ZONES];
 
-static void flow_reporting_task_handler(void *args)
+// The zone of the relay, sensor or zone_t the event is about (NULL before the zone is opened).
+static zone_context_t *find_zone(esp_event_base_t event_base, const void *event_data)
 {
-    pulse_sensor_notification_t pulse_sensor_notification;
-    const pump_control_message_t ctrl_msg = {.type = FLOW_STARTED};
-
-    while (true)
+    for (size_t i = 0; i < CONFIG_ZONES; i++)
     {
-        if (!xQueueReceive(flow_reporting_queue, &pulse_sensor_notification, portMAX_DELAY))
+        const zone_t zone = s_zones[i].zone;
+        if (!zone)
         {
-            ESP_LOGW(TAG, "Pulse sensor notification receive timeout. Bailing out.");
-            break;
+            continue;
         }
-        switch (pulse_sensor_notification.type)
+        if ((event_base == TEMPERATURE_DELTA_SENSOR_EVENT &&
+             ((const temperature_delta_sensor_event_t *)event_data)->sensor ==
+                 zone_get_temperature_delta_sensor(zone)) ||
+            (event_base == RELAY_EVENT && ((const relay_event_t *)event_data)->relay == zone_get_relay(zone)) ||
+            (event_base == ZONE_EVENT && ((const zone_event_t *)event_data)->zone == zone))
         {
-        case PULSE_SENSOR_CYCLE_STARTED:
-            if (!xQueueSend(pump_control_queue, (void *)&(ctrl_msg), pdMS_TO_TICKS(10)))
-            {
-                ESP_LOGW(TAG, "Flow started message send timeout. Ignoring.");
-            }
-            break;
-        default:
-            break;
+            return &s_zones[i];
         }
     }
+    return NULL;
 }
 
-static void temperature_reporting_task_handler(void *args)
+static void publish_flow_event(zone_context_t *ctx, const char *state)
 {
-    temperature_delta_sensor_notification_t temperature_delta_sensor_notification;
-    pump_control_message_t ctrl_msg = {.type = TEMPERATURE_MEASURED};
+    pulse_sensor_data_t data;
+    if (pulse_sensor_get_data(zone_get_flow_sensor(ctx->zone), &data) == ESP_OK)
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(event_stream_publish(s_event_stream, "flow", ctx->config.name,
+                                                           "{\"zone\":\"%s\",\"state\":\"%s\",\"rate\":%.2f,"
+                                                           "\"t\":%.3f}",
+                                                           ctx->config.name, state,
+                                                           pulse_sensor_get_current_rate(&data),
+                                                           esp_timer_get_time() / USEC_IN_SEC));
+    }
+}
 
-    while (true)
+static void update_status(zone_context_t *ctx)
+{
+    // the sensors may report before the status is opened, which renders the current state anyway
+    if (ctx->status)
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_status_update(ctx->status));
+    }
+}
+
+// Journals the cycle that ended, from the increase of the totals since the previous one.
+static void record_flow_cycle(zone_context_t *ctx)
+{
+    pulse_sensor_data_t data;
+    if (pulse_sensor_get_data(zone_get_flow_sensor(ctx->zone), &data) == ESP_OK)
+    {
+        const uint64_t duration = (data.total_duration - ctx->ended.total_duration) / USEC_IN_SEC;
+        ESP_ERROR_CHECK_WITHOUT_ABORT(journal_append(s_journal, ctx - s_zones, JOURNAL_FLOW_CYCLE,
+                                                     duration < UINT16_MAX ? duration : UINT16_MAX,
+                                                     data.total_pulses - ctx->ended.total_pulses));
+        ctx->ended = data;
+    }
+}
+
+static void flow_event_handler(void *arg, esp_event_base_t event_base,
+                               int32_t event_id, void *event_data)
+{
+    zone_context_t *const ctx = find_zone(event_base, event_data);
+    if (!ctx)
+    {
+        return;
+    }
+    if (event_id == ZONE_EVENT_FLOW_STARTED)
+    {
+        publish_flow_event(ctx, "started");
+    }
+    else if (event_id == ZONE_EVENT_FLOW_ENDED)
+    {
+        record_flow_cycle(ctx);
+        publish_flow_event(ctx, "ended");
+    }
+    update_status(ctx);
+}
+
+static void history_event_handler(void *arg, esp_event_base_t event_base,
+                                  int32_t event_id, void *event_data)
+{
+    zone_context_t *const ctx = find_zone(event_base, event_data);
+    if (!ctx)
     {
-        if (!xQueueReceive(temperature_reporting_queue, &temperature_delta_sensor_notification, portMAX_DELAY))
+        return;
+    }
+    if (event_base == TEMPERATURE_DELTA_SENSOR_EVENT && event_id == TEMPERATURE_DELTA_SENSOR_EVENT_READING)
+    {
+        const temperature_delta_sensor_event_t *event = (const temperature_delta_sensor_event_t *)event_data;
+        for (size_t c = 0; c < event->channel_count; c++)
         {
-            ESP_LOGW(TAG, "Temperature sensor notification receive timeout. Bailing out.");
-            break;
+            ESP_ERROR_CHECK_WITHOUT_ABORT(history_record(ctx->history, HISTORY_SERIES_TEMPERATURE + c,
+                                                         event->timestamp, event->latest[c]));
         }
-        ctrl_msg.temperature_delta = temperature_delta_sensor_notification.delta;
-        if (!xQueueSend(pump_control_queue, (void *)&(ctrl_msg), pdMS_TO_TICKS(10)))
+    }
+    else if (event_base == RELAY_EVENT && event_id == RELAY_EVENT_STATE_CHANGED)
+    {
+        const relay_event_t *event = (const relay_event_t *)event_data;
+        ESP_ERROR_CHECK_WITHOUT_ABORT(history_record(ctx->history, HISTORY_SERIES_RELAY,
+                                                     event->timestamp, event->state));
+    }
+}
+
+static void event_stream_event_handler(void *arg, esp_event_base_t event_base,
+                                       int32_t event_id, void *event_data)
+{
+    const zone_context_t *const ctx = find_zone(event_base, event_data);
+    if (!ctx)
+    {
+        return;
+    }
+    if (event_base == TEMPERATURE_DELTA_SENSOR_EVENT && event_id == TEMPERATURE_DELTA_SENSOR_EVENT_READING)
+    {
+        const temperature_delta_sensor_event_t *event = (const temperature_delta_sensor_event_t *)event_data;
+        char channels[EVENT_STREAM_MESSAGE_SIZE] = "";
+        for (size_t c = 0, len = 0; c < event->channel_count && len < sizeof(channels); c++)
         {
-            ESP_LOGW(TAG, "Temperature measured message send timeout. Ignoring.");
+            // JSON has no NaN: an unknown temperature (a lost probe) is null
+            const char *name = temperature_delta_sensor_get_channel_name(event->sensor, c);
+            len += isnan(event->latest[c])
+                       ? snprintf(channels + len, sizeof(channels) - len, "\"%s\":null,", name)
+                       : snprintf(channels + len, sizeof(channels) - len, "\"%s\":%.2f,", name, event->latest[c]);
         }
+        ESP_ERROR_CHECK_WITHOUT_ABORT(event_stream_publish(s_event_stream, "temperature", ctx->config.name,
+                                                           "{\"zone\":\"%s\",%s\"t\":%.3f}", ctx->config.name,
+                                                           channels, event->timestamp / USEC_IN_SEC));
+    }
+    else if (event_base == RELAY_EVENT && event_id == RELAY_EVENT_STATE_CHANGED)
+    {
+        const relay_event_t *event = (const relay_event_t *)event_data;
+        ESP_ERROR_CHECK_WITHOUT_ABORT(event_stream_publish(s_event_stream, "relay", ctx->config.name,
+                                                           "{\"zone\":\"%s\",\"state\":\"%s\",\"t\":%.3f}",
+                                                           ctx->config.name, event->state ? "on" : "off",
+                                                           event->timestamp / USEC_IN_SEC));
     }
 }
 
-static void pump_timeout_handler(void *args)
+static void journal_event_handler(void *arg, esp_event_base_t event_base,
+                                  int32_t event_id, void *event_data)
 {
-    const pump_control_message_t ctrl_msg = {.type = PUMP_TIMEOUT};
-    if (!xQueueSend(pump_control_queue, (void *)&(ctrl_msg), pdMS_TO_TICKS(10)))
+    const zone_context_t *const ctx = find_zone(event_base, event_data);
+    if (!ctx)
+    {
+        return;
+    }
+    const uint8_t zone = ctx - s_zones;
+    if (event_base == TEMPERATURE_DELTA_SENSOR_EVENT && event_id == TEMPERATURE_DELTA_SENSOR_EVENT_FAULT)
+    {
+        // a run of faults (e.g. a lost probe, read again and again) is journaled once, with its first error
+        const temperature_delta_sensor_event_t *event = (const temperature_delta_sensor_event_t *)event_data;
+        if (event->failures == 1)
+        {
+            ESP_ERROR_CHECK_WITHOUT_ABORT(
+                journal_append(s_journal, zone, JOURNAL_SENSOR_FAULT, (uint16_t)event->err, 0));
+        }
+    }
+    else if (event_base == RELAY_EVENT && event_id == RELAY_EVENT_STATE_CHANGED)
     {
-        ESP_LOGW(TAG, "Timer tick message send timeout. Ignoring");
+        // changes over HTTP have no reason (0), which is JOURNAL_REASON_MANUAL
+        const relay_event_t *event = (const relay_event_t *)event_data;
+        if (event->state == RELAY_ON)
+        {
+            temperature_delta_sensor_data_t data;
+            ESP_ERROR_CHECK(temperature_delta_sensor_get_data(zone_get_temperature_delta_sensor(ctx->zone), &data));
+            const float value = temperature_delta_sensor_get_delta(&data);
+            const int32_t delta = isnan(value) ? INT32_MIN : value * 100;
+            ESP_ERROR_CHECK_WITHOUT_ABORT(journal_append(s_journal, zone, JOURNAL_PUMP_ON, event->reason, delta));
+        }
+        else
+        {
+            ESP_ERROR_CHECK_WITHOUT_ABORT(journal_append(s_journal, zone, JOURNAL_PUMP_OFF, event->reason,
+                                                         event->time_in_previous_state / 1000));
+        }
     }
 }
 
-static void pump_control_task_handler(void *args)
+static void reporter_event_handler(void *arg, esp_event_base_t event_base,
+                                   int32_t event_id, void *event_data)
 {
-    esp_timer_handle_t timeout_timer;
-    pump_control_message_t msg;
-    temperature_delta_sensor_data_t t_data;
-    relay_data_t r_data;
-
-    const esp_timer_create_args_t timer_args = {.callback = &pump_timeout_handler,
-                                                .name = "Pump timeout timer"};
-    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timeout_timer));
-
-    while (true)
+    const zone_context_t *const ctx = find_zone(event_base, event_data);
+    if (!ctx)
+    {
+        return;
+    }
+    // a full queue drops events, which the reporter counts: nothing to log for each
+    if (event_base == TEMPERATURE_DELTA_SENSOR_EVENT && event_id == TEMPERATURE_DELTA_SENSOR_EVENT_READING)
     {
-        if (!xQueueReceive(pump_control_queue, &msg, portMAX_DELAY))
+        const temperature_delta_sensor_event_t *event = (const temperature_delta_sensor_event_t *)event_data;
+        for (size_t c = 0; c < event->channel_count; c++)
         {
-            ESP_LOGW(TAG, "Pump control message receive timeout. Bailing out.");
-            break;
+            reporter_add(s_reporter, ctx->config.name, temperature_delta_sensor_get_channel_name(event->sensor, c),
+                         event->timestamp, event->latest[c]);
         }
-        ESP_LOGD(TAG, "Got pump control message type: %d", msg.type);
-        switch (msg.type)
+    }
+    else if (event_base == RELAY_EVENT && event_id == RELAY_EVENT_STATE_CHANGED)
+    {
+        const relay_event_t *event = (const relay_event_t *)event_data;
+        reporter_add(s_reporter, ctx->config.name, "relay", event->timestamp, event->state);
+    }
+    else if (event_base == ZONE_EVENT && (event_id == ZONE_EVENT_FLOW_STARTED || event_id == ZONE_EVENT_FLOW_ENDED))
+    {
+        pulse_sensor_data_t data;
+        if (pulse_sensor_get_data(zone_get_flow_sensor(ctx->zone), &data) == ESP_OK)
         {
-        case FLOW_STARTED:
-            ESP_ERROR_CHECK(temperature_delta_sensor_get_data(s_temperature_delta_sensor, &t_data));
-            ESP_ERROR_CHECK(relay_get_data(s_relay, &r_data));
-            if (t_data.info[TEMPERATURE_DELTA_SENSOR_DELTA].latest >= MAX_TEMP_DIFF &&
-                r_data.current_state == RELAY_OFF &&
-                (r_data.time_in_current_state >= MIN_PUMP_OFF_DURATION || !r_data.state_changes))
-            {
-                ESP_LOGI(TAG, "Turning pump ON");
-                ESP_ERROR_CHECK(esp_timer_start_once(timeout_timer, MAX_PUMP_ON_DURATION));
-                ESP_ERROR_CHECK(relay_set_state(s_relay, RELAY_ON));
-            }
-            break;
-        case TEMPERATURE_MEASURED:
-            if (msg.temperature_delta <= MIN_TEMP_DIFF)
+            reporter_add(s_reporter, ctx->config.name, "flow", esp_timer_get_time(),
+                         pulse_sensor_get_current_rate(&data));
+        }
+    }
+}
+
+static void status_event_handler(void *arg, esp_event_base_t event_base,
+                                 int32_t event_id, void *event_data)
+{
+    zone_context_t *const ctx = find_zone(event_base, event_data);
+    if (ctx)
+    {
+        update_status(ctx);
+    }
+}
+
+static void flow_history_timer_handler(void *args)
+{
+    for (size_t i = 0; i < CONFIG_ZONES; i++)
+    {
+        zone_context_t *const ctx = &s_zones[i];
+        pulse_sensor_data_t data;
+        if (pulse_sensor_get_data(zone_get_flow_sensor(ctx->zone), &data) == ESP_OK)
+        {
+            const int64_t now = esp_timer_get_time();
+            const float rate = pulse_sensor_get_current_rate(&data);
+            ESP_ERROR_CHECK_WITHOUT_ABORT(window_stats_add(ctx->flow_stats, now, &rate));
+            // the flow is a step series, so only changes need to be recorded
+            if (rate != ctx->recorded_rate)
             {
-                ESP_ERROR_CHECK(relay_get_data(s_relay, &r_data));
-                if (r_data.current_state == RELAY_ON &&
-                    r_data.time_in_current_state >= MIN_PUMP_ON_DURATION)
-                {
-                    ESP_LOGI(TAG, "Turning pump OFF (temperature reached)");
-                    ESP_ERROR_CHECK(relay_set_state(s_relay, RELAY_OFF));
-                    ESP_ERROR_CHECK(esp_timer_stop(timeout_timer));
-                }
+                ESP_ERROR_CHECK_WITHOUT_ABORT(history_record(ctx->history, HISTORY_SERIES_FLOW, now, rate));
+                ctx->recorded_rate = rate;
             }
-            break;
-        case PUMP_TIMEOUT:
-            ESP_LOGI(TAG, "Turning pump OFF (timeout)");
-            ESP_ERROR_CHECK(relay_set_state(s_relay, RELAY_OFF));
-            break;
-        default:
-            ESP_LOGW(TAG, "Unexpected pump control message type: %d. Ignoring", msg.type);
-            break;
         }
     }
-    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_delete(timeout_timer));
+}
+
+// Sets the zone's settings that all zones share.
+static void init_zone_config(zone_config_t *config, zone_executor_t executor)
+{
+    *config = (zone_config_t){
+        .executor = executor,
+        .flow_sensor = PULSE_SENSOR_CONFIG_DEFAULT(),
+        .temperature_delta_sensor = TEMPERATURE_SENSOR_PAIR_CONFIG_DEFAULT(),
+        .control = PUMP_CONTROL_CONFIG_DEFAULT(),
+        .preheat = PREHEAT_CONFIG_DEFAULT(),
+        .trace_records = CONFIG_PUMP_TRACE_RECORDS,
+    };
+    config->flow_sensor.min_cycle_pulses = CONFIG_FLOW_METER_SENSOR_MIN_PULSES;
+    config->temperature_delta_sensor.sample_period = CONFIG_TEMPERATURE_SENSORS_SAMPLE_PERIOD;
+    config->temperature_delta_sensor.pump_sample_period = CONFIG_TEMPERATURE_SENSORS_PUMP_SAMPLE_PERIOD;
+    config->temperature_delta_sensor.idle_sample_period = CONFIG_TEMPERATURE_SENSORS_IDLE_SAMPLE_PERIOD;
+    config->temperature_delta_sensor.read_retries = CONFIG_TEMPERATURE_SENSORS_READ_RETRIES;
+    config->temperature_delta_sensor.max_step = CONFIG_TEMPERATURE_SENSORS_MAX_STEP / 10.0f;
+    config->temperature_delta_sensor.lost_after = CONFIG_TEMPERATURE_SENSORS_LOST_AFTER;
+    config->preheat.lead = CONFIG_PREHEAT_LEAD;
+    config->preheat.min_likelihood = CONFIG_PREHEAT_MIN_LIKELIHOOD;
+    ESP_ERROR_CHECK(window_stats_parse_windows(&config->temperature_delta_sensor.stats, CONFIG_STATS_WINDOWS));
+    config->temperature_delta_sensor.stats.resolution = CONFIG_STATS_RESOLUTION;
+    config->temperature_delta_sensor.stats.time_constant = CONFIG_STATS_TIME_CONSTANT;
+}
+
+// Moves key from the from namespace to the to namespace, if it is still in the former.
+static esp_err_t move_nvs_key(const char *from, const char *to, const char *key)
+{
+    esp_err_t ret = ESP_OK;
+    nvs_handle_t nvs, target;
+    size_t length = 0;
+    // looked up read-only, so that the old namespace is not created on a board that never had it
+    esp_err_t err = nvs_open(from, NVS_READONLY, &nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_get_blob(nvs, key, NULL, &length);
+        nvs_close(nvs);
+    }
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        return ESP_OK;
+    }
+    ESP_RETURN_ON_ERROR(err, TAG, "find %s/%s", from, key);
+    void *const value = malloc(length);
+    ESP_RETURN_ON_FALSE(value, ESP_ERR_NO_MEM, TAG, "allocate %s/%s", from, key);
+    ESP_GOTO_ON_ERROR(nvs_open(from, NVS_READWRITE, &nvs), free_value, TAG, "open %s", from);
+    ESP_GOTO_ON_ERROR(nvs_get_blob(nvs, key, value, &length), close_nvs, TAG, "get %s/%s", from, key);
+    ESP_GOTO_ON_ERROR(nvs_open(to, NVS_READWRITE, &target), close_nvs, TAG, "open %s", to);
+    err = nvs_set_blob(target, key, value, length);
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(target);
+    }
+    nvs_close(target);
+    ESP_GOTO_ON_ERROR(err, close_nvs, TAG, "set %s/%s", to, key);
+    // erased once copied, so that an interrupted move is done again at the next boot
+    ESP_GOTO_ON_ERROR(nvs_erase_key(nvs, key), close_nvs, TAG, "erase %s/%s", from, key);
+    ESP_GOTO_ON_ERROR(nvs_commit(nvs), close_nvs, TAG, "commit %s", from);
+    ESP_LOGI(TAG, "Moved %s/%s to %s", from, key, to);
+close_nvs:
+    nvs_close(nvs);
+free_value:
+    free(value);
+    return ret;
+}
+
+// Moves the zone's settings to its namespace from where they were kept before each zone had one: the
+// pre-heat histogram and the thresholds in old_namespace, the totals in old_totals_namespace.
+static void move_zone_settings(const zone_config_t *config, const char *old_namespace,
+                               const char *old_totals_namespace)
+{
+    static const char *const keys[] = {"bins", "control"};
+    static const char *const totals_keys[] = {"totals_a", "totals_b"};
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(move_nvs_key(old_namespace, config->nvs_namespace, keys[i]));
+    }
+    for (size_t i = 0; i < sizeof(totals_keys) / sizeof(totals_keys[0]); i++)
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(move_nvs_key(old_totals_namespace, config->nvs_namespace, totals_keys[i]));
+    }
+}
+
+// Sets the zone's own settings from its Kconfig options, which are named prefix##<option> (zone 1 keeps the
+// options of a single-zone board).
+#define SET_ZONE_CONFIG(config, zone_name, prefix, namespace)                                                \
+    do                                                                                                       \
+    {                                                                                                        \
+        (config)->name = (zone_name);                                                                        \
+        (config)->flow_sensor.gpio_num = prefix##FLOW_METER_SENSOR_GPIO;                                     \
+        (config)->temperature_delta_sensor.gpio_num = prefix##TEMPERATURE_SENSORS_GPIO;                      \
+        (config)->relay_gpio_num = prefix##RELAY_GPIO;                                                       \
+        (config)->control.max_temperature_delta = prefix##PUMP_ON_TEMPERATURE_DELTA / 10.0f;                 \
+        (config)->control.min_temperature_delta = prefix##PUMP_OFF_TEMPERATURE_DELTA / 10.0f;                \
+        (config)->nvs_namespace = (namespace);                                                               \
+        (config)->preheat.nvs_namespace = (namespace);                                                       \
+        ESP_ERROR_CHECK(temperature_delta_sensor_parse_layout(&(config)->temperature_delta_sensor,           \
+                                                              prefix##TEMPERATURE_SENSORS_PROBES,            \
+                                                              prefix##TEMPERATURE_SENSORS_DELTAS));          \
+    } while (0)
+
+// Opens the zone's history, whose temperature series follow the zone's probes and deltas.
+static void open_history(zone_context_t *ctx)
+{
+    const temperature_delta_sensor_config_t *sensor_config = &ctx->config.temperature_delta_sensor;
+    history_series_config_t *const series = ctx->history_series;
+    series[HISTORY_SERIES_FLOW] = (history_series_config_t){
+        .name = "flow", .kind = HISTORY_SERIES_STEP, .resolution = 0.01}; // pulses/s
+    series[HISTORY_SERIES_RELAY] = (history_series_config_t){
+        .name = "relay", .kind = HISTORY_SERIES_STEP, .resolution = 0.0001};
+    size_t series_count = HISTORY_SERIES_TEMPERATURE;
+    for (size_t i = 0; i < sensor_config->probe_count; i++)
+    {
+        series[series_count++] = (history_series_config_t){
+            .name = sensor_config->probes[i].name, .kind = HISTORY_SERIES_SAMPLED, .resolution = 0.01};
+    }
+    for (size_t i = 0; i < sensor_config->delta_count; i++)
+    {
+        series[series_count++] = (history_series_config_t){
+            .name = sensor_config->deltas[i].name, .kind = HISTORY_SERIES_SAMPLED, .resolution = 0.01};
+    }
+    const history_config_t history_config = {.series = series, .series_count = series_count};
+    ESP_ERROR_CHECK(history_open(&history_config, &ctx->history));
+    ctx->recorded_rate = -1;
 }
 
 static void wifi_connect_handler(void *arg, esp_event_base_t event_base,
                                  int32_t event_id, void *event_data)
 {
-    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_open((httpd_context_t *)event_data, &s_httpd));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_open((httpd_context_t *)arg, &s_httpd));
+    if (s_reporter)
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(reporter_start(s_reporter));
+    }
 }
 
 static void wifi_disconnect_handler(void *arg, esp_event_base_t event_base,
                                     int32_t event_id, void *event_data)
 {
+    // the subscribers' async requests are freed with the server
+    ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_events_stop(((httpd_context_t *)arg)->events));
     ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_close(s_httpd));
     s_httpd = NULL;
+    // the reporter keeps the events until Wi-Fi is back
+    if (s_reporter)
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(reporter_stop(s_reporter));
+    }
 }
 
 void app_main(void)
 {
     ESP_LOGI(TAG, "Initializing...");
-    flow_reporting_queue = xQueueCreate(8, sizeof(pulse_sensor_notification_t));
-    ESP_ERROR_CHECK(flow_reporting_queue == NULL ? ESP_ERR_NO_MEM : ESP_OK);
-    ESP_ERROR_CHECK(xTaskCreate(&flow_reporting_task_handler, "Flow reporting task",
-                                2048, NULL, 1, NULL) == pdPASS
-                        ? ESP_OK
-                        : ESP_ERR_NO_MEM);
-
-    temperature_reporting_queue = xQueueCreate(8, sizeof(temperature_delta_sensor_notification_t));
-    ESP_ERROR_CHECK(temperature_reporting_queue == NULL ? ESP_ERR_NO_MEM : ESP_OK);
-    ESP_ERROR_CHECK(xTaskCreate(&temperature_reporting_task_handler, "Temperature reporting task",
-                                2048, NULL, 1, NULL) == pdPASS
-                        ? ESP_OK
-                        : ESP_ERR_NO_MEM);
-
-    pump_control_queue = xQueueCreate(16, sizeof(pump_control_message_t));
-    ESP_ERROR_CHECK(pump_control_queue == NULL ? ESP_ERR_NO_MEM : ESP_OK);
-    ESP_ERROR_CHECK(xTaskCreate(&pump_control_task_handler, "Pump control task",
-                                2048, NULL, 1, NULL) == pdPASS
-                        ? ESP_OK
-                        : ESP_ERR_NO_MEM);
+    // the pre-heat histogram is loaded from NVS, and binned by local time
+    ESP_ERROR_CHECK(nvs_flash_init());
+    setenv("TZ", CONFIG_TIMEZONE, 1);
+    tzset();
 
     ESP_ERROR_CHECK(gpio_install_isr_service(0));
+    // created before the zones, whose sensors and relays post their events to it
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
 
-    pulse_sensor_config_t pulse_sensor_config = PULSE_SENSOR_CONFIG_DEFAULT();
-    pulse_sensor_config.gpio_num = CONFIG_FLOW_METER_SENSOR_GPIO;
-    pulse_sensor_config.min_cycle_pulses = CONFIG_FLOW_METER_SENSOR_MIN_PULSES;
-    pulse_sensor_config.notification_queue = flow_reporting_queue;
-    ESP_ERROR_CHECK(pulse_sensor_open(&pulse_sensor_config, &s_flow_sensor));
+    zone_executor_config_t executor_config = ZONE_EXECUTOR_CONFIG_DEFAULT();
+    zone_executor_t executor;
+    ESP_ERROR_CHECK(zone_executor_open(&executor_config, &executor));
+    init_zone_config(&s_zones[0].config, executor);
+    SET_ZONE_CONFIG(&s_zones[0].config, CONFIG_ZONE_NAME, CONFIG_, "zone1");
+    // the first zone's totals were the board's
+    move_zone_settings(&s_zones[0].config, "preheat", "totals");
+#if CONFIG_ZONES >= 2
+    init_zone_config(&s_zones[1].config, executor);
+    SET_ZONE_CONFIG(&s_zones[1].config, CONFIG_ZONE_2_NAME, CONFIG_ZONE_2_, "zone2");
+    move_zone_settings(&s_zones[1].config, "preheat2", "preheat2");
+#endif
+#if CONFIG_ZONES >= 3
+    init_zone_config(&s_zones[2].config, executor);
+    SET_ZONE_CONFIG(&s_zones[2].config, CONFIG_ZONE_3_NAME, CONFIG_ZONE_3_, "zone3");
+    move_zone_settings(&s_zones[2].config, "preheat3", "preheat3");
+#endif
+    for (size_t i = 0; i < CONFIG_ZONES; i++)
+    {
+        open_history(&s_zones[i]);
+    }
+    ESP_ERROR_CHECK(esp_event_handler_register(TEMPERATURE_DELTA_SENSOR_EVENT, TEMPERATURE_DELTA_SENSOR_EVENT_READING,
+                                               &history_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(RELAY_EVENT, RELAY_EVENT_STATE_CHANGED, &history_event_handler, NULL));
 
-    temperature_delta_sensor_config_t temperature_delta_sensor_config =
-        TEMPERATURE_SENSOR_PAIR_CONFIG_DEFAULT();
-    temperature_delta_sensor_config.gpio_num = CONFIG_TEMPERATURE_SENSORS_GPIO;
-    temperature_delta_sensor_config.sample_period = CONFIG_TEMPERATURE_SENSORS_SAMPLE_PERIOD;
-    temperature_delta_sensor_config.notification_queue = temperature_reporting_queue;
+    journal_config_t journal_config = JOURNAL_CONFIG_DEFAULT();
+    journal_config.flush_period = CONFIG_JOURNAL_FLUSH_PERIOD * 1000;
+    ESP_ERROR_CHECK(journal_open(&journal_config, &s_journal));
+    ESP_ERROR_CHECK(esp_event_handler_register(TEMPERATURE_DELTA_SENSOR_EVENT, TEMPERATURE_DELTA_SENSOR_EVENT_FAULT,
+                                               &journal_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(RELAY_EVENT, RELAY_EVENT_STATE_CHANGED, &journal_event_handler, NULL));
 
-    ESP_ERROR_CHECK(temperature_delta_sensor_open(&temperature_delta_sensor_config,
-                                                  &s_temperature_delta_sensor));
+    const event_stream_config_t event_stream_config = {.slots = CONFIG_EVENTS_BUFFERED_MESSAGES};
+    ESP_ERROR_CHECK(event_stream_open(&event_stream_config, &s_event_stream));
+    ESP_ERROR_CHECK(esp_event_handler_register(TEMPERATURE_DELTA_SENSOR_EVENT, TEMPERATURE_DELTA_SENSOR_EVENT_READING,
+                                               &event_stream_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(RELAY_EVENT, RELAY_EVENT_STATE_CHANGED,
+                                               &event_stream_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(ZONE_EVENT, ESP_EVENT_ANY_ID, &flow_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(TEMPERATURE_DELTA_SENSOR_EVENT, ESP_EVENT_ANY_ID,
+                                               &status_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(RELAY_EVENT, RELAY_EVENT_STATE_CHANGED, &status_event_handler, NULL));
 
-    ESP_ERROR_CHECK(relay_open(CONFIG_RELAY_GPIO, &s_relay));
+    // reporting is enabled by a broker URI; the events are queued until Wi-Fi is up
+    if (CONFIG_REPORTER_BROKER_URI[0])
+    {
+        reporter_config_t reporter_config = REPORTER_CONFIG_DEFAULT();
+        reporter_config.uri = CONFIG_REPORTER_BROKER_URI;
+        reporter_config.topic = CONFIG_REPORTER_TOPIC;
+        reporter_config.capacity = CONFIG_REPORTER_CAPACITY;
+        reporter_config.batch_size = CONFIG_REPORTER_BATCH_SIZE;
+        reporter_config.batch_period = CONFIG_REPORTER_BATCH_PERIOD * 1000;
+        ESP_ERROR_CHECK(reporter_open(&reporter_config, &s_reporter));
+        ESP_ERROR_CHECK(esp_event_handler_register(TEMPERATURE_DELTA_SENSOR_EVENT,
+                                                   TEMPERATURE_DELTA_SENSOR_EVENT_READING, &reporter_event_handler,
+                                                   NULL));
+        ESP_ERROR_CHECK(esp_event_handler_register(RELAY_EVENT, RELAY_EVENT_STATE_CHANGED, &reporter_event_handler,
+                                                   NULL));
+        ESP_ERROR_CHECK(esp_event_handler_register(ZONE_EVENT, ESP_EVENT_ANY_ID, &reporter_event_handler, NULL));
+    }
 
     static httpd_context_t httpd_context;
-    httpd_context.temperature_delta_sensor = s_temperature_delta_sensor;
-    httpd_context.relay = s_relay;
-    httpd_context.flow_sensor = s_flow_sensor;
+    static httpd_metrics_zone_t metrics_zones[CONFIG_ZONES];
+    for (size_t i = 0; i < CONFIG_ZONES; i++)
+    {
+        zone_context_t *const ctx = &s_zones[i];
+        ESP_ERROR_CHECK(zone_open(&ctx->config, &ctx->zone));
+        // the flow rate is kept over the same windows as the temperatures
+        window_stats_config_t flow_stats_config = ctx->config.temperature_delta_sensor.stats;
+        flow_stats_config.channel_count = 1;
+        ESP_ERROR_CHECK(window_stats_open(&flow_stats_config, &ctx->flow_stats));
+        ESP_ERROR_CHECK(history_record(ctx->history, HISTORY_SERIES_RELAY, esp_timer_get_time(), RELAY_OFF));
+        ESP_ERROR_CHECK(event_stream_publish(s_event_stream, "relay", ctx->config.name,
+                                             "{\"zone\":\"%s\",\"state\":\"off\",\"t\":%.3f}", ctx->config.name,
+                                             esp_timer_get_time() / USEC_IN_SEC));
+
+        const httpd_status_config_t status_config = {
+            .relay = zone_get_relay(ctx->zone),
+            .temperature_delta_sensor = zone_get_temperature_delta_sensor(ctx->zone),
+            .flow_sensor = zone_get_flow_sensor(ctx->zone)};
+        ESP_ERROR_CHECK(httpd_status_open(&status_config, &ctx->status));
+
+        totals_config_t totals_config = TOTALS_CONFIG_DEFAULT();
+        totals_config.nvs_namespace = ctx->config.nvs_namespace;
+        totals_config.relay = zone_get_relay(ctx->zone);
+        totals_config.temperature_delta_sensor = zone_get_temperature_delta_sensor(ctx->zone);
+        totals_config.flow_sensor = zone_get_flow_sensor(ctx->zone);
+        totals_config.write_interval = CONFIG_TOTALS_CHECKPOINT_INTERVAL;
+        ESP_ERROR_CHECK(totals_open(&totals_config, &ctx->totals));
+
+        httpd_context.zones[i] = (httpd_zone_context_t){
+            .name = ctx->config.name,
+            .zone = ctx->zone,
+            .temperature_delta_sensor = zone_get_temperature_delta_sensor(ctx->zone),
+            .relay = zone_get_relay(ctx->zone),
+            .flow_sensor = zone_get_flow_sensor(ctx->zone),
+            .flow_stats = ctx->flow_stats,
+            .history = ctx->history,
+            .status = ctx->status,
+            .trace = zone_get_trace(ctx->zone),
+            .pump_model = zone_get_pump_model(ctx->zone),
+            .preheat = zone_get_preheat(ctx->zone),
+            .totals = ctx->totals};
+        metrics_zones[i] = (httpd_metrics_zone_t){
+            .name = ctx->config.name,
+            .relay = zone_get_relay(ctx->zone),
+            .temperature_delta_sensor = zone_get_temperature_delta_sensor(ctx->zone),
+            .flow_sensor = zone_get_flow_sensor(ctx->zone),
+            .totals = ctx->totals};
+    }
+    httpd_context.zone_count = CONFIG_ZONES;
+
+    esp_timer_handle_t flow_history_timer;
+    const esp_timer_create_args_t flow_history_timer_args = {.callback = &flow_history_timer_handler,
+                                                             .name = "Flow history timer"};
+    ESP_ERROR_CHECK(esp_timer_create(&flow_history_timer_args, &flow_history_timer));
+    flow_history_timer_handler(NULL);
+    ESP_ERROR_CHECK(esp_timer_start_periodic(flow_history_timer, FLOW_HISTORY_PERIOD));
+
+    ESP_ERROR_CHECK(httpd_events_open(s_event_stream, &httpd_context.events));
+    httpd_context.journal = s_journal;
+
+    // samples the tasks, heaps and control queues for GET /system
+    system_monitor_config_t system_monitor_config = SYSTEM_MONITOR_CONFIG_DEFAULT();
+    system_monitor_config.period = CONFIG_SYSTEM_MONITOR_PERIOD * 1000;
+#if !CONFIG_SYSTEM_MONITOR_LOG
+    system_monitor_config.log = false;
+#endif
+    system_monitor_config.queues[system_monitor_config.queue_count++] = (system_monitor_queue_t){
+        .name = "control", .queue = zone_executor_get_queue(executor, ZONE_SOURCE_TIMER)};
+    system_monitor_config.queues[system_monitor_config.queue_count++] = (system_monitor_queue_t){
+        .name = "flow", .queue = zone_executor_get_queue(executor, ZONE_SOURCE_FLOW)};
+    ESP_ERROR_CHECK(system_monitor_open(&system_monitor_config, &httpd_context.system));
+
+    static httpd_metrics_queue_t metrics_queues[] = {
+        {.name = "pump_control"},
+    };
+    metrics_queues[0].dropped = zone_executor_get_dropped(executor);
+    const httpd_metrics_config_t metrics_config = {.zones = metrics_zones,
+                                                   .zone_count = CONFIG_ZONES,
+                                                   .event_stream = s_event_stream,
+                                                   .queues = metrics_queues,
+                                                   .queue_count = sizeof(metrics_queues) / sizeof(metrics_queues[0]),
+                                                   .executor = executor,
+                                                   .reporter = s_reporter};
+    ESP_ERROR_CHECK(httpd_metrics_open(&metrics_config, &httpd_context.metrics));
 
-    ESP_ERROR_CHECK(nvs_flash_init());
     ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
 
     /* This helper function configures Wi-Fi as selected in menuconfig.
      * Read "Establishing Wi-Fi or Ethernet Connection" section in
      * examples/protocols/README.md for more information about this function.
      */
     ESP_ERROR_CHECK(example_connect());
+    const esp_sntp_config_t sntp_config = ESP_NETIF_SNTP_DEFAULT_CONFIG(CONFIG_SNTP_SERVER);
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_netif_sntp_init(&sntp_config));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_connect_handler, &httpd_context));
-    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &wifi_disconnect_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &wifi_disconnect_handler,
+                                               &httpd_context));
 
     ESP_ERROR_CHECK_WITHOUT_ABORT(httpd_open(&httpd_context, &s_httpd));
+    if (s_reporter)
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(reporter_start(s_reporter));
+    }
     ESP_LOGI(TAG, "Done initializing");
 }
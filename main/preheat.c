@@ -0,0 +1,242 @@
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <nvs.h>
+#include "preheat.h"
+
+#define TICK_PERIOD 60000000                      // checks for a predicted bin once a minute (µs)
+#define SAVE_PERIOD 3600                          // saves a changed histogram at most once an hour (s)
+#define CLOCK_SET_AFTER 1700000000                // wall clock (s) before which it is not set yet
+#define BIN_SECONDS (PREHEAT_BIN_MINUTES * 60)
+#define LEARNING_SHIFT 2                          // each week moves a bin 1/4 of the way to 0 or 256
+#define NVS_KEY "bins"
+#define MUTEX_TIMEOUT pdMS_TO_TICKS(100)
+
+static const char *TAG = "preheat";
+
+struct preheat_s
+{
+    preheat_config_t config;
+    preheat_data_t data;       /// guarded by mutex
+    SemaphoreHandle_t mutex;
+    esp_timer_handle_t timer;  /// ticks once a minute
+    int bin;                   /// the current bin, -1 until the clock is set
+    bool demand;               /// whether water was drawn in the current bin
+    int predicted_bin;         /// the latest predicted bin, -1 if none
+    time_t predicted_end;      /// the end of the latest predicted bin
+    time_t window_end;         /// a flow before this is a hit of the latest preheat, 0 if none
+    bool dirty;                /// whether bins changed since they were saved
+    time_t saved;              /// when bins were last saved
+};
+
+// Returns the bin of t, and the seconds t is into it.
+static int get_bin(time_t t, time_t *into)
+{
+    struct tm tm;
+    localtime_r(&t, &tm);
+    const int minute = (tm.tm_wday * 24 + tm.tm_hour) * 60 + tm.tm_min;
+    if (into)
+    {
+        *into = (minute % PREHEAT_BIN_MINUTES) * 60 + tm.tm_sec;
+    }
+    return minute / PREHEAT_BIN_MINUTES;
+}
+
+// Moves on to the bin of now, learning whether water was drawn in the one that ended.
+static void advance(preheat_t preheat, time_t now)
+{
+    const int bin = get_bin(now, NULL);
+    if (bin == preheat->bin)
+    {
+        return;
+    }
+    if (preheat->bin >= 0)
+    {
+        uint8_t *likelihood = &preheat->data.bins[preheat->bin];
+        const uint32_t learned = (*likelihood * ((1 << LEARNING_SHIFT) - 1) + (preheat->demand ? 256 : 0)) >>
+                                 LEARNING_SHIFT;
+        const uint8_t value = learned > UINT8_MAX ? UINT8_MAX : learned;
+        preheat->dirty |= value != *likelihood;
+        *likelihood = value;
+    }
+    preheat->bin = bin;
+    preheat->demand = false;
+}
+
+static esp_err_t save(const preheat_config_t *config, const uint8_t *bins)
+{
+    esp_err_t ret = ESP_OK;
+    nvs_handle_t nvs;
+    ESP_RETURN_ON_ERROR(nvs_open(config->nvs_namespace, NVS_READWRITE, &nvs), TAG, "open NVS");
+    ESP_GOTO_ON_ERROR(nvs_set_blob(nvs, NVS_KEY, bins, PREHEAT_BINS), close_nvs, TAG, "set blob");
+    ESP_GOTO_ON_ERROR(nvs_commit(nvs), close_nvs, TAG, "commit");
+    ESP_LOGI(TAG, "Saved histogram");
+close_nvs:
+    nvs_close(nvs);
+    return ret;
+}
+
+static void load(preheat_t preheat)
+{
+    nvs_handle_t nvs;
+    size_t length = PREHEAT_BINS;
+    esp_err_t err = nvs_open(preheat->config.nvs_namespace, NVS_READONLY, &nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_get_blob(nvs, NVS_KEY, preheat->data.bins, &length);
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK || length != PREHEAT_BINS)
+    {
+        // a histogram of another size (another PREHEAT_BIN_MINUTES) is not worth converting
+        ESP_LOGI(TAG, "No histogram loaded: %s", err == ESP_OK ? "size mismatch" : esp_err_to_name(err));
+        memset(preheat->data.bins, 0, PREHEAT_BINS);
+    }
+}
+
+static void tick(void *arg)
+{
+    const preheat_t preheat = (preheat_t)arg;
+    const time_t now = time(NULL);
+    if (now < CLOCK_SET_AFTER || !xSemaphoreTake(preheat->mutex, MUTEX_TIMEOUT))
+    {
+        return;
+    }
+    preheat->data.clock_set = true;
+    advance(preheat, now);
+    if (preheat->window_end && now >= preheat->window_end)
+    {
+        preheat->data.misses++;
+        preheat->window_end = 0;
+    }
+    // the histogram is copied so that NVS (slow flash writes) is written without the lock
+    uint8_t *bins = NULL;
+    if (preheat->dirty && now - preheat->saved >= SAVE_PERIOD && (bins = malloc(PREHEAT_BINS)))
+    {
+        memcpy(bins, preheat->data.bins, PREHEAT_BINS);
+        preheat->dirty = false;
+        preheat->saved = now;
+    }
+    time_t into;
+    const int upcoming = get_bin(now + preheat->config.lead, &into);
+    const bool predicted = upcoming != preheat->predicted_bin &&
+                           preheat->data.bins[upcoming] * 100 >= preheat->config.min_likelihood * 256;
+    if (predicted)
+    {
+        preheat->predicted_bin = upcoming;
+        preheat->predicted_end = now + preheat->config.lead - into + BIN_SECONDS;
+        preheat->data.predictions++;
+    }
+    xSemaphoreGive(preheat->mutex);
+    if (bins)
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(save(&preheat->config, bins));
+        free(bins);
+    }
+    if (predicted)
+    {
+        ESP_LOGI(TAG, "Demand predicted in %lu s", (unsigned long)preheat->config.lead);
+        preheat->config.callback(preheat->config.arg);
+    }
+}
+
+esp_err_t preheat_open(const preheat_config_t *config, preheat_t *preheat_out)
+{
+    esp_err_t ret = ESP_FAIL;
+    ESP_GOTO_ON_FALSE(config && config->nvs_namespace && config->callback && preheat_out, ESP_ERR_INVALID_ARG,
+                      handle_error, TAG, "null");
+    ESP_GOTO_ON_FALSE(config->min_likelihood <= 100, ESP_ERR_INVALID_ARG, handle_error, TAG, "invalid min_likelihood");
+    const preheat_t preheat = calloc(1, sizeof(struct preheat_s));
+    ESP_GOTO_ON_FALSE(preheat, ESP_ERR_NO_MEM, handle_error, TAG, "malloc preheat");
+    preheat->config = *config;
+    preheat->bin = -1;
+    preheat->predicted_bin = -1;
+    load(preheat);
+    preheat->mutex = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(preheat->mutex, ESP_ERR_NO_MEM, free_preheat, TAG, "create mutex");
+    const esp_timer_create_args_t timer_args = {.callback = &tick, .arg = preheat, .name = "Preheat timer"};
+    ESP_GOTO_ON_ERROR(esp_timer_create(&timer_args, &preheat->timer), delete_mutex, TAG, "create timer");
+    ESP_GOTO_ON_ERROR(esp_timer_start_periodic(preheat->timer, TICK_PERIOD), delete_timer, TAG, "start timer");
+    *preheat_out = preheat;
+    ESP_LOGI(TAG, "Opened with %d bins of %d minutes", PREHEAT_BINS, PREHEAT_BIN_MINUTES);
+    return ESP_OK;
+delete_timer:
+    esp_timer_delete(preheat->timer);
+delete_mutex:
+    vSemaphoreDelete(preheat->mutex);
+free_preheat:
+    free(preheat);
+handle_error:
+    return ret;
+}
+
+esp_err_t preheat_close(preheat_t preheat)
+{
+    ESP_RETURN_ON_FALSE(preheat, ESP_ERR_INVALID_ARG, TAG, "preheat must not be NULL");
+    esp_timer_stop(preheat->timer);
+    esp_timer_delete(preheat->timer);
+    if (preheat->dirty)
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(save(&preheat->config, preheat->data.bins));
+    }
+    vSemaphoreDelete(preheat->mutex);
+    free(preheat);
+    ESP_LOGI(TAG, "Closed");
+    return ESP_OK;
+}
+
+esp_err_t preheat_record_flow(preheat_t preheat)
+{
+    ESP_RETURN_ON_FALSE(preheat, ESP_ERR_INVALID_ARG, TAG, "preheat must not be NULL");
+    const time_t now = time(NULL);
+    if (now < CLOCK_SET_AFTER)
+    {
+        return ESP_OK;
+    }
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(preheat->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    advance(preheat, now);
+    if (preheat->window_end && now < preheat->window_end)
+    {
+        preheat->data.hits++;
+        preheat->window_end = 0;
+    }
+    else if (!preheat->demand)
+    {
+        preheat->data.unpredicted++;
+    }
+    preheat->demand = true;
+    xSemaphoreGive(preheat->mutex);
+    return ESP_OK;
+}
+
+esp_err_t preheat_begin(preheat_t preheat)
+{
+    ESP_RETURN_ON_FALSE(preheat, ESP_ERR_INVALID_ARG, TAG, "preheat must not be NULL");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(preheat->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    preheat->data.preheats++;
+    preheat->window_end = preheat->predicted_end;
+    xSemaphoreGive(preheat->mutex);
+    return ESP_OK;
+}
+
+esp_err_t preheat_end(preheat_t preheat, uint64_t on_duration)
+{
+    ESP_RETURN_ON_FALSE(preheat, ESP_ERR_INVALID_ARG, TAG, "preheat must not be NULL");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(preheat->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    preheat->data.runtime += on_duration;
+    xSemaphoreGive(preheat->mutex);
+    return ESP_OK;
+}
+
+esp_err_t preheat_get_data(preheat_t preheat, preheat_data_t *data)
+{
+    ESP_RETURN_ON_FALSE(preheat && data, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(preheat->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    *data = preheat->data;
+    xSemaphoreGive(preheat->mutex);
+    return ESP_OK;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <esp_err.h>
+
+#define PREHEAT_BIN_MINUTES 15                           // resolution of the demand histogram
+#define PREHEAT_BINS (7 * 24 * 60 / PREHEAT_BIN_MINUTES) // bins in a week
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Predicts hot-water demand from a time-of-week histogram of flow cycle starts, so that the pump
+     * can heat the loop just before the water is drawn instead of when it starts to be.
+     *
+     * Each bin holds the likelihood (in 1/256) that water is drawn in it, a moving average over the
+     * weeks updated when the bin ends. Once a minute, the bin lead seconds ahead is checked, and the
+     * callback is called when a likely one comes up. The histogram is saved to NVS once an hour (when
+     * it changed), and loaded at open.
+     *
+     * The histogram needs the wall clock: until it is set (by SNTP), flows are not recorded.
+     */
+    typedef struct preheat_s *preheat_t;
+
+    typedef struct
+    {
+        const char *nvs_namespace;   /// where to persist the histogram (*required)
+        uint32_t lead;               /// seconds ahead of a predicted bin to heat the loop
+        uint8_t min_likelihood;      /// likelihood (in %) from which a bin is predicted
+        void (*callback)(void *arg); /// called (from the esp_timer task) to heat the loop now (*required)
+        void *arg;                   /// the callback's argument
+    } preheat_config_t;
+
+#define PREHEAT_CONFIG_DEFAULT()     \
+    {                                \
+        .nvs_namespace = "preheat",  \
+        .lead = 300,                 \
+        .min_likelihood = 50,        \
+    }
+
+    typedef struct
+    {
+        bool clock_set;             /// whether the wall clock is set, so that the histogram is updated
+        uint32_t predictions;       /// bins predicted, i.e. callback calls
+        uint32_t preheats;          /// predictions for which the pump was turned on (preheat_begin)
+        uint32_t hits;              /// preheats followed by a flow before their bin ended
+        uint32_t misses;            /// preheats not followed by a flow
+        uint32_t unpredicted;       /// bins in which water was drawn without a preheat
+        uint64_t runtime;           /// microseconds the pump ran for preheats
+        uint8_t bins[PREHEAT_BINS]; /// likelihood (in 1/256) of a flow in each bin, from Sunday 00:00 local time
+    } preheat_data_t;
+
+    esp_err_t preheat_open(const preheat_config_t *config, preheat_t *preheat_out);
+    esp_err_t preheat_close(preheat_t preheat);
+
+    // Records the start of a flow cycle.
+    esp_err_t preheat_record_flow(preheat_t preheat);
+    // Records that the pump was turned on for a prediction.
+    esp_err_t preheat_begin(preheat_t preheat);
+    // Adds the on_duration (in microseconds) of a cycle started by preheat_begin.
+    esp_err_t preheat_end(preheat_t preheat, uint64_t on_duration);
+
+    esp_err_t preheat_get_data(preheat_t preheat, preheat_data_t *data);
+
+#ifdef __cplusplus
+}
+#endif
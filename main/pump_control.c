@@ -0,0 +1,99 @@
+#include <math.h>
+#include <stddef.h>
+#include "pump_control.h"
+
+typedef uint32_t (*transition_t)(const pump_control_config_t *config, const pump_control_input_t *input);
+
+// Starts a cycle if the loop cooled down (or its temperature is unknown) and the pump has been off for long enough.
+static uint32_t turn_on(const pump_control_config_t *config, const pump_control_input_t *input)
+{
+    if ((!isnan(input->temperature_delta) && input->temperature_delta < config->max_temperature_delta) ||
+        (input->time_in_relay_state < config->min_off_duration && input->relay_state_changes))
+    {
+        return 0;
+    }
+    return PUMP_CONTROL_RELAY_ON | PUMP_CONTROL_START_TIMEOUT | (input->cutoff_after ? PUMP_CONTROL_START_CUTOFF : 0);
+}
+
+static uint32_t off_flow_started(const pump_control_config_t *config, const pump_control_input_t *input)
+{
+    // the reading is refreshed so that TEMPERATURE_MEASURED follows without waiting for the next sample
+    return PUMP_CONTROL_REQUEST_READING | turn_on(config, input);
+}
+
+static uint32_t off_preheat(const pump_control_config_t *config, const pump_control_input_t *input)
+{
+    // no fresh reading: the sensor only samples slowly while the delta stays put
+    return turn_on(config, input);
+}
+
+static uint32_t on_flow_started(const pump_control_config_t *config, const pump_control_input_t *input)
+{
+    return PUMP_CONTROL_REQUEST_READING;
+}
+
+static uint32_t on_temperature_measured(const pump_control_config_t *config, const pump_control_input_t *input)
+{
+    // an unknown delta never ends the cycle: the timeout does
+    if (!isnan(input->temperature_delta) && input->temperature_delta <= config->min_temperature_delta &&
+        input->time_in_relay_state >= config->min_on_duration)
+    {
+        return PUMP_CONTROL_RELAY_OFF | PUMP_CONTROL_STOP_TIMEOUT | PUMP_CONTROL_STOP_CUTOFF;
+    }
+    return 0;
+}
+
+static uint32_t on_timeout(const pump_control_config_t *config, const pump_control_input_t *input)
+{
+    return PUMP_CONTROL_RELAY_OFF | PUMP_CONTROL_STOP_CUTOFF;
+}
+
+static uint32_t on_cutoff(const pump_control_config_t *config, const pump_control_input_t *input)
+{
+    // the predicted time alone is not trusted: the latest reading must show hot water arriving
+    if (!isnan(input->temperature_delta) && input->temperature_delta < config->max_temperature_delta &&
+        input->time_in_relay_state >= config->min_on_duration)
+    {
+        return PUMP_CONTROL_RELAY_OFF | PUMP_CONTROL_STOP_TIMEOUT;
+    }
+    return 0;
+}
+
+// NULL: nothing to do (e.g. a timeout that was queued just before the temperature turned the pump off)
+static const transition_t transitions[2][PUMP_CONTROL_EVENT_MAX] = {
+    [RELAY_OFF] = {
+        [PUMP_CONTROL_FLOW_STARTED] = off_flow_started,
+        [PUMP_CONTROL_TEMPERATURE_MEASURED] = NULL,
+        [PUMP_CONTROL_TIMEOUT] = NULL,
+        [PUMP_CONTROL_CUTOFF] = NULL,
+        [PUMP_CONTROL_PREHEAT] = off_preheat,
+    },
+    [RELAY_ON] = {
+        [PUMP_CONTROL_FLOW_STARTED] = on_flow_started,
+        [PUMP_CONTROL_TEMPERATURE_MEASURED] = on_temperature_measured,
+        [PUMP_CONTROL_TIMEOUT] = on_timeout,
+        [PUMP_CONTROL_CUTOFF] = on_cutoff,
+        [PUMP_CONTROL_PREHEAT] = NULL,
+    },
+};
+
+bool pump_control_is_valid_config(const pump_control_config_t *config)
+{
+    // written so that NANs fail; the model divides by min_temperature_delta
+    return config && config->min_temperature_delta > 0 &&
+           config->max_temperature_delta > config->min_temperature_delta && isfinite(config->max_temperature_delta) &&
+           config->max_on_duration && config->max_on_duration <= PUMP_CONTROL_MAX_DURATION &&
+           config->min_on_duration <= config->max_on_duration &&
+           config->min_off_duration <= PUMP_CONTROL_MAX_DURATION;
+}
+
+uint32_t pump_control_step(const pump_control_config_t *config, const pump_control_input_t *input)
+{
+    if (!config || !input || (unsigned)input->relay_state > RELAY_ON ||
+        (unsigned)input->event >= PUMP_CONTROL_EVENT_MAX)
+    {
+        return 0;
+    }
+    const transition_t transition = transitions[input->relay_state][input->event];
+    return transition ? transition(config, input) : 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "relay.h"
+
+#define PUMP_CONTROL_MAX_DURATION 86400000000ULL // 1 day: the longest duration a config may set (in microseconds)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * The pump control decisions, as a pure function of one input: the message being handled and the
+     * sensor and relay data read for it. It has no state and no side effects, so the firmware and the
+     * trace replay (host/pump_replay.c) make the same decisions from the same inputs.
+     *
+     * Without a temperature delta (a probe is lost), a flow turns the pump on and only the timeout
+     * turns it off.
+     */
+    typedef enum
+    {
+        PUMP_CONTROL_FLOW_STARTED,         /// a flow cycle started (someone draws water)
+        PUMP_CONTROL_TEMPERATURE_MEASURED, /// a temperature reading completed
+        PUMP_CONTROL_TIMEOUT,              /// the pump has been on for the cycle's max_on_duration
+        PUMP_CONTROL_CUTOFF,               /// the pump has been on for the cycle's cutoff_after
+        PUMP_CONTROL_PREHEAT,              /// hot water is predicted to be drawn soon
+        PUMP_CONTROL_EVENT_MAX,
+    } pump_control_event_t;
+
+    typedef enum
+    {
+        PUMP_CONTROL_REQUEST_READING = 1 << 0, /// start a temperature conversion now
+        PUMP_CONTROL_RELAY_ON = 1 << 1,
+        PUMP_CONTROL_RELAY_OFF = 1 << 2,
+        PUMP_CONTROL_START_TIMEOUT = 1 << 3, /// start the timer for the input's max_on_duration
+        PUMP_CONTROL_STOP_TIMEOUT = 1 << 4,
+        PUMP_CONTROL_START_CUTOFF = 1 << 5, /// start the timer for the input's cutoff_after
+        PUMP_CONTROL_STOP_CUTOFF = 1 << 6,
+    } pump_control_action_t;
+
+    typedef struct
+    {
+        float max_temperature_delta; /// delta (in °C) at or above which a flow turns the pump on
+        float min_temperature_delta; /// delta (in °C) at or below which the pump is turned off
+        uint64_t min_off_duration;   /// microseconds the pump stays off before it may turn on again
+        uint64_t min_on_duration;    /// microseconds the pump stays on before the temperature may turn it off
+        uint64_t max_on_duration;    /// microseconds after which the pump is always turned off
+    } pump_control_config_t;
+
+#define PUMP_CONTROL_CONFIG_DEFAULT()       \
+    {                                       \
+        .max_temperature_delta = 6,         \
+        .min_temperature_delta = 3,         \
+        .min_off_duration = 180000000,      \
+        .min_on_duration = 60000000,        \
+        .max_on_duration = 600000000,       \
+    }
+
+    typedef struct
+    {
+        pump_control_event_t event;
+        int64_t timestamp;            /// microseconds since boot when the message was handled
+        float temperature_delta;      /// the message's delta, or else the latest reading's (in °C; NAN: unknown)
+        relay_state_t relay_state;
+        uint64_t time_in_relay_state; /// microseconds
+        uint32_t relay_state_changes;
+        uint64_t cutoff_after;        /// microseconds after which a cycle starting now should end (0: unknown)
+        uint64_t max_on_duration;     /// timeout (in microseconds) of a cycle starting now
+    } pump_control_input_t;
+
+    /*
+     * Whether decisions can be made with the config: 0 < min_temperature_delta < max_temperature_delta,
+     * min_on_duration <= max_on_duration, and 0 < max_on_duration, min_off_duration <= PUMP_CONTROL_MAX_DURATION.
+     */
+    bool pump_control_is_valid_config(const pump_control_config_t *config);
+
+    // Returns the actions (a pump_control_action_t mask) to take for the input.
+    uint32_t pump_control_step(const pump_control_config_t *config, const pump_control_input_t *input);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,239 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include "snapshot.h"
+#include "pump_model.h"
+
+#define MIN_CYCLES 2         // cycles learned before the model makes predictions
+#define LEARNING_RATE 0.25f  // weight of the latest cycle in the learned parameters
+#define TRANSIT_DROP 0.2f    // fraction of the starting delta lost when hot water starts arriving
+#define DELTA_FLOOR 0.1f     // deltas below this (in °C) are within the sensors' noise
+#define NOISE_FRACTION 0.02f // and so are deltas below this fraction of the starting one
+#define DEFAULT_DECAY 10.0f  // decay (s) assumed until one is learned
+#define TIMEOUT_FACTOR 2.0f  // a cycle times out after this many times its predicted duration (or min_on)
+#define USEC_IN_SEC 1000000.0f
+
+static const char *TAG = "pump_model";
+
+typedef struct
+{
+    float time;  /// seconds since the pump turned on
+    float delta; /// in °C
+} sample_t;
+
+struct pump_model_s
+{
+    pump_control_config_t control;
+    pump_model_data_t data;                /// the learned parameters (owned by the feeding task)
+    pump_model_data_t snapshots[2];        /// published copies of data, for lock-free readers
+    snapshot_latch_t latch;                /// selects which of the snapshots readers copy
+    bool in_cycle;                         /// whether the pump is on
+    sample_t samples[PUMP_MODEL_MAX_SAMPLES];
+    uint32_t sample_count;
+    uint32_t stride;                       /// readings per kept sample, doubled whenever samples fill up
+    uint32_t readings;                     /// readings of the cycle
+};
+
+esp_err_t pump_model_open(const pump_control_config_t *control, pump_model_t *model_out)
+{
+    ESP_RETURN_ON_FALSE(control && model_out, ESP_ERR_INVALID_ARG, TAG, "null");
+    const pump_model_t model = calloc(1, sizeof(struct pump_model_s));
+    ESP_RETURN_ON_FALSE(model, ESP_ERR_NO_MEM, TAG, "malloc model");
+    model->control = *control;
+    model->data = (pump_model_data_t){
+        .transit = NAN,
+        .decay = NAN,
+        .last = {.start_delta = NAN, .transit = NAN, .decay = NAN, .predicted_cutoff = NAN, .on_duration = NAN},
+    };
+    snapshot_publish(&model->latch, model->snapshots, &model->data, sizeof(pump_model_data_t));
+    *model_out = model;
+    ESP_LOGI(TAG, "Opened");
+    return ESP_OK;
+}
+
+esp_err_t pump_model_close(pump_model_t model)
+{
+    ESP_RETURN_ON_FALSE(model, ESP_ERR_INVALID_ARG, TAG, "model must not be NULL");
+    free(model);
+    ESP_LOGI(TAG, "Closed");
+    return ESP_OK;
+}
+
+static float clamp(float value, float min, float max)
+{
+    return value < min ? min : value > max ? max : value;
+}
+
+void pump_model_set_control(pump_model_t model, const pump_control_config_t *control)
+{
+    model->control = *control;
+}
+
+void pump_model_predict(pump_model_t model, pump_control_input_t *input)
+{
+    const pump_control_config_t *control = &model->control;
+    input->cutoff_after = 0;
+    input->max_on_duration = control->max_on_duration;
+    // nothing to predict from a delta that is already low, or unknown
+    if (model->data.cycles < MIN_CYCLES || !(input->temperature_delta > control->min_temperature_delta))
+    {
+        return;
+    }
+    const float crossing =
+        model->data.transit + model->data.decay * logf(input->temperature_delta / control->min_temperature_delta);
+    const float min_on = control->min_on_duration / USEC_IN_SEC;
+    const float max_on = control->max_on_duration / USEC_IN_SEC;
+    // the timeout must leave the cutoff, clamped to min_on, room to be checked against a reading
+    input->max_on_duration = clamp(TIMEOUT_FACTOR * fmaxf(crossing, min_on), min_on, max_on) * USEC_IN_SEC;
+    if (crossing < max_on)
+    {
+        input->cutoff_after = clamp(crossing, min_on, max_on) * USEC_IN_SEC;
+    }
+}
+
+void pump_model_begin_cycle(pump_model_t model, const pump_control_input_t *input)
+{
+    model->in_cycle = true;
+    model->sample_count = 0;
+    model->stride = 1;
+    model->readings = 0;
+    model->data.last = (pump_model_cycle_t){
+        .start_delta = input->temperature_delta,
+        .transit = NAN,
+        .decay = NAN,
+        .predicted_cutoff = input->cutoff_after ? input->cutoff_after / USEC_IN_SEC : NAN,
+        .on_duration = NAN,
+    };
+}
+
+void pump_model_add_reading(pump_model_t model, const pump_control_input_t *input)
+{
+    if (!model->in_cycle || model->readings++ % model->stride)
+    {
+        return;
+    }
+    if (model->sample_count == PUMP_MODEL_MAX_SAMPLES)
+    {
+        // keep every other sample, which spreads them over the whole cycle however long it runs
+        for (uint32_t i = 0; i < PUMP_MODEL_MAX_SAMPLES / 2; i++)
+        {
+            model->samples[i] = model->samples[2 * i];
+        }
+        model->sample_count = PUMP_MODEL_MAX_SAMPLES / 2;
+        model->stride *= 2;
+        if ((model->readings - 1) % model->stride)
+        {
+            return;
+        }
+    }
+    model->samples[model->sample_count++] = (sample_t){
+        .time = input->time_in_relay_state / USEC_IN_SEC,
+        .delta = input->temperature_delta,
+    };
+}
+
+// Fits transit and decay to the cycle's readings; NAN when they do not determine them.
+static void fit(pump_model_t model, pump_model_cycle_t *cycle)
+{
+    const float d0 = cycle->start_delta;
+    if (!(d0 > DELTA_FLOOR))
+    {
+        return;
+    }
+    // the readings before the drop bound the transit from below, the first one after from above
+    float before = 0;
+    uint32_t first = 0;
+    while (first < model->sample_count && model->samples[first].delta >= d0 * (1 - TRANSIT_DROP))
+    {
+        before = model->samples[first++].time;
+    }
+    if (first == model->sample_count)
+    {
+        return;
+    }
+    // least squares fit of ln(delta / d0) = (transit - t) / decay, over the readings above the noise,
+    // which in the log domain would otherwise dominate the tail
+    const float floor = fmaxf(DELTA_FLOOR, d0 * NOISE_FRACTION);
+    float n = 0, st = 0, sy = 0, stt = 0, sty = 0;
+    for (uint32_t i = first; i < model->sample_count; i++)
+    {
+        const sample_t *s = &model->samples[i];
+        if (s->delta > floor)
+        {
+            const float y = logf(s->delta / d0);
+            n++;
+            st += s->time;
+            sy += y;
+            stt += s->time * s->time;
+            sty += s->time * y;
+        }
+    }
+    const float after = model->samples[first].time;
+    const float slope = n >= 2 ? (n * sty - st * sy) / (n * stt - st * st) : NAN;
+    if (slope < 0)
+    {
+        cycle->decay = -1 / slope;
+        cycle->transit = clamp((sy - slope * st) / n * cycle->decay, before, after);
+    }
+    else
+    {
+        // a single reading in the decay: the transit follows from the decay learned so far
+        const float decay = isnan(model->data.decay) ? DEFAULT_DECAY : model->data.decay;
+        const float delta = fmaxf(model->samples[first].delta, DELTA_FLOOR);
+        cycle->transit = clamp(after - decay * logf(d0 / delta), before, after);
+    }
+}
+
+static float learn(float learned, float value)
+{
+    return isnan(learned) ? value : learned + LEARNING_RATE * (value - learned);
+}
+
+void pump_model_end_cycle(pump_model_t model, uint64_t on_duration)
+{
+    if (!model->in_cycle)
+    {
+        return;
+    }
+    model->in_cycle = false;
+    pump_model_cycle_t *cycle = &model->data.last;
+    cycle->on_duration = on_duration / USEC_IN_SEC;
+    cycle->samples = model->readings;
+    fit(model, cycle);
+    if (!isnan(cycle->transit))
+    {
+        model->data.transit = learn(model->data.transit, cycle->transit);
+        if (!isnan(cycle->decay))
+        {
+            model->data.decay = learn(model->data.decay, cycle->decay);
+        }
+        else if (isnan(model->data.decay))
+        {
+            model->data.decay = DEFAULT_DECAY;
+        }
+        model->data.cycles++;
+    }
+    else
+    {
+        // timed out before hot water arrived: the transit is at least that long, and the next
+        // timeout (proportional to it) must grow, or the model would never see hot water again
+        model->data.cold_cycles++;
+        if (isnan(model->data.transit) || model->data.transit < cycle->on_duration)
+        {
+            model->data.transit = cycle->on_duration;
+        }
+    }
+    snapshot_publish(&model->latch, model->snapshots, &model->data, sizeof(pump_model_data_t));
+    ESP_LOGI(TAG, "Cycle of %.1f s: transit %.1f s, decay %.1f s (learned %.1f s, %.1f s from %lu cycles)",
+             cycle->on_duration, cycle->transit, cycle->decay, model->data.transit, model->data.decay,
+             (unsigned long)model->data.cycles);
+}
+
+esp_err_t pump_model_get_data(pump_model_t model, pump_model_data_t *data)
+{
+    ESP_RETURN_ON_FALSE(model && data, ESP_ERR_INVALID_ARG, TAG, "null");
+    snapshot_read(&model->latch, model->snapshots, data, sizeof(pump_model_data_t));
+    return ESP_OK;
+}
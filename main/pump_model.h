@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+#include "pump_control.h"
+
+#define PUMP_MODEL_MAX_SAMPLES 64 // readings kept per pump cycle (thinned out as a long cycle fills them)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Learns how the temperature delta falls once the pump is on: it stays flat for the pipe transit
+     * time, then decays exponentially as hot water reaches the return sensor:
+     *
+     *     delta(t) = delta(0) * exp(-(t - transit) / decay)    for t > transit
+     *
+     * Each cycle is fitted from its readings when the pump turns off, and the fits are averaged across
+     * cycles. The model then predicts when the delta of a new cycle reaches min_temperature_delta, so
+     * that the pump can be turned off then instead of at the next reading, and bounds the cycle with a
+     * timeout proportional to that prediction instead of the fixed max_on_duration.
+     *
+     * Not thread-safe except for pump_model_get_data: one task (the pump control task) feeds it.
+     */
+    typedef struct pump_model_s *pump_model_t;
+
+    typedef struct
+    {
+        float start_delta;      /// delta (in °C) when the pump turned on
+        float transit;          /// fitted transit time (s), NAN if hot water did not arrive
+        float decay;            /// fitted decay time constant (s), NAN if too few readings to fit it
+        float predicted_cutoff; /// predicted time (s) to reach min_temperature_delta, NAN if none
+        float on_duration;      /// time (s) the pump was on
+        uint32_t samples;       /// readings taken while on
+    } pump_model_cycle_t;
+
+    typedef struct
+    {
+        uint32_t cycles;         /// cycles the model learned from
+        uint32_t cold_cycles;    /// cycles that ended before hot water arrived
+        float transit;           /// learned transit time (s), NAN until learned
+        float decay;             /// learned decay time constant (s), NAN until learned
+        pump_model_cycle_t last; /// the latest cycle
+    } pump_model_data_t;
+
+    esp_err_t pump_model_open(const pump_control_config_t *control, pump_model_t *model_out);
+    esp_err_t pump_model_close(pump_model_t model);
+
+    // Predicts with control from now on (the learned fits do not depend on it).
+    void pump_model_set_control(pump_model_t model, const pump_control_config_t *control);
+
+    // Sets input->cutoff_after and input->max_on_duration for a cycle starting at input->temperature_delta.
+    void pump_model_predict(pump_model_t model, pump_control_input_t *input);
+
+    // Starts a cycle: the pump was turned on with the prediction made for input.
+    void pump_model_begin_cycle(pump_model_t model, const pump_control_input_t *input);
+    // Adds a reading taken while the pump is on (time_in_relay_state and temperature_delta).
+    void pump_model_add_reading(pump_model_t model, const pump_control_input_t *input);
+    // Ends the cycle after on_duration microseconds, and learns from it.
+    void pump_model_end_cycle(pump_model_t model, uint64_t on_duration);
+
+    esp_err_t pump_model_get_data(pump_model_t model, pump_model_data_t *data);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include "pump_trace.h"
+
+#define MUTEX_TIMEOUT pdMS_TO_TICKS(10) // max time the control task waits for a reader (10 ms)
+
+static const char *TAG = "pump_trace";
+
+struct pump_trace_s
+{
+    pump_trace_config_t config;
+    pump_control_config_t control; /// copied, so that the caller's config need not outlive the trace
+    pump_trace_record_t *ring;     /// config.records records, indexed by sequence % records
+    uint32_t start;                /// sequence number of the first record decided with control
+    uint32_t next;                 /// sequence number of the next record
+    SemaphoreHandle_t mutex;       /// guards control, ring, start and next
+};
+
+esp_err_t pump_trace_open(const pump_trace_config_t *config, pump_trace_t *trace_out)
+{
+    esp_err_t ret = ESP_FAIL;
+    ESP_GOTO_ON_FALSE(config && config->control && trace_out, ESP_ERR_INVALID_ARG, handle_error, TAG, "null");
+    ESP_GOTO_ON_FALSE(config->records, ESP_ERR_INVALID_ARG, handle_error, TAG, "no records");
+    const pump_trace_t trace = calloc(1, sizeof(struct pump_trace_s));
+    ESP_GOTO_ON_FALSE(trace, ESP_ERR_NO_MEM, handle_error, TAG, "malloc trace");
+    trace->config = *config;
+    trace->control = *config->control;
+    trace->config.control = &trace->control;
+    trace->ring = calloc(config->records, sizeof(pump_trace_record_t));
+    ESP_GOTO_ON_FALSE(trace->ring, ESP_ERR_NO_MEM, free_trace, TAG, "malloc %u records", (unsigned)config->records);
+    trace->mutex = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(trace->mutex, ESP_ERR_NO_MEM, free_ring, TAG, "create mutex");
+    *trace_out = trace;
+    ESP_LOGI(TAG, "Opened with %u records (%u bytes)", (unsigned)config->records,
+             (unsigned)(config->records * sizeof(pump_trace_record_t)));
+    return ESP_OK;
+free_ring:
+    free(trace->ring);
+free_trace:
+    free(trace);
+handle_error:
+    return ret;
+}
+
+esp_err_t pump_trace_close(pump_trace_t trace)
+{
+    ESP_RETURN_ON_FALSE(trace, ESP_ERR_INVALID_ARG, TAG, "trace must not be NULL");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(trace->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    vSemaphoreDelete(trace->mutex);
+    free(trace->ring);
+    free(trace);
+    ESP_LOGI(TAG, "Closed");
+    return ESP_OK;
+}
+
+esp_err_t pump_trace_record(pump_trace_t trace, const pump_control_input_t *input, uint32_t actions)
+{
+    ESP_RETURN_ON_FALSE(trace && input, ESP_ERR_INVALID_ARG, TAG, "null");
+    // built before taking the lock, which then only covers a copy
+    const pump_trace_record_t record = {
+        .timestamp = input->timestamp,
+        .time_in_relay_state = input->time_in_relay_state,
+        .temperature_delta = input->temperature_delta,
+        .relay_state_changes = input->relay_state_changes,
+        .cutoff_after = input->cutoff_after / 1000,
+        .max_on_duration = input->max_on_duration / 1000,
+        .event = input->event,
+        .relay_state = input->relay_state,
+        .actions = actions,
+    };
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(trace->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    memcpy(&trace->ring[trace->next % trace->config.records], &record, sizeof(record));
+    trace->next++;
+    xSemaphoreGive(trace->mutex);
+    return ESP_OK;
+}
+
+esp_err_t pump_trace_set_control(pump_trace_t trace, const pump_control_config_t *control)
+{
+    ESP_RETURN_ON_FALSE(trace && control, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(trace->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    trace->control = *control;
+    trace->start = trace->next;
+    xSemaphoreGive(trace->mutex);
+    ESP_LOGI(TAG, "Started over with a new config");
+    return ESP_OK;
+}
+
+esp_err_t pump_trace_get_header(pump_trace_t trace, pump_trace_header_t *header, uint32_t *first)
+{
+    ESP_RETURN_ON_FALSE(trace && header && first, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(trace->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    const uint32_t next = trace->next;
+    const uint32_t recorded = next - trace->start;
+    const pump_control_config_t control = trace->control;
+    xSemaphoreGive(trace->mutex);
+    const uint32_t count = recorded < trace->config.records ? recorded : trace->config.records;
+    *header = (pump_trace_header_t){
+        .version = PUMP_TRACE_VERSION,
+        .record_size = sizeof(pump_trace_record_t),
+        .count = count,
+        .overwritten = next - count,
+        .control = control,
+    };
+    memcpy(header->magic, PUMP_TRACE_MAGIC, sizeof(header->magic));
+    *first = next - count;
+    return ESP_OK;
+}
+
+esp_err_t pump_trace_read(pump_trace_t trace, uint32_t first, pump_trace_record_t *records, size_t count)
+{
+    esp_err_t ret = ESP_OK;
+    ESP_RETURN_ON_FALSE(trace && records, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(trace->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    // unsigned arithmetic, so that sequence numbers may wrap
+    const uint32_t available = trace->next - first;
+    ESP_GOTO_ON_FALSE(count <= available && available <= trace->config.records &&
+                          available <= trace->next - trace->start,
+                      ESP_ERR_NOT_FOUND, release_mutex, TAG, "records %lu..%lu not in the ring", (unsigned long)first,
+                      (unsigned long)(first + count));
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy(&records[i], &trace->ring[(first + i) % trace->config.records], sizeof(pump_trace_record_t));
+    }
+release_mutex:
+    xSemaphoreGive(trace->mutex);
+    return ret;
+}
+
+void pump_trace_get_input(const pump_trace_record_t *record, pump_control_input_t *input)
+{
+    *input = (pump_control_input_t){
+        .event = record->event,
+        .timestamp = record->timestamp,
+        .temperature_delta = record->temperature_delta,
+        .relay_state = record->relay_state,
+        .time_in_relay_state = record->time_in_relay_state,
+        .relay_state_changes = record->relay_state_changes,
+        .cutoff_after = (uint64_t)record->cutoff_after * 1000,
+        .max_on_duration = (uint64_t)record->max_on_duration * 1000,
+    };
+}
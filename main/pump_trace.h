@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include "pump_control.h"
+
+#define PUMP_TRACE_MAGIC "PCTR"
+#define PUMP_TRACE_VERSION 2
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Records every pump control input, and the actions decided for it, into a RAM ring of fixed-size
+     * binary records; the oldest records are overwritten. A serialized trace is a header followed by
+     * header.count records, oldest first, little-endian as on the device.
+     *
+     * A trace holds the decisions of a single config, so that it replays as recorded: setting another
+     * config starts it over.
+     */
+    typedef struct __attribute__((packed))
+    {
+        char magic[4];                 /// PUMP_TRACE_MAGIC
+        uint8_t version;               /// PUMP_TRACE_VERSION
+        uint8_t record_size;           /// sizeof(pump_trace_record_t)
+        uint16_t reserved;
+        uint32_t count;                /// records that follow
+        uint32_t overwritten;          /// records lost before the first one (overwritten, or of earlier configs)
+        pump_control_config_t control; /// the config the actions were decided with
+    } pump_trace_header_t;
+
+    typedef struct __attribute__((packed))
+    {
+        int64_t timestamp;
+        uint64_t time_in_relay_state;
+        float temperature_delta;
+        uint32_t relay_state_changes;
+        uint32_t cutoff_after;    /// milliseconds
+        uint32_t max_on_duration; /// milliseconds
+        uint8_t event;
+        uint8_t relay_state;
+        uint8_t actions; /// pump_control_action_t mask
+    } pump_trace_record_t;
+
+    typedef struct
+    {
+        size_t records;                        /// ring size (*required)
+        const pump_control_config_t *control;  /// (*required)
+    } pump_trace_config_t;
+
+    typedef struct pump_trace_s *pump_trace_t;
+
+    esp_err_t pump_trace_open(const pump_trace_config_t *config, pump_trace_t *trace_out);
+    esp_err_t pump_trace_close(pump_trace_t trace);
+
+    esp_err_t pump_trace_record(pump_trace_t trace, const pump_control_input_t *input, uint32_t actions);
+    // Starts the trace over: the records that follow are decided with control.
+    esp_err_t pump_trace_set_control(pump_trace_t trace, const pump_control_config_t *control);
+
+    // Fills the header of the trace as it is now; *first is set to the sequence number of its first record.
+    esp_err_t pump_trace_get_header(pump_trace_t trace, pump_trace_header_t *header, uint32_t *first);
+
+    /*
+     * Copies count records, starting at sequence number first. Returns ESP_ERR_NOT_FOUND when any of
+     * them is not recorded yet, or was overwritten (or the trace started over) since the header was read.
+     */
+    esp_err_t pump_trace_read(pump_trace_t trace, uint32_t first, pump_trace_record_t *records, size_t count);
+
+    // Rebuilds the input a record was made from.
+    void pump_trace_get_input(const pump_trace_record_t *record, pump_control_input_t *input);
+
+#ifdef __cplusplus
+}
+#endif
@@ -6,19 +6,29 @@
 #include <esp_log.h>
 #include <esp_timer.h>
 #include <driver/gpio.h>
+#include "snapshot.h"
 #include "relay.h"
 
-#define MUTEX_TIMEOUT pdMS_TO_TICKS(3) // max time to wait for a lock (3 ms)
+#define MUTEX_TIMEOUT pdMS_TO_TICKS(50) // max time to wait for the writer lock (50 ms)
 static const char *TAG = "relay";
 
-struct relay_s
+ESP_EVENT_DEFINE_BASE(RELAY_EVENT);
+
+typedef struct
 {
-    gpio_num_t gpio_num;       /// the GPIO pin number
     relay_state_t state;       /// current state (on or off)
     int64_t timestamp;         /// the time (microseconds since boot) of the latest state change
     uint64_t time_in_state[2]; /// time (in microseconds) spent in each state (up to last change)
     uint32_t state_changes;    /// the number of state changes (/2 for off=>on; /2 + 1 for on=>off)
-    SemaphoreHandle_t mutex;   /// synchronization mutex
+} relay_snapshot_t;
+
+struct relay_s
+{
+    gpio_num_t gpio_num;           /// the GPIO pin number
+    relay_snapshot_t current;      /// the latest state (owned by the writer holding the mutex)
+    relay_snapshot_t snapshots[2]; /// published copies of current, for lock-free readers
+    snapshot_latch_t latch;        /// selects which of the snapshots readers copy
+    SemaphoreHandle_t mutex;       /// serializes writers (the control task and HTTP handlers)
 };
 
 esp_err_t relay_open(const gpio_num_t gpio_num, relay_t *relay_out)
@@ -36,7 +46,8 @@ esp_err_t relay_open(const gpio_num_t gpio_num, relay_t *relay_out)
     ESP_GOTO_ON_ERROR(gpio_set_level(gpio_num, RELAY_OFF), reset_gpio, TAG,
                       "set level to 0 on GPIO %d", gpio_num);
 
-    relay->timestamp = esp_timer_get_time();
+    relay->current.timestamp = esp_timer_get_time();
+    snapshot_publish(&relay->latch, relay->snapshots, &relay->current, sizeof(relay_snapshot_t));
     *relay_out = relay;
     ESP_LOGI(TAG, "Opened (GPIO: %d)", gpio_num);
     return ESP_OK;
@@ -64,43 +75,71 @@ esp_err_t relay_close(const relay_t relay)
 }
 
 esp_err_t relay_set_state(const relay_t relay, relay_state_t state)
+{
+    return relay_set_state_with_reason(relay, state, 0);
+}
+
+esp_err_t relay_set_state_with_reason(const relay_t relay, relay_state_t state, uint32_t reason)
 {
     esp_err_t ret = ESP_OK;
     ESP_RETURN_ON_FALSE(relay, ESP_ERR_INVALID_ARG, TAG, "relay must not be NULL");
     ESP_RETURN_ON_FALSE(state == 0 || state == 1, ESP_ERR_INVALID_ARG, TAG, "invalid state %d", state);
     ESP_RETURN_ON_FALSE(xSemaphoreTake(relay->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
-    ESP_GOTO_ON_FALSE(relay->state != state, ESP_ERR_INVALID_STATE, release_mutex, TAG,
+    relay_event_t event = {.relay = relay, .state = state, .reason = reason};
+    relay_snapshot_t *const current = &relay->current;
+    ESP_GOTO_ON_FALSE(current->state != state, ESP_ERR_INVALID_STATE, release_mutex, TAG,
                       "state already set to %d", state);
     ESP_GOTO_ON_ERROR(gpio_set_level(relay->gpio_num, state), release_mutex, TAG, "set state to %d", state);
     const int64_t now = esp_timer_get_time();
-    relay->time_in_state[relay->state] += now - relay->timestamp;
-    relay->timestamp = now;
-    relay->state = state;
-    relay->state_changes++;
+    event.time_in_previous_state = now - current->timestamp;
+    current->time_in_state[current->state] += event.time_in_previous_state;
+    current->timestamp = now;
+    event.timestamp = now;
+    current->state = state;
+    current->state_changes++;
+    snapshot_publish(&relay->latch, relay->snapshots, current, sizeof(relay_snapshot_t));
     ESP_LOGI(TAG, "Set state to %d (GPIO:%d)", state, relay->gpio_num);
 release_mutex:
     ESP_RETURN_ON_FALSE(xSemaphoreGive(relay->mutex), ESP_ERR_NOT_FINISHED, TAG, "release mutex");
+    if (ret == ESP_OK)
+    {
+        // never block the caller (the control task) on listeners; a dropped event only costs history
+        const esp_err_t err = esp_event_post(RELAY_EVENT, RELAY_EVENT_STATE_CHANGED, &event, sizeof(event), 0);
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Post state change event: %d", err);
+        }
+    }
     return ret;
 }
 
 relay_state_t relay_get_state(const relay_t relay)
 {
     ESP_RETURN_ON_FALSE(relay, -1, TAG, "relay must not be NULL");
-    return relay->state;
+    relay_snapshot_t snapshot;
+    snapshot_read(&relay->latch, relay->snapshots, &snapshot, sizeof(relay_snapshot_t));
+    return snapshot.state;
 }
 
 esp_err_t relay_get_data(const relay_t relay, relay_data_t *data)
 {
     ESP_RETURN_ON_FALSE(relay, ESP_ERR_INVALID_ARG, TAG, "relay must not be NULL");
-    ESP_RETURN_ON_FALSE(xSemaphoreTake(relay->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
-    data->current_state = relay->state;
-    data->time_in_current_state = esp_timer_get_time() - relay->timestamp;
-    memcpy(data->time_in_state, relay->time_in_state, 2 * sizeof(uint64_t));
-    data->state_changes = relay->state_changes;
-    ESP_RETURN_ON_FALSE(xSemaphoreGive(relay->mutex), ESP_ERR_NOT_FINISHED, TAG, "release mutex");
+    ESP_RETURN_ON_FALSE(data, ESP_ERR_INVALID_ARG, TAG, "data must not be NULL");
+    relay_snapshot_t snapshot;
+    snapshot_read(&relay->latch, relay->snapshots, &snapshot, sizeof(relay_snapshot_t));
+    data->current_state = snapshot.state;
+    data->time_in_current_state = esp_timer_get_time() - snapshot.timestamp;
+    memcpy(data->time_in_state, snapshot.time_in_state, 2 * sizeof(uint64_t));
+    data->state_changes = snapshot.state_changes;
     return ESP_OK;
 }
 
+uint32_t relay_get_snapshot_retries(const relay_t relay)
+{
+    ESP_RETURN_ON_FALSE(relay, 0, TAG, "relay must not be NULL");
+    return snapshot_get_retries(&relay->latch);
+}
+
 uint32_t relay_get_total_state_changes(const relay_data_t *data, const relay_state_t state)
 {
     ESP_RETURN_ON_FALSE(data, 0, TAG, "NULL data");
@@ -3,12 +3,15 @@
 #include <stdint.h>
 #include <esp_err.h>
 #include <driver/gpio.h>
+#include <esp_event.h>
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+    ESP_EVENT_DECLARE_BASE(RELAY_EVENT);
+
     typedef struct relay_s *relay_t;
     typedef enum
     {
@@ -24,11 +27,28 @@ extern "C"
         uint32_t state_changes;
     } relay_data_t;
 
+    typedef enum
+    {
+        RELAY_EVENT_STATE_CHANGED, /// posted to the default event loop with a relay_event_t
+    } relay_event_id_t;
+
+    typedef struct
+    {
+        relay_t relay;                   /// the relay that changed state
+        relay_state_t state;             /// the new state
+        int64_t timestamp;               /// microseconds since boot of the change
+        uint64_t time_in_previous_state; /// microseconds the relay spent in the previous state
+        uint32_t reason;                 /// as passed to relay_set_state_with_reason (0 by relay_set_state)
+    } relay_event_t;
+
     esp_err_t relay_open(const gpio_num_t gpio_num, relay_t *relay_out);
     esp_err_t relay_close(const relay_t relay);
     esp_err_t relay_set_state(const relay_t relay, relay_state_t state);
+    // Like relay_set_state, with a caller-defined reason that is passed on in the relay_event_t.
+    esp_err_t relay_set_state_with_reason(const relay_t relay, relay_state_t state, uint32_t reason);
     relay_state_t relay_get_state(const relay_t relay);
     esp_err_t relay_get_data(const relay_t relay, relay_data_t *data);
+    uint32_t relay_get_snapshot_retries(const relay_t relay);
 
     uint32_t relay_get_total_state_changes(const relay_data_t *data, const relay_state_t state);
     uint64_t relay_get_total_time_in_state(const relay_data_t *data, const relay_state_t state);
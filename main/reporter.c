@@ -0,0 +1,383 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <mqtt_client.h>
+#include "reporter.h"
+
+#define MUTEX_TIMEOUT pdMS_TO_TICKS(10)   // max time a producer waits for the lock before dropping (10 ms)
+#define RETRY_DELAY pdMS_TO_TICKS(1000)   // after a publish the client refused
+#define HEADER_SIZE 96                    // max length of a payload without its events
+#define USEC_IN_SEC (double)1000000
+#define USEC_IN_MSEC 1000
+
+static const char *TAG = "reporter";
+
+typedef struct
+{
+    int64_t timestamp; /// microseconds since boot
+    const char *zone;
+    const char *name;
+    float value;
+} event_t;
+
+struct reporter_s
+{
+    reporter_config_t config;
+    esp_mqtt_client_handle_t client;
+    TaskHandle_t task;
+    event_t *ring;               /// config.capacity events waiting for a batch, from head
+    size_t head;
+    size_t count;
+    SemaphoreHandle_t mutex;     /// guards the ring
+    char *payload;               /// the batch in flight (owned by the task)
+    size_t payload_size;
+    size_t payload_len;          /// 0: no batch in flight
+    uint32_t payload_events;
+    uint32_t attempts;           /// publishes of the batch in flight
+    int msg_id;                  /// of the latest publish of the batch in flight (-1: to be published)
+    int64_t published_at;        /// microseconds since boot of that publish
+    uint32_t seq;                /// of the next batch
+    atomic_bool started;
+    atomic_bool connected;
+    atomic_int acked;            /// message id of the latest acknowledgement
+    atomic_int_least64_t acked_at;
+    atomic_uint events;
+    atomic_uint dropped;
+    atomic_uint batches;
+    atomic_uint published;
+    atomic_uint_least64_t bytes;
+    atomic_uint max_batch;
+    atomic_uint retries;
+    atomic_uint_least64_t latency_sum;
+    atomic_uint latency_max;
+};
+
+static void mqtt_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    const reporter_t reporter = (reporter_t)arg;
+    const esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
+    switch (event_id)
+    {
+    case MQTT_EVENT_CONNECTED:
+        ESP_LOGI(TAG, "Connected to %s", reporter->config.uri);
+        reporter->connected = true;
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        ESP_LOGW(TAG, "Disconnected");
+        reporter->connected = false;
+        break;
+    case MQTT_EVENT_PUBLISHED:
+        // the time first: the task reads the id first
+        reporter->acked_at = esp_timer_get_time();
+        reporter->acked = event->msg_id;
+        break;
+    default:
+        return;
+    }
+    xTaskNotifyGive(reporter->task);
+}
+
+// Formats the event, preceded by a comma unless it is the first of the batch; returns its length.
+static int format_event(char *buf, const event_t *event, bool first)
+{
+    const char *separator = first ? "" : ",";
+    const double t = event->timestamp / USEC_IN_SEC;
+    // JSON has no NaN: an unknown value (e.g. of a lost probe) is null
+    return isnan(event->value)
+               ? snprintf(buf, REPORTER_EVENT_SIZE + 1, "%s[%.3f,\"%s\",\"%s\",null]", separator, t, event->zone,
+                          event->name)
+               : snprintf(buf, REPORTER_EVENT_SIZE + 1, "%s[%.3f,\"%s\",\"%s\",%.7g]", separator, t, event->zone,
+                          event->name, event->value);
+}
+
+/*
+ * Moves the next batch from the ring into the payload if it is due (full, or its oldest event is
+ * batch_period old); otherwise returns how long until it is.
+ */
+static TickType_t take_batch(reporter_t reporter, int64_t now)
+{
+    const reporter_config_t *config = &reporter->config;
+    xSemaphoreTake(reporter->mutex, portMAX_DELAY);
+    if (!reporter->count)
+    {
+        xSemaphoreGive(reporter->mutex);
+        return portMAX_DELAY;
+    }
+    const int64_t due = reporter->ring[reporter->head].timestamp + (int64_t)config->batch_period * USEC_IN_MSEC;
+    if (reporter->count < config->batch_size && now < due)
+    {
+        xSemaphoreGive(reporter->mutex);
+        return pdMS_TO_TICKS((due - now) / USEC_IN_MSEC) + 1;
+    }
+    size_t len = snprintf(reporter->payload, HEADER_SIZE,
+                          "{\"seq\":%lu,\"time\":%lld,\"uptime\":%.3f,\"dropped\":%u,\"events\":[",
+                          (unsigned long)reporter->seq, (long long)time(NULL), now / USEC_IN_SEC,
+                          atomic_load(&reporter->dropped));
+    uint32_t events = 0;
+    while (events < config->batch_size && reporter->count)
+    {
+        const event_t *event = &reporter->ring[reporter->head];
+        const int n = format_event(reporter->payload + len, event, events == 0);
+        reporter->head = (reporter->head + 1) % config->capacity;
+        reporter->count--;
+        if (n < 0 || n > REPORTER_EVENT_SIZE)
+        {
+            ESP_LOGW(TAG, "Dropped an event of '%s' too long to report", event->name);
+            reporter->dropped++;
+            continue;
+        }
+        len += n;
+        events++;
+    }
+    xSemaphoreGive(reporter->mutex);
+    if (events)
+    {
+        len += snprintf(reporter->payload + len, reporter->payload_size - len, "]}");
+        reporter->payload_len = len;
+        reporter->payload_events = events;
+        reporter->attempts = 0;
+        reporter->msg_id = -1;
+        reporter->seq++;
+    }
+    return 0;
+}
+
+static void publish(reporter_t reporter, int64_t now)
+{
+    if (reporter->attempts++)
+    {
+        reporter->retries++;
+    }
+    reporter->published_at = now;
+    reporter->msg_id = esp_mqtt_client_publish(reporter->client, reporter->config.topic, reporter->payload,
+                                               reporter->payload_len, 1, 0);
+    if (reporter->msg_id < 0)
+    {
+        ESP_LOGW(TAG, "Publish of batch %lu refused", (unsigned long)(reporter->seq - 1));
+        reporter->msg_id = -1;
+    }
+}
+
+static void acknowledged(reporter_t reporter, int64_t at)
+{
+    const int64_t latency = at - reporter->published_at;
+    const unsigned latency_us = latency < 0 ? 0 : latency > UINT32_MAX ? UINT32_MAX : (unsigned)latency;
+    reporter->batches++;
+    reporter->published += reporter->payload_events;
+    reporter->bytes += reporter->payload_len;
+    reporter->latency_sum += latency_us;
+    // only the task writes the maximums
+    if (reporter->payload_events > reporter->max_batch)
+    {
+        reporter->max_batch = reporter->payload_events;
+    }
+    if (latency_us > reporter->latency_max)
+    {
+        reporter->latency_max = latency_us;
+    }
+    ESP_LOGD(TAG, "Batch %lu of %lu events acknowledged in %u us", (unsigned long)(reporter->seq - 1),
+             (unsigned long)reporter->payload_events, latency_us);
+    reporter->payload_len = 0;
+}
+
+// Advances the batch in flight (acknowledged, to publish or to publish again); returns how long to wait.
+static TickType_t step(reporter_t reporter)
+{
+    const int64_t now = esp_timer_get_time();
+    if (reporter->payload_len && reporter->msg_id >= 0 && reporter->acked == reporter->msg_id)
+    {
+        acknowledged(reporter, reporter->acked_at);
+    }
+    if (!reporter->connected)
+    {
+        // the acknowledgement of a batch in flight is lost with the connection
+        reporter->msg_id = -1;
+        return portMAX_DELAY;
+    }
+    if (!reporter->payload_len)
+    {
+        const TickType_t wait = take_batch(reporter, now);
+        if (!reporter->payload_len)
+        {
+            return wait;
+        }
+    }
+    const int64_t timeout = (int64_t)reporter->config.publish_timeout * USEC_IN_MSEC;
+    if (reporter->msg_id < 0 || now - reporter->published_at >= timeout)
+    {
+        publish(reporter, now);
+    }
+    if (reporter->msg_id < 0)
+    {
+        return RETRY_DELAY;
+    }
+    return pdMS_TO_TICKS((reporter->published_at + timeout - now) / USEC_IN_MSEC) + 1;
+}
+
+static void reporter_task(void *arg)
+{
+    const reporter_t reporter = (reporter_t)arg;
+    TickType_t wait = portMAX_DELAY;
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, wait);
+        wait = step(reporter);
+    }
+}
+
+esp_err_t reporter_open(const reporter_config_t *config, reporter_t *reporter_out)
+{
+    esp_err_t ret = ESP_FAIL;
+    ESP_GOTO_ON_FALSE(config && reporter_out, ESP_ERR_INVALID_ARG, handle_error, TAG, "null");
+    ESP_GOTO_ON_FALSE(config->uri && config->topic, ESP_ERR_INVALID_ARG, handle_error, TAG, "missing uri or topic");
+    ESP_GOTO_ON_FALSE(config->capacity && config->batch_size && config->batch_size <= config->capacity,
+                      ESP_ERR_INVALID_ARG, handle_error, TAG, "invalid capacity or batch_size");
+    ESP_GOTO_ON_FALSE(config->batch_period && config->publish_timeout, ESP_ERR_INVALID_ARG, handle_error, TAG,
+                      "invalid batch_period or publish_timeout");
+    const reporter_t reporter = calloc(1, sizeof(struct reporter_s));
+    ESP_GOTO_ON_FALSE(reporter, ESP_ERR_NO_MEM, handle_error, TAG, "malloc reporter");
+    reporter->config = *config;
+    reporter->msg_id = -1;
+    reporter->acked = -1;
+    reporter->ring = calloc(config->capacity, sizeof(event_t));
+    ESP_GOTO_ON_FALSE(reporter->ring, ESP_ERR_NO_MEM, free_reporter, TAG, "malloc %u events",
+                      (unsigned)config->capacity);
+    reporter->payload_size = HEADER_SIZE + config->batch_size * REPORTER_EVENT_SIZE + sizeof("]}");
+    reporter->payload = malloc(reporter->payload_size);
+    ESP_GOTO_ON_FALSE(reporter->payload, ESP_ERR_NO_MEM, free_ring, TAG, "malloc payload");
+    reporter->mutex = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(reporter->mutex, ESP_ERR_NO_MEM, free_payload, TAG, "create mutex");
+    const esp_mqtt_client_config_t mqtt_config = {
+        .broker.address.uri = config->uri,
+        // the client's own copy of the batch in flight, for retransmission
+        .outbox.limit = reporter->payload_size,
+    };
+    reporter->client = esp_mqtt_client_init(&mqtt_config);
+    ESP_GOTO_ON_FALSE(reporter->client, ESP_ERR_NO_MEM, delete_mutex, TAG, "init MQTT client");
+    ESP_GOTO_ON_FALSE(xTaskCreate(reporter_task, "Reporter", 3072, reporter, 1, &reporter->task) == pdPASS,
+                      ESP_ERR_NO_MEM, destroy_client, TAG, "create task");
+    ESP_GOTO_ON_ERROR(esp_mqtt_client_register_event(reporter->client, MQTT_EVENT_ANY, mqtt_event_handler, reporter),
+                      delete_task, TAG, "register MQTT events");
+    *reporter_out = reporter;
+    ESP_LOGI(TAG, "Opened for %s (%u events, batches of up to %u)", config->uri, (unsigned)config->capacity,
+             (unsigned)config->batch_size);
+    return ESP_OK;
+delete_task:
+    vTaskDelete(reporter->task);
+destroy_client:
+    esp_mqtt_client_destroy(reporter->client);
+delete_mutex:
+    vSemaphoreDelete(reporter->mutex);
+free_payload:
+    free(reporter->payload);
+free_ring:
+    free(reporter->ring);
+free_reporter:
+    free(reporter);
+handle_error:
+    return ret;
+}
+
+esp_err_t reporter_close(reporter_t reporter)
+{
+    ESP_RETURN_ON_FALSE(reporter, ESP_ERR_INVALID_ARG, TAG, "reporter must not be NULL");
+    ESP_ERROR_CHECK_WITHOUT_ABORT(reporter_stop(reporter));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_mqtt_client_destroy(reporter->client));
+    vTaskDelete(reporter->task);
+    vSemaphoreDelete(reporter->mutex);
+    free(reporter->payload);
+    free(reporter->ring);
+    free(reporter);
+    ESP_LOGI(TAG, "Closed");
+    return ESP_OK;
+}
+
+esp_err_t reporter_start(reporter_t reporter)
+{
+    ESP_RETURN_ON_FALSE(reporter, ESP_ERR_INVALID_ARG, TAG, "reporter must not be NULL");
+    if (atomic_exchange(&reporter->started, true))
+    {
+        return ESP_OK;
+    }
+    const esp_err_t err = esp_mqtt_client_start(reporter->client);
+    if (err != ESP_OK)
+    {
+        reporter->started = false;
+    }
+    ESP_RETURN_ON_ERROR(err, TAG, "start MQTT client");
+    ESP_LOGI(TAG, "Started");
+    return ESP_OK;
+}
+
+esp_err_t reporter_stop(reporter_t reporter)
+{
+    ESP_RETURN_ON_FALSE(reporter, ESP_ERR_INVALID_ARG, TAG, "reporter must not be NULL");
+    if (!atomic_exchange(&reporter->started, false))
+    {
+        return ESP_OK;
+    }
+    const esp_err_t err = esp_mqtt_client_stop(reporter->client);
+    // the client may not report the disconnection it made
+    reporter->connected = false;
+    xTaskNotifyGive(reporter->task);
+    ESP_RETURN_ON_ERROR(err, TAG, "stop MQTT client");
+    ESP_LOGI(TAG, "Stopped");
+    return ESP_OK;
+}
+
+esp_err_t reporter_add(reporter_t reporter, const char *zone, const char *name, int64_t timestamp, float value)
+{
+    ESP_RETURN_ON_FALSE(reporter && zone && name, ESP_ERR_INVALID_ARG, TAG, "null");
+    reporter->events++;
+    if (!xSemaphoreTake(reporter->mutex, MUTEX_TIMEOUT))
+    {
+        reporter->dropped++;
+        return ESP_ERR_TIMEOUT;
+    }
+    const size_t capacity = reporter->config.capacity;
+    if (reporter->count == capacity)
+    {
+        // the oldest makes room: the newest events say the most about the current state
+        reporter->head = (reporter->head + 1) % capacity;
+        reporter->count--;
+        reporter->dropped++;
+    }
+    reporter->ring[(reporter->head + reporter->count) % capacity] =
+        (event_t){.timestamp = timestamp, .zone = zone, .name = name, .value = value};
+    reporter->count++;
+    // the first event starts the batch period, the batch_size-th fills the batch
+    const bool notify = reporter->count == 1 || reporter->count == reporter->config.batch_size;
+    xSemaphoreGive(reporter->mutex);
+    if (notify)
+    {
+        xTaskNotifyGive(reporter->task);
+    }
+    return ESP_OK;
+}
+
+esp_err_t reporter_get_data(reporter_t reporter, reporter_data_t *data)
+{
+    ESP_RETURN_ON_FALSE(reporter && data, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(reporter->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    data->queued = reporter->count;
+    xSemaphoreGive(reporter->mutex);
+    data->events = reporter->events;
+    data->dropped = reporter->dropped;
+    data->batches = reporter->batches;
+    data->published = reporter->published;
+    data->bytes = reporter->bytes;
+    data->max_batch = reporter->max_batch;
+    data->retries = reporter->retries;
+    data->latency_sum = reporter->latency_sum;
+    data->latency_max = reporter->latency_max;
+    data->connected = reporter->connected;
+    return ESP_OK;
+}
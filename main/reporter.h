@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+#define REPORTER_EVENT_SIZE 80 // max length of a formatted event (longer ones are dropped)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Batched reporting to an MQTT broker. Producers add events (a reading, a relay change, a flow
+     * rate) to a ring in RAM, which never waits on the network. A task formats up to batch_size of
+     * them into one payload and publishes it (QoS 1) once the batch is full or its oldest event is
+     * batch_period old:
+     *
+     *   {"seq":12,"time":1760700000,"uptime":3600.25,"dropped":0,
+     *    "events":[[3590.5,"main","delta",3.25],[3591.25,"main","relay",1]]}
+     *
+     * where each event is [seconds since boot, zone, name, value]; time is the wall clock (seconds
+     * since the epoch) as of uptime, and dropped counts the events lost since boot.
+     *
+     * A single batch is in flight: the next one is taken from the ring once the broker acknowledged
+     * the previous one, so a backlog drains as fast as the broker takes it, and no faster. A batch
+     * that is not acknowledged within publish_timeout, or whose connection dropped, is published
+     * again (at least once delivery). While the broker is unreachable, the ring keeps the newest
+     * capacity events: the oldest are dropped.
+     */
+    typedef struct reporter_s *reporter_t;
+
+    typedef struct
+    {
+        const char *uri;          /// of the broker, e.g. "mqtt://192.168.1.2" (*required)
+        const char *topic;        /// (*required)
+        size_t capacity;          /// events kept while the broker is unreachable (24 bytes each)
+        size_t batch_size;        /// max events per payload
+        uint32_t batch_period;    /// max milliseconds an event waits for its batch to fill
+        uint32_t publish_timeout; /// milliseconds after which an unacknowledged batch is published again
+    } reporter_config_t;
+
+#define REPORTER_CONFIG_DEFAULT()         \
+    {                                     \
+        .capacity = 1024,                 \
+        .batch_size = 32,                 \
+        .batch_period = 30000,            \
+        .publish_timeout = 10000,         \
+    }
+
+    typedef struct
+    {
+        uint32_t events;      /// added since boot
+        uint32_t dropped;     /// lost: the ring was full, or they were too long
+        uint32_t queued;      /// waiting in the ring (not counting the batch in flight)
+        uint32_t batches;     /// acknowledged by the broker
+        uint32_t published;   /// events in those batches
+        uint64_t bytes;       /// payload bytes of those batches
+        uint32_t max_batch;   /// events in the largest batch
+        uint32_t retries;     /// batches published again
+        uint64_t latency_sum; /// microseconds from publish to acknowledgement, summed over the batches
+        uint32_t latency_max; /// microseconds
+        bool connected;       /// to the broker
+    } reporter_data_t;
+
+    // Creates the MQTT client, which connects on reporter_start.
+    esp_err_t reporter_open(const reporter_config_t *config, reporter_t *reporter_out);
+    esp_err_t reporter_close(reporter_t reporter);
+
+    // Connects to the broker (when the network comes up); no-op if started already.
+    esp_err_t reporter_start(reporter_t reporter);
+    // Disconnects (when the network goes down); the events are kept until reporter_start.
+    esp_err_t reporter_stop(reporter_t reporter);
+
+    /*
+     * Adds an event, at timestamp (microseconds since boot), to the next batch. zone and name must be
+     * JSON-safe and outlive the reporter. A NaN value is reported as null.
+     */
+    esp_err_t reporter_add(reporter_t reporter, const char *zone, const char *name, int64_t timestamp, float value);
+
+    esp_err_t reporter_get_data(reporter_t reporter, reporter_data_t *data);
+
+#ifdef __cplusplus
+}
+#endif
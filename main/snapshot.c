@@ -0,0 +1,39 @@
+#include <stdbool.h>
+#include <string.h>
+#include "snapshot.h"
+
+void snapshot_publish(snapshot_latch_t *latch, void *copies, const void *data, size_t size)
+{
+    uint8_t *const copy = (uint8_t *)copies;
+    // readers move to copy 1 while copy 0 is updated...
+    atomic_fetch_add_explicit(&latch->sequence, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(copy, data, size);
+    // ... and back to copy 0 while copy 1 is updated
+    atomic_fetch_add_explicit(&latch->sequence, 1, memory_order_release);
+    atomic_thread_fence(memory_order_release);
+    memcpy(copy + size, data, size);
+}
+
+void snapshot_read(snapshot_latch_t *latch, const void *copies, void *data, size_t size)
+{
+    const uint8_t *const copy = (const uint8_t *)copies;
+    unsigned int sequence = atomic_load_explicit(&latch->sequence, memory_order_acquire);
+    while (true)
+    {
+        memcpy(data, copy + (sequence & 1) * size, size);
+        atomic_thread_fence(memory_order_acquire);
+        const unsigned int current = atomic_load_explicit(&latch->sequence, memory_order_relaxed);
+        if (current == sequence)
+        {
+            return;
+        }
+        atomic_fetch_add_explicit(&latch->retries, 1, memory_order_relaxed);
+        sequence = current;
+    }
+}
+
+uint32_t snapshot_get_retries(snapshot_latch_t *latch)
+{
+    return atomic_load_explicit(&latch->retries, memory_order_relaxed);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Double-buffered sequence latch: a single writer publishes a struct into two copies, and any
+     * number of readers copy it out without taking a lock. A reader never waits for the writer; it
+     * only repeats its copy when a publish completed while it was reading.
+     */
+    typedef struct
+    {
+        atomic_uint sequence; /// bumped twice per publish; the low bit selects the copy to read
+        atomic_uint retries;  /// reads repeated because they raced with a publish
+    } snapshot_latch_t;
+
+    // Writes `size` bytes of data into both copies (an array of two `size`-byte elements).
+    void snapshot_publish(snapshot_latch_t *latch, void *copies, const void *data, size_t size);
+
+    // Copies the latest published version into data.
+    void snapshot_read(snapshot_latch_t *latch, const void *copies, void *data, size_t size);
+
+    uint32_t snapshot_get_retries(snapshot_latch_t *latch);
+
+#ifdef __cplusplus
+}
+#endif
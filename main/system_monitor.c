@@ -0,0 +1,256 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_check.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include "sdkconfig.h"
+#include "snapshot.h"
+#include "system_monitor.h"
+
+#define SUMMARY_SIZE 160 // characters per logged line of the summary
+
+static const char *TAG = "system_monitor";
+
+static const uint32_t heap_caps[SYSTEM_MONITOR_HEAP_MAX] = {
+    [SYSTEM_MONITOR_HEAP_INTERNAL] = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+    [SYSTEM_MONITOR_HEAP_DMA] = MALLOC_CAP_DMA,
+    [SYSTEM_MONITOR_HEAP_SPIRAM] = MALLOC_CAP_SPIRAM,
+};
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+typedef struct
+{
+    TaskHandle_t handle;
+    configRUN_TIME_COUNTER_TYPE run_time;
+} run_time_t;
+#endif
+
+struct system_monitor_s
+{
+    system_monitor_config_t config;
+    esp_timer_handle_t timer;
+    system_monitor_data_t data;           /// the latest sample (owned by the timer callback)
+    system_monitor_data_t snapshots[2];   /// published copies of data, for lock-free readers
+    snapshot_latch_t latch;               /// selects which of the snapshots readers copy
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    TaskStatus_t statuses[SYSTEM_MONITOR_MAX_TASKS];
+    run_time_t run_times[SYSTEM_MONITOR_MAX_TASKS]; /// of the tasks at the previous sample
+    size_t run_time_count;
+    configRUN_TIME_COUNTER_TYPE total_run_time; /// at the previous sample
+#endif
+    char summary[SUMMARY_SIZE];
+    size_t summary_len;
+};
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+// The task's run time at the previous sample, or false if it was not sampled.
+static bool find_run_time(const system_monitor_t monitor, TaskHandle_t handle, configRUN_TIME_COUNTER_TYPE *run_time)
+{
+    for (size_t i = 0; i < monitor->run_time_count; i++)
+    {
+        if (monitor->run_times[i].handle == handle)
+        {
+            *run_time = monitor->run_times[i].run_time;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void sample_tasks(system_monitor_t monitor)
+{
+    system_monitor_data_t *const data = &monitor->data;
+    configRUN_TIME_COUNTER_TYPE total_run_time = 0;
+    data->total_tasks = uxTaskGetNumberOfTasks();
+    // fails (0) when tasks were created since uxTaskGetNumberOfTasks, or there are too many
+    data->task_count = uxTaskGetSystemState(monitor->statuses, SYSTEM_MONITOR_MAX_TASKS, &total_run_time);
+    // the counters wrap around, which the unsigned differences absorb
+    const configRUN_TIME_COUNTER_TYPE elapsed = total_run_time - monitor->total_run_time;
+    for (size_t i = 0; i < data->task_count; i++)
+    {
+        const TaskStatus_t *status = &monitor->statuses[i];
+        system_monitor_task_data_t *task = &data->tasks[i];
+        memset(task->name, 0, sizeof(task->name));
+        strncpy(task->name, status->pcTaskName, sizeof(task->name) - 1);
+        task->priority = status->uxCurrentPriority;
+        task->stack_high_water_mark = status->usStackHighWaterMark;
+        task->cpu = -1;
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        configRUN_TIME_COUNTER_TYPE previous;
+        if (elapsed && monitor->total_run_time && find_run_time(monitor, status->xHandle, &previous))
+        {
+            task->cpu = (configRUN_TIME_COUNTER_TYPE)(status->ulRunTimeCounter - previous) * 100.0f / elapsed;
+        }
+#endif
+    }
+    for (size_t i = 0; i < data->task_count; i++)
+    {
+        monitor->run_times[i] = (run_time_t){.handle = monitor->statuses[i].xHandle,
+                                             .run_time = monitor->statuses[i].ulRunTimeCounter};
+    }
+    monitor->run_time_count = data->task_count;
+    monitor->total_run_time = total_run_time;
+}
+#endif
+
+static void sample(system_monitor_t monitor)
+{
+    system_monitor_data_t *const data = &monitor->data;
+    const int64_t now = esp_timer_get_time();
+    data->period = data->timestamp ? now - data->timestamp : 0;
+    data->timestamp = now;
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    sample_tasks(monitor);
+#endif
+    for (size_t i = 0; i < SYSTEM_MONITOR_HEAP_MAX; i++)
+    {
+        data->heaps[i] = (system_monitor_heap_data_t){
+            .total = heap_caps_get_total_size(heap_caps[i]),
+            .free = heap_caps_get_free_size(heap_caps[i]),
+            .minimum_free = heap_caps_get_minimum_free_size(heap_caps[i]),
+            .largest_free_block = heap_caps_get_largest_free_block(heap_caps[i]),
+        };
+    }
+    for (size_t i = 0; i < monitor->config.queue_count; i++)
+    {
+        const QueueHandle_t queue = monitor->config.queues[i].queue;
+        const UBaseType_t waiting = uxQueueMessagesWaiting(queue);
+        data->queues[i] = (system_monitor_queue_data_t){.waiting = waiting,
+                                                        .length = waiting + uxQueueSpacesAvailable(queue)};
+    }
+    snapshot_publish(&monitor->latch, monitor->snapshots, data, sizeof(system_monitor_data_t));
+}
+
+// Appends an item to the summary line, logging the line first when the item does not fit.
+static void summarize(system_monitor_t monitor, const char *format, ...)
+{
+    char item[SUMMARY_SIZE];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(item, sizeof(item), format, args);
+    va_end(args);
+    const size_t len = strlen(item);
+    if (monitor->summary_len + len >= sizeof(monitor->summary))
+    {
+        ESP_LOGI(TAG, "%s", monitor->summary);
+        monitor->summary_len = 0;
+    }
+    memcpy(monitor->summary + monitor->summary_len, item, len + 1);
+    monitor->summary_len += len;
+}
+
+static void log_summary(system_monitor_t monitor)
+{
+    const system_monitor_data_t *const data = &monitor->data;
+    const system_monitor_heap_data_t *heap = &data->heaps[SYSTEM_MONITOR_HEAP_INTERNAL];
+    ESP_LOGI(TAG, "Heap: %zu free, %zu min free, %zu largest block (of %zu)", heap->free, heap->minimum_free,
+             heap->largest_free_block, heap->total);
+    monitor->summary_len = 0;
+    summarize(monitor, "Tasks (stack free, cpu):");
+    for (size_t i = 0; i < data->task_count; i++)
+    {
+        const system_monitor_task_data_t *task = &data->tasks[i];
+        summarize(monitor, " %s %lu %.1f%%", task->name, (unsigned long)task->stack_high_water_mark,
+                  task->cpu < 0 ? 0.0f : task->cpu);
+    }
+    if (data->task_count < data->total_tasks)
+    {
+        summarize(monitor, " (%zu not sampled)", data->total_tasks - data->task_count);
+    }
+    ESP_LOGI(TAG, "%s", monitor->summary);
+    monitor->summary_len = 0;
+    summarize(monitor, "Queues (waiting/length):");
+    for (size_t i = 0; i < monitor->config.queue_count; i++)
+    {
+        summarize(monitor, " %s %lu/%lu", monitor->config.queues[i].name, (unsigned long)data->queues[i].waiting,
+                  (unsigned long)data->queues[i].length);
+    }
+    if (monitor->config.queue_count)
+    {
+        ESP_LOGI(TAG, "%s", monitor->summary);
+    }
+}
+
+static void timer_handler(void *arg)
+{
+    const system_monitor_t monitor = (system_monitor_t)arg;
+    sample(monitor);
+    if (monitor->config.log)
+    {
+        log_summary(monitor);
+    }
+}
+
+esp_err_t system_monitor_open(const system_monitor_config_t *config, system_monitor_t *monitor_out)
+{
+    esp_err_t ret = ESP_FAIL;
+    ESP_GOTO_ON_FALSE(config && monitor_out, ESP_ERR_INVALID_ARG, handle_error, TAG, "null");
+    ESP_GOTO_ON_FALSE(config->period, ESP_ERR_INVALID_ARG, handle_error, TAG, "invalid period");
+    ESP_GOTO_ON_FALSE(config->queue_count <= SYSTEM_MONITOR_MAX_QUEUES, ESP_ERR_INVALID_ARG, handle_error, TAG,
+                      "too many queues");
+    for (size_t i = 0; i < config->queue_count; i++)
+    {
+        ESP_GOTO_ON_FALSE(config->queues[i].name && config->queues[i].queue, ESP_ERR_INVALID_ARG, handle_error,
+                          TAG, "invalid queue %zu", i);
+    }
+    const system_monitor_t monitor = calloc(1, sizeof(struct system_monitor_s));
+    ESP_GOTO_ON_FALSE(monitor, ESP_ERR_NO_MEM, handle_error, TAG, "malloc monitor");
+    monitor->config = *config;
+    // the first sample has no CPU shares, which need a previous one
+    sample(monitor);
+    const esp_timer_create_args_t timer_args = {.callback = &timer_handler, .arg = monitor,
+                                                .name = "System monitor timer"};
+    ESP_GOTO_ON_ERROR(esp_timer_create(&timer_args, &monitor->timer), free_monitor, TAG, "create timer");
+    ESP_GOTO_ON_ERROR(esp_timer_start_periodic(monitor->timer, (uint64_t)config->period * 1000), delete_timer,
+                      TAG, "start timer");
+    *monitor_out = monitor;
+    ESP_LOGI(TAG, "Opened (sampling every %lu ms)", (unsigned long)config->period);
+    return ESP_OK;
+delete_timer:
+    esp_timer_delete(monitor->timer);
+free_monitor:
+    free(monitor);
+handle_error:
+    return ret;
+}
+
+esp_err_t system_monitor_close(system_monitor_t monitor)
+{
+    ESP_RETURN_ON_FALSE(monitor, ESP_ERR_INVALID_ARG, TAG, "monitor must not be NULL");
+    esp_timer_stop(monitor->timer);
+    esp_timer_delete(monitor->timer);
+    free(monitor);
+    ESP_LOGI(TAG, "Closed");
+    return ESP_OK;
+}
+
+esp_err_t system_monitor_get_data(system_monitor_t monitor, system_monitor_data_t *data)
+{
+    ESP_RETURN_ON_FALSE(monitor && data, ESP_ERR_INVALID_ARG, TAG, "null");
+    snapshot_read(&monitor->latch, monitor->snapshots, data, sizeof(system_monitor_data_t));
+    return ESP_OK;
+}
+
+const char *system_monitor_get_queue_name(system_monitor_t monitor, size_t queue)
+{
+    return monitor && queue < monitor->config.queue_count ? monitor->config.queues[queue].name : NULL;
+}
+
+size_t system_monitor_get_queue_count(system_monitor_t monitor)
+{
+    return monitor ? monitor->config.queue_count : 0;
+}
+
+const char *system_monitor_heap_name(system_monitor_heap_t heap)
+{
+    static const char *const names[SYSTEM_MONITOR_HEAP_MAX] = {
+        [SYSTEM_MONITOR_HEAP_INTERNAL] = "internal",
+        [SYSTEM_MONITOR_HEAP_DMA] = "dma",
+        [SYSTEM_MONITOR_HEAP_SPIRAM] = "spiram",
+    };
+    return heap < SYSTEM_MONITOR_HEAP_MAX ? names[heap] : "unknown";
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#define SYSTEM_MONITOR_MAX_TASKS 32 // tasks beyond this are counted but not sampled
+#define SYSTEM_MONITOR_MAX_QUEUES 4
+#define SYSTEM_MONITOR_NAME_SIZE 16 // configMAX_TASK_NAME_LEN of ESP-IDF
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Samples the tasks, the heaps and the control queues once per period: each task's stack high-water
+     * mark and share of the CPU over the period, the free, minimum free and largest free block of each
+     * heap, and the depth of each queue. Sampling costs one uxTaskGetSystemState call and a few heap
+     * queries per period, so the monitor can stay enabled in production; it optionally logs a summary of
+     * each sample.
+     *
+     * The CPU shares need CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS, and the tasks need
+     * CONFIG_FREERTOS_USE_TRACE_FACILITY; without them, only the heaps and queues are sampled.
+     */
+    typedef struct system_monitor_s *system_monitor_t;
+
+    typedef struct
+    {
+        const char *name;    /// as reported (*required)
+        QueueHandle_t queue; /// (*required)
+    } system_monitor_queue_t;
+
+    typedef struct
+    {
+        uint32_t period;                                                /// milliseconds between samples
+        bool log;                                                       /// whether to log a summary of each sample
+        system_monitor_queue_t queues[SYSTEM_MONITOR_MAX_QUEUES];       /// queues whose depth to sample
+        size_t queue_count;
+    } system_monitor_config_t;
+
+#define SYSTEM_MONITOR_CONFIG_DEFAULT() \
+    {                                   \
+        .period = 60000,                \
+        .log = true,                    \
+    }
+
+    typedef enum
+    {
+        SYSTEM_MONITOR_HEAP_INTERNAL, /// internal 8-bit capable RAM
+        SYSTEM_MONITOR_HEAP_DMA,      /// DMA capable RAM (part of the internal RAM)
+        SYSTEM_MONITOR_HEAP_SPIRAM,   /// external RAM (0 bytes on boards without it)
+        SYSTEM_MONITOR_HEAP_MAX,
+    } system_monitor_heap_t;
+
+    typedef struct
+    {
+        char name[SYSTEM_MONITOR_NAME_SIZE];
+        uint32_t priority;
+        uint32_t stack_high_water_mark; /// stack bytes never used
+        float cpu;                      /// percentage of a core used over the latest period (-1: unknown)
+    } system_monitor_task_data_t;
+
+    typedef struct
+    {
+        size_t total;
+        size_t free;
+        size_t minimum_free;       /// the lowest free size since boot
+        size_t largest_free_block; /// much less than free means fragmentation
+    } system_monitor_heap_data_t;
+
+    typedef struct
+    {
+        uint32_t waiting;
+        uint32_t length;
+    } system_monitor_queue_data_t;
+
+    typedef struct
+    {
+        int64_t timestamp; /// microseconds since boot of the sample (0: none yet)
+        uint64_t period;   /// microseconds the CPU shares were measured over
+        system_monitor_task_data_t tasks[SYSTEM_MONITOR_MAX_TASKS];
+        size_t task_count;
+        size_t total_tasks; /// including those beyond SYSTEM_MONITOR_MAX_TASKS
+        system_monitor_heap_data_t heaps[SYSTEM_MONITOR_HEAP_MAX];
+        system_monitor_queue_data_t queues[SYSTEM_MONITOR_MAX_QUEUES];
+    } system_monitor_data_t;
+
+    esp_err_t system_monitor_open(const system_monitor_config_t *config, system_monitor_t *monitor_out);
+    esp_err_t system_monitor_close(system_monitor_t monitor);
+    // Copies the latest sample.
+    esp_err_t system_monitor_get_data(system_monitor_t monitor, system_monitor_data_t *data);
+    const char *system_monitor_get_queue_name(system_monitor_t monitor, size_t queue);
+    size_t system_monitor_get_queue_count(system_monitor_t monitor);
+    const char *system_monitor_heap_name(system_monitor_heap_t heap);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,9 +1,12 @@
+#include <ctype.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/queue.h>
-#include <freertos/semphr.h>
 
 #include <esp_check.h>
 #include <esp_log.h>
@@ -11,99 +14,548 @@
 #include <driver/gpio.h>
 #include <ds18x20.h>
 
+#include "snapshot.h"
 #include "temperature_delta_sensor.h"
 
-#define MUTEX_TIMEOUT pdMS_TO_TICKS(3) // max time to wait for a lock (3 ms)
+#define CONVERSION_TIME (TEMPERATURE_SENSOR_PAIR_SAMPLE_PERIOD_MIN * 1000) // 12-bit conversion (µs)
+#define POWER_ON_TEMPERATURE 85.0f // the scratchpad of a probe that has not converted since it was powered
+
+#define NOTIFY_START_CONVERSION (1 << 0) // task notification bit: start a conversion
+#define NOTIFY_CONVERSION_DONE (1 << 1)  // task notification bit: read the converted temperatures
+#define NOTIFY_RESET (1 << 2)            // task notification bit: reset the readings
+#define NOTIFY_FLOW (1 << 3)             // task notification bit: TEMPERATURE_DELTA_SENSOR_HINT_FLOW
+#define NOTIFY_PUMP_ON (1 << 4)          // task notification bit: TEMPERATURE_DELTA_SENSOR_HINT_PUMP_ON
+#define NOTIFY_PUMP_OFF (1 << 5)         // task notification bit: TEMPERATURE_DELTA_SENSOR_HINT_PUMP_OFF
+#define MAX_SCANNED_DEVICES 16           // devices the bus scan reports, including ones no probe claims
 
 static const char *TAG = "temperature_delta_sensor";
 
+ESP_EVENT_DEFINE_BASE(TEMPERATURE_DELTA_SENSOR_EVENT);
+
+typedef struct
+{
+    float recent[TEMPERATURE_DELTA_SENSOR_MAX_MEDIAN_WINDOW]; /// ring of the latest plausible readings
+    uint8_t recent_count;
+    uint8_t recent_next; /// index of the next reading in recent
+    float value;         /// the latest accepted reading (NAN: none yet)
+} probe_state_t;
+
 struct temperature_delta_sensor_s
 {
     temperature_delta_sensor_config_t config; /// the config used to open this device
-    ds18x20_addr_t sensors[2];
-    temperature_delta_sensor_data_t data;
-    TaskHandle_t task; /// internal task for reading from the sensor
-    SemaphoreHandle_t mutex;
+    ds18x20_addr_t addresses[TEMPERATURE_DELTA_SENSOR_MAX_PROBES]; /// by probe, as configured or assigned
+    temperature_delta_sensor_data_t data;         /// the latest data (owned by the task)
+    temperature_delta_sensor_data_t snapshots[2]; /// published copies of data, for lock-free readers
+    snapshot_latch_t latch;                       /// selects which of the snapshots readers copy
+    TaskHandle_t task; /// internal task for reading from the sensor (the only writer of data)
+    window_stats_t stats;                /// windowed statistics by channel (written by the task)
+    probe_state_t probes[TEMPERATURE_DELTA_SENSOR_MAX_PROBES]; /// by probe (task-owned)
+    temperature_delta_sensor_health_t health;           /// the bus health (owned by the task)
+    temperature_delta_sensor_health_t health_snapshots[2]; /// published copies of health
+    snapshot_latch_t health_latch;                      /// selects which of the health snapshots readers copy
+    esp_timer_handle_t sample_timer;     /// one-shot timer that requests the next conversion
+    esp_timer_handle_t conversion_timer; /// one-shot timer that fires when a conversion is complete
+    bool converting;                     /// whether a conversion is in progress (task-owned)
+    bool confirming;                     /// whether the next conversion confirms rejected readings (task-owned)
+    uint32_t failures;                   /// failed readings in a row (task-owned)
+    bool pump_on;                        /// the latest pump hint (task-owned)
+    int64_t conversion_started;          /// microseconds since boot of the latest conversion (task-owned)
+    int64_t last_activity;               /// microseconds since boot of the latest activity (task-owned)
+    float reference_delta;               /// the delta at the latest change by change_threshold (task-owned)
+    uint64_t idle_period;                /// the current idle period (in ms), doubled by each idle reading
+    atomic_uint dropped_notifications;   /// notifications not sent because the queue stayed full
+    atomic_uint coalesced_notifications; /// pending notifications overwritten by a newer one
 };
 
-static void update_info(temperature_delta_sensor_info_t *info, uint32_t readings, float value)
+// Folds a reading (by channel) into the statistics, one array at a time.
+static void update_stats(temperature_delta_sensor_data_t *data, const float *values)
 {
-    info->latest = value;
-    info->min = readings ? fmin(info->min, value) : value;
-    info->max = readings ? fmax(info->max, value) : value;
-    info->average = info->average + (value - info->average) / (readings + 1);
+    const int n = data->channel_count;
+    const uint32_t readings = data->readings;
+    memcpy(data->latest, values, n * sizeof(float));
+    for (int c = 0; c < n; c++)
+    {
+        data->min[c] = readings ? fminf(data->min[c], values[c]) : values[c];
+    }
+    for (int c = 0; c < n; c++)
+    {
+        data->max[c] = readings ? fmaxf(data->max[c], values[c]) : values[c];
+    }
+    for (int c = 0; c < n; c++)
+    {
+        data->average[c] += (values[c] - data->average[c]) / (readings + 1);
+    }
 }
 
-esp_err_t temperature_delta_sensor_read(temperature_delta_sensor_t sensor)
+static void post_event(temperature_delta_sensor_t sensor, esp_err_t err)
+{
+    temperature_delta_sensor_event_t event = {.sensor = sensor,
+                                              .timestamp = esp_timer_get_time(),
+                                              .probe_count = sensor->data.probe_count,
+                                              .channel_count = sensor->data.channel_count,
+                                              .err = err,
+                                              .failures = sensor->failures};
+    memcpy(event.latest, sensor->data.latest, sizeof(event.latest));
+    // listeners are best effort: never delay the next conversion on a full event queue
+    const esp_err_t r = esp_event_post(TEMPERATURE_DELTA_SENSOR_EVENT,
+                                       err == ESP_OK ? TEMPERATURE_DELTA_SENSOR_EVENT_READING
+                                                     : TEMPERATURE_DELTA_SENSOR_EVENT_FAULT,
+                                       &event, sizeof(event), 0);
+    if (r != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Post event on GPIO %d: %d", sensor->config.gpio_num, r);
+    }
+}
+
+static esp_err_t temperature_delta_sensor_start_conversion(temperature_delta_sensor_t sensor)
 {
-    float temps[3];
-    // this will block internally for ~750ms
-    esp_err_t err = ds18x20_measure_and_read_multi(sensor->config.gpio_num, sensor->sensors, 2, temps);
-    ESP_RETURN_ON_FALSE(xSemaphoreTake(sensor->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
+    // broadcast to all the probes and return right away; the conversion timer picks up the result
+    sensor->conversion_started = esp_timer_get_time();
+    sensor->confirming = false;
+    esp_err_t err = ds18x20_measure(sensor->config.gpio_num, DS18X20_ANY, false);
     if (err == ESP_OK)
     {
-        temps[2] = fabs(temps[0] - temps[1]);
-        for (int i = 0; i < 3; i++)
+        return esp_timer_start_once(sensor->conversion_timer, CONVERSION_TIME);
+    }
+    ESP_LOGE(TAG, "Failed to start conversion on GPIO %d: %d", sensor->config.gpio_num, err);
+    sensor->data.faults++;
+    sensor->failures++;
+    snapshot_publish(&sensor->latch, sensor->snapshots, &sensor->data, sizeof(temperature_delta_sensor_data_t));
+    post_event(sensor, err);
+    return err;
+}
+
+// Reads the scratchpad of a probe, again right away if that failed: it holds the result until the next conversion.
+static esp_err_t read_probe(temperature_delta_sensor_t sensor, size_t probe, float *value)
+{
+    temperature_delta_sensor_probe_health_t *health = &sensor->health.probes[probe];
+    esp_err_t err = ESP_FAIL;
+    for (uint8_t attempt = 0; attempt <= sensor->config.read_retries; attempt++)
+    {
+        if (attempt)
+        {
+            health->retries++;
+        }
+        err = ds18x20_read_temperature(sensor->config.gpio_num, sensor->addresses[probe], value);
+        if (err == ESP_OK)
+        {
+            break;
+        }
+        health->read_errors++;
+    }
+    return err;
+}
+
+static float median(const float *values, size_t count)
+{
+    float sorted[TEMPERATURE_DELTA_SENSOR_MAX_MEDIAN_WINDOW];
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t j = i;
+        for (; j > 0 && sorted[j - 1] > values[i]; j--)
+        {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = values[i];
+    }
+    return sorted[count / 2];
+}
+
+// Returns ESP_OK if the reading of a probe is accepted, or why it is rejected.
+static esp_err_t check_reading(temperature_delta_sensor_t sensor, size_t probe, float value)
+{
+    const temperature_delta_sensor_config_t *config = &sensor->config;
+    temperature_delta_sensor_probe_health_t *health = &sensor->health.probes[probe];
+    probe_state_t *state = &sensor->probes[probe];
+    if (!(value >= config->min_plausible && value <= config->max_plausible))
+    {
+        health->implausible++;
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    // the median is trusted once most of the window is filled (NAN until then)
+    const float reference =
+        state->recent_count > config->median_window / 2 ? median(state->recent, state->recent_count) : NAN;
+    if (value == POWER_ON_TEMPERATURE && !(fabsf(value - reference) <= config->max_step))
+    {
+        health->power_on++;
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (config->median_window)
+    {
+        state->recent[state->recent_next] = value;
+        state->recent_next = (state->recent_next + 1) % config->median_window;
+        state->recent_count = MIN(state->recent_count + 1, config->median_window);
+    }
+    if (fabsf(value - reference) > config->max_step)
+    {
+        health->outliers++;
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    return ESP_OK;
+}
+
+// Reads each probe into values, and returns ESP_OK if the probes all have a value and at least one is new.
+static esp_err_t read_probes(temperature_delta_sensor_t sensor, float *values)
+{
+    const temperature_delta_sensor_config_t *config = &sensor->config;
+    esp_err_t first_err = ESP_OK;   // of the first rejected reading
+    esp_err_t unknown_err = ESP_OK; // of the first probe without a value
+    size_t accepted = 0;
+    for (size_t p = 0; p < config->probe_count; p++)
+    {
+        temperature_delta_sensor_probe_health_t *health = &sensor->health.probes[p];
+        probe_state_t *state = &sensor->probes[p];
+        float value;
+        esp_err_t err = read_probe(sensor, p, &value);
+        if (err == ESP_OK)
+        {
+            err = check_reading(sensor, p, value);
+        }
+        if (err == ESP_OK)
+        {
+            if (health->lost)
+            {
+                ESP_LOGW(TAG, "Probe '%s' on GPIO %d is back (%.2f °C)", config->probes[p].name, config->gpio_num,
+                         value);
+            }
+            state->value = value;
+            health->consecutive_failures = 0;
+            health->lost = false;
+            accepted++;
+        }
+        else
+        {
+            ESP_LOGD(TAG, "Rejected reading of probe '%s' on GPIO %d: %d", config->probes[p].name, config->gpio_num,
+                     err);
+            health->last_error = err;
+            first_err = first_err == ESP_OK ? err : first_err;
+            if (++health->consecutive_failures == config->lost_after)
+            {
+                ESP_LOGE(TAG, "Lost probe '%s' on GPIO %d: %d", config->probes[p].name, config->gpio_num, err);
+                health->lost = true;
+                health->losses++;
+                // the recent readings say nothing about when it is back
+                state->recent_count = 0;
+                state->recent_next = 0;
+            }
+            sensor->confirming |= !health->lost;
+        }
+        // a rejected reading is stood in for by the previous one until the probe is lost
+        values[p] = health->lost ? NAN : state->value;
+        if (isnan(values[p]) && unknown_err == ESP_OK)
         {
-            update_info(&sensor->data.info[i], sensor->data.readings, temps[i]);
+            unknown_err = err;
         }
+    }
+    return unknown_err != ESP_OK ? unknown_err : accepted ? ESP_OK : first_err;
+}
+
+esp_err_t temperature_delta_sensor_read(temperature_delta_sensor_t sensor)
+{
+    const temperature_delta_sensor_config_t *config = &sensor->config;
+    temperature_delta_sensor_health_t *health = &sensor->health;
+    float values[TEMPERATURE_DELTA_SENSOR_MAX_CHANNELS];
+    // only reads the scratchpads; the conversion was started CONVERSION_TIME ago
+    const int64_t start = esp_timer_get_time();
+    esp_err_t err = read_probes(sensor, values);
+    health->read_time = esp_timer_get_time() - start;
+    health->read_time_max = MAX(health->read_time_max, health->read_time);
+    health->conversion_time = start - sensor->conversion_started;
+    health->conversion_time_max = MAX(health->conversion_time_max, health->conversion_time);
+    snapshot_publish(&sensor->health_latch, sensor->health_snapshots, health,
+                     sizeof(temperature_delta_sensor_health_t));
+    for (size_t d = 0; d < config->delta_count; d++)
+    {
+        const uint8_t *probes = config->deltas[d].probes;
+        values[config->probe_count + d] = fabsf(values[probes[0]] - values[probes[1]]);
+    }
+    if (err == ESP_OK)
+    {
+        update_stats(&sensor->data, values);
         sensor->data.readings++;
+        sensor->data.samples[sensor->data.sampling]++;
         sensor->data.latest_reading_timestamp = esp_timer_get_time();
-
-        ESP_LOGD(TAG, "Completed reading %lu on GPIO %d: latest=%.3f/%.3f/%.3f, min=%.3f/%.3f/%.3f"
-                      ", max=%.3f/%.3f/%.3f, average=%.3f/%.3f/%.3f",
-                 sensor->data.readings, sensor->config.gpio_num,
-                 sensor->data.info[TEMPERATURE_DELTA_SENSOR_FIRST].latest,
-                 sensor->data.info[TEMPERATURE_DELTA_SENSOR_SECOND].latest,
-                 sensor->data.info[TEMPERATURE_DELTA_SENSOR_DELTA].latest,
-                 sensor->data.info[TEMPERATURE_DELTA_SENSOR_FIRST].min,
-                 sensor->data.info[TEMPERATURE_DELTA_SENSOR_SECOND].min,
-                 sensor->data.info[TEMPERATURE_DELTA_SENSOR_DELTA].min,
-                 sensor->data.info[TEMPERATURE_DELTA_SENSOR_FIRST].max,
-                 sensor->data.info[TEMPERATURE_DELTA_SENSOR_SECOND].max,
-                 sensor->data.info[TEMPERATURE_DELTA_SENSOR_DELTA].max,
-                 sensor->data.info[TEMPERATURE_DELTA_SENSOR_FIRST].average,
-                 sensor->data.info[TEMPERATURE_DELTA_SENSOR_SECOND].average,
-                 sensor->data.info[TEMPERATURE_DELTA_SENSOR_DELTA].average);
+        ESP_ERROR_CHECK_WITHOUT_ABORT(window_stats_add(sensor->stats, sensor->data.latest_reading_timestamp, values));
+        ESP_LOGD(TAG, "Completed reading %lu on GPIO %d: %s=%.3f (min=%.3f, max=%.3f, average=%.3f)",
+                 sensor->data.readings, config->gpio_num, config->deltas[0].name,
+                 sensor->data.latest[config->probe_count], sensor->data.min[config->probe_count],
+                 sensor->data.max[config->probe_count], sensor->data.average[config->probe_count]);
     }
     else
     {
-        ESP_LOGE(TAG, "Failed to read temperatures on GPIO %d: %d", sensor->config.gpio_num, err);
+        // the channels of lost probes become unknown; the others keep their latest values
+        if (sensor->failures)
+        {
+            ESP_LOGD(TAG, "Still failing to read temperatures on GPIO %d: %d", config->gpio_num, err);
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Failed to read temperatures on GPIO %d: %d", config->gpio_num, err);
+        }
+        memcpy(sensor->data.latest, values, sensor->data.channel_count * sizeof(float));
         sensor->data.faults++;
     }
-    ESP_RETURN_ON_FALSE(xSemaphoreGive(sensor->mutex), ESP_ERR_NOT_FINISHED, TAG, "release mutex");
+    sensor->failures = err == ESP_OK ? 0 : sensor->failures + 1;
+    snapshot_publish(&sensor->latch, sensor->snapshots, &sensor->data, sizeof(temperature_delta_sensor_data_t));
+    post_event(sensor, err);
     return err;
 }
 
+// Feeds a successful reading to the sampling policy.
+static void update_sampling(temperature_delta_sensor_t sensor)
+{
+    const float delta = temperature_delta_sensor_get_delta(&sensor->data);
+    if (sensor->data.readings == 1 || fabsf(delta - sensor->reference_delta) >= sensor->config.change_threshold)
+    {
+        sensor->reference_delta = delta;
+        sensor->last_activity = sensor->data.latest_reading_timestamp;
+        sensor->idle_period = sensor->config.sample_period;
+    }
+    else if (sensor->data.sampling == TEMPERATURE_DELTA_SENSOR_SAMPLING_IDLE)
+    {
+        sensor->idle_period = MIN(sensor->idle_period * 2, sensor->config.idle_sample_period);
+    }
+}
+
+// Starts the sample timer for the next conversion, sample_period after the latest one started.
+static void schedule_conversion(temperature_delta_sensor_t sensor)
+{
+    const temperature_delta_sensor_config_t *config = &sensor->config;
+    const int64_t now = esp_timer_get_time();
+    temperature_delta_sensor_sampling_t sampling;
+    uint64_t period;
+    if (sensor->pump_on)
+    {
+        sampling = TEMPERATURE_DELTA_SENSOR_SAMPLING_PUMP;
+        period = config->pump_sample_period;
+    }
+    else if (now - sensor->last_activity < (int64_t)config->idle_after * 1000)
+    {
+        sampling = TEMPERATURE_DELTA_SENSOR_SAMPLING_ACTIVE;
+        period = config->sample_period;
+    }
+    else
+    {
+        sampling = TEMPERATURE_DELTA_SENSOR_SAMPLING_IDLE;
+        period = sensor->idle_period;
+    }
+    if (sampling != sensor->data.sampling || period != sensor->data.sample_period)
+    {
+        ESP_LOGD(TAG, "Sampling every %lu ms (%s) on GPIO %d", (unsigned long)period,
+                 temperature_delta_sensor_sampling_name(sampling), config->gpio_num);
+        sensor->data.sampling = sampling;
+        sensor->data.sample_period = period;
+        snapshot_publish(&sensor->latch, sensor->snapshots, &sensor->data, sizeof(temperature_delta_sensor_data_t));
+    }
+    // rejected readings are confirmed (or not) right away, whatever the policy
+    const int64_t due = sensor->confirming ? now : sensor->conversion_started + (int64_t)period * 1000;
+    esp_timer_stop(sensor->sample_timer);
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_start_once(sensor->sample_timer, due > now ? due - now : 0));
+}
+
 static void temperature_delta_sensor_task(void *args)
 {
     const temperature_delta_sensor_t sensor = (temperature_delta_sensor_t)args;
-    const TickType_t delay = pdMS_TO_TICKS(sensor->config.sample_period);
     temperature_delta_sensor_notification_t msg = {
         .temperature_delta_sensor = sensor, .notification_arg = sensor->config.notification_arg};
-    TickType_t t;
+    uint32_t events;
     while (true)
     {
-        t = xTaskGetTickCount();
-        if (temperature_delta_sensor_read(sensor) == ESP_OK && sensor->config.notification_queue)
+        xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+        if (events & NOTIFY_RESET)
+        {
+            sensor->data = (const temperature_delta_sensor_data_t){.probe_count = sensor->data.probe_count,
+                                                                   .channel_count = sensor->data.channel_count,
+                                                                   .sampling = sensor->data.sampling,
+                                                                   .sample_period = sensor->data.sample_period};
+            snapshot_publish(&sensor->latch, sensor->snapshots, &sensor->data,
+                             sizeof(temperature_delta_sensor_data_t));
+            ESP_ERROR_CHECK_WITHOUT_ABORT(window_stats_reset(sensor->stats));
+        }
+        if (events & (NOTIFY_FLOW | NOTIFY_PUMP_ON | NOTIFY_PUMP_OFF))
         {
-            msg.delta = sensor->data.info[TEMPERATURE_DELTA_SENSOR_DELTA].latest;
-            const BaseType_t r = xQueueSendToBack(sensor->config.notification_queue,
-                                                  (void *)&msg,
-                                                  sensor->config.notification_timeout);
-            if (r != pdTRUE)
+            sensor->pump_on = (sensor->pump_on || (events & NOTIFY_PUMP_ON)) && !(events & NOTIFY_PUMP_OFF);
+            sensor->last_activity = esp_timer_get_time();
+            sensor->idle_period = sensor->config.sample_period;
+        }
+        if (events & NOTIFY_CONVERSION_DONE)
+        {
+            sensor->converting = false;
+            const esp_err_t err = temperature_delta_sensor_read(sensor);
+            if (err == ESP_OK)
+            {
+                update_sampling(sensor);
+            }
+            if (err == ESP_OK && sensor->config.notification_queue)
             {
-                ESP_LOGW(TAG, "Notification timeout on GPIO %d queue: %d", sensor->config.gpio_num, r);
+                msg.delta = temperature_delta_sensor_get_delta(&sensor->data);
+                if (sensor->config.notification_overwrite)
+                {
+                    // the consumer may take the pending notification meanwhile, so the count is an upper bound
+                    if (uxQueueMessagesWaiting(sensor->config.notification_queue))
+                    {
+                        sensor->coalesced_notifications++;
+                    }
+                    xQueueOverwrite(sensor->config.notification_queue, (void *)&msg);
+                }
+                else if (xQueueSendToBack(sensor->config.notification_queue, (void *)&msg,
+                                          sensor->config.notification_timeout) != pdTRUE)
+                {
+                    sensor->dropped_notifications++;
+                    ESP_LOGW(TAG, "Notification timeout on GPIO %d queue", sensor->config.gpio_num);
+                }
             }
         }
-        t = xTaskGetTickCount() - t;
-        if (delay > t)
+        // a request that arrives while converting is served by the conversion in progress
+        if ((events & NOTIFY_START_CONVERSION) && !sensor->converting)
         {
-            vTaskDelay(delay - t);
+            sensor->converting = temperature_delta_sensor_start_conversion(sensor) == ESP_OK;
+        }
+        // the next conversion is scheduled once this one completes, with the policy it then calls for
+        if (!sensor->converting)
+        {
+            schedule_conversion(sensor);
         }
     }
 }
 
+static void temperature_delta_sensor_sample_timer_handler(void *args)
+{
+    xTaskNotify(((temperature_delta_sensor_t)args)->task, NOTIFY_START_CONVERSION, eSetBits);
+}
+
+static void temperature_delta_sensor_conversion_timer_handler(void *args)
+{
+    xTaskNotify(((temperature_delta_sensor_t)args)->task, NOTIFY_CONVERSION_DONE, eSetBits);
+}
+
+// Names key the channels in URIs, metric labels and the members of GET /temperature, whose other
+// members they must not shadow.
+static bool is_valid_name(const char *name)
+{
+    static const char *const reserved[] = {"readings", "latest_reading_timestamp", "snapshot_retries", "sampling",
+                                           "bus"};
+    const size_t len = strnlen(name, TEMPERATURE_DELTA_SENSOR_NAME_SIZE);
+    if (!len || len == TEMPERATURE_DELTA_SENSOR_NAME_SIZE)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!isalnum((unsigned char)name[i]) && name[i] != '_')
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < sizeof(reserved) / sizeof(reserved[0]); i++)
+    {
+        if (!strcmp(name, reserved[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const char *get_name(const temperature_delta_sensor_config_t *config, size_t channel)
+{
+    return channel < config->probe_count ? config->probes[channel].name
+                                         : config->deltas[channel - config->probe_count].name;
+}
+
+static int find_channel(const temperature_delta_sensor_config_t *config, const char *name)
+{
+    for (size_t c = 0; c < config->probe_count + config->delta_count; c++)
+    {
+        if (!strcmp(get_name(config, c), name))
+        {
+            return c;
+        }
+    }
+    return -1;
+}
+
+static esp_err_t check_layout(const temperature_delta_sensor_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(config->probe_count >= 1 && config->probe_count <= TEMPERATURE_DELTA_SENSOR_MAX_PROBES,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid probe_count %u", (unsigned)config->probe_count);
+    ESP_RETURN_ON_FALSE(config->delta_count >= 1 && config->delta_count <= TEMPERATURE_DELTA_SENSOR_MAX_DELTAS,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid delta_count %u", (unsigned)config->delta_count);
+    for (size_t c = 0; c < config->probe_count + config->delta_count; c++)
+    {
+        const char *name = get_name(config, c);
+        ESP_RETURN_ON_FALSE(is_valid_name(name), ESP_ERR_INVALID_ARG, TAG, "invalid name '%.*s'",
+                            TEMPERATURE_DELTA_SENSOR_NAME_SIZE, name);
+        ESP_RETURN_ON_FALSE(find_channel(config, name) == c, ESP_ERR_INVALID_ARG, TAG, "duplicate name '%s'", name);
+    }
+    for (size_t d = 0; d < config->delta_count; d++)
+    {
+        const uint8_t *probes = config->deltas[d].probes;
+        ESP_RETURN_ON_FALSE(probes[0] < config->probe_count && probes[1] < config->probe_count &&
+                                probes[0] != probes[1],
+                            ESP_ERR_INVALID_ARG, TAG, "invalid probes of delta '%s'", config->deltas[d].name);
+    }
+    return ESP_OK;
+}
+
+static int compare_addresses(const void *a, const void *b)
+{
+    const ds18x20_addr_t x = *(const ds18x20_addr_t *)a, y = *(const ds18x20_addr_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Gives each probe its configured address, or else the lowest scanned address no other probe claims.
+static esp_err_t assign_addresses(temperature_delta_sensor_t sensor)
+{
+    const temperature_delta_sensor_config_t *config = &sensor->config;
+    ds18x20_addr_t found[MAX_SCANNED_DEVICES];
+    size_t count = 0;
+    ESP_RETURN_ON_ERROR(ds18x20_scan_devices(config->gpio_num, found, MAX_SCANNED_DEVICES, &count), TAG,
+                        "scan for temperature sensors on GPIO %d", config->gpio_num);
+    count = MIN(count, MAX_SCANNED_DEVICES);
+    qsort(found, count, sizeof(ds18x20_addr_t), compare_addresses);
+    bool claimed[MAX_SCANNED_DEVICES] = {false};
+    for (size_t p = 0; p < config->probe_count; p++)
+    {
+        if (config->probes[p].address)
+        {
+            size_t i = 0;
+            while (i < count && found[i] != config->probes[p].address)
+            {
+                i++;
+            }
+            ESP_RETURN_ON_FALSE(i < count, ESP_ERR_NOT_FOUND, TAG, "probe '%s' (%016llx) not found on GPIO %d",
+                                config->probes[p].name, (unsigned long long)config->probes[p].address,
+                                config->gpio_num);
+            claimed[i] = true;
+            sensor->addresses[p] = found[i];
+        }
+    }
+    size_t next = 0;
+    for (size_t p = 0; p < config->probe_count; p++)
+    {
+        if (!config->probes[p].address)
+        {
+            while (next < count && claimed[next])
+            {
+                next++;
+            }
+            ESP_RETURN_ON_FALSE(next < count, ESP_ERR_NOT_FOUND, TAG,
+                                "expecting %u temperature sensors on GPIO %d, but got %u",
+                                (unsigned)config->probe_count, config->gpio_num, (unsigned)count);
+            claimed[next] = true;
+            sensor->addresses[p] = found[next];
+        }
+        ESP_LOGI(TAG, "Probe '%s' is %016llx", config->probes[p].name, (unsigned long long)sensor->addresses[p]);
+    }
+    if (count > config->probe_count)
+    {
+        ESP_LOGW(TAG, "Ignoring %u unnamed temperature sensors on GPIO %d", (unsigned)(count - config->probe_count),
+                 config->gpio_num);
+    }
+    return ESP_OK;
+}
+
 esp_err_t temperature_delta_sensor_open(const temperature_delta_sensor_config_t *config,
                                         temperature_delta_sensor_t *sensor_out)
 {
@@ -112,31 +564,89 @@ esp_err_t temperature_delta_sensor_open(const temperature_delta_sensor_config_t
     ESP_GOTO_ON_FALSE(config->sample_period == 0 ||
                           config->sample_period > TEMPERATURE_SENSOR_PAIR_SAMPLE_PERIOD_MIN,
                       ESP_ERR_INVALID_ARG, handle_error, TAG, "invalid sample_period");
+    ESP_GOTO_ON_FALSE(config->pump_sample_period == 0 ||
+                          config->pump_sample_period >= TEMPERATURE_SENSOR_PAIR_SAMPLE_PERIOD_MIN,
+                      ESP_ERR_INVALID_ARG, handle_error, TAG, "invalid pump_sample_period");
+    ESP_GOTO_ON_FALSE(config->idle_sample_period == 0 || config->idle_sample_period >= config->sample_period,
+                      ESP_ERR_INVALID_ARG, handle_error, TAG, "invalid idle_sample_period");
+    ESP_GOTO_ON_FALSE(!config->notification_overwrite ||
+                          (config->notification_queue &&
+                           uxQueueMessagesWaiting(config->notification_queue) +
+                                   uxQueueSpacesAvailable(config->notification_queue) ==
+                               1),
+                      ESP_ERR_INVALID_ARG, handle_error, TAG, "notification_overwrite needs a queue of length 1");
+    ESP_GOTO_ON_ERROR(check_layout(config), handle_error, TAG, "check probes and deltas");
+    ESP_GOTO_ON_FALSE(config->median_window <= TEMPERATURE_DELTA_SENSOR_MAX_MEDIAN_WINDOW && config->lost_after &&
+                          config->min_plausible < config->max_plausible && config->max_step > 0,
+                      ESP_ERR_INVALID_ARG, handle_error, TAG, "invalid rejection of readings");
 
     const temperature_delta_sensor_t sensor = calloc(1, sizeof(struct temperature_delta_sensor_s));
     ESP_GOTO_ON_FALSE(sensor != NULL, ESP_ERR_NO_MEM, handle_error, TAG, "malloc sensor");
     sensor->config = *config;
+    // a zero sample period means back-to-back conversions
+    if (!sensor->config.sample_period)
+    {
+        sensor->config.sample_period = TEMPERATURE_SENSOR_PAIR_SAMPLE_PERIOD_MIN;
+    }
+    if (!sensor->config.pump_sample_period)
+    {
+        sensor->config.pump_sample_period = TEMPERATURE_SENSOR_PAIR_SAMPLE_PERIOD_MIN;
+    }
+    if (!sensor->config.idle_sample_period)
+    {
+        sensor->config.idle_sample_period = sensor->config.sample_period;
+    }
+    sensor->idle_period = sensor->config.sample_period;
+    sensor->data.sampling = TEMPERATURE_DELTA_SENSOR_SAMPLING_ACTIVE;
+    sensor->data.sample_period = sensor->config.sample_period;
+    sensor->data.probe_count = config->probe_count;
+    sensor->data.channel_count = config->probe_count + config->delta_count;
+    for (size_t c = 0; c < sensor->data.channel_count; c++)
+    {
+        sensor->data.latest[c] = NAN;
+    }
+    snapshot_publish(&sensor->latch, sensor->snapshots, &sensor->data, sizeof(temperature_delta_sensor_data_t));
+    for (size_t p = 0; p < config->probe_count; p++)
+    {
+        sensor->probes[p].value = NAN;
+    }
+    sensor->health.probe_count = config->probe_count;
+    snapshot_publish(&sensor->health_latch, sensor->health_snapshots, &sensor->health,
+                     sizeof(temperature_delta_sensor_health_t));
+    window_stats_config_t stats_config = config->stats;
+    stats_config.channel_count = sensor->data.channel_count;
+    ESP_GOTO_ON_ERROR(window_stats_open(&stats_config, &sensor->stats), free_sensor, TAG, "open stats");
+    ESP_GOTO_ON_ERROR(assign_addresses(sensor), close_stats, TAG, "assign addresses");
 
-    size_t sensor_count = 0;
-    ESP_GOTO_ON_ERROR(ds18x20_scan_devices(config->gpio_num, sensor->sensors, 2, &sensor_count),
-                      free_sensor, TAG, "scanning for temperature sensors on GPIO %d", config->gpio_num);
-    ESP_GOTO_ON_FALSE(sensor_count == 2, ESP_ERR_INVALID_STATE, free_sensor, TAG,
-                      "expecting a pair of temperature sensors on GPIO %d, but got %d",
-                      config->gpio_num, sensor_count);
-
-    sensor->mutex = xSemaphoreCreateMutex();
-    ESP_GOTO_ON_FALSE(sensor->mutex, ESP_ERR_NO_MEM, free_sensor, TAG,
-                      "create mutex on GPIO %d", config->gpio_num);
+    const esp_timer_create_args_t sample_timer_args = {
+        .callback = &temperature_delta_sensor_sample_timer_handler,
+        .arg = sensor,
+        .name = "temperature sample timer"};
+    ESP_GOTO_ON_ERROR(esp_timer_create(&sample_timer_args, &sensor->sample_timer), close_stats, TAG,
+                      "create sample timer on GPIO %d", config->gpio_num);
+    const esp_timer_create_args_t conversion_timer_args = {
+        .callback = &temperature_delta_sensor_conversion_timer_handler,
+        .arg = sensor,
+        .name = "temperature conversion timer"};
+    ESP_GOTO_ON_ERROR(esp_timer_create(&conversion_timer_args, &sensor->conversion_timer), delete_sample_timer,
+                      TAG, "create conversion timer on GPIO %d", config->gpio_num);
     char name[64];
-    snprintf(name, sizeof(name), "temperature sensor pair task on GPIO %d", config->gpio_num);
+    snprintf(name, sizeof(name), "temperature sensors task on GPIO %d", config->gpio_num);
     const BaseType_t r = xTaskCreate(temperature_delta_sensor_task, name, 3072,
                                      (void *)sensor, 1, &(sensor->task));
-    ESP_GOTO_ON_FALSE(r == pdPASS, ESP_ERR_NO_MEM, free_mutex, TAG, "create task: %d", r);
+    ESP_GOTO_ON_FALSE(r == pdPASS, ESP_ERR_NO_MEM, delete_conversion_timer, TAG, "create task: %d", r);
+    // the task schedules the following conversions itself
+    xTaskNotify(sensor->task, NOTIFY_START_CONVERSION, eSetBits);
     *sensor_out = sensor;
-    ESP_LOGI(TAG, "Opened on GPIO %d", config->gpio_num);
+    ESP_LOGI(TAG, "Opened on GPIO %d (%u probes, %u deltas)", config->gpio_num, (unsigned)config->probe_count,
+             (unsigned)config->delta_count);
     return ESP_OK;
-free_mutex:
-    vSemaphoreDelete(sensor->mutex);
+delete_conversion_timer:
+    esp_timer_delete(sensor->conversion_timer);
+delete_sample_timer:
+    esp_timer_delete(sensor->sample_timer);
+close_stats:
+    window_stats_close(sensor->stats);
 free_sensor:
     free(sensor);
 handle_error:
@@ -146,19 +656,54 @@ handle_error:
 esp_err_t temperature_delta_sensor_close(temperature_delta_sensor_t sensor)
 {
     ESP_RETURN_ON_FALSE(sensor, ESP_ERR_INVALID_ARG, TAG, "sensor must not be NULL");
-    ESP_RETURN_ON_FALSE(xSemaphoreTake(sensor->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
     const gpio_num_t gpio_num = sensor->config.gpio_num;
+    esp_timer_stop(sensor->sample_timer);
+    esp_timer_stop(sensor->conversion_timer);
     vTaskDelete(sensor->task);
-    vSemaphoreDelete(sensor->mutex);
+    esp_timer_delete(sensor->sample_timer);
+    esp_timer_delete(sensor->conversion_timer);
+    window_stats_close(sensor->stats);
     free(sensor);
     ESP_LOGI(TAG, "Closed on GPIO %d", gpio_num);
     return ESP_OK;
 }
 
+esp_err_t temperature_delta_sensor_request_reading(temperature_delta_sensor_t sensor)
+{
+    ESP_RETURN_ON_FALSE(sensor, ESP_ERR_INVALID_ARG, TAG, "sensor must not be NULL");
+    xTaskNotify(sensor->task, NOTIFY_START_CONVERSION, eSetBits);
+    return ESP_OK;
+}
+
+esp_err_t temperature_delta_sensor_hint(temperature_delta_sensor_t sensor, temperature_delta_sensor_hint_t hint)
+{
+    static const uint32_t notifications[] = {
+        [TEMPERATURE_DELTA_SENSOR_HINT_FLOW] = NOTIFY_FLOW,
+        [TEMPERATURE_DELTA_SENSOR_HINT_PUMP_ON] = NOTIFY_PUMP_ON,
+        [TEMPERATURE_DELTA_SENSOR_HINT_PUMP_OFF] = NOTIFY_PUMP_OFF,
+    };
+    ESP_RETURN_ON_FALSE(sensor, ESP_ERR_INVALID_ARG, TAG, "sensor must not be NULL");
+    ESP_RETURN_ON_FALSE((unsigned)hint <= TEMPERATURE_DELTA_SENSOR_HINT_PUMP_OFF, ESP_ERR_INVALID_ARG, TAG,
+                        "invalid hint %d", hint);
+    xTaskNotify(sensor->task, notifications[hint], eSetBits);
+    return ESP_OK;
+}
+
+const char *temperature_delta_sensor_sampling_name(temperature_delta_sensor_sampling_t sampling)
+{
+    static const char *names[] = {
+        [TEMPERATURE_DELTA_SENSOR_SAMPLING_PUMP] = "pump",
+        [TEMPERATURE_DELTA_SENSOR_SAMPLING_ACTIVE] = "active",
+        [TEMPERATURE_DELTA_SENSOR_SAMPLING_IDLE] = "idle",
+    };
+    return (unsigned)sampling < TEMPERATURE_DELTA_SENSOR_SAMPLING_MAX ? names[sampling] : "unknown";
+}
+
 esp_err_t temperature_delta_sensor_reset(temperature_delta_sensor_t sensor)
 {
     ESP_RETURN_ON_FALSE(sensor, ESP_ERR_INVALID_ARG, TAG, "sensor must not be NULL");
-    sensor->data = (const temperature_delta_sensor_data_t){0};
+    // performed by the task, so that it stays the only writer
+    xTaskNotify(sensor->task, NOTIFY_RESET, eSetBits);
     return ESP_OK;
 }
 
@@ -167,8 +712,141 @@ esp_err_t temperature_delta_sensor_get_data(temperature_delta_sensor_t sensor,
 {
     ESP_RETURN_ON_FALSE(sensor, ESP_ERR_INVALID_ARG, TAG, "sensor must not be NULL");
     ESP_RETURN_ON_FALSE(data, ESP_ERR_INVALID_ARG, TAG, "data must not be NULL");
-    ESP_RETURN_ON_FALSE(xSemaphoreTake(sensor->mutex, MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG, "acquire mutex");
-    *data = sensor->data;
-    ESP_RETURN_ON_FALSE(xSemaphoreGive(sensor->mutex), ESP_ERR_NOT_FINISHED, TAG, "release mutex");
+    snapshot_read(&sensor->latch, sensor->snapshots, data, sizeof(temperature_delta_sensor_data_t));
+    return ESP_OK;
+}
+
+esp_err_t temperature_delta_sensor_get_health(temperature_delta_sensor_t sensor,
+                                              temperature_delta_sensor_health_t *health)
+{
+    ESP_RETURN_ON_FALSE(sensor && health, ESP_ERR_INVALID_ARG, TAG, "null");
+    snapshot_read(&sensor->health_latch, sensor->health_snapshots, health, sizeof(temperature_delta_sensor_health_t));
+    return ESP_OK;
+}
+
+window_stats_t temperature_delta_sensor_get_stats(temperature_delta_sensor_t sensor)
+{
+    ESP_RETURN_ON_FALSE(sensor, NULL, TAG, "sensor must not be NULL");
+    return sensor->stats;
+}
+
+float temperature_delta_sensor_get_delta(const temperature_delta_sensor_data_t *data)
+{
+    ESP_RETURN_ON_FALSE(data, NAN, TAG, "data must not be NULL");
+    return data->latest[data->probe_count];
+}
+
+int temperature_delta_sensor_find_channel(temperature_delta_sensor_t sensor, const char *name)
+{
+    ESP_RETURN_ON_FALSE(sensor && name, -1, TAG, "null");
+    return find_channel(&sensor->config, name);
+}
+
+const char *temperature_delta_sensor_get_channel_name(temperature_delta_sensor_t sensor, size_t channel)
+{
+    ESP_RETURN_ON_FALSE(sensor, NULL, TAG, "sensor must not be NULL");
+    ESP_RETURN_ON_FALSE(channel < sensor->data.channel_count, NULL, TAG, "invalid channel %u", (unsigned)channel);
+    return get_name(&sensor->config, channel);
+}
+
+uint64_t temperature_delta_sensor_get_address(temperature_delta_sensor_t sensor, size_t channel)
+{
+    ESP_RETURN_ON_FALSE(sensor, 0, TAG, "sensor must not be NULL");
+    return channel < sensor->config.probe_count ? sensor->addresses[channel] : 0;
+}
+
+// Copies the next comma-separated item of *list into item, and advances *list past it.
+static esp_err_t next_item(const char **list, char *item, size_t size)
+{
+    const size_t len = strcspn(*list, ",");
+    ESP_RETURN_ON_FALSE(len < size, ESP_ERR_INVALID_SIZE, TAG, "item too long: '%.*s'", (int)len, *list);
+    memcpy(item, *list, len);
+    item[len] = '\0';
+    *list += len + ((*list)[len] == ',');
+    return ESP_OK;
+}
+
+static esp_err_t parse_probe(const char *item, temperature_delta_sensor_probe_t *probe)
+{
+    const size_t len = strcspn(item, "=");
+    ESP_RETURN_ON_FALSE(len < sizeof(probe->name), ESP_ERR_INVALID_ARG, TAG, "invalid probe '%s'", item);
+    *probe = (temperature_delta_sensor_probe_t){0};
+    memcpy(probe->name, item, len);
+    if (item[len] == '=')
+    {
+        char *end;
+        probe->address = strtoull(&item[len + 1], &end, 16);
+        ESP_RETURN_ON_FALSE(probe->address && !*end, ESP_ERR_INVALID_ARG, TAG, "invalid address of probe '%s'",
+                            item);
+    }
     return ESP_OK;
 }
+
+static esp_err_t parse_delta(const temperature_delta_sensor_config_t *config, const char *item,
+                             temperature_delta_sensor_delta_t *delta)
+{
+    char probes[2][TEMPERATURE_DELTA_SENSOR_NAME_SIZE];
+    const size_t len = strcspn(item, "=");
+    const size_t first = item[len] ? strcspn(&item[len + 1], "-") : 0;
+    ESP_RETURN_ON_FALSE(len < sizeof(delta->name) && item[len] == '=' && first < sizeof(probes[0]) &&
+                            item[len + 1 + first] == '-' && strlen(&item[len + 2 + first]) < sizeof(probes[1]),
+                        ESP_ERR_INVALID_ARG, TAG, "expecting name=probe-probe, got '%s'", item);
+    *delta = (temperature_delta_sensor_delta_t){0};
+    memcpy(delta->name, item, len);
+    memcpy(probes[0], &item[len + 1], first);
+    probes[0][first] = '\0';
+    strcpy(probes[1], &item[len + 2 + first]);
+    for (int i = 0; i < 2; i++)
+    {
+        const int probe = find_channel(config, probes[i]);
+        ESP_RETURN_ON_FALSE(probe >= 0 && probe < config->probe_count, ESP_ERR_NOT_FOUND, TAG,
+                            "unknown probe '%s' in delta '%s'", probes[i], delta->name);
+        delta->probes[i] = probe;
+    }
+    return ESP_OK;
+}
+
+esp_err_t temperature_delta_sensor_parse_layout(temperature_delta_sensor_config_t *config, const char *probes,
+                                                const char *deltas)
+{
+    ESP_RETURN_ON_FALSE(config && probes && deltas, ESP_ERR_INVALID_ARG, TAG, "null");
+    char item[64];
+    // the deltas are looked up against the new probes alone
+    config->probe_count = 0;
+    config->delta_count = 0;
+    while (*probes)
+    {
+        ESP_RETURN_ON_FALSE(config->probe_count < TEMPERATURE_DELTA_SENSOR_MAX_PROBES, ESP_ERR_INVALID_SIZE, TAG,
+                            "more than %d probes", TEMPERATURE_DELTA_SENSOR_MAX_PROBES);
+        ESP_RETURN_ON_ERROR(next_item(&probes, item, sizeof(item)), TAG, "next probe");
+        ESP_RETURN_ON_ERROR(parse_probe(item, &config->probes[config->probe_count]), TAG, "parse probe");
+        config->probe_count++;
+    }
+    while (*deltas)
+    {
+        ESP_RETURN_ON_FALSE(config->delta_count < TEMPERATURE_DELTA_SENSOR_MAX_DELTAS, ESP_ERR_INVALID_SIZE, TAG,
+                            "more than %d deltas", TEMPERATURE_DELTA_SENSOR_MAX_DELTAS);
+        ESP_RETURN_ON_ERROR(next_item(&deltas, item, sizeof(item)), TAG, "next delta");
+        ESP_RETURN_ON_ERROR(parse_delta(config, item, &config->deltas[config->delta_count]), TAG, "parse delta");
+        config->delta_count++;
+    }
+    return check_layout(config);
+}
+
+uint32_t temperature_delta_sensor_get_snapshot_retries(temperature_delta_sensor_t sensor)
+{
+    ESP_RETURN_ON_FALSE(sensor, 0, TAG, "sensor must not be NULL");
+    return snapshot_get_retries(&sensor->latch);
+}
+
+uint32_t temperature_delta_sensor_get_dropped_notifications(temperature_delta_sensor_t sensor)
+{
+    ESP_RETURN_ON_FALSE(sensor, 0, TAG, "sensor must not be NULL");
+    return sensor->dropped_notifications;
+}
+
+uint32_t temperature_delta_sensor_get_coalesced_notifications(temperature_delta_sensor_t sensor)
+{
+    ESP_RETURN_ON_FALSE(sensor, 0, TAG, "sensor must not be NULL");
+    return sensor->coalesced_notifications;
+}
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <esp_check.h>
 #include <driver/gpio.h>
+#include <esp_event.h>
+#include "window_stats.h"
 
 #define TEMPERATURE_SENSOR_PAIR_SAMPLE_PERIOD_MIN 750
 
@@ -11,52 +15,190 @@ extern "C"
 {
 #endif
 
+    /*
+     * The time between readings adapts to what the readings are needed for: pump_sample_period while
+     * the pump runs (hot water is arriving), sample_period after flow activity or a change of the delta
+     * by change_threshold, and once nothing happened for idle_after, a period that doubles with each
+     * reading up to idle_sample_period. The pump state and the flow activity are hinted by the caller.
+     */
+    typedef enum
+    {
+        TEMPERATURE_DELTA_SENSOR_SAMPLING_PUMP,   /// the pump is on: pump_sample_period
+        TEMPERATURE_DELTA_SENSOR_SAMPLING_ACTIVE, /// recent flow or change: sample_period
+        TEMPERATURE_DELTA_SENSOR_SAMPLING_IDLE,   /// backing off towards idle_sample_period
+        TEMPERATURE_DELTA_SENSOR_SAMPLING_MAX,
+    } temperature_delta_sensor_sampling_t;
+
+    typedef enum
+    {
+        TEMPERATURE_DELTA_SENSOR_HINT_FLOW,     /// water is drawn (a flow cycle started or ended)
+        TEMPERATURE_DELTA_SENSOR_HINT_PUMP_ON,  /// the pump was turned on
+        TEMPERATURE_DELTA_SENSOR_HINT_PUMP_OFF, /// the pump was turned off
+    } temperature_delta_sensor_hint_t;
+
+    /*
+     * Any number of DS18B20 probes share the OneWire bus and are converted by one broadcast. Each probe
+     * has a stable name, and either a configured ROM address or the lowest address the bus scan finds
+     * that no other probe claims, so that a probe keeps its name when others are added. Deltas are
+     * derived between pairs of probes; the first one drives the sampling policy and the notifications.
+     *
+     * Probes and deltas are reported as channels: the probes in configuration order, then the deltas.
+     */
+#define TEMPERATURE_DELTA_SENSOR_MAX_PROBES 8
+#define TEMPERATURE_DELTA_SENSOR_MAX_DELTAS 4
+#define TEMPERATURE_DELTA_SENSOR_MAX_CHANNELS (TEMPERATURE_DELTA_SENSOR_MAX_PROBES + TEMPERATURE_DELTA_SENSOR_MAX_DELTAS)
+#define TEMPERATURE_DELTA_SENSOR_NAME_SIZE 16 // including the terminating NUL
+#define TEMPERATURE_DELTA_SENSOR_MAX_MEDIAN_WINDOW 7
+
+    typedef struct
+    {
+        char name[TEMPERATURE_DELTA_SENSOR_NAME_SIZE]; /// e.g. "supply", as used in URIs and metric labels
+        uint64_t address;                              /// ROM address (0: assigned from the bus scan)
+    } temperature_delta_sensor_probe_t;
+
+    typedef struct
+    {
+        char name[TEMPERATURE_DELTA_SENSOR_NAME_SIZE]; /// e.g. "delta"
+        uint8_t probes[2];                             /// indexes of the probes it is the absolute difference of
+    } temperature_delta_sensor_delta_t;
+
     typedef struct
     {
         gpio_num_t gpio_num;              /// GPIO number for this sensor (*required)
         uint64_t sample_period;           /// Time (in milliseconds) between temperature sensor readings. Cannot be less than 750ms.
+        uint64_t pump_sample_period;      /// Time (in milliseconds) between readings while the pump is on (0: 750ms).
+        uint64_t idle_sample_period;      /// Max time (in milliseconds) between readings when idle (0: sample_period).
+        uint64_t idle_after;              /// Time (in milliseconds) without activity after which sampling backs off.
+        float change_threshold;           /// change of the delta (in °C) that counts as activity.
         TickType_t notification_timeout;  /// max time (in ticks) to wait to send a notification (defaults to 1 ms)
         QueueHandle_t notification_queue; /// notification queue to which to send events when the latest readings are available.
         void *notification_arg;           /// an argument to pass in each notification message (optional)
+        bool notification_overwrite;      /// replace a pending notification (latest-value-wins); needs a queue of length 1
+        temperature_delta_sensor_probe_t probes[TEMPERATURE_DELTA_SENSOR_MAX_PROBES];
+        size_t probe_count;               /// at least 1
+        temperature_delta_sensor_delta_t deltas[TEMPERATURE_DELTA_SENSOR_MAX_DELTAS];
+        size_t delta_count;               /// at least 1
+        window_stats_config_t stats;      /// windowed statistics of each channel (channel_count is set by the sensor)
+        uint8_t read_retries;             /// immediate re-reads of a scratchpad that failed (CRC or no response)
+        float min_plausible;              /// readings below this (in °C) are rejected
+        float max_plausible;              /// readings above this (in °C) are rejected
+        uint8_t median_window;            /// recent readings of a probe that a reading is checked against (0: none)
+        float max_step;                   /// max distance (in °C) of a reading from the median of the recent ones
+        uint8_t lost_after;               /// rejected readings in a row after which a probe is lost (at least 1)
     } temperature_delta_sensor_config_t;
 
-#define TEMPERATURE_SENSOR_PAIR_CONFIG_DEFAULT()  \
-    {                                             \
-        .sample_period = 10000,                   \
-        .notification_timeout = pdMS_TO_TICKS(1), \
+#define TEMPERATURE_SENSOR_PAIR_CONFIG_DEFAULT()                      \
+    {                                                                 \
+        .sample_period = 10000,                                       \
+        .pump_sample_period = 750,                                    \
+        .idle_sample_period = 300000,                                 \
+        .idle_after = 600000,                                         \
+        .change_threshold = 1,                                        \
+        .notification_timeout = pdMS_TO_TICKS(1),                     \
+        .probes = {{.name = "1"}, {.name = "2"}},                     \
+        .probe_count = 2,                                             \
+        .deltas = {{.name = "delta", .probes = {0, 1}}},              \
+        .delta_count = 1,                                             \
+        .stats = WINDOW_STATS_CONFIG_DEFAULT(),                       \
+        .read_retries = 2,                                            \
+        .min_plausible = -20,                                         \
+        .max_plausible = 110,                                         \
+        .median_window = 5,                                           \
+        .max_step = 10,                                               \
+        .lost_after = 3,                                              \
     }
 
     typedef struct temperature_delta_sensor_s *temperature_delta_sensor_t;
 
+    ESP_EVENT_DECLARE_BASE(TEMPERATURE_DELTA_SENSOR_EVENT);
+
+    typedef enum
+    {
+        TEMPERATURE_DELTA_SENSOR_EVENT_READING, /// a reading completed (latest is set)
+        TEMPERATURE_DELTA_SENSOR_EVENT_FAULT,   /// a conversion or reading failed, or a probe is lost (err is set)
+    } temperature_delta_sensor_event_id_t;
+
     typedef struct
     {
-        float delta;                                         /// the latest absolute delta (in °C)
+        temperature_delta_sensor_t sensor;                   /// the sensor that was read
+        int64_t timestamp;                                   /// microseconds since boot of the reading
+        float latest[TEMPERATURE_DELTA_SENSOR_MAX_CHANNELS]; /// by channel (in °C; NAN: unknown)
+        uint8_t probe_count;                                 /// the channel of the first delta
+        uint8_t channel_count;
+        esp_err_t err;                                       /// the error of a failed reading
+        uint32_t failures;                                   /// failed readings in a row, this one included
+    } temperature_delta_sensor_event_t;
+
+    typedef struct
+    {
+        float delta;                                         /// the latest value of the first delta (in °C)
         temperature_delta_sensor_t temperature_delta_sensor; /// the temperature delta sensor
         void *notification_arg;                              /// the configured argument
     } temperature_delta_sensor_notification_t;
 
+    /*
+     * The statistics are kept as arrays by channel, which the update of a reading sweeps one at a time.
+     * Only complete readings, in which every channel has a value, count and update the statistics; a
+     * channel whose value is unknown (a probe not read yet, or lost) has a NAN latest temperature.
+     */
     typedef struct
     {
-        float latest;  /// the latest temperature (in °C)
-        float min;     /// the minimum temperature (in °C)
-        float max;     /// the maximum temperature (in °C)
-        float average; /// the average temperature (in °C)
-    } temperature_delta_sensor_info_t;
+        float latest[TEMPERATURE_DELTA_SENSOR_MAX_CHANNELS];  /// the latest temperatures (in °C; NAN: unknown)
+        float min[TEMPERATURE_DELTA_SENSOR_MAX_CHANNELS];     /// the minimum temperatures (in °C)
+        float max[TEMPERATURE_DELTA_SENSOR_MAX_CHANNELS];     /// the maximum temperatures (in °C)
+        float average[TEMPERATURE_DELTA_SENSOR_MAX_CHANNELS]; /// the average temperatures (in °C)
+        uint8_t probe_count;                                  /// the channel of the first delta
+        uint8_t channel_count;                                /// probes and deltas
+        uint32_t readings;                                    /// the number of (complete) readings
+        uint32_t faults;                                      /// the number of (failed or incomplete) readings
+        uint64_t latest_reading_timestamp;                    /// microseconds since boot of the latest reading
+        temperature_delta_sensor_sampling_t sampling;            /// why readings are sample_period apart
+        uint32_t sample_period;                                  /// the current time (in ms) between readings
+        uint32_t samples[TEMPERATURE_DELTA_SENSOR_SAMPLING_MAX]; /// readings taken in each sampling mode
+    } temperature_delta_sensor_data_t;
 
-    typedef enum
+    /*
+     * The health of the OneWire bus. Each probe's scratchpad is re-read right away when the read fails,
+     * up to read_retries times. A reading is then rejected when it is out of the plausible range, when it
+     * is the 85 °C a probe reports after losing power mid-conversion (unless its recent readings are about
+     * as hot), or when it is further than max_step from the median of the probe's recent readings. The
+     * latter are remembered even when rejected, so that a genuine step is accepted once it makes the
+     * median. A rejected reading is stood in for by the probe's previous one and the next conversion is
+     * started right away to confirm it; after lost_after rejected readings in a row, the probe is lost:
+     * its channels (and those of the deltas it is part of) become unknown until it is read again.
+     *
+     * The counters are since boot.
+     */
+    typedef struct
     {
-        TEMPERATURE_DELTA_SENSOR_FIRST = 0,
-        TEMPERATURE_DELTA_SENSOR_SECOND = 1,
-        TEMPERATURE_DELTA_SENSOR_DELTA = 2
-    } temperature_delta_sensor_position_t;
+        uint32_t read_errors;          /// scratchpad reads that failed (CRC or no response), retries included
+        uint32_t retries;              /// scratchpad reads retried
+        uint32_t implausible;          /// readings out of the plausible range
+        uint32_t power_on;             /// power-on values rejected
+        uint32_t outliers;             /// readings too far from the median of the recent ones
+        uint32_t consecutive_failures; /// rejected readings in a row
+        uint32_t losses;               /// times the probe was lost
+        esp_err_t last_error;          /// of the latest rejected reading (ESP_ERR_INVALID_RESPONSE: a value rejected)
+        bool lost;                     /// whether the probe is lost
+    } temperature_delta_sensor_probe_health_t;
 
     typedef struct
     {
-        temperature_delta_sensor_info_t info[3]; /// temperature sensor info
-        uint32_t readings;                       /// the number of (successful) readings
-        uint32_t faults;                         /// the number of (unsuccessful) readings
-        uint64_t latest_reading_timestamp;       /// microseconds since boot of the latest reading
-    } temperature_delta_sensor_data_t;
+        temperature_delta_sensor_probe_health_t probes[TEMPERATURE_DELTA_SENSOR_MAX_PROBES];
+        uint8_t probe_count;
+        uint32_t conversion_time;     /// microseconds from the latest conversion command to the reading of its result
+        uint32_t conversion_time_max; /// microseconds
+        uint32_t read_time;           /// microseconds the latest reading of the scratchpads took, retries included
+        uint32_t read_time_max;       /// microseconds
+    } temperature_delta_sensor_health_t;
+
+    /*
+     * Sets the probes and deltas of config from comma-separated lists: probes as "name[=address]" (the
+     * address in hex, e.g. "supply=28ff641e8016036c,return") and deltas as "name=probe-probe" (e.g.
+     * "delta=supply-return"). Names are made of letters, digits and '_', and must be unique.
+     */
+    esp_err_t temperature_delta_sensor_parse_layout(temperature_delta_sensor_config_t *config, const char *probes,
+                                                    const char *deltas);
 
     esp_err_t temperature_delta_sensor_open(const temperature_delta_sensor_config_t *config,
                                             temperature_delta_sensor_t *sensor_out);
@@ -65,8 +207,36 @@ extern "C"
 
     esp_err_t temperature_delta_sensor_reset(temperature_delta_sensor_t sensor);
 
+    // Starts a conversion now (unless one is in progress); the reading is reported as usual ~750ms later.
+    esp_err_t temperature_delta_sensor_request_reading(temperature_delta_sensor_t sensor);
+
+    // Tells the sensor about activity that makes readings more (or less) useful; see the sampling modes.
+    esp_err_t temperature_delta_sensor_hint(temperature_delta_sensor_t sensor, temperature_delta_sensor_hint_t hint);
+
+    const char *temperature_delta_sensor_sampling_name(temperature_delta_sensor_sampling_t sampling);
+
     esp_err_t temperature_delta_sensor_get_data(temperature_delta_sensor_t sensor,
                                                 temperature_delta_sensor_data_t *data);
+
+    esp_err_t temperature_delta_sensor_get_health(temperature_delta_sensor_t sensor,
+                                                  temperature_delta_sensor_health_t *health);
+
+    // The windowed statistics of the channels, which are reset with the readings.
+    window_stats_t temperature_delta_sensor_get_stats(temperature_delta_sensor_t sensor);
+
+    // The latest value of the first delta, which drives the pump (NAN: unknown).
+    float temperature_delta_sensor_get_delta(const temperature_delta_sensor_data_t *data);
+
+    // Returns the channel with the given name, or -1 if there is none.
+    int temperature_delta_sensor_find_channel(temperature_delta_sensor_t sensor, const char *name);
+    const char *temperature_delta_sensor_get_channel_name(temperature_delta_sensor_t sensor, size_t channel);
+    // Returns the ROM address of a probe channel, or 0 for a delta.
+    uint64_t temperature_delta_sensor_get_address(temperature_delta_sensor_t sensor, size_t channel);
+
+    uint32_t temperature_delta_sensor_get_snapshot_retries(temperature_delta_sensor_t sensor);
+    uint32_t temperature_delta_sensor_get_dropped_notifications(temperature_delta_sensor_t sensor);
+    // Notifications replaced before they were received (with notification_overwrite).
+    uint32_t temperature_delta_sensor_get_coalesced_notifications(temperature_delta_sensor_t sensor);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,257 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_rom_crc.h>
+#include <nvs.h>
+#include "snapshot.h"
+#include "totals.h"
+
+#define SAMPLE_PERIOD 60000000 // samples the counters once a minute (µs)
+#define RECORD_VERSION 1       // bumped when totals_counters_t changes
+#define HOURS_IN_DAY 24
+#define USEC_IN_HOUR 3600000000LL
+
+static const char *TAG = "totals";
+
+// The two checkpoint slots; a record goes to slot sequence % 2.
+static const char *const slot_keys[2] = {"totals_a", "totals_b"};
+
+typedef struct
+{
+    uint32_t version;           /// RECORD_VERSION
+    uint32_t sequence;          /// incremented by each checkpoint
+    totals_counters_t counters; /// the lifetime totals
+    uint32_t crc;               /// CRC-32 of the bytes before it
+} record_t;
+
+struct totals_s
+{
+    totals_config_t config;
+    esp_timer_handle_t timer;             /// samples the counters
+    totals_counters_t seen;               /// the counters at the latest sample (since boot)
+    totals_data_t data;                   /// the totals (owned by the timer callback)
+    totals_data_t snapshots[2];           /// published copies of data, for lock-free readers
+    snapshot_latch_t latch;               /// selects which of the snapshots readers copy
+    totals_counters_t written;            /// the totals of the latest checkpoint
+    int64_t written_at;                   /// microseconds since boot of the latest checkpoint
+    uint16_t hourly_writes[HOURS_IN_DAY]; /// checkpoints by hour of uptime, for writes_last_day
+    int64_t hour;                         /// hour of uptime of the latest sample
+};
+
+static uint32_t get_crc(const record_t *record)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)record, offsetof(record_t, crc));
+}
+
+// Reads the counters of the producers since boot.
+static esp_err_t read_counters(const totals_config_t *config, totals_counters_t *counters)
+{
+    relay_data_t relay;
+    temperature_delta_sensor_data_t temperature;
+    pulse_sensor_data_t flow = {0};
+    ESP_RETURN_ON_ERROR(relay_get_data(config->relay, &relay), TAG, "get relay data");
+    ESP_RETURN_ON_ERROR(temperature_delta_sensor_get_data(config->temperature_delta_sensor, &temperature), TAG,
+                        "get temperature data");
+    ESP_RETURN_ON_ERROR(pulse_sensor_get_data(config->flow_sensor, &flow), TAG, "get flow data");
+    *counters = (totals_counters_t){
+        .pump_on_time = relay_get_total_time_in_state(&relay, RELAY_ON),
+        .pump_off_time = relay_get_total_time_in_state(&relay, RELAY_OFF),
+        .flow_pulses = flow.total_pulses,
+        .flow_duration = flow.total_duration,
+        .pump_starts = relay_get_total_state_changes(&relay, RELAY_ON),
+        .flow_cycles = flow.cycles,
+        .temperature_readings = temperature.readings,
+        .temperature_faults = temperature.faults,
+    };
+    return ESP_OK;
+}
+
+// Adds the increase of a counter since the latest sample; a counter that went down was reset.
+#define ACCUMULATE(field)                                                                                   \
+    totals->data.totals.field += current.field >= totals->seen.field ? current.field - totals->seen.field \
+                                                                     : current.field
+
+static void accumulate(totals_t totals, const totals_counters_t *counters)
+{
+    const totals_counters_t current = *counters;
+    ACCUMULATE(pump_on_time);
+    ACCUMULATE(pump_off_time);
+    ACCUMULATE(flow_pulses);
+    ACCUMULATE(flow_duration);
+    ACCUMULATE(pump_starts);
+    ACCUMULATE(flow_cycles);
+    ACCUMULATE(temperature_readings);
+    ACCUMULATE(temperature_faults);
+    totals->seen = current;
+}
+
+static bool is_dirty(const totals_counters_t *totals, const totals_counters_t *written)
+{
+    // everything but the off time, which grows by itself
+    totals_counters_t a = *totals;
+    a.pump_off_time = written->pump_off_time;
+    return memcmp(&a, written, sizeof(totals_counters_t)) != 0;
+}
+
+static esp_err_t write_record(const totals_config_t *config, const record_t *record)
+{
+    esp_err_t ret = ESP_OK;
+    nvs_handle_t nvs;
+    ESP_RETURN_ON_ERROR(nvs_open(config->nvs_namespace, NVS_READWRITE, &nvs), TAG, "open NVS");
+    ESP_GOTO_ON_ERROR(nvs_set_blob(nvs, slot_keys[record->sequence % 2], record, sizeof(record_t)), close_nvs, TAG,
+                      "set %s", slot_keys[record->sequence % 2]);
+    ESP_GOTO_ON_ERROR(nvs_commit(nvs), close_nvs, TAG, "commit");
+close_nvs:
+    nvs_close(nvs);
+    return ret;
+}
+
+static void checkpoint(totals_t totals, int64_t now)
+{
+    record_t record = {
+        .version = RECORD_VERSION,
+        .sequence = totals->data.sequence + 1,
+        .counters = totals->data.totals,
+    };
+    record.crc = get_crc(&record);
+    if (write_record(&totals->config, &record) != ESP_OK)
+    {
+        totals->data.write_failures++;
+        return;
+    }
+    totals->data.sequence = record.sequence;
+    totals->data.writes++;
+    totals->hourly_writes[totals->hour % HOURS_IN_DAY]++;
+    totals->written = record.counters;
+    totals->written_at = now;
+    ESP_LOGD(TAG, "Checkpoint %lu written", (unsigned long)record.sequence);
+}
+
+static void sample(totals_t totals)
+{
+    const int64_t now = esp_timer_get_time();
+    totals_counters_t counters;
+    if (read_counters(&totals->config, &counters) == ESP_OK)
+    {
+        accumulate(totals, &counters);
+    }
+    // the buckets of the hours that went by since the latest sample start over
+    const int64_t hour = now / USEC_IN_HOUR;
+    for (int64_t h = totals->hour + 1; h <= hour && h <= totals->hour + HOURS_IN_DAY; h++)
+    {
+        totals->hourly_writes[h % HOURS_IN_DAY] = 0;
+    }
+    totals->hour = hour;
+    if (is_dirty(&totals->data.totals, &totals->written) &&
+        (!totals->data.writes || now - totals->written_at >= (int64_t)totals->config.write_interval * 1000000))
+    {
+        checkpoint(totals, now);
+    }
+    totals->data.writes_last_day = 0;
+    for (int i = 0; i < HOURS_IN_DAY; i++)
+    {
+        totals->data.writes_last_day += totals->hourly_writes[i];
+    }
+    snapshot_publish(&totals->latch, totals->snapshots, &totals->data, sizeof(totals_data_t));
+}
+
+static void timer_handler(void *arg)
+{
+    sample((totals_t)arg);
+}
+
+// Restores the totals from the valid slot with the highest sequence number, if any.
+static void restore(totals_t totals)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(totals->config.nvs_namespace, NVS_READONLY, &nvs);
+    for (int slot = 0; err == ESP_OK && slot < 2; slot++)
+    {
+        record_t record;
+        size_t length = sizeof(record);
+        if (nvs_get_blob(nvs, slot_keys[slot], &record, &length) != ESP_OK || length != sizeof(record) ||
+            record.version != RECORD_VERSION || record.crc != get_crc(&record))
+        {
+            continue;
+        }
+        if (!totals->data.restored || (int32_t)(record.sequence - totals->data.sequence) > 0)
+        {
+            totals->data.totals = record.counters;
+            totals->data.sequence = record.sequence;
+            totals->data.restored = true;
+        }
+    }
+    if (err == ESP_OK)
+    {
+        nvs_close(nvs);
+    }
+    if (totals->data.restored)
+    {
+        ESP_LOGI(TAG, "Restored checkpoint %lu", (unsigned long)totals->data.sequence);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "No checkpoint restored, starting from zero");
+    }
+    totals->written = totals->data.totals;
+}
+
+esp_err_t totals_open(const totals_config_t *config, totals_t *totals_out)
+{
+    esp_err_t ret = ESP_FAIL;
+    ESP_GOTO_ON_FALSE(config && totals_out, ESP_ERR_INVALID_ARG, handle_error, TAG, "null");
+    ESP_GOTO_ON_FALSE(config->relay && config->temperature_delta_sensor && config->flow_sensor &&
+                          config->nvs_namespace,
+                      ESP_ERR_INVALID_ARG, handle_error, TAG, "missing producer or namespace");
+    ESP_GOTO_ON_FALSE(config->write_interval, ESP_ERR_INVALID_ARG, handle_error, TAG, "invalid write_interval");
+    const totals_t totals = calloc(1, sizeof(struct totals_s));
+    ESP_GOTO_ON_FALSE(totals, ESP_ERR_NO_MEM, handle_error, TAG, "malloc totals");
+    totals->config = *config;
+    restore(totals);
+    totals->data.totals.boots++;
+    totals->data.write_budget = 24 * 3600 / config->write_interval;
+    totals->hour = esp_timer_get_time() / USEC_IN_HOUR;
+    // the producers count from boot, which their first sample adds in full
+    snapshot_publish(&totals->latch, totals->snapshots, &totals->data, sizeof(totals_data_t));
+    const esp_timer_create_args_t timer_args = {.callback = &timer_handler, .arg = totals, .name = "Totals timer"};
+    ESP_GOTO_ON_ERROR(esp_timer_create(&timer_args, &totals->timer), free_totals, TAG, "create timer");
+    ESP_GOTO_ON_ERROR(esp_timer_start_periodic(totals->timer, SAMPLE_PERIOD), delete_timer, TAG, "start timer");
+    *totals_out = totals;
+    ESP_LOGI(TAG, "Opened (boot %lu)", (unsigned long)totals->data.totals.boots);
+    return ESP_OK;
+delete_timer:
+    esp_timer_delete(totals->timer);
+free_totals:
+    free(totals);
+handle_error:
+    return ret;
+}
+
+esp_err_t totals_close(totals_t totals)
+{
+    ESP_RETURN_ON_FALSE(totals, ESP_ERR_INVALID_ARG, TAG, "totals must not be NULL");
+    esp_timer_stop(totals->timer);
+    esp_timer_delete(totals->timer);
+    totals_counters_t counters;
+    if (read_counters(&totals->config, &counters) == ESP_OK)
+    {
+        accumulate(totals, &counters);
+    }
+    if (is_dirty(&totals->data.totals, &totals->written))
+    {
+        checkpoint(totals, esp_timer_get_time());
+    }
+    free(totals);
+    ESP_LOGI(TAG, "Closed");
+    return ESP_OK;
+}
+
+esp_err_t totals_get_data(totals_t totals, totals_data_t *data)
+{
+    ESP_RETURN_ON_FALSE(totals && data, ESP_ERR_INVALID_ARG, TAG, "null");
+    snapshot_read(&totals->latch, totals->snapshots, data, sizeof(totals_data_t));
+    return ESP_OK;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "relay.h"
+#include "temperature_delta_sensor.h"
+#include "pulse_sensor.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Lifetime totals of the relay, the flow sensor and the temperature sensor, which only count since
+     * boot (or since a reset). Once a minute the counters are sampled and their increase is added to
+     * the totals; the totals are checkpointed to NVS when they changed, at most once per write
+     * interval, and restored at open.
+     *
+     * Checkpoints alternate between two NVS keys, each record carrying a sequence number and a CRC, so
+     * that a write cut short by a power loss leaves the previous checkpoint to restore. The pump's off
+     * time alone does not make the totals dirty: an idle controller does not write.
+     */
+    typedef struct totals_s *totals_t;
+
+    typedef struct
+    {
+        relay_t relay;                                       /// (*required)
+        temperature_delta_sensor_t temperature_delta_sensor; /// (*required)
+        pulse_sensor_t flow_sensor;                          /// (*required)
+        const char *nvs_namespace;                           /// where to checkpoint the totals (*required)
+        uint32_t write_interval;                             /// min seconds between checkpoints
+    } totals_config_t;
+
+#define TOTALS_CONFIG_DEFAULT()     \
+    {                               \
+        .nvs_namespace = "totals",  \
+        .write_interval = 900,      \
+    }
+
+    typedef struct
+    {
+        uint64_t pump_on_time;         /// microseconds the pump ran
+        uint64_t pump_off_time;        /// microseconds the pump was off
+        uint64_t flow_pulses;          /// flow meter pulses of completed cycles
+        uint64_t flow_duration;        /// microseconds of completed flow cycles
+        uint32_t pump_starts;          /// times the pump was turned on
+        uint32_t flow_cycles;          /// completed flow cycles
+        uint32_t temperature_readings; /// successful temperature readings
+        uint32_t temperature_faults;   /// failed temperature readings
+        uint32_t boots;                /// times the totals were opened
+    } totals_counters_t;
+
+    typedef struct
+    {
+        totals_counters_t totals; /// lifetime totals, as of the latest sample
+        bool restored;            /// whether the totals were restored from a checkpoint at open
+        uint32_t sequence;        /// sequence number of the latest checkpoint
+        uint32_t writes;          /// checkpoints written since boot
+        uint32_t write_failures;  /// checkpoints that failed to be written since boot
+        uint32_t writes_last_day; /// checkpoints written in the last 24 hours (of uptime)
+        uint32_t write_budget;    /// max checkpoints per day the write interval allows
+    } totals_data_t;
+
+    esp_err_t totals_open(const totals_config_t *config, totals_t *totals_out);
+    // Checkpoints the totals (if they changed) before closing.
+    esp_err_t totals_close(totals_t totals);
+    esp_err_t totals_get_data(totals_t totals, totals_data_t *data);
+
+#ifdef __cplusplus
+}
+#endif
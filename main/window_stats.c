@@ -0,0 +1,240 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include "snapshot.h"
+#include "window_stats.h"
+
+#define USEC_IN_SEC 1000000
+
+static const char *TAG = "window_stats";
+
+typedef struct
+{
+    float value;   /// the sample (negated in the deques of minimums)
+    uint32_t slot; /// the slot it was taken in
+} entry_t;
+
+// A ring of resolution entries with decreasing values and increasing slots: the front is the extreme.
+typedef struct
+{
+    entry_t *entries;
+    uint32_t head;  /// index of the front
+    uint32_t count;
+} deque_t;
+
+typedef struct
+{
+    float ewma;
+    float ewm_variance;
+    double mean; /// doubles, so that late samples still move the mean after months of them
+    double m2;   /// sum of the squared differences from the mean
+    uint32_t count;
+} moments_t;
+
+struct window_stats_s
+{
+    window_stats_config_t config;
+    uint64_t slot_lengths[WINDOW_STATS_MAX_WINDOWS]; /// microseconds, by window
+    entry_t *entries;                                 /// of all the deques
+    deque_t *deques;                                  /// by channel, window, then min (0) or max (1)
+    moments_t *moments;                               /// by channel
+    window_stats_summary_t *summaries;                /// by channel (owned by the writer)
+    window_stats_summary_t *snapshots;                /// two published copies by channel, for lock-free readers
+    snapshot_latch_t *latches;                        /// by channel: selects which of its snapshots readers copy
+    int64_t latest;                                   /// microseconds since boot of the latest sample (0: none)
+};
+
+// Adds a sample to a deque of maximums, and returns the maximum over the window.
+static float push(deque_t *deque, uint32_t capacity, float value, uint32_t slot)
+{
+    // the samples that left the window, from the front (the difference survives the slots wrapping around)
+    while (deque->count && slot - deque->entries[deque->head].slot >= capacity)
+    {
+        deque->head = (deque->head + 1) % capacity;
+        deque->count--;
+    }
+    // the samples that can no longer be the maximum, from the back
+    while (deque->count && deque->entries[(deque->head + deque->count - 1) % capacity].value <= value)
+    {
+        deque->count--;
+    }
+    // a greater sample of the same slot leaves the window with this one; otherwise a slot is free
+    const entry_t *back = deque->count ? &deque->entries[(deque->head + deque->count - 1) % capacity] : NULL;
+    if (!back || back->slot != slot)
+    {
+        deque->entries[(deque->head + deque->count) % capacity] = (entry_t){.value = value, .slot = slot};
+        deque->count++;
+    }
+    return deque->entries[deque->head].value;
+}
+
+static void update_moments(moments_t *moments, float alpha, float value)
+{
+    // the exponentially weighted form of Welford's update
+    const float diff = value - moments->ewma;
+    const float increment = alpha * diff;
+    moments->ewma += increment;
+    moments->ewm_variance = (1 - alpha) * (moments->ewm_variance + diff * increment);
+    moments->count++;
+    const double delta = value - moments->mean;
+    moments->mean += delta / moments->count;
+    moments->m2 += delta * (value - moments->mean);
+}
+
+esp_err_t window_stats_parse_windows(window_stats_config_t *config, const char *windows)
+{
+    ESP_RETURN_ON_FALSE(config && windows, ESP_ERR_INVALID_ARG, TAG, "null");
+    config->window_count = 0;
+    while (*windows)
+    {
+        ESP_RETURN_ON_FALSE(config->window_count < WINDOW_STATS_MAX_WINDOWS, ESP_ERR_INVALID_SIZE, TAG,
+                            "more than %d windows", WINDOW_STATS_MAX_WINDOWS);
+        char *end;
+        const unsigned long window = strtoul(windows, &end, 10);
+        ESP_RETURN_ON_FALSE(window && window <= UINT32_MAX / 2 && end != windows && (*end == ',' || !*end),
+                            ESP_ERR_INVALID_ARG, TAG, "invalid window '%s'", windows);
+        config->windows[config->window_count++] = window;
+        windows = end + (*end == ',');
+    }
+    ESP_RETURN_ON_FALSE(config->window_count, ESP_ERR_INVALID_ARG, TAG, "no windows");
+    return ESP_OK;
+}
+
+esp_err_t window_stats_open(const window_stats_config_t *config, window_stats_t *stats_out)
+{
+    esp_err_t ret = ESP_FAIL;
+    ESP_GOTO_ON_FALSE(config && stats_out, ESP_ERR_INVALID_ARG, handle_error, TAG, "null");
+    ESP_GOTO_ON_FALSE(config->channel_count, ESP_ERR_INVALID_ARG, handle_error, TAG, "invalid channel_count");
+    ESP_GOTO_ON_FALSE(config->window_count && config->window_count <= WINDOW_STATS_MAX_WINDOWS,
+                      ESP_ERR_INVALID_ARG, handle_error, TAG, "invalid window_count");
+    ESP_GOTO_ON_FALSE(config->resolution && config->time_constant, ESP_ERR_INVALID_ARG, handle_error, TAG,
+                      "invalid resolution or time_constant");
+    for (size_t w = 0; w < config->window_count; w++)
+    {
+        ESP_GOTO_ON_FALSE((uint64_t)config->windows[w] * USEC_IN_SEC >= config->resolution, ESP_ERR_INVALID_ARG,
+                          handle_error, TAG, "invalid window %u", (unsigned)w);
+    }
+    const window_stats_t stats = calloc(1, sizeof(struct window_stats_s));
+    ESP_GOTO_ON_FALSE(stats, ESP_ERR_NO_MEM, handle_error, TAG, "malloc stats");
+    stats->config = *config;
+    const size_t deques = config->channel_count * config->window_count * 2;
+    stats->entries = calloc(deques * config->resolution, sizeof(entry_t));
+    ESP_GOTO_ON_FALSE(stats->entries, ESP_ERR_NO_MEM, free_stats, TAG, "malloc %u deques", (unsigned)deques);
+    stats->deques = calloc(deques, sizeof(deque_t));
+    ESP_GOTO_ON_FALSE(stats->deques, ESP_ERR_NO_MEM, free_entries, TAG, "malloc deques");
+    stats->moments = calloc(config->channel_count, sizeof(moments_t));
+    ESP_GOTO_ON_FALSE(stats->moments, ESP_ERR_NO_MEM, free_deques, TAG, "malloc moments");
+    stats->summaries = calloc(config->channel_count * 3, sizeof(window_stats_summary_t));
+    ESP_GOTO_ON_FALSE(stats->summaries, ESP_ERR_NO_MEM, free_moments, TAG, "malloc summaries");
+    stats->snapshots = stats->summaries + config->channel_count;
+    stats->latches = calloc(config->channel_count, sizeof(snapshot_latch_t));
+    ESP_GOTO_ON_FALSE(stats->latches, ESP_ERR_NO_MEM, free_summaries, TAG, "malloc latches");
+    for (size_t d = 0; d < deques; d++)
+    {
+        stats->deques[d].entries = stats->entries + d * config->resolution;
+    }
+    for (size_t w = 0; w < config->window_count; w++)
+    {
+        stats->slot_lengths[w] = (uint64_t)config->windows[w] * USEC_IN_SEC / config->resolution;
+    }
+    *stats_out = stats;
+    ESP_LOGD(TAG, "Opened (%u channels, %u bytes of deques)", (unsigned)config->channel_count,
+             (unsigned)(deques * config->resolution * sizeof(entry_t)));
+    return ESP_OK;
+free_summaries:
+    free(stats->summaries);
+free_moments:
+    free(stats->moments);
+free_deques:
+    free(stats->deques);
+free_entries:
+    free(stats->entries);
+free_stats:
+    free(stats);
+handle_error:
+    return ret;
+}
+
+esp_err_t window_stats_close(window_stats_t stats)
+{
+    ESP_RETURN_ON_FALSE(stats, ESP_ERR_INVALID_ARG, TAG, "stats must not be NULL");
+    free(stats->latches);
+    free(stats->summaries);
+    free(stats->moments);
+    free(stats->deques);
+    free(stats->entries);
+    free(stats);
+    return ESP_OK;
+}
+
+esp_err_t window_stats_add(window_stats_t stats, int64_t timestamp, const float *values)
+{
+    ESP_RETURN_ON_FALSE(stats && values, ESP_ERR_INVALID_ARG, TAG, "null");
+    const window_stats_config_t *config = &stats->config;
+    // the weight of the new sample grows with the time since the previous one (the sampling adapts)
+    const float alpha = stats->latest && timestamp > stats->latest
+                            ? 1 - expf(-(float)(timestamp - stats->latest) / USEC_IN_SEC / config->time_constant)
+                            : stats->latest ? 0 : 1;
+    stats->latest = timestamp;
+    for (size_t c = 0; c < config->channel_count; c++)
+    {
+        window_stats_summary_t *summary = &stats->summaries[c];
+        for (size_t w = 0; w < config->window_count; w++)
+        {
+            deque_t *deques = &stats->deques[(c * config->window_count + w) * 2];
+            const uint32_t slot = timestamp / stats->slot_lengths[w];
+            summary->min[w] = -push(&deques[0], config->resolution, -values[c], slot);
+            summary->max[w] = push(&deques[1], config->resolution, values[c], slot);
+        }
+        moments_t *moments = &stats->moments[c];
+        update_moments(moments, alpha, values[c]);
+        summary->ewma = moments->ewma;
+        summary->ewm_stddev = sqrtf(moments->ewm_variance);
+        summary->mean = moments->mean;
+        summary->stddev = moments->count > 1 ? sqrt(moments->m2 / (moments->count - 1)) : 0;
+        summary->count = moments->count;
+        snapshot_publish(&stats->latches[c], &stats->snapshots[c * 2], summary, sizeof(window_stats_summary_t));
+    }
+    return ESP_OK;
+}
+
+esp_err_t window_stats_reset(window_stats_t stats)
+{
+    ESP_RETURN_ON_FALSE(stats, ESP_ERR_INVALID_ARG, TAG, "stats must not be NULL");
+    const window_stats_config_t *config = &stats->config;
+    for (size_t d = 0; d < config->channel_count * config->window_count * 2; d++)
+    {
+        stats->deques[d].head = 0;
+        stats->deques[d].count = 0;
+    }
+    memset(stats->moments, 0, config->channel_count * sizeof(moments_t));
+    memset(stats->summaries, 0, config->channel_count * sizeof(window_stats_summary_t));
+    stats->latest = 0;
+    for (size_t c = 0; c < config->channel_count; c++)
+    {
+        snapshot_publish(&stats->latches[c], &stats->snapshots[c * 2], &stats->summaries[c],
+                         sizeof(window_stats_summary_t));
+    }
+    return ESP_OK;
+}
+
+esp_err_t window_stats_get(window_stats_t stats, size_t channel, window_stats_summary_t *summary)
+{
+    ESP_RETURN_ON_FALSE(stats && summary, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(channel < stats->config.channel_count, ESP_ERR_INVALID_ARG, TAG, "invalid channel %u",
+                        (unsigned)channel);
+    snapshot_read(&stats->latches[channel], &stats->snapshots[channel * 2], summary, sizeof(window_stats_summary_t));
+    return ESP_OK;
+}
+
+size_t window_stats_get_window_count(window_stats_t stats)
+{
+    return stats ? stats->config.window_count : 0;
+}
+
+uint32_t window_stats_get_window(window_stats_t stats, size_t window)
+{
+    return stats && window < stats->config.window_count ? stats->config.windows[window] : 0;
+}
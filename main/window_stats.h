@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+#define WINDOW_STATS_MAX_WINDOWS 3
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Rolling statistics of a fixed number of channels sampled together, in O(1) (amortized) per sample
+     * and channel: the min and max over each window, an exponentially weighted moving average (EWMA)
+     * and standard deviation, and the mean and standard deviation since the latest reset (Welford's
+     * algorithm). All the memory is allocated at open.
+     *
+     * The min and max of a window come from a monotonic deque of the samples that may still become the
+     * extreme. To bound the deques, time is divided into `resolution` slots per window and a deque keeps
+     * at most one sample per slot, so that a sample leaves the window up to one slot late.
+     *
+     * A single writer adds the samples; the statistics are published after each one, so any number of
+     * readers get them without a lock. They are as of the latest sample.
+     */
+    typedef struct window_stats_s *window_stats_t;
+
+    typedef struct
+    {
+        uint32_t windows[WINDOW_STATS_MAX_WINDOWS]; /// lengths (in seconds) of the min/max windows
+        size_t window_count;
+        uint32_t resolution;    /// slots per window (16 bytes of deques per slot, window and channel)
+        uint32_t time_constant; /// seconds after which a sample weighs 1/e in the EWMA
+        size_t channel_count;   /// (*required)
+    } window_stats_config_t;
+
+#define WINDOW_STATS_CONFIG_DEFAULT()          \
+    {                                          \
+        .windows = {300, 3600, 86400},         \
+        .window_count = 3,                     \
+        .resolution = 30,                      \
+        .time_constant = 300,                  \
+    }
+
+    typedef struct
+    {
+        float min[WINDOW_STATS_MAX_WINDOWS]; /// by window
+        float max[WINDOW_STATS_MAX_WINDOWS]; /// by window
+        float ewma;
+        float ewm_stddev; /// the exponentially weighted standard deviation around the EWMA
+        float mean;       /// since the latest reset
+        float stddev;     /// since the latest reset
+        uint32_t count;   /// samples since the latest reset
+    } window_stats_summary_t;
+
+    /*
+     * Sets the windows of config from a comma-separated list of lengths in seconds (e.g.
+     * "300,3600,86400").
+     */
+    esp_err_t window_stats_parse_windows(window_stats_config_t *config, const char *windows);
+
+    esp_err_t window_stats_open(const window_stats_config_t *config, window_stats_t *stats_out);
+    esp_err_t window_stats_close(window_stats_t stats);
+
+    // Adds a sample of each channel, taken at timestamp (microseconds since boot, not decreasing).
+    esp_err_t window_stats_add(window_stats_t stats, int64_t timestamp, const float *values);
+    // Forgets all the samples; called by the writer.
+    esp_err_t window_stats_reset(window_stats_t stats);
+
+    esp_err_t window_stats_get(window_stats_t stats, size_t channel, window_stats_summary_t *summary);
+    size_t window_stats_get_window_count(window_stats_t stats);
+    // The length of the window (in seconds), or 0 if there is none.
+    uint32_t window_stats_get_window(window_stats_t stats, size_t window);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,659 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_check.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <nvs.h>
+#include "journal.h"
+#include "latency_trace.h"
+#include "snapshot.h"
+#include "zone.h"
+
+#define FLOW_QUEUE_LENGTH 8 // flow cycles start and end seconds apart, so this never fills up
+#define SEND_TIMEOUT pdMS_TO_TICKS(10)
+#define CUTOFF_READING_LEAD 1000000 // 1 second: a reading (750 ms) completes before the cutoff
+#define USEC_IN_SEC (double)1000000
+#define CONTROL_MUTEX_TIMEOUT pdMS_TO_TICKS(1000) // a writer may wait for another one's flash write
+#define NVS_KEY "control"
+
+static const char *TAG = "zone";
+
+ESP_EVENT_DEFINE_BASE(ZONE_EVENT);
+
+typedef struct
+{
+    zone_t zone;
+    pump_control_event_t type;
+    float temperature_delta;
+#if CONFIG_LATENCY_TRACE
+    latency_trace_span_t span; /// from the first pulse of the flow cycle (flow messages only)
+#endif
+} message_t;
+
+struct zone_executor_s
+{
+    zone_executor_config_t config;
+    QueueSetHandle_t inbox;      /// the members with pending items, in the order the items were sent
+    QueueHandle_t control_queue; /// message_t, from the timers and pre-heat callbacks of all zones
+    QueueHandle_t flow_queue;    /// pulse_sensor_notification_t, from the flow sensors of all zones
+    TaskHandle_t control_task;
+    atomic_uint dropped;
+    atomic_uint received[ZONE_SOURCE_MAX];
+};
+
+struct zone_s
+{
+    zone_config_t config;
+    pulse_sensor_t flow_sensor;
+    temperature_delta_sensor_t temperature_delta_sensor;
+    relay_t relay;
+    pump_model_t pump_model;
+    pump_trace_t trace;
+    preheat_t preheat;
+    esp_timer_handle_t timeout_timer;
+    esp_timer_handle_t cutoff_timer;
+    esp_timer_handle_t cutoff_reading_timer;
+    QueueHandle_t temperature_mailbox; /// the latest temperature_delta_sensor_notification_t of the zone
+    message_t timeout_msg; /// posted by the timers and the pre-heat callback
+    message_t cutoff_msg;
+    message_t preheat_msg;
+    bool preheating; /// whether the pump was turned on for predicted demand (owned by the control task)
+    pump_control_config_t control;           /// the thresholds in effect (owned by the control task)
+    unsigned int control_version;            /// the published version control was read from
+    pump_control_config_t control_copies[2]; /// the thresholds last published
+    snapshot_latch_t control_latch;          /// selects which of control_copies the control task copies
+    atomic_uint published_version;           /// bumped after each publish
+    SemaphoreHandle_t control_mutex;         /// serializes the writers (which also save to NVS)
+};
+
+// Why the pump is turned on or off in response to each message, as journaled.
+static const journal_reason_t journal_reasons[PUMP_CONTROL_EVENT_MAX] = {
+    [PUMP_CONTROL_FLOW_STARTED] = JOURNAL_REASON_FLOW,
+    [PUMP_CONTROL_TEMPERATURE_MEASURED] = JOURNAL_REASON_TEMPERATURE,
+    [PUMP_CONTROL_TIMEOUT] = JOURNAL_REASON_TIMEOUT,
+    [PUMP_CONTROL_CUTOFF] = JOURNAL_REASON_CUTOFF,
+    [PUMP_CONTROL_PREHEAT] = JOURNAL_REASON_PREHEAT,
+};
+
+static void send_message(const message_t *msg)
+{
+    const zone_executor_t executor = msg->zone->config.executor;
+    if (!xQueueSend(executor->control_queue, msg, SEND_TIMEOUT))
+    {
+        executor->dropped++;
+        ESP_LOGW(TAG, "%s: message %d send timeout. Ignoring.", msg->zone->config.name, msg->type);
+    }
+}
+
+// Posts the message (args) when a timer fires, or a pre-heat is due.
+static void message_timer_handler(void *args)
+{
+    send_message((const message_t *)args);
+}
+
+static void cutoff_reading_timer_handler(void *args)
+{
+    ESP_ERROR_CHECK_WITHOUT_ABORT(temperature_delta_sensor_request_reading(((zone_t)args)->temperature_delta_sensor));
+}
+
+static void stop_timer(esp_timer_handle_t timer)
+{
+    // a timer that already fired is not running; its queued message then finds the pump off
+    const esp_err_t err = esp_timer_stop(timer);
+    if (err != ESP_ERR_INVALID_STATE)
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(err);
+    }
+}
+
+/*
+ * Starts the timer over: it may still run from a cycle that the control task did not end, e.g. one turned
+ * off by PUT /relay, which esp_timer_start_once would refuse.
+ */
+static void start_timer(esp_timer_handle_t timer, uint64_t timeout)
+{
+    stop_timer(timer);
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_start_once(timer, timeout));
+}
+
+// Sets the relay as decided; returns false if it was set otherwise already (e.g. by PUT /relay meanwhile).
+static bool set_relay(zone_t zone, relay_state_t state, pump_control_event_t type)
+{
+    const esp_err_t err = relay_set_state_with_reason(zone->relay, state, journal_reasons[type]);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "%s: turn pump %s: %s", zone->config.name, state == RELAY_ON ? "ON" : "OFF",
+                 esp_err_to_name(err));
+    }
+    return err == ESP_OK;
+}
+
+static void post_event(zone_t zone, zone_event_id_t id)
+{
+    const zone_event_t event = {.zone = zone, .timestamp = esp_timer_get_time()};
+    const esp_err_t err = esp_event_post(ZONE_EVENT, id, &event, sizeof(event), 0);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "%s: post event %d: %d", zone->config.name, id, err);
+    }
+}
+
+// Reads what the decision depends on; the trace records exactly this.
+static void read_input(zone_t zone, const message_t *msg, pump_control_input_t *input)
+{
+    relay_data_t r_data;
+    ESP_ERROR_CHECK(relay_get_data(zone->relay, &r_data));
+    *input = (pump_control_input_t){.event = msg->type,
+                                    .timestamp = esp_timer_get_time(),
+                                    .temperature_delta = msg->temperature_delta,
+                                    .relay_state = r_data.current_state,
+                                    .time_in_relay_state = r_data.time_in_current_state,
+                                    .relay_state_changes = r_data.state_changes};
+    if (msg->type != PUMP_CONTROL_TEMPERATURE_MEASURED)
+    {
+        temperature_delta_sensor_data_t t_data;
+        ESP_ERROR_CHECK(temperature_delta_sensor_get_data(zone->temperature_delta_sensor, &t_data));
+        input->temperature_delta = temperature_delta_sensor_get_delta(&t_data);
+    }
+    pump_model_predict(zone->pump_model, input);
+}
+
+// Switches to thresholds published since the previous message, if any.
+static void update_control(zone_t zone)
+{
+    const unsigned int version = atomic_load_explicit(&zone->published_version, memory_order_acquire);
+    if (version == zone->control_version)
+    {
+        return;
+    }
+    snapshot_read(&zone->control_latch, zone->control_copies, &zone->control, sizeof(pump_control_config_t));
+    zone->control_version = version;
+    pump_model_set_control(zone->pump_model, &zone->control);
+    ESP_ERROR_CHECK_WITHOUT_ABORT(pump_trace_set_control(zone->trace, &zone->control));
+    ESP_LOGI(TAG, "%s: switched to new thresholds (version %u)", zone->config.name, version);
+}
+
+static void step(zone_t zone, message_t *msg)
+{
+    update_control(zone);
+    pump_control_input_t input;
+    read_input(zone, msg, &input);
+    LATENCY_TRACE_MARK(&msg->span, LATENCY_TRACE_INPUT);
+    const uint32_t actions = pump_control_step(&zone->control, &input);
+    ESP_ERROR_CHECK_WITHOUT_ABORT(pump_trace_record(zone->trace, &input, actions));
+    LATENCY_TRACE_MARK(&msg->span, LATENCY_TRACE_DECISION);
+    if (msg->type == PUMP_CONTROL_TEMPERATURE_MEASURED && input.relay_state == RELAY_ON)
+    {
+        pump_model_add_reading(zone->pump_model, &input);
+    }
+
+    if (actions & PUMP_CONTROL_REQUEST_READING)
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(temperature_delta_sensor_request_reading(zone->temperature_delta_sensor));
+    }
+    // the relay first, so that the timers never fire before time_in_relay_state reaches them
+    if ((actions & PUMP_CONTROL_RELAY_ON) && set_relay(zone, RELAY_ON, msg->type))
+    {
+        ESP_LOGI(TAG, "%s: turning pump ON%s (timeout in %.0f s, cutoff in %.0f s)", zone->config.name,
+                 msg->type == PUMP_CONTROL_PREHEAT ? " ahead of predicted demand" : "",
+                 input.max_on_duration / USEC_IN_SEC, input.cutoff_after / USEC_IN_SEC);
+        LATENCY_TRACE_END(&msg->span, LATENCY_TRACE_RELAY);
+        pump_model_begin_cycle(zone->pump_model, &input);
+        zone->preheating = msg->type == PUMP_CONTROL_PREHEAT;
+        if (zone->preheating)
+        {
+            ESP_ERROR_CHECK_WITHOUT_ABORT(preheat_begin(zone->preheat));
+        }
+        ESP_ERROR_CHECK_WITHOUT_ABORT(
+            temperature_delta_sensor_hint(zone->temperature_delta_sensor, TEMPERATURE_DELTA_SENSOR_HINT_PUMP_ON));
+    }
+    if (actions & PUMP_CONTROL_START_TIMEOUT)
+    {
+        start_timer(zone->timeout_timer, input.max_on_duration);
+    }
+    if (actions & PUMP_CONTROL_START_CUTOFF)
+    {
+        start_timer(zone->cutoff_timer, input.cutoff_after);
+        // a fresh reading lets the cutoff check that hot water is arriving
+        if (input.cutoff_after > CUTOFF_READING_LEAD)
+        {
+            start_timer(zone->cutoff_reading_timer, input.cutoff_after - CUTOFF_READING_LEAD);
+        }
+    }
+    if ((actions & PUMP_CONTROL_RELAY_OFF) && set_relay(zone, RELAY_OFF, msg->type))
+    {
+        ESP_LOGI(TAG, "%s: turning pump OFF (%s)", zone->config.name,
+                 msg->type == PUMP_CONTROL_TIMEOUT  ? "timeout"
+                 : msg->type == PUMP_CONTROL_CUTOFF ? "predicted temperature reached"
+                                                    : "temperature reached");
+        pump_model_end_cycle(zone->pump_model, input.time_in_relay_state);
+        if (zone->preheating)
+        {
+            ESP_ERROR_CHECK_WITHOUT_ABORT(preheat_end(zone->preheat, input.time_in_relay_state));
+        }
+        ESP_ERROR_CHECK_WITHOUT_ABORT(
+            temperature_delta_sensor_hint(zone->temperature_delta_sensor, TEMPERATURE_DELTA_SENSOR_HINT_PUMP_OFF));
+    }
+    if (actions & PUMP_CONTROL_STOP_TIMEOUT)
+    {
+        stop_timer(zone->timeout_timer);
+    }
+    if (actions & PUMP_CONTROL_STOP_CUTOFF)
+    {
+        stop_timer(zone->cutoff_timer);
+        stop_timer(zone->cutoff_reading_timer);
+    }
+}
+
+#if CONFIG_LATENCY_TRACE
+// Microseconds since boot of the first pulse of the sensor's current cycle (0 if unknown).
+static int64_t first_pulse_timestamp(pulse_sensor_t sensor)
+{
+    pulse_sensor_data_t data;
+    return pulse_sensor_get_data(sensor, &data) == ESP_OK ? data.current_cycle_start_timestamp : 0;
+}
+#endif
+
+static void handle_flow(const pulse_sensor_notification_t *notification)
+{
+    const zone_t zone = (zone_t)notification->notification_arg;
+    message_t msg = {.zone = zone, .type = PUMP_CONTROL_FLOW_STARTED};
+    if (notification->type == PULSE_SENSOR_CYCLE_STARTED)
+    {
+        LATENCY_TRACE_BEGIN(&msg.span, first_pulse_timestamp(notification->sensor));
+        LATENCY_TRACE_MARK(&msg.span, LATENCY_TRACE_DETECTION);
+    }
+    ESP_ERROR_CHECK_WITHOUT_ABORT(
+        temperature_delta_sensor_hint(zone->temperature_delta_sensor, TEMPERATURE_DELTA_SENSOR_HINT_FLOW));
+    switch (notification->type)
+    {
+    case PULSE_SENSOR_CYCLE_STARTED:
+        ESP_ERROR_CHECK_WITHOUT_ABORT(preheat_record_flow(zone->preheat));
+        step(zone, &msg);
+        post_event(zone, ZONE_EVENT_FLOW_STARTED);
+        break;
+    case PULSE_SENSOR_CYCLE_ENDED:
+        post_event(zone, ZONE_EVENT_FLOW_ENDED);
+        break;
+    default:
+        break;
+    }
+}
+
+// Serves the inbox: the sensors post to its members directly, so a reading reaches the decision with a
+// single context switch.
+static void control_task_handler(void *args)
+{
+    const zone_executor_t executor = (zone_executor_t)args;
+    QueueSetMemberHandle_t member;
+    while ((member = xQueueSelectFromSet(executor->inbox, portMAX_DELAY)) != NULL)
+    {
+        if (member == executor->control_queue)
+        {
+            message_t msg;
+            if (xQueueReceive(member, &msg, 0))
+            {
+                executor->received[ZONE_SOURCE_TIMER]++;
+                ESP_LOGD(TAG, "%s: got pump control message type: %d", msg.zone->config.name, msg.type);
+                step(msg.zone, &msg);
+            }
+        }
+        else if (member == executor->flow_queue)
+        {
+            pulse_sensor_notification_t notification;
+            if (xQueueReceive(member, &notification, 0))
+            {
+                executor->received[ZONE_SOURCE_FLOW]++;
+                handle_flow(&notification);
+            }
+        }
+        else
+        {
+            // a temperature mailbox, which holds the zone's latest reading only
+            temperature_delta_sensor_notification_t notification;
+            if (xQueueReceive(member, &notification, 0))
+            {
+                executor->received[ZONE_SOURCE_TEMPERATURE]++;
+                const zone_t zone = (zone_t)notification.notification_arg;
+                step(zone, &(message_t){.zone = zone,
+                                        .type = PUMP_CONTROL_TEMPERATURE_MEASURED,
+                                        .temperature_delta = notification.delta});
+            }
+        }
+    }
+    ESP_LOGW(TAG, "Inbox select failed. Bailing out.");
+    vTaskDelete(NULL);
+}
+
+esp_err_t zone_executor_open(const zone_executor_config_t *config, zone_executor_t *executor_out)
+{
+    esp_err_t ret = ESP_FAIL;
+    ESP_GOTO_ON_FALSE(config && executor_out, ESP_ERR_INVALID_ARG, handle_error, TAG, "null");
+    ESP_GOTO_ON_FALSE(config->queue_length && config->stack_size, ESP_ERR_INVALID_ARG, handle_error, TAG,
+                      "invalid queue_length or stack_size");
+    const zone_executor_t executor = calloc(1, sizeof(struct zone_executor_s));
+    ESP_GOTO_ON_FALSE(executor, ESP_ERR_NO_MEM, handle_error, TAG, "malloc executor");
+    executor->config = *config;
+    // room for every item of every member, so that no send finds the inbox full
+    executor->inbox = xQueueCreateSet(config->queue_length + FLOW_QUEUE_LENGTH + ZONE_MAX_ZONES);
+    ESP_GOTO_ON_FALSE(executor->inbox, ESP_ERR_NO_MEM, free_executor, TAG, "create inbox");
+    executor->control_queue = xQueueCreate(config->queue_length, sizeof(message_t));
+    ESP_GOTO_ON_FALSE(executor->control_queue, ESP_ERR_NO_MEM, delete_inbox, TAG, "create control queue");
+    executor->flow_queue = xQueueCreate(FLOW_QUEUE_LENGTH, sizeof(pulse_sensor_notification_t));
+    ESP_GOTO_ON_FALSE(executor->flow_queue, ESP_ERR_NO_MEM, delete_control_queue, TAG, "create flow queue");
+    vQueueAddToRegistry(executor->inbox, "zone_inbox");
+    vQueueAddToRegistry(executor->control_queue, "zone_control");
+    vQueueAddToRegistry(executor->flow_queue, "zone_flow");
+    xQueueAddToSet(executor->control_queue, executor->inbox);
+    xQueueAddToSet(executor->flow_queue, executor->inbox);
+    ESP_GOTO_ON_FALSE(xTaskCreate(&control_task_handler, "Pump control task", config->stack_size, executor,
+                                  config->priority, &executor->control_task) == pdPASS,
+                      ESP_ERR_NO_MEM, delete_flow_queue, TAG, "create control task");
+    *executor_out = executor;
+    ESP_LOGI(TAG, "Opened executor");
+    return ESP_OK;
+delete_flow_queue:
+    vQueueDelete(executor->flow_queue);
+delete_control_queue:
+    vQueueDelete(executor->control_queue);
+delete_inbox:
+    vQueueDelete(executor->inbox);
+free_executor:
+    free(executor);
+handle_error:
+    return ret;
+}
+
+esp_err_t zone_executor_close(zone_executor_t executor)
+{
+    ESP_RETURN_ON_FALSE(executor, ESP_ERR_INVALID_ARG, TAG, "executor must not be NULL");
+    vTaskDelete(executor->control_task);
+    vQueueDelete(executor->flow_queue);
+    vQueueDelete(executor->control_queue);
+    vQueueDelete(executor->inbox);
+    free(executor);
+    ESP_LOGI(TAG, "Closed executor");
+    return ESP_OK;
+}
+
+const atomic_uint *zone_executor_get_dropped(zone_executor_t executor)
+{
+    return executor ? &executor->dropped : NULL;
+}
+
+uint32_t zone_executor_get_received(zone_executor_t executor, zone_source_t source)
+{
+    return executor && source < ZONE_SOURCE_MAX ? executor->received[source] : 0;
+}
+
+QueueHandle_t zone_executor_get_queue(zone_executor_t executor, zone_source_t source)
+{
+    if (!executor)
+    {
+        return NULL;
+    }
+    switch (source)
+    {
+    case ZONE_SOURCE_FLOW:
+        return executor->flow_queue;
+    case ZONE_SOURCE_TIMER:
+        return executor->control_queue;
+    default:
+        return NULL;
+    }
+}
+
+const char *zone_source_name(zone_source_t source)
+{
+    static const char *const names[ZONE_SOURCE_MAX] = {
+        [ZONE_SOURCE_FLOW] = "flow",
+        [ZONE_SOURCE_TEMPERATURE] = "temperature",
+        [ZONE_SOURCE_TIMER] = "timer",
+    };
+    return source < ZONE_SOURCE_MAX ? names[source] : "unknown";
+}
+
+// Names are used in URIs, so they are limited to letters, digits, "_" and "-".
+static bool is_valid_name(const char *name)
+{
+    const size_t len = name ? strlen(name) : 0;
+    if (len == 0 || len >= ZONE_NAME_SIZE)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!isalnum((unsigned char)name[i]) && name[i] != '_' && name[i] != '-')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The thresholds last set at runtime, if any, replace the configured ones.
+static void load_control(zone_t zone)
+{
+    nvs_handle_t nvs;
+    pump_control_config_t control;
+    size_t length = sizeof(control);
+    esp_err_t err = nvs_open(zone->config.nvs_namespace, NVS_READONLY, &nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_get_blob(nvs, NVS_KEY, &control, &length);
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK || length != sizeof(control) || !pump_control_is_valid_config(&control))
+    {
+        ESP_LOGI(TAG, "%s: using the configured thresholds: %s", zone->config.name,
+                 err != ESP_OK ? esp_err_to_name(err) : "saved ones invalid");
+        return;
+    }
+    zone->config.control = control;
+    ESP_LOGI(TAG, "%s: loaded thresholds set at runtime", zone->config.name);
+}
+
+static esp_err_t save_control(const char *nvs_namespace, const pump_control_config_t *control)
+{
+    esp_err_t ret = ESP_OK;
+    nvs_handle_t nvs;
+    ESP_RETURN_ON_ERROR(nvs_open(nvs_namespace, NVS_READWRITE, &nvs), TAG, "open NVS");
+    ESP_GOTO_ON_ERROR(nvs_set_blob(nvs, NVS_KEY, control, sizeof(pump_control_config_t)), close_nvs, TAG,
+                      "set blob");
+    ESP_GOTO_ON_ERROR(nvs_commit(nvs), close_nvs, TAG, "commit");
+close_nvs:
+    nvs_close(nvs);
+    return ret;
+}
+
+static esp_err_t create_timer(esp_timer_cb_t callback, void *arg, const char *name, esp_timer_handle_t *timer)
+{
+    const esp_timer_create_args_t args = {.callback = callback, .arg = arg, .name = name};
+    return esp_timer_create(&args, timer);
+}
+
+esp_err_t zone_open(const zone_config_t *config, zone_t *zone_out)
+{
+    esp_err_t ret = ESP_FAIL;
+    ESP_GOTO_ON_FALSE(config && zone_out, ESP_ERR_INVALID_ARG, handle_error, TAG, "null");
+    ESP_GOTO_ON_FALSE(config->executor, ESP_ERR_INVALID_ARG, handle_error, TAG, "missing executor");
+    ESP_GOTO_ON_FALSE(is_valid_name(config->name), ESP_ERR_INVALID_ARG, handle_error, TAG, "invalid name");
+    ESP_GOTO_ON_FALSE(config->nvs_namespace, ESP_ERR_INVALID_ARG, handle_error, TAG, "missing nvs_namespace");
+    const zone_t zone = calloc(1, sizeof(struct zone_s));
+    ESP_GOTO_ON_FALSE(zone, ESP_ERR_NO_MEM, handle_error, TAG, "malloc zone");
+    zone->config = *config;
+    if (!pump_control_is_valid_config(&zone->config.control))
+    {
+        // a configuration error, which should not leave the loop without its pump
+        const pump_control_config_t defaults = PUMP_CONTROL_CONFIG_DEFAULT();
+        ESP_LOGE(TAG, "%s: invalid thresholds: the pump off delta (%.1f °C) must be above 0 and below the pump on "
+                      "delta (%.1f °C); using %.1f and %.1f °C",
+                 config->name, config->control.min_temperature_delta, config->control.max_temperature_delta,
+                 defaults.min_temperature_delta, defaults.max_temperature_delta);
+        zone->config.control.max_temperature_delta = defaults.max_temperature_delta;
+        zone->config.control.min_temperature_delta = defaults.min_temperature_delta;
+    }
+    ESP_GOTO_ON_FALSE(pump_control_is_valid_config(&zone->config.control), ESP_ERR_INVALID_ARG, free_zone, TAG,
+                      "invalid durations");
+    load_control(zone);
+    zone->control = zone->config.control;
+    snapshot_publish(&zone->control_latch, zone->control_copies, &zone->control, sizeof(pump_control_config_t));
+    zone->timeout_msg = (message_t){.zone = zone, .type = PUMP_CONTROL_TIMEOUT};
+    zone->cutoff_msg = (message_t){.zone = zone, .type = PUMP_CONTROL_CUTOFF};
+    zone->preheat_msg = (message_t){.zone = zone, .type = PUMP_CONTROL_PREHEAT};
+    zone->config.flow_sensor.notification_queue = config->executor->flow_queue;
+    zone->config.flow_sensor.notification_arg = zone;
+    zone->config.temperature_delta_sensor.notification_arg = zone;
+    zone->config.temperature_delta_sensor.notification_overwrite = true;
+    zone->config.preheat.callback = &message_timer_handler;
+    zone->config.preheat.arg = &zone->preheat_msg;
+
+    zone->control_mutex = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(zone->control_mutex, ESP_ERR_NO_MEM, free_zone, TAG, "create control mutex");
+    zone->temperature_mailbox = xQueueCreate(1, sizeof(temperature_delta_sensor_notification_t));
+    ESP_GOTO_ON_FALSE(zone->temperature_mailbox, ESP_ERR_NO_MEM, delete_control_mutex, TAG,
+                      "create temperature mailbox");
+    ESP_GOTO_ON_FALSE(xQueueAddToSet(zone->temperature_mailbox, config->executor->inbox), ESP_ERR_INVALID_STATE,
+                      delete_temperature_mailbox, TAG, "add temperature mailbox to inbox");
+    zone->config.temperature_delta_sensor.notification_queue = zone->temperature_mailbox;
+    ESP_GOTO_ON_ERROR(create_timer(&message_timer_handler, &zone->timeout_msg, "Pump timeout timer",
+                                   &zone->timeout_timer),
+                      remove_temperature_mailbox, TAG, "create timeout timer");
+    ESP_GOTO_ON_ERROR(create_timer(&message_timer_handler, &zone->cutoff_msg, "Pump cutoff timer",
+                                   &zone->cutoff_timer),
+                      delete_timeout_timer, TAG, "create cutoff timer");
+    ESP_GOTO_ON_ERROR(create_timer(&cutoff_reading_timer_handler, zone, "Pump cutoff reading timer",
+                                   &zone->cutoff_reading_timer),
+                      delete_cutoff_timer, TAG, "create cutoff reading timer");
+    const pump_trace_config_t trace_config = {.records = config->trace_records, .control = &zone->control};
+    ESP_GOTO_ON_ERROR(pump_trace_open(&trace_config, &zone->trace), delete_cutoff_reading_timer, TAG, "open trace");
+    ESP_GOTO_ON_ERROR(pump_model_open(&zone->control, &zone->pump_model), close_trace, TAG, "open model");
+    // the relay before the sensors, whose notifications may turn it on right away
+    ESP_GOTO_ON_ERROR(relay_open(config->relay_gpio_num, &zone->relay), close_pump_model, TAG, "open relay");
+    ESP_GOTO_ON_ERROR(preheat_open(&zone->config.preheat, &zone->preheat), close_relay, TAG, "open preheat");
+    ESP_GOTO_ON_ERROR(temperature_delta_sensor_open(&zone->config.temperature_delta_sensor,
+                                                    &zone->temperature_delta_sensor),
+                      close_preheat, TAG, "open temperature sensor");
+    ESP_GOTO_ON_ERROR(pulse_sensor_open(&zone->config.flow_sensor, &zone->flow_sensor), close_temperature_sensor,
+                      TAG, "open flow sensor");
+    *zone_out = zone;
+    ESP_LOGI(TAG, "Opened '%s' (relay on GPIO %d)", config->name, config->relay_gpio_num);
+    return ESP_OK;
+close_temperature_sensor:
+    temperature_delta_sensor_close(zone->temperature_delta_sensor);
+close_preheat:
+    preheat_close(zone->preheat);
+close_relay:
+    relay_close(zone->relay);
+close_pump_model:
+    pump_model_close(zone->pump_model);
+close_trace:
+    pump_trace_close(zone->trace);
+delete_cutoff_reading_timer:
+    esp_timer_delete(zone->cutoff_reading_timer);
+delete_cutoff_timer:
+    esp_timer_delete(zone->cutoff_timer);
+delete_timeout_timer:
+    esp_timer_delete(zone->timeout_timer);
+remove_temperature_mailbox:
+    xQueueRemoveFromSet(zone->temperature_mailbox, config->executor->inbox);
+delete_temperature_mailbox:
+    vQueueDelete(zone->temperature_mailbox);
+delete_control_mutex:
+    vSemaphoreDelete(zone->control_mutex);
+free_zone:
+    free(zone);
+handle_error:
+    return ret;
+}
+
+esp_err_t zone_close(zone_t zone)
+{
+    ESP_RETURN_ON_FALSE(zone, ESP_ERR_INVALID_ARG, TAG, "zone must not be NULL");
+    // messages for the zone may still be queued; the executor must not run them after this
+    pulse_sensor_close(zone->flow_sensor);
+    temperature_delta_sensor_close(zone->temperature_delta_sensor);
+    preheat_close(zone->preheat);
+    esp_timer_stop(zone->cutoff_reading_timer);
+    esp_timer_stop(zone->cutoff_timer);
+    esp_timer_stop(zone->timeout_timer);
+    esp_timer_delete(zone->cutoff_reading_timer);
+    esp_timer_delete(zone->cutoff_timer);
+    esp_timer_delete(zone->timeout_timer);
+    xQueueReset(zone->temperature_mailbox);
+    xQueueRemoveFromSet(zone->temperature_mailbox, zone->config.executor->inbox);
+    vQueueDelete(zone->temperature_mailbox);
+    relay_close(zone->relay);
+    pump_model_close(zone->pump_model);
+    pump_trace_close(zone->trace);
+    vSemaphoreDelete(zone->control_mutex);
+    ESP_LOGI(TAG, "Closed '%s'", zone->config.name);
+    free(zone);
+    return ESP_OK;
+}
+
+const char *zone_get_name(zone_t zone)
+{
+    return zone ? zone->config.name : NULL;
+}
+
+esp_err_t zone_get_control_config(zone_t zone, pump_control_config_t *control)
+{
+    ESP_RETURN_ON_FALSE(zone && control, ESP_ERR_INVALID_ARG, TAG, "null");
+    snapshot_read(&zone->control_latch, zone->control_copies, control, sizeof(pump_control_config_t));
+    return ESP_OK;
+}
+
+esp_err_t zone_set_control_config(zone_t zone, const pump_control_config_t *control)
+{
+    esp_err_t ret = ESP_OK;
+    ESP_RETURN_ON_FALSE(zone && control, ESP_ERR_INVALID_ARG, TAG, "null");
+    ESP_RETURN_ON_FALSE(pump_control_is_valid_config(control), ESP_ERR_INVALID_ARG, TAG, "%s: invalid thresholds",
+                        zone->config.name);
+    ESP_RETURN_ON_FALSE(xSemaphoreTake(zone->control_mutex, CONTROL_MUTEX_TIMEOUT), ESP_ERR_TIMEOUT, TAG,
+                        "acquire control mutex");
+    // saved first, so that the thresholds in effect are always the ones a reboot restores
+    ESP_GOTO_ON_ERROR(save_control(zone->config.nvs_namespace, control), release_mutex, TAG, "%s: save thresholds",
+                      zone->config.name);
+    snapshot_publish(&zone->control_latch, zone->control_copies, control, sizeof(pump_control_config_t));
+    const unsigned int version = atomic_fetch_add_explicit(&zone->published_version, 1, memory_order_release) + 1;
+    ESP_LOGI(TAG, "%s: published thresholds version %u", zone->config.name, version);
+release_mutex:
+    xSemaphoreGive(zone->control_mutex);
+    return ret;
+}
+
+pulse_sensor_t zone_get_flow_sensor(zone_t zone)
+{
+    return zone ? zone->flow_sensor : NULL;
+}
+
+temperature_delta_sensor_t zone_get_temperature_delta_sensor(zone_t zone)
+{
+    return zone ? zone->temperature_delta_sensor : NULL;
+}
+
+relay_t zone_get_relay(zone_t zone)
+{
+    return zone ? zone->relay : NULL;
+}
+
+pump_model_t zone_get_pump_model(zone_t zone)
+{
+    return zone ? zone->pump_model : NULL;
+}
+
+pump_trace_t zone_get_trace(zone_t zone)
+{
+    return zone ? zone->trace : NULL;
+}
+
+preheat_t zone_get_preheat(zone_t zone)
+{
+    return zone ? zone->preheat : NULL;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_event.h>
+#include <driver/gpio.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "pulse_sensor.h"
+#include "temperature_delta_sensor.h"
+#include "relay.h"
+#include "pump_control.h"
+#include "pump_model.h"
+#include "pump_trace.h"
+#include "preheat.h"
+
+#define ZONE_MAX_ZONES 3 // the upper bound of CONFIG_ZONES
+#define ZONE_NAME_SIZE 16 // including the terminator; names are letters, digits, "_" or "-"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * A zone is one recirculation loop: a flow meter, a bus of temperature probes, the pump relay, and
+     * the controller state that drives them (thresholds, timers, the learned pump model, the pre-heat
+     * histogram and the decision trace). A board runs one or more zones.
+     *
+     * The zones share one executor, whose control task runs pump_control_step for the zone each message
+     * is for. Its inbox is a queue set that the sources post to directly: the flow sensors to a shared
+     * queue, the timers and pre-heat callbacks to another, and each zone's temperature sensor to a
+     * mailbox of one, which it overwrites (a newer reading supersedes a pending one). Adding a zone adds
+     * no task, only its sensors' and timers' state.
+     *
+     * The thresholds may be set while the zone runs: zone_set_control_config persists them to NVS and
+     * publishes them, and the control task picks them up with the next message it handles (checking
+     * for them costs it a single atomic load).
+     */
+    typedef struct zone_executor_s *zone_executor_t;
+    typedef struct zone_s *zone_t;
+
+    ESP_EVENT_DECLARE_BASE(ZONE_EVENT);
+
+    typedef enum
+    {
+        ZONE_EVENT_FLOW_STARTED, /// posted to the default event loop with a zone_event_t
+        ZONE_EVENT_FLOW_ENDED,   /// likewise
+    } zone_event_id_t;
+
+    typedef struct
+    {
+        zone_t zone;       /// the zone of the flow meter
+        int64_t timestamp; /// microseconds since boot of the notification
+    } zone_event_t;
+
+    typedef enum
+    {
+        ZONE_SOURCE_FLOW,        /// flow cycle notifications
+        ZONE_SOURCE_TEMPERATURE, /// readings (coalesced by the sensors' mailboxes)
+        ZONE_SOURCE_TIMER,       /// timeouts, cutoffs and pre-heats
+        ZONE_SOURCE_MAX,
+    } zone_source_t;
+
+    typedef struct
+    {
+        UBaseType_t queue_length; /// timer and pre-heat messages that may wait for the control task
+        uint32_t stack_size;      /// of the control task
+        UBaseType_t priority;     /// of the control task
+    } zone_executor_config_t;
+
+#define ZONE_EXECUTOR_CONFIG_DEFAULT() \
+    {                                  \
+        .queue_length = 16,            \
+        .stack_size = 3072,            \
+        .priority = 1,                 \
+    }
+
+    typedef struct
+    {
+        const char *name;                                           /// in routes and events (*required; see ZONE_NAME_SIZE)
+        zone_executor_t executor;                                   /// runs the zone's control (*required)
+        gpio_num_t relay_gpio_num;                                  /// the pump relay
+        pulse_sensor_config_t flow_sensor;                          /// notifies the executor (set by open)
+        temperature_delta_sensor_config_t temperature_delta_sensor; /// likewise, with its probes and deltas
+        pump_control_config_t control;                              /// the zone's thresholds, unless set at runtime
+        const char *nvs_namespace;                                  /// where those set at runtime persist (*required)
+        preheat_config_t preheat;                                   /// calls back the zone (set by open)
+        uint32_t trace_records;                                     /// pump control decisions kept in the trace
+    } zone_config_t;
+
+    esp_err_t zone_executor_open(const zone_executor_config_t *config, zone_executor_t *executor_out);
+    // The zones of the executor must be closed first.
+    esp_err_t zone_executor_close(zone_executor_t executor);
+    // Timer and pre-heat messages not sent because the control queue stayed full.
+    const atomic_uint *zone_executor_get_dropped(zone_executor_t executor);
+    // Messages from the source handled by the control task.
+    uint32_t zone_executor_get_received(zone_executor_t executor, zone_source_t source);
+    const char *zone_source_name(zone_source_t source);
+    // The queue of the source (NULL for the temperature readings, which have a mailbox per zone), for
+    // instrumentation.
+    QueueHandle_t zone_executor_get_queue(zone_executor_t executor, zone_source_t source);
+
+    esp_err_t zone_open(const zone_config_t *config, zone_t *zone_out);
+    esp_err_t zone_close(zone_t zone);
+
+    const char *zone_get_name(zone_t zone);
+    // The thresholds last published, which the control task uses from its next message on.
+    esp_err_t zone_get_control_config(zone_t zone, pump_control_config_t *control);
+    /*
+     * Validates (see pump_control_is_valid_config), persists and publishes new thresholds. Returns
+     * ESP_ERR_INVALID_ARG for an invalid config, which is neither saved nor published.
+     */
+    esp_err_t zone_set_control_config(zone_t zone, const pump_control_config_t *control);
+    pulse_sensor_t zone_get_flow_sensor(zone_t zone);
+    temperature_delta_sensor_t zone_get_temperature_delta_sensor(zone_t zone);
+    relay_t zone_get_relay(zone_t zone);
+    pump_model_t zone_get_pump_model(zone_t zone);
+    pump_trace_t zone_get_trace(zone_t zone);
+    preheat_t zone_get_preheat(zone_t zone);
+
+#ifdef __cplusplus
+}
+#endif